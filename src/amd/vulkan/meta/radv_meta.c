@@ -325,10 +325,7 @@ radv_builtin_cache_path(char *path)
 static uint32_t
 num_cache_entries(VkPipelineCache cache)
 {
-   struct set *s = vk_pipeline_cache_from_handle(cache)->object_cache;
-   if (!s)
-      return 0;
-   return s->entries;
+   return vk_pipeline_cache_object_count(vk_pipeline_cache_from_handle(cache));
 }
 
 static bool
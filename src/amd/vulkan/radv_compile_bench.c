@@ -0,0 +1,376 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Offline compile-time benchmark for ACO, through RADV.
+ *
+ * RADV_FORCE_FAMILY makes RADV create a null winsys device for the target,
+ * so compute pipelines can be compiled for any GPU supported by ACO without
+ * the hardware.  The pipeline layout is built from the descriptors and push
+ * constants the shader declares, which is what a typical application does.
+ *
+ * Only vkCreateComputePipelines is timed, with the caches disabled.  It
+ * includes spirv_to_nir, the RADV NIR passes and ACO.  The statistics are the
+ * ones of VK_KHR_pipeline_executable_properties, one row per wave size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler/nir/nir.h"
+#include "compiler/spirv/nir_spirv.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/u_dynarray.h"
+#include "util/u_math.h"
+#include "shader_bench.h"
+
+#include <vulkan/vulkan_core.h>
+
+PFN_vkVoidFunction VKAPI_CALL vk_icdGetInstanceProcAddr(VkInstance instance, const char *pName);
+
+#define FUNCTION_LIST                                                                              \
+   ITEM(DestroyInstance)                                                                           \
+   ITEM(EnumeratePhysicalDevices)                                                                  \
+   ITEM(CreateDevice)                                                                              \
+   ITEM(DestroyDevice)                                                                             \
+   ITEM(CreateShaderModule)                                                                        \
+   ITEM(DestroyShaderModule)                                                                       \
+   ITEM(CreateComputePipelines)                                                                    \
+   ITEM(DestroyPipeline)                                                                           \
+   ITEM(CreateDescriptorSetLayout)                                                                 \
+   ITEM(DestroyDescriptorSetLayout)                                                                \
+   ITEM(CreatePipelineLayout)                                                                      \
+   ITEM(DestroyPipelineLayout)                                                                     \
+   ITEM(GetPipelineExecutablePropertiesKHR)                                                        \
+   ITEM(GetPipelineExecutableStatisticsKHR)
+
+#define ITEM(n) static PFN_vk##n n;
+FUNCTION_LIST
+#undef ITEM
+
+#define MAX_SETS 32
+
+static VkInstance instance;
+static VkDevice device;
+
+/* Names of the executable statistics reported, the others are ignored. */
+static const char *const stat_names[] = {
+   "SGPRs",        "VGPRs",      "Spilled SGPRs",      "Spilled VGPRs", "Code size",
+   "LDS size",     "Scratch size", "Subgroups per SIMD", "Instructions",  "Copies",
+   "Branches",     "Latency",    "Inverse Throughput", "VMEM Clause",   "SMEM Clause",
+};
+
+/* Only used to find the resources of the shader. */
+static const struct spirv_to_nir_options reflect_spirv_options = {
+   .environment = NIR_SPIRV_VULKAN,
+   .ubo_addr_format = nir_address_format_32bit_index_offset,
+   .ssbo_addr_format = nir_address_format_32bit_index_offset,
+   .phys_ssbo_addr_format = nir_address_format_64bit_global,
+   .push_const_addr_format = nir_address_format_logical,
+   .shared_addr_format = nir_address_format_32bit_offset,
+};
+
+static const nir_shader_compiler_options reflect_nir_options = {0};
+
+static VkDescriptorType
+get_descriptor_type(const nir_variable *var)
+{
+   const struct glsl_type *type = glsl_without_array(var->type);
+
+   switch (var->data.mode) {
+   case nir_var_mem_ubo:
+      return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+   case nir_var_mem_ssbo:
+      return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+   case nir_var_image:
+      return glsl_get_sampler_dim(type) == GLSL_SAMPLER_DIM_BUF ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                                                                : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+   default:
+      break;
+   }
+
+   if (glsl_type_is_bare_sampler(type))
+      return VK_DESCRIPTOR_TYPE_SAMPLER;
+   if (glsl_type_is_texture(type)) {
+      if (glsl_get_sampler_dim(type) == GLSL_SAMPLER_DIM_BUF)
+         return VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      if (glsl_get_sampler_dim(type) == GLSL_SAMPLER_DIM_SUBPASS)
+         return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+   }
+   if (glsl_type_is_sampler(type))
+      return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+   /* Acceleration structures would need the ray tracing extensions. */
+   return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+}
+
+static void
+add_binding(struct util_dynarray *set, const nir_variable *var)
+{
+   const VkDescriptorType type = get_descriptor_type(var);
+   if (type == VK_DESCRIPTOR_TYPE_MAX_ENUM)
+      return;
+
+   /* Several variables can alias the same binding. */
+   util_dynarray_foreach (set, VkDescriptorSetLayoutBinding, binding) {
+      if (binding->binding == var->data.binding)
+         return;
+   }
+
+   /* Runtime arrays get a fixed size, there is no descriptor indexing. */
+   unsigned count = glsl_type_is_array(var->type) ? glsl_get_aoa_size(var->type) : 1;
+   if (count == 0)
+      count = 64;
+
+   const VkDescriptorSetLayoutBinding binding = {
+      .binding = var->data.binding,
+      .descriptorType = type,
+      .descriptorCount = count,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+   };
+   util_dynarray_append(set, VkDescriptorSetLayoutBinding, binding);
+}
+
+/* Creates a pipeline layout with the descriptors and push constants used by
+ * the shader.
+ */
+static VkPipelineLayout
+create_pipeline_layout(struct shader_bench_job *job, const uint32_t *words, size_t word_count,
+                       VkDescriptorSetLayout *set_layouts)
+{
+   nir_shader *nir = spirv_to_nir(words, word_count, NULL, 0, MESA_SHADER_COMPUTE, job->entrypoint,
+                                  &reflect_spirv_options, &reflect_nir_options);
+   if (nir == NULL)
+      return VK_NULL_HANDLE;
+   ralloc_steal(job->mem_ctx, nir);
+
+   struct util_dynarray sets[MAX_SETS];
+   for (unsigned i = 0; i < MAX_SETS; i++)
+      util_dynarray_init(&sets[i], job->mem_ctx);
+
+   unsigned set_count = 0;
+   unsigned push_size = 0;
+   nir_foreach_variable_in_shader (var, nir) {
+      if (var->data.mode == nir_var_mem_push_const) {
+         push_size = MAX2(push_size, glsl_get_explicit_size(var->type, false));
+         continue;
+      }
+
+      if (!(var->data.mode & (nir_var_mem_ubo | nir_var_mem_ssbo | nir_var_image | nir_var_uniform)) ||
+          var->data.descriptor_set >= MAX_SETS)
+         continue;
+
+      add_binding(&sets[var->data.descriptor_set], var);
+      set_count = MAX2(set_count, var->data.descriptor_set + 1);
+   }
+
+   for (unsigned i = 0; i < set_count; i++) {
+      const VkDescriptorSetLayoutCreateInfo set_info = {
+         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+         .bindingCount = util_dynarray_num_elements(&sets[i], VkDescriptorSetLayoutBinding),
+         .pBindings = sets[i].data,
+      };
+      CreateDescriptorSetLayout(device, &set_info, NULL, &set_layouts[i]);
+   }
+
+   const VkPushConstantRange push_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = align(push_size, 4),
+   };
+
+   const VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = set_count,
+      .pSetLayouts = set_layouts,
+      .pushConstantRangeCount = push_size ? 1 : 0,
+      .pPushConstantRanges = &push_range,
+   };
+
+   VkPipelineLayout layout = VK_NULL_HANDLE;
+   CreatePipelineLayout(device, &layout_info, NULL, &layout);
+   return layout;
+}
+
+static void
+read_statistics(struct shader_bench_job *job, VkPipeline pipeline)
+{
+   const VkPipelineInfoKHR pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INFO_KHR,
+      .pipeline = pipeline,
+   };
+
+   VkPipelineExecutablePropertiesKHR executables[SHADER_BENCH_MAX_VARIANTS];
+   uint32_t executable_count = ARRAY_SIZE(executables);
+   for (unsigned i = 0; i < executable_count; i++) {
+      executables[i] = (VkPipelineExecutablePropertiesKHR){
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_PROPERTIES_KHR,
+      };
+   }
+   GetPipelineExecutablePropertiesKHR(device, &pipeline_info, &executable_count, executables);
+
+   for (unsigned e = 0; e < executable_count; e++) {
+      const VkPipelineExecutableInfoKHR exec_info = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_INFO_KHR,
+         .pipeline = pipeline,
+         .executableIndex = e,
+      };
+
+      VkPipelineExecutableStatisticKHR stats[64];
+      uint32_t stat_count = ARRAY_SIZE(stats);
+      for (unsigned i = 0; i < stat_count; i++) {
+         stats[i] = (VkPipelineExecutableStatisticKHR){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_STATISTIC_KHR,
+         };
+      }
+      GetPipelineExecutableStatisticsKHR(device, &exec_info, &stat_count, stats);
+
+      char name[16];
+      snprintf(name, sizeof(name), "wave%u", executables[e].subgroupSize);
+
+      struct shader_bench_variant *variant = shader_bench_add_variant(job, name);
+      for (unsigned i = 0; i < stat_count; i++) {
+         for (unsigned s = 0; s < ARRAY_SIZE(stat_names); s++) {
+            if (strcmp(stats[i].name, stat_names[s]) == 0)
+               variant->stats[s] = stats[i].value.u64;
+         }
+      }
+   }
+}
+
+static bool
+radv_bench_compile_spirv(struct shader_bench_job *job, const uint32_t *words, size_t word_count)
+{
+   VkDescriptorSetLayout set_layouts[MAX_SETS] = {0};
+   VkPipelineLayout layout = create_pipeline_layout(job, words, word_count, set_layouts);
+   if (layout == VK_NULL_HANDLE)
+      return false;
+
+   const VkShaderModuleCreateInfo module_info = {
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = word_count * 4,
+      .pCode = words,
+   };
+   VkShaderModule module = VK_NULL_HANDLE;
+   CreateShaderModule(device, &module_info, NULL, &module);
+
+   const VkComputePipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .flags = VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR,
+      .stage =
+         {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName = job->entrypoint,
+         },
+      .layout = layout,
+   };
+
+   VkPipeline pipeline = VK_NULL_HANDLE;
+   const int64_t t = os_time_get_nano();
+   VkResult result = CreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline);
+   shader_bench_add_step(job, "vkCreateComputePipelines", t);
+
+   if (result == VK_SUCCESS)
+      read_statistics(job, pipeline);
+   else
+      fprintf(stderr, "%s: vkCreateComputePipelines failed: %d\n", job->path, result);
+
+   DestroyPipeline(device, pipeline, NULL);
+   DestroyShaderModule(device, module, NULL);
+   DestroyPipelineLayout(device, layout, NULL);
+   for (unsigned i = 0; i < MAX_SETS; i++)
+      DestroyDescriptorSetLayout(device, set_layouts[i], NULL);
+
+   return result == VK_SUCCESS;
+}
+
+static bool
+radv_bench_init(const char *target)
+{
+   /* The debug options are parsed when the instance is created. */
+   const char *debug = getenv("RADV_DEBUG");
+   char *radv_debug = ralloc_asprintf(NULL, "%s%snocache", debug ? debug : "", debug ? "," : "");
+   setenv("RADV_DEBUG", radv_debug, 1);
+   ralloc_free(radv_debug);
+
+   setenv("MESA_SHADER_CACHE_DISABLE", "true", 1);
+   setenv("RADV_FORCE_FAMILY", target, 1);
+
+   const VkApplicationInfo app_info = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = "radv_compile_bench",
+      .apiVersion = VK_API_VERSION_1_3,
+   };
+   const VkInstanceCreateInfo instance_info = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &app_info,
+   };
+   PFN_vkCreateInstance CreateInstance = (PFN_vkCreateInstance)vk_icdGetInstanceProcAddr(NULL, "vkCreateInstance");
+   if (CreateInstance(&instance_info, NULL, &instance) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create a RADV instance\n");
+      return false;
+   }
+
+#define ITEM(n) n = (PFN_vk##n)vk_icdGetInstanceProcAddr(instance, "vk" #n);
+   FUNCTION_LIST
+#undef ITEM
+
+   /* The null winsys only exposes the forced family. */
+   uint32_t device_count = 1;
+   VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+   EnumeratePhysicalDevices(instance, &device_count, &physical_device);
+   if (physical_device == VK_NULL_HANDLE) {
+      fprintf(stderr, "%s is not supported by RADV\n", target);
+      return false;
+   }
+
+   const VkPhysicalDevicePipelineExecutablePropertiesFeaturesKHR executable_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_EXECUTABLE_PROPERTIES_FEATURES_KHR,
+      .pipelineExecutableInfo = VK_TRUE,
+   };
+   static const char *const extensions[] = {"VK_KHR_pipeline_executable_properties"};
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &executable_features,
+      .enabledExtensionCount = ARRAY_SIZE(extensions),
+      .ppEnabledExtensionNames = extensions,
+   };
+   if (CreateDevice(physical_device, &device_info, NULL, &device) != VK_SUCCESS) {
+      fprintf(stderr, "failed to create a RADV device\n");
+      return false;
+   }
+
+   return true;
+}
+
+static void
+radv_bench_finish(void)
+{
+   DestroyDevice(device, NULL);
+   DestroyInstance(instance, NULL);
+}
+
+static const struct shader_bench_backend radv_bench = {
+   .name = "RADV/ACO",
+   .default_target = "navi31",
+   .stages = BITFIELD_BIT(MESA_SHADER_COMPUTE),
+   .stat_names = stat_names,
+   .stat_count = ARRAY_SIZE(stat_names),
+   .init = radv_bench_init,
+   .finish = radv_bench_finish,
+   .compile_spirv = radv_bench_compile_spirv,
+};
+
+int
+main(int argc, char *argv[])
+{
+   return shader_bench_main(argc, argv, &radv_bench);
+}
@@ -797,10 +797,8 @@ generate_array_index(void *mem_ctx, exec_list *instructions,
 }
 
 static bool
-function_exists(_mesa_glsl_parse_state *state,
-                struct glsl_symbol_table *symbols, const char *name)
+function_exists(_mesa_glsl_parse_state *state, ir_function *f)
 {
-   ir_function *f = symbols->get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin() && !sig->is_builtin_available(state))
@@ -839,11 +837,12 @@ no_matching_function_error(const char *name,
                            exec_list *actual_parameters,
                            _mesa_glsl_parse_state *state)
 {
-   gl_shader *sh = _mesa_glsl_get_builtin_function_shader();
+   ir_function *builtin =
+      state->uses_builtin_functions ? _mesa_glsl_get_builtin_function(name)
+                                    : NULL;
 
-   if (!function_exists(state, state->symbols, name)
-       && (!state->uses_builtin_functions
-           || !function_exists(state, sh->symbols, name))) {
+   if (!function_exists(state, state->symbols->get_function(name))
+       && !function_exists(state, builtin)) {
       _mesa_glsl_error(loc, state, "no function with name '%s'", name);
    } else {
       char *str = prototype_string(NULL, name, actual_parameters);
@@ -856,10 +855,7 @@ no_matching_function_error(const char *name,
       print_function_prototypes(state, loc,
                                 state->symbols->get_function(name));
 
-      if (state->uses_builtin_functions) {
-         print_function_prototypes(state, loc,
-                                   sh->symbols->get_function(name));
-      }
+      print_function_prototypes(state, loc, builtin);
    }
 }
 
@@ -78,6 +78,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include "util/simple_mtx.h"
+#include "util/set.h"
 #include "main/consts_exts.h"
 #include "main/shader_types.h"
 #include "main/shaderobj.h"
@@ -1023,22 +1024,38 @@ public:
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
 
+   bool has_function(_mesa_glsl_parse_state *state, const char *name);
+   ir_function *get_function(const char *name);
+
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * The intrinsics are created up front, the built-in functions only once
+    * something looks them up by name.  A function holds the signatures for
+    * every version and extension; the availability predicate associated with
+    * each signature allows matching_signature() to filter out the irrelevant
+    * ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /**
+    * While create_builtins() runs for a single name, the name to create;
+    * NULL when creating every built-in.
+    */
+   const char *lazy_name;
+
+   /** Names create_builtins() has already been run for. */
+   struct set *created_names;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
 
+   bool want_function(const char *name);
+
    /**
     * IR builder helpers:
     *
@@ -1428,6 +1445,8 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   lazy_name = NULL;
+   created_names = NULL;
 }
 
 builtin_builder::~builtin_builder()
@@ -1456,7 +1475,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1468,6 +1487,55 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+bool
+builtin_builder::has_function(_mesa_glsl_parse_state *state,
+                              const char *name)
+{
+   ir_function *f = get_function(name);
+   if (f == NULL)
+      return false;
+
+   foreach_in_list(ir_function_signature, sig, &f->signatures) {
+      if (sig->is_builtin_available(state))
+         return true;
+   }
+
+   return false;
+}
+
+/**
+ * Look up the built-in function called \p name, generating its signatures
+ * if this is the first time anything asked for it.
+ *
+ * Shaders only call a few dozen distinct built-ins, so rather than building
+ * IR for all of them when the module is initialized, create_builtins() is
+ * re-run with lazy_name set, which skips every add_function() for another
+ * name without evaluating its signature generators.  Names that aren't
+ * built-ins are remembered too, so that looking up user functions doesn't
+ * walk the list again and again.
+ */
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL || _mesa_set_search(created_names, name) != NULL)
+      return f;
+
+   _mesa_set_add(created_names, ralloc_strdup(mem_ctx, name));
+
+   lazy_name = name;
+   create_builtins();
+   lazy_name = NULL;
+
+   return shader->symbols->get_function(name);
+}
+
+bool
+builtin_builder::want_function(const char *name)
+{
+   return lazy_name == NULL || strcmp(name, lazy_name) == 0;
+}
+
 void
 builtin_builder::initialize()
 {
@@ -1478,9 +1546,10 @@ builtin_builder::initialize()
    glsl_type_singleton_init_or_ref();
 
    mem_ctx = ralloc_context(NULL);
+   created_names = _mesa_set_create(mem_ctx, _mesa_hash_string,
+                                    _mesa_key_string_equal);
    create_shader();
    create_intrinsics();
-   create_builtins();
 }
 
 void
@@ -1488,6 +1557,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   created_names = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1766,6 +1836,13 @@ builtin_builder::create_intrinsics()
 void
 builtin_builder::create_builtins()
 {
+   /* Only evaluate the signature generators of the function being created. */
+#define add_function(NAME, ...)                  \
+   do {                                          \
+      if (want_function(NAME))                   \
+         add_function(NAME, __VA_ARGS__);        \
+   } while (0)
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(&glsl_type_builtin_float), \
@@ -5785,6 +5862,7 @@ builtin_builder::create_builtins()
 #undef FIUDHF_VEC
 #undef FIUBDHF_VEC
 #undef FIU2_MIXED
+#undef add_function
 }
 
 void
@@ -5857,6 +5935,9 @@ builtin_builder::add_image_function(const char *name,
       &glsl_type_builtin_uimage2DMSArray
    };
 
+   if (!want_function(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -9009,27 +9090,23 @@ _mesa_glsl_find_builtin_function(_mesa_glsl_parse_state *state,
 bool
 _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
 {
-   ir_function *f;
-   bool ret = false;
+   bool ret;
    simple_mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
-   if (f != NULL) {
-      foreach_in_list(ir_function_signature, sig, &f->signatures) {
-         if (sig->is_builtin_available(state)) {
-            ret = true;
-            break;
-         }
-      }
-   }
+   ret = builtins.has_function(state, name);
    simple_mtx_unlock(&builtins_lock);
 
    return ret;
 }
 
-gl_shader *
-_mesa_glsl_get_builtin_function_shader()
+ir_function *
+_mesa_glsl_get_builtin_function(const char *name)
 {
-   return builtins.shader;
+   ir_function *f;
+   simple_mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   simple_mtx_unlock(&builtins_lock);
+
+   return f;
 }
 
 
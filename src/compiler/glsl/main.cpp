@@ -46,6 +46,7 @@ const struct option compiler_opts[] = {
    { "link",     no_argument, &options.do_link,  1 },
    { "just-log", no_argument, &options.just_log, 1 },
    { "lower-precision", no_argument, &options.lower_precision, 1 },
+   { "time",     no_argument, &options.print_time, 1 },
    { "version",  required_argument, NULL, 'v' },
    { NULL, 0, NULL, 0 }
 };
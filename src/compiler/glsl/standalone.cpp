@@ -41,14 +41,36 @@
 #include "builtin_functions.h"
 #include "main/mtypes.h"
 #include "program/program.h"
+#include "util/os_time.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 static const struct standalone_options *options;
 
+/**
+ * With --time, print how long a step took to stderr, so that the compiler's
+ * startup cost can be compared with the cost of the compile itself.
+ */
+static void
+print_time(const char *step, const char *name, int64_t start)
+{
+   if (!options->print_time)
+      return;
+
+   fprintf(stderr, "%s%s%s: %.3f ms\n", step, name ? " " : "",
+           name ? name : "", (os_time_get_nano() - start) / 1000000.0);
+}
+
 static void
 initialize_context(struct gl_context *ctx, gl_api api)
 {
    initialize_context_to_defaults(ctx, api);
+
+   int64_t start = os_time_get_nano();
    _mesa_glsl_builtin_functions_init_or_ref();
+   print_time("builtin functions init", NULL, start);
 
    /* The standalone compiler needs to claim support for almost
     * everything in order to compile the built-in functions.
@@ -401,7 +423,9 @@ standalone_compile_shader(const struct standalone_options *_options,
 
       struct gl_shader *shader = standalone_add_shader_source(ctx, whole_program, type, source);
 
+      int64_t start = os_time_get_nano();
       compile_shader(ctx, shader);
+      print_time("compile", files[i], start);
 
       if (strlen(shader->InfoLog) > 0) {
          if (!options->just_log)
@@ -421,7 +445,9 @@ standalone_compile_shader(const struct standalone_options *_options,
    if (status == EXIT_SUCCESS && options->do_link) {
       _mesa_clear_shader_program_data(ctx, whole_program);
 
+      int64_t start = os_time_get_nano();
       link_shaders(ctx, whole_program);
+      print_time("link", NULL, start);
 
       status = (whole_program->data->LinkStatus) ? EXIT_SUCCESS : EXIT_FAILURE;
 
@@ -435,6 +461,14 @@ standalone_compile_shader(const struct standalone_options *_options,
       }
    }
 
+#ifndef _WIN32
+   if (options->print_time) {
+      struct rusage usage;
+      if (getrusage(RUSAGE_SELF, &usage) == 0)
+         fprintf(stderr, "max resident set size: %ld KiB\n", usage.ru_maxrss);
+   }
+#endif
+
    return whole_program;
 
 fail:
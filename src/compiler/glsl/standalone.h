@@ -36,6 +36,7 @@ struct standalone_options {
    int do_link;
    int just_log;
    int lower_precision;
+   int print_time;
 };
 
 struct gl_shader_program;
@@ -90,6 +90,8 @@ static const struct debug_named_value nir_debug_control[] = {
      "Print shaders even if they are marked as internal" },
    { "print_pass_flags", NIR_DEBUG_PRINT_PASS_FLAGS,
      "Print pass_flags for every instruction when pass_flags are non-zero" },
+   { "check_loop_skips", NIR_DEBUG_CHECK_LOOP_SKIPS,
+     "Run the passes skipped by NIR_LOOP_PASS on a clone of the shader and abort if they make progress" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -201,6 +203,7 @@ nir_shader_create(void *mem_ctx,
 #ifndef NDEBUG
    nir_process_debug_variable();
 #endif
+   nir_pass_stats_init();
 
    exec_list_make_empty(&shader->variables);
 
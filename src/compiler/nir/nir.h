@@ -91,6 +91,7 @@ extern bool nir_debug_print_shader[MESA_SHADER_KERNEL + 1];
 #define NIR_DEBUG_PRINT_NO_INLINE_CONSTS (1u << 20)
 #define NIR_DEBUG_PRINT_INTERNAL         (1u << 21)
 #define NIR_DEBUG_PRINT_PASS_FLAGS       (1u << 22)
+#define NIR_DEBUG_CHECK_LOOP_SKIPS       (1u << 23)
 
 #define NIR_DEBUG_PRINT (NIR_DEBUG_PRINT_VS |  \
                          NIR_DEBUG_PRINT_TCS | \
@@ -5192,6 +5193,63 @@ should_print_nir(UNUSED nir_shader *shader)
 }
 #endif /* NDEBUG */
 
+/* Per-pass statistics, enabled by setting NIR_PASS_STATS to the path of the
+ * JSON file to write them to when the process exits.  See nir_pass_stats.c.
+ */
+extern bool nir_pass_stats_enabled;
+
+struct nir_pass_stats_scope {
+   int64_t start_ns;
+   int64_t child_ns;
+   uint64_t start_gc_size;
+   struct nir_pass_stats_scope *parent;
+};
+
+/* The statistics of one pass, summed over all its runs. */
+struct nir_pass_stats {
+   const char *name;
+   uint64_t invocations;
+   uint64_t progress;
+   uint64_t no_progress;
+   int64_t time_ns;
+   int64_t self_time_ns;
+   uint64_t gc_bytes;
+};
+
+/* Collects the statistics without NIR_PASS_STATS, for tools reading them
+ * with nir_pass_stats_foreach().
+ */
+void nir_pass_stats_enable(void);
+
+typedef void (*nir_pass_stats_cb)(const struct nir_pass_stats *stats,
+                                  void *data);
+
+/* Calls cb for every pass run since the statistics were enabled. */
+void nir_pass_stats_foreach(nir_pass_stats_cb cb, void *data);
+
+void nir_pass_stats_init(void);
+void nir_pass_stats_begin_slow(nir_shader *shader,
+                               struct nir_pass_stats_scope *scope);
+void nir_pass_stats_end_slow(nir_shader *shader, const char *pass_name,
+                             struct nir_pass_stats_scope *scope, int progress);
+
+static inline void
+nir_pass_stats_begin(nir_shader *shader, struct nir_pass_stats_scope *scope)
+{
+   scope->start_ns = 0;
+   if (unlikely(nir_pass_stats_enabled))
+      nir_pass_stats_begin_slow(shader, scope);
+}
+
+/* progress is negative when the pass doesn't report it (NIR_PASS_V). */
+static inline void
+nir_pass_stats_end(nir_shader *shader, const char *pass_name,
+                   struct nir_pass_stats_scope *scope, int progress)
+{
+   if (unlikely(scope->start_ns))
+      nir_pass_stats_end_slow(shader, pass_name, scope, progress);
+}
+
 #define _PASS(pass, nir, do_pass)                                       \
    do {                                                                 \
       if (should_skip_nir(#pass)) {                                     \
@@ -5212,7 +5270,11 @@ should_print_nir(UNUSED nir_shader *shader)
    nir_metadata_set_validation_flag(nir);                       \
    if (should_print_nir(nir))                                   \
       printf("%s\n", #pass);                                    \
-   if (pass(nir, ##__VA_ARGS__)) {                              \
+   struct nir_pass_stats_scope _pass_stats;                     \
+   nir_pass_stats_begin(nir, &_pass_stats);                     \
+   const bool _pass_progress = pass(nir, ##__VA_ARGS__);        \
+   nir_pass_stats_end(nir, #pass, &_pass_stats, _pass_progress);\
+   if (_pass_progress) {                                        \
       nir_validate_shader(nir, "after " #pass " in " __FILE__); \
       UNUSED bool _;                                            \
       progress = true;                                          \
@@ -5225,28 +5287,41 @@ should_print_nir(UNUSED nir_shader *shader)
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir, {        \
    if (should_print_nir(nir))                                \
       printf("%s\n", #pass);                                 \
+   struct nir_pass_stats_scope _pass_stats;                  \
+   nir_pass_stats_begin(nir, &_pass_stats);                  \
    pass(nir, ##__VA_ARGS__);                                 \
+   nir_pass_stats_end(nir, #pass, &_pass_stats, -1);         \
    nir_validate_shader(nir, "after " #pass " in " __FILE__); \
    if (should_print_nir(nir))                                \
       nir_print_shader(nir, stdout);                         \
 })
 
-#define _NIR_LOOP_PASS(progress, idempotent, skip, nir, pass, ...)   \
-do {                                                                 \
-   bool nir_loop_pass_progress = false;                              \
-   if (!_mesa_set_search(skip, (void (*)())&pass))                   \
-      NIR_PASS(nir_loop_pass_progress, nir, pass, ##__VA_ARGS__);    \
-   if (nir_loop_pass_progress)                                       \
-      _mesa_set_clear(skip, NULL);                                   \
-   if (idempotent || !nir_loop_pass_progress)                        \
-      _mesa_set_add(skip, (void (*)())&pass);                        \
-   UNUSED bool _ = false;                                            \
-   progress |= nir_loop_pass_progress;                               \
+#define _NIR_LOOP_PASS(progress, idempotent, skip, key, nir, pass, ...)  \
+do {                                                                     \
+   bool nir_loop_pass_progress = false;                                  \
+   if (!_mesa_set_search(skip, key)) {                                   \
+      NIR_PASS(nir_loop_pass_progress, nir, pass, ##__VA_ARGS__);        \
+   } else if (NIR_DEBUG(CHECK_LOOP_SKIPS)) {                             \
+      nir_shader *_clone = nir_shader_clone(NULL, nir);                  \
+      if (pass(_clone, ##__VA_ARGS__)) {                                 \
+         fprintf(stderr, "NIR_DEBUG=check_loop_skips: %s made progress " \
+                 "after being skipped\n", #pass);                        \
+         abort();                                                        \
+      }                                                                  \
+      ralloc_free(_clone);                                               \
+   }                                                                     \
+   if (nir_loop_pass_progress)                                           \
+      _mesa_set_clear(skip, NULL);                                       \
+   if (idempotent || !nir_loop_pass_progress)                            \
+      _mesa_set_add(skip, key);                                          \
+   UNUSED bool _ = false;                                                \
+   progress |= nir_loop_pass_progress;                                   \
 } while (0)
 
 /* Helper to skip a pass if no different passes have made progress since it was
  * previously run. Note that two passes are considered the same if they have
- * the same function pointer, even if they used different options.
+ * the same function pointer, even if they used different options.  See
+ * NIR_LOOP_SITE_PASS to tell them apart.
  *
  * The usage of this is mostly identical to NIR_PASS. "skip" is a "struct set *"
  * (created by _mesa_pointer_set_create) which the macro uses to keep track of
@@ -5267,14 +5342,41 @@ do {                                                                 \
  * You shouldn't mix usage of this with the NIR_PASS set of helpers, without
  * using a new "skip" in-between.
  */
-#define NIR_LOOP_PASS(progress, skip, nir, pass, ...) \
-   _NIR_LOOP_PASS(progress, true, skip, nir, pass, ##__VA_ARGS__)
+#define NIR_LOOP_PASS(progress, skip, nir, pass, ...)                   \
+   _NIR_LOOP_PASS(progress, true, skip, (const void *)&pass, nir, pass,  \
+                  ##__VA_ARGS__)
 
 /* Like NIR_LOOP_PASS, but use this for passes which may make further progress
  * when repeated.
  */
-#define NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, pass, ...) \
-   _NIR_LOOP_PASS(progress, false, skip, nir, pass, ##__VA_ARGS__)
+#define NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, pass, ...)    \
+   _NIR_LOOP_PASS(progress, false, skip, (const void *)&pass, nir, pass, \
+                  ##__VA_ARGS__)
+
+#define _NIR_LOOP_SITE_PASS(progress, idempotent, skip, nir, pass, ...)   \
+do {                                                                      \
+   static const char _loop_pass_site = 0;                                 \
+   _NIR_LOOP_PASS(progress, idempotent, skip, &_loop_pass_site, nir, pass, \
+                  ##__VA_ARGS__);                                         \
+} while (0)
+
+/* Like NIR_LOOP_PASS, but each call site is tracked on its own instead of
+ * each function pointer, so a pass called twice in the same loop, possibly
+ * with different options, is only skipped at the call site which last ran
+ * it without progress.  Both can share the same "skip" set.
+ *
+ * With NIR_DEBUG=check_loop_skips, skipped passes are run on a clone of the
+ * shader and it is an error if they make progress there.  That catches
+ * passes wrongly assumed to be idempotent.
+ */
+#define NIR_LOOP_SITE_PASS(progress, skip, nir, pass, ...) \
+   _NIR_LOOP_SITE_PASS(progress, true, skip, nir, pass, ##__VA_ARGS__)
+
+/* Like NIR_LOOP_SITE_PASS, but use this for passes which may make further
+ * progress when repeated.
+ */
+#define NIR_LOOP_SITE_PASS_NOT_IDEMPOTENT(progress, skip, nir, pass, ...) \
+   _NIR_LOOP_SITE_PASS(progress, false, skip, nir, pass, ##__VA_ARGS__)
 
 #define NIR_SKIP(name) should_skip_nir(#name)
 
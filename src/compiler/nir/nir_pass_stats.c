@@ -0,0 +1,243 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Aggregates, per pass name, how often NIR_PASS and NIR_PASS_V ran a pass,
+ * how often it made progress, the time spent in it and the amount of
+ * instruction memory it allocated, across all shaders and threads of the
+ * process.  The results are written as JSON when the process exits:
+ *
+ *    {
+ *       "passes": [
+ *          { "name": "nir_opt_algebraic", "invocations": 120,
+ *            "progress": 31, "no_progress": 89, "time_ns": 5310221,
+ *            "self_time_ns": 5310221, "gc_bytes": 1048576 },
+ *          ...
+ *       ]
+ *    }
+ *
+ * Passes are sorted by self time.  time_ns and gc_bytes include the passes
+ * run from inside the pass, self_time_ns doesn't.  Passes run with
+ * NIR_PASS_V don't report progress, so their invocations are counted in
+ * neither progress nor no_progress.
+ *
+ * This is enabled by setting NIR_PASS_STATS to the path of the file to
+ * write, or to "-" for stderr.  When disabled, the cost in NIR_PASS is a
+ * single load and branch.  Tools can also enable the statistics with
+ * nir_pass_stats_enable() and read them with nir_pass_stats_foreach(), for
+ * example to compute the cost of each pass for a single shader.
+ */
+
+#include "nir.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "c11/threads.h"
+#include "util/os_misc.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+#include "util/u_thread.h"
+
+bool nir_pass_stats_enabled = false;
+
+static const char *stats_path;
+static simple_mtx_t stats_mutex = SIMPLE_MTX_INITIALIZER;
+static struct hash_table *stats_table;
+
+static __THREAD_INITIAL_EXEC struct nir_pass_stats_scope *current_scope;
+
+static int
+compare_self_time(const void *a, const void *b)
+{
+   const struct nir_pass_stats *sa = *(const struct nir_pass_stats *const *)a;
+   const struct nir_pass_stats *sb = *(const struct nir_pass_stats *const *)b;
+
+   if (sa->self_time_ns != sb->self_time_ns)
+      return sa->self_time_ns < sb->self_time_ns ? 1 : -1;
+
+   return strcmp(sa->name, sb->name);
+}
+
+static void
+print_json_string(FILE *f, const char *str)
+{
+   fputc('"', f);
+   for (const char *c = str; *c; c++) {
+      if (*c == '"' || *c == '\\')
+         fputc('\\', f);
+      fputc(*c, f);
+   }
+   fputc('"', f);
+}
+
+static void
+nir_pass_stats_dump(void)
+{
+   simple_mtx_lock(&stats_mutex);
+
+   const unsigned count = _mesa_hash_table_num_entries(stats_table);
+   struct nir_pass_stats **sorted =
+      ralloc_array(stats_table, struct nir_pass_stats *, count);
+
+   unsigned i = 0;
+   hash_table_foreach(stats_table, entry)
+      sorted[i++] = entry->data;
+   qsort(sorted, count, sizeof(*sorted), compare_self_time);
+
+   FILE *f = strcmp(stats_path, "-") == 0 ? stderr : fopen(stats_path, "w");
+   if (f == NULL) {
+      fprintf(stderr, "NIR_PASS_STATS: failed to open %s\n", stats_path);
+   } else {
+      fprintf(f, "{\n   \"passes\": [");
+      for (i = 0; i < count; i++) {
+         const struct nir_pass_stats *stats = sorted[i];
+
+         fprintf(f, "%s\n      { \"name\": ", i ? "," : "");
+         print_json_string(f, stats->name);
+         fprintf(f, ", \"invocations\": %" PRIu64
+                    ", \"progress\": %" PRIu64
+                    ", \"no_progress\": %" PRIu64
+                    ", \"time_ns\": %" PRId64
+                    ", \"self_time_ns\": %" PRId64
+                    ", \"gc_bytes\": %" PRIu64 " }",
+                 stats->invocations, stats->progress, stats->no_progress,
+                 stats->time_ns, stats->self_time_ns, stats->gc_bytes);
+      }
+      fprintf(f, "\n   ]\n}\n");
+
+      if (f != stderr)
+         fclose(f);
+   }
+
+   ralloc_free(stats_table);
+   stats_table = NULL;
+   nir_pass_stats_enabled = false;
+
+   simple_mtx_unlock(&stats_mutex);
+}
+
+static void
+nir_pass_stats_init_once(void)
+{
+   stats_path = os_get_option("NIR_PASS_STATS");
+   if (stats_path == NULL || stats_path[0] == '\0')
+      return;
+
+   stats_table = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                         _mesa_key_string_equal);
+   atexit(nir_pass_stats_dump);
+   nir_pass_stats_enabled = true;
+}
+
+void
+nir_pass_stats_init(void)
+{
+   static once_flag flag = ONCE_FLAG_INIT;
+   call_once(&flag, nir_pass_stats_init_once);
+}
+
+void
+nir_pass_stats_enable(void)
+{
+   nir_pass_stats_init();
+
+   simple_mtx_lock(&stats_mutex);
+   if (stats_table == NULL) {
+      stats_table = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                            _mesa_key_string_equal);
+   }
+   nir_pass_stats_enabled = true;
+   simple_mtx_unlock(&stats_mutex);
+}
+
+void
+nir_pass_stats_foreach(nir_pass_stats_cb cb, void *data)
+{
+   simple_mtx_lock(&stats_mutex);
+   if (stats_table) {
+      hash_table_foreach(stats_table, entry)
+         cb(entry->data, data);
+   }
+   simple_mtx_unlock(&stats_mutex);
+}
+
+void
+nir_pass_stats_begin_slow(nir_shader *shader,
+                          struct nir_pass_stats_scope *scope)
+{
+   scope->child_ns = 0;
+   scope->start_gc_size = gc_get_allocated_size(shader->gctx);
+   scope->parent = current_scope;
+   current_scope = scope;
+   scope->start_ns = os_time_get_nano();
+}
+
+void
+nir_pass_stats_end_slow(nir_shader *shader, const char *pass_name,
+                        struct nir_pass_stats_scope *scope, int progress)
+{
+   const int64_t time_ns = os_time_get_nano() - scope->start_ns;
+   const uint64_t gc_size = gc_get_allocated_size(shader->gctx);
+
+   assert(current_scope == scope);
+   current_scope = scope->parent;
+   if (scope->parent)
+      scope->parent->child_ns += time_ns;
+
+   simple_mtx_lock(&stats_mutex);
+
+   /* The stats were already dumped, this is a pass run from an atexit
+    * handler or another thread while exiting.
+    */
+   if (stats_table == NULL) {
+      simple_mtx_unlock(&stats_mutex);
+      return;
+   }
+
+   struct hash_entry *entry = _mesa_hash_table_search(stats_table, pass_name);
+   struct nir_pass_stats *stats;
+   if (entry) {
+      stats = entry->data;
+   } else {
+      stats = rzalloc(stats_table, struct nir_pass_stats);
+      stats->name = ralloc_strdup(stats, pass_name);
+      _mesa_hash_table_insert(stats_table, stats->name, stats);
+   }
+
+   stats->invocations++;
+   if (progress > 0)
+      stats->progress++;
+   else if (progress == 0)
+      stats->no_progress++;
+   stats->time_ns += time_ns;
+   stats->self_time_ns += time_ns - scope->child_ns;
+
+   /* A pass replacing the shader, like nir_shader_replace(), also replaces
+    * its GC context.
+    */
+   if (gc_size > scope->start_gc_size)
+      stats->gc_bytes += gc_size - scope->start_gc_size;
+
+   simple_mtx_unlock(&stats_mutex);
+}
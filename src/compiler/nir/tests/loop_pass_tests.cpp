@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "nir_test.h"
+
+namespace {
+
+/* A pass which doesn't change the shader but reports progress for its
+ * first progress_runs runs.
+ */
+struct fake_pass {
+   unsigned runs;
+   unsigned progress_runs;
+};
+
+static bool
+run_fake_pass(nir_shader *shader, fake_pass *pass)
+{
+   if (pass->runs++ >= pass->progress_runs)
+      return false;
+
+   nir_metadata_preserve(nir_shader_get_entrypoint(shader),
+                         nir_metadata_none);
+   return true;
+}
+
+class nir_loop_pass_test : public nir_test {
+protected:
+   nir_loop_pass_test()
+      : nir_test::nir_test("nir_loop_pass_test")
+   {
+      skip = _mesa_pointer_set_create(NULL);
+   }
+
+   ~nir_loop_pass_test()
+   {
+      _mesa_set_destroy(skip, NULL);
+   }
+
+   struct set *skip;
+   unsigned iterations = 0;
+};
+
+} /* namespace */
+
+TEST_F(nir_loop_pass_test, skips_passes_until_progress)
+{
+   fake_pass first = { 0, 0 };
+   fake_pass second = { 0, 1 };
+
+   bool progress;
+   do {
+      progress = false;
+      NIR_LOOP_SITE_PASS(progress, skip, b->shader, run_fake_pass, &first);
+      NIR_LOOP_SITE_PASS(progress, skip, b->shader, run_fake_pass, &second);
+      iterations++;
+   } while (progress);
+
+   /* The second pass made progress once, so the first one runs again but
+    * the second one is idempotent.
+    */
+   EXPECT_EQ(iterations, 2);
+   EXPECT_EQ(first.runs, 2);
+   EXPECT_EQ(second.runs, 1);
+}
+
+TEST_F(nir_loop_pass_test, not_idempotent_reruns_after_progress)
+{
+   fake_pass pass = { 0, 2 };
+
+   bool progress;
+   do {
+      progress = false;
+      NIR_LOOP_SITE_PASS_NOT_IDEMPOTENT(progress, skip, b->shader,
+                                        run_fake_pass, &pass);
+      iterations++;
+   } while (progress);
+
+   EXPECT_EQ(iterations, 3);
+   EXPECT_EQ(pass.runs, 3);
+}
+
+TEST_F(nir_loop_pass_test, call_sites_are_tracked_separately)
+{
+   fake_pass first = { 0, 0 };
+   fake_pass second = { 0, 0 };
+
+   for (unsigned i = 0; i < 2; i++) {
+      bool progress = false;
+      NIR_LOOP_SITE_PASS(progress, skip, b->shader, run_fake_pass, &first);
+      NIR_LOOP_SITE_PASS(progress, skip, b->shader, run_fake_pass, &second);
+      EXPECT_FALSE(progress);
+   }
+
+   /* The same function at two call sites runs once at each of them. */
+   EXPECT_EQ(first.runs, 1);
+   EXPECT_EQ(second.runs, 1);
+}
+
+TEST_F(nir_loop_pass_test, function_pointers_are_shared)
+{
+   fake_pass first = { 0, 0 };
+   fake_pass second = { 0, 0 };
+
+   for (unsigned i = 0; i < 2; i++) {
+      bool progress = false;
+      NIR_LOOP_PASS(progress, skip, b->shader, run_fake_pass, &first);
+      NIR_LOOP_PASS(progress, skip, b->shader, run_fake_pass, &second);
+      EXPECT_FALSE(progress);
+   }
+
+   /* Unlike with NIR_LOOP_SITE_PASS, the second call is skipped because
+    * it uses the same function as the first one.
+    */
+   EXPECT_EQ(first.runs, 1);
+   EXPECT_EQ(second.runs, 0);
+}
+
+#ifndef NDEBUG
+TEST_F(nir_loop_pass_test, check_loop_skips)
+{
+   /* Wrongly used as an idempotent pass. */
+   fake_pass pass = { 0, 2 };
+
+   const uint32_t saved_debug = nir_debug;
+   nir_debug |= NIR_DEBUG_CHECK_LOOP_SKIPS;
+
+   EXPECT_DEATH({
+      bool progress;
+      do {
+         progress = false;
+         NIR_LOOP_SITE_PASS(progress, skip, b->shader, run_fake_pass, &pass);
+      } while (progress);
+   }, "run_fake_pass made progress after being skipped");
+
+   nir_debug = saved_debug;
+}
+#endif
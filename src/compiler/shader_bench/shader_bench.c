@@ -0,0 +1,715 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Corpus walk, frontends and CSV output shared by the offline compile-time
+ * benchmarks, see shader_bench.h.
+ *
+ * Directories are walked recursively in a stable order.  .spv files are
+ * SPIR-V modules, .vert, .tesc, .tese, .geom, .frag and .comp files are GLSL
+ * shaders compiled and linked on their own.  When a shader is compiled more
+ * than once (-r), the fastest time of each step is reported.
+ *
+ * The per-pass CSV (-P) comes from the NIR pass statistics (see
+ * nir_pass_stats.c): the difference of the statistics before and after each
+ * compile is the cost of the passes for that shader.  It only sees the passes
+ * run by the NIR linked into the tool, not the ones of a Vulkan driver
+ * loaded as a shared library.
+ */
+
+#include "shader_bench.h"
+
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "compiler/spirv/spirv.h"
+#include "util/os_file.h"
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/u_dynarray.h"
+
+#ifdef HAVE_SHADER_BENCH_GLSL
+#include "compiler/glsl/builtin_functions.h"
+#endif
+
+#define SPIR_V_MAGIC_NUMBER  0x07230203
+#define SPIRV_OP_ENTRY_POINT 15
+
+static const struct shader_bench_backend *backend;
+static const char *target;
+static const char *entrypoint_name;
+static unsigned glsl_version = 460;
+static unsigned repeat = 1;
+static FILE *shader_csv;
+static FILE *step_csv;
+static FILE *pass_csv;
+
+static const struct {
+   const char *ext;
+   gl_shader_stage stage;
+} glsl_exts[] = {
+   { ".vert", MESA_SHADER_VERTEX },
+   { ".tesc", MESA_SHADER_TESS_CTRL },
+   { ".tese", MESA_SHADER_TESS_EVAL },
+   { ".geom", MESA_SHADER_GEOMETRY },
+   { ".frag", MESA_SHADER_FRAGMENT },
+   { ".comp", MESA_SHADER_COMPUTE },
+};
+
+static void
+print_usage(const char *name, FILE *f)
+{
+   fprintf(f,
+           "Usage: %s [OPTION]... FILE|DIRECTORY...\n"
+           "Compiles SPIR-V and GLSL shaders with %s and reports compile\n"
+           "time, peak memory and code statistics as CSV.\n"
+           "\n"
+           "    -t, --target=NAME|ID     GPU to compile for (default: %s)\n"
+           "    -e, --entrypoint=NAME    SPIR-V entrypoint to compile (default:\n"
+           "                             the first one of a supported stage)\n"
+           "    -g, --glsl-version=N     GLSL version of the compiler\n"
+           "                             (default: 460)\n"
+           "    -r, --repeat=N           compile each shader N times and report\n"
+           "                             the fastest run (default: 1)\n"
+           "    -o, --output=FILE        per-shader CSV file (default: stdout)\n"
+           "    -s, --steps=FILE         per-step CSV file\n"
+           "    -P, --passes=FILE        per-pass CSV file, this adds the cost\n"
+           "                             of the NIR pass statistics to the\n"
+           "                             compile times\n"
+           "    -h, --help               display this help and exit\n",
+           name, backend->name, backend->default_target);
+}
+
+/* Writes a string as a CSV field, quoting it when needed. */
+static void
+csv_print_str(FILE *f, const char *str)
+{
+   if (strpbrk(str, ",\"\n") == NULL) {
+      fputs(str, f);
+      return;
+   }
+
+   fputc('"', f);
+   for (const char *c = str; *c; c++) {
+      if (*c == '"')
+         fputc('"', f);
+      fputc(*c, f);
+   }
+   fputc('"', f);
+}
+
+/* Resets the peak RSS of the process so that the next read only accounts
+ * for what happened since.  Only supported on Linux, elsewhere the peak is
+ * the one of the whole run.
+ */
+static void
+reset_peak_rss(void)
+{
+   FILE *f = fopen("/proc/self/clear_refs", "w");
+   if (f) {
+      fputs("5", f);
+      fclose(f);
+   }
+}
+
+static long
+read_peak_rss_kb(void)
+{
+   FILE *f = fopen("/proc/self/status", "r");
+   if (f) {
+      char line[128];
+      long kb = -1;
+      while (fgets(line, sizeof(line), f)) {
+         if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+            break;
+      }
+      fclose(f);
+      if (kb >= 0)
+         return kb;
+   }
+
+   struct rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   return usage.ru_maxrss;
+}
+
+static gl_shader_stage
+spirv_execution_model_to_stage(uint32_t model)
+{
+   switch (model) {
+   case SpvExecutionModelVertex:                 return MESA_SHADER_VERTEX;
+   case SpvExecutionModelTessellationControl:    return MESA_SHADER_TESS_CTRL;
+   case SpvExecutionModelTessellationEvaluation: return MESA_SHADER_TESS_EVAL;
+   case SpvExecutionModelGeometry:               return MESA_SHADER_GEOMETRY;
+   case SpvExecutionModelFragment:               return MESA_SHADER_FRAGMENT;
+   case SpvExecutionModelGLCompute:              return MESA_SHADER_COMPUTE;
+   case SpvExecutionModelTaskEXT:                return MESA_SHADER_TASK;
+   case SpvExecutionModelMeshEXT:                return MESA_SHADER_MESH;
+   default:                                      return MESA_SHADER_NONE;
+   }
+}
+
+/* Finds the entrypoint to compile and its stage from the OpEntryPoint
+ * instructions of the module.
+ */
+static const char *
+find_entrypoint(const uint32_t *words, size_t word_count,
+                gl_shader_stage *stage)
+{
+   for (size_t i = 5; i < word_count;) {
+      const unsigned count = words[i] >> 16;
+      const unsigned opcode = words[i] & 0xffff;
+
+      if (count == 0 || i + count > word_count)
+         break;
+
+      if (opcode == SPIRV_OP_ENTRY_POINT && count > 3) {
+         const char *name = (const char *)&words[i + 3];
+         const gl_shader_stage s = spirv_execution_model_to_stage(words[i + 1]);
+
+         if (s != MESA_SHADER_NONE && (backend->stages & BITFIELD_BIT(s)) &&
+             (entrypoint_name == NULL || strcmp(name, entrypoint_name) == 0)) {
+            *stage = s;
+            return name;
+         }
+      }
+
+      i += count;
+   }
+
+   return NULL;
+}
+
+static bool
+glsl_stage_from_path(const char *path, gl_shader_stage *stage)
+{
+   const size_t len = strlen(path);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(glsl_exts); i++) {
+      const size_t ext_len = strlen(glsl_exts[i].ext);
+      if (len > ext_len &&
+          strcmp(path + len - ext_len, glsl_exts[i].ext) == 0) {
+         *stage = glsl_exts[i].stage;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static bool
+is_shader_path(const char *path)
+{
+   gl_shader_stage stage;
+   const size_t len = strlen(path);
+
+   return (len > 4 && strcmp(path + len - 4, ".spv") == 0) ||
+          glsl_stage_from_path(path, &stage);
+}
+
+static void
+add_step(struct shader_bench_job *job, const char *name, int64_t start,
+         bool is_backend)
+{
+   assert(job->step_count < SHADER_BENCH_MAX_STEPS);
+   job->steps[job->step_count++] = (struct shader_bench_step) {
+      .name = name,
+      .ns = os_time_get_nano() - start,
+      .backend = is_backend,
+   };
+}
+
+void
+shader_bench_add_step(struct shader_bench_job *job, const char *name,
+                      int64_t start)
+{
+   add_step(job, name, start, true);
+}
+
+struct shader_bench_variant *
+shader_bench_add_variant(struct shader_bench_job *job, const char *name)
+{
+   assert(job->variant_count < SHADER_BENCH_MAX_VARIANTS);
+   struct shader_bench_variant *variant = &job->variants[job->variant_count++];
+
+   memset(variant, 0, sizeof(*variant));
+   snprintf(variant->name, sizeof(variant->name), "%s", name);
+   return variant;
+}
+
+static bool
+run_once(struct shader_bench_job *job, const uint32_t *words,
+         size_t word_count)
+{
+   const gl_shader_stage stage = job->stage;
+   nir_shader *nir = NULL;
+   int64_t t;
+
+   if (job->input == SHADER_BENCH_INPUT_SPIRV) {
+      if (backend->compile_spirv)
+         return backend->compile_spirv(job, words, word_count);
+
+      t = os_time_get_nano();
+      nir = spirv_to_nir(words, word_count, NULL, 0, stage, job->entrypoint,
+                         backend->spirv_options,
+                         backend->get_nir_options(stage));
+      add_step(job, "spirv_to_nir", t, false);
+   } else {
+#ifdef HAVE_SHADER_BENCH_GLSL
+      t = os_time_get_nano();
+      nir = shader_bench_glsl_to_nir(job->path, stage, glsl_version,
+                                     backend->get_nir_options(stage));
+      add_step(job, "glsl_to_nir", t, false);
+#endif
+   }
+
+   if (nir == NULL) {
+      fprintf(stderr, "%s: failed to translate to NIR\n", job->path);
+      return false;
+   }
+   ralloc_steal(job->mem_ctx, nir);
+
+   return backend->compile_nir(job, nir);
+}
+
+static void
+snapshot_pass(const struct nir_pass_stats *stats, void *data)
+{
+   struct hash_table *table = data;
+   struct nir_pass_stats *copy = ralloc(table, struct nir_pass_stats);
+
+   *copy = *stats;
+   copy->name = ralloc_strdup(copy, stats->name);
+   _mesa_hash_table_insert(table, copy->name, copy);
+}
+
+static struct hash_table *
+snapshot_passes(void *mem_ctx)
+{
+   struct hash_table *table =
+      _mesa_hash_table_create(mem_ctx, _mesa_hash_string,
+                              _mesa_key_string_equal);
+   nir_pass_stats_foreach(snapshot_pass, table);
+   return table;
+}
+
+/* Adds the passes run since the before snapshot to passes.  When a shader
+ * is compiled more than once, the fastest run of each pass is kept.
+ */
+static void
+record_passes(struct hash_table *passes, struct hash_table *before)
+{
+   struct hash_table *after = snapshot_passes(passes);
+
+   hash_table_foreach(after, entry) {
+      const struct nir_pass_stats *end = entry->data;
+      struct nir_pass_stats delta = *end;
+
+      struct hash_entry *start_entry =
+         _mesa_hash_table_search(before, end->name);
+      if (start_entry) {
+         const struct nir_pass_stats *start = start_entry->data;
+         delta.invocations -= start->invocations;
+         delta.progress -= start->progress;
+         delta.no_progress -= start->no_progress;
+         delta.time_ns -= start->time_ns;
+         delta.self_time_ns -= start->self_time_ns;
+         delta.gc_bytes -= start->gc_bytes;
+      }
+
+      if (delta.invocations == 0)
+         continue;
+
+      struct hash_entry *prev = _mesa_hash_table_search(passes, end->name);
+      if (prev) {
+         struct nir_pass_stats *stats = prev->data;
+         stats->time_ns = MIN2(stats->time_ns, delta.time_ns);
+         stats->self_time_ns = MIN2(stats->self_time_ns, delta.self_time_ns);
+      } else {
+         struct nir_pass_stats *stats = ralloc(passes, struct nir_pass_stats);
+         *stats = delta;
+         stats->name = ralloc_strdup(stats, end->name);
+         _mesa_hash_table_insert(passes, stats->name, stats);
+      }
+   }
+
+   ralloc_free(after);
+}
+
+static int
+compare_self_time(const void *a, const void *b)
+{
+   const struct nir_pass_stats *sa = *(const struct nir_pass_stats *const *)a;
+   const struct nir_pass_stats *sb = *(const struct nir_pass_stats *const *)b;
+
+   if (sa->self_time_ns != sb->self_time_ns)
+      return sa->self_time_ns < sb->self_time_ns ? 1 : -1;
+
+   return strcmp(sa->name, sb->name);
+}
+
+static void
+write_passes(const struct shader_bench_job *job, struct hash_table *passes)
+{
+   const unsigned count = _mesa_hash_table_num_entries(passes);
+   const struct nir_pass_stats **sorted =
+      ralloc_array(passes, const struct nir_pass_stats *, count);
+
+   unsigned i = 0;
+   hash_table_foreach(passes, entry)
+      sorted[i++] = entry->data;
+   qsort(sorted, count, sizeof(*sorted), compare_self_time);
+
+   for (i = 0; i < count; i++) {
+      const struct nir_pass_stats *stats = sorted[i];
+
+      csv_print_str(pass_csv, job->path);
+      fprintf(pass_csv, ",%s,", _mesa_shader_stage_to_abbrev(job->stage));
+      csv_print_str(pass_csv, stats->name);
+      fprintf(pass_csv, ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRId64
+                        ",%" PRId64 ",%" PRIu64 "\n",
+              stats->invocations, stats->progress, stats->no_progress,
+              stats->time_ns, stats->self_time_ns, stats->gc_bytes);
+   }
+}
+
+static void
+write_results(const struct shader_bench_job *job, long peak_rss_kb)
+{
+   const char *stage = _mesa_shader_stage_to_abbrev(job->stage);
+   int64_t frontend_ns = 0, backend_ns = 0;
+
+   for (unsigned s = 0; s < job->step_count; s++) {
+      const struct shader_bench_step *step = &job->steps[s];
+
+      if (step->backend)
+         backend_ns += step->ns;
+      else
+         frontend_ns += step->ns;
+
+      if (step_csv) {
+         csv_print_str(step_csv, job->path);
+         fprintf(step_csv, ",%s,%s,%" PRId64 "\n", stage, step->name,
+                 step->ns);
+      }
+   }
+
+   for (unsigned v = 0; v < job->variant_count; v++) {
+      const struct shader_bench_variant *variant = &job->variants[v];
+
+      csv_print_str(shader_csv, job->path);
+      fprintf(shader_csv, ",%s,", stage);
+      csv_print_str(shader_csv, target);
+      fprintf(shader_csv, ",%s", variant->name);
+      for (unsigned i = 0; i < backend->stat_count; i++)
+         fprintf(shader_csv, ",%" PRIu64, variant->stats[i]);
+      fprintf(shader_csv, ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%ld\n",
+              frontend_ns, backend_ns, frontend_ns + backend_ns,
+              peak_rss_kb);
+   }
+}
+
+static bool
+bench_shader(const char *path)
+{
+   struct shader_bench_job job = {
+      .path = path,
+   };
+   const uint32_t *words = NULL;
+   size_t word_count = 0;
+   char *data = NULL;
+
+   if (glsl_stage_from_path(path, &job.stage)) {
+      job.input = SHADER_BENCH_INPUT_GLSL;
+#ifdef HAVE_SHADER_BENCH_GLSL
+      const bool glsl_supported = backend->compile_nir != NULL;
+#else
+      const bool glsl_supported = false;
+#endif
+      if (!glsl_supported) {
+         fprintf(stderr, "%s: GLSL is not supported, skipping\n", path);
+         return true;
+      }
+      if (!(backend->stages & BITFIELD_BIT(job.stage))) {
+         fprintf(stderr, "%s: unsupported stage, skipping\n", path);
+         return true;
+      }
+   } else {
+      size_t size;
+      data = os_read_file(path, &size);
+      if (data == NULL) {
+         fprintf(stderr, "%s: failed to read file\n", path);
+         return false;
+      }
+
+      words = (const uint32_t *)data;
+      word_count = size / 4;
+      if (size % 4 != 0 || word_count < 5 || words[0] != SPIR_V_MAGIC_NUMBER) {
+         fprintf(stderr, "%s: not a SPIR-V binary\n", path);
+         free(data);
+         return false;
+      }
+
+      job.input = SHADER_BENCH_INPUT_SPIRV;
+      job.entrypoint = find_entrypoint(words, word_count, &job.stage);
+      if (job.entrypoint == NULL) {
+         fprintf(stderr, "%s: no entrypoint of a supported stage, skipping\n",
+                 path);
+         free(data);
+         return true;
+      }
+   }
+
+   int64_t best_ns[SHADER_BENCH_MAX_STEPS];
+   bool ok = true;
+
+   struct hash_table *passes = NULL;
+   if (pass_csv) {
+      passes = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                       _mesa_key_string_equal);
+   }
+
+   reset_peak_rss();
+
+   for (unsigned r = 0; r < repeat && ok; r++) {
+      struct hash_table *before = passes ? snapshot_passes(passes) : NULL;
+
+      job.mem_ctx = ralloc_context(NULL);
+      job.step_count = 0;
+      job.variant_count = 0;
+
+      ok = run_once(&job, words, word_count);
+
+      if (passes) {
+         record_passes(passes, before);
+         ralloc_free(before);
+      }
+
+      for (unsigned s = 0; s < job.step_count; s++) {
+         if (r == 0 || job.steps[s].ns < best_ns[s])
+            best_ns[s] = job.steps[s].ns;
+      }
+
+      ralloc_free(job.mem_ctx);
+      job.mem_ctx = NULL;
+   }
+
+   const long peak_rss_kb = read_peak_rss_kb();
+
+   free(data);
+
+   if (!ok) {
+      fprintf(stderr, "%s: failed to compile\n", path);
+      ralloc_free(passes);
+      return false;
+   }
+
+   for (unsigned s = 0; s < job.step_count; s++)
+      job.steps[s].ns = best_ns[s];
+
+   write_results(&job, peak_rss_kb);
+   if (passes) {
+      write_passes(&job, passes);
+      ralloc_free(passes);
+   }
+   return true;
+}
+
+static int
+compare_paths(const void *a, const void *b)
+{
+   return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Benchmarks a file, or every shader below a directory in a stable order.
+ * Returns the number of failed shaders.
+ */
+static unsigned
+bench_path(const char *path)
+{
+   struct stat st;
+   if (stat(path, &st) != 0) {
+      fprintf(stderr, "%s: no such file or directory\n", path);
+      return 1;
+   }
+
+   if (!S_ISDIR(st.st_mode))
+      return bench_shader(path) ? 0 : 1;
+
+   DIR *dir = opendir(path);
+   if (dir == NULL) {
+      fprintf(stderr, "%s: failed to open directory\n", path);
+      return 1;
+   }
+
+   void *mem_ctx = ralloc_context(NULL);
+   struct util_dynarray entries;
+   util_dynarray_init(&entries, mem_ctx);
+
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      if (entry->d_name[0] == '.')
+         continue;
+
+      char *child = ralloc_asprintf(mem_ctx, "%s/%s", path, entry->d_name);
+      if (stat(child, &st) != 0)
+         continue;
+
+      if (S_ISDIR(st.st_mode) || is_shader_path(entry->d_name))
+         util_dynarray_append(&entries, char *, child);
+   }
+   closedir(dir);
+
+   qsort(entries.data, util_dynarray_num_elements(&entries, char *),
+         sizeof(char *), compare_paths);
+
+   unsigned failed = 0;
+   util_dynarray_foreach(&entries, char *, child)
+      failed += bench_path(*child);
+
+   ralloc_free(mem_ctx);
+   return failed;
+}
+
+int
+shader_bench_main(int argc, char **argv,
+                  const struct shader_bench_backend *_backend)
+{
+   const char *shader_csv_path = NULL;
+   const char *step_csv_path = NULL;
+   const char *pass_csv_path = NULL;
+   int c;
+
+   backend = _backend;
+   target = backend->default_target;
+
+   const struct option options[] = {
+      { "help",         no_argument,       NULL, 'h' },
+      { "target",       required_argument, NULL, 't' },
+      { "entrypoint",   required_argument, NULL, 'e' },
+      { "glsl-version", required_argument, NULL, 'g' },
+      { "repeat",       required_argument, NULL, 'r' },
+      { "output",       required_argument, NULL, 'o' },
+      { "steps",        required_argument, NULL, 's' },
+      { "passes",       required_argument, NULL, 'P' },
+      { NULL,           0,                 NULL, 0 }
+   };
+
+   while ((c = getopt_long(argc, argv, ":ht:e:g:r:o:s:P:", options,
+                           NULL)) != -1) {
+      switch (c) {
+      case 'h':
+         print_usage(argv[0], stdout);
+         return EXIT_SUCCESS;
+      case 't':
+         target = optarg;
+         break;
+      case 'e':
+         entrypoint_name = optarg;
+         break;
+      case 'g':
+         glsl_version = atoi(optarg);
+         break;
+      case 'r':
+         repeat = MAX2(atoi(optarg), 1);
+         break;
+      case 'o':
+         shader_csv_path = optarg;
+         break;
+      case 's':
+         step_csv_path = optarg;
+         break;
+      case 'P':
+         pass_csv_path = optarg;
+         break;
+      case ':':
+         fprintf(stderr, "%s: option `-%c' requires an argument\n",
+                 argv[0], optopt);
+         return EXIT_FAILURE;
+      case '?':
+      default:
+         fprintf(stderr, "%s: option `-%c' is invalid: ignored\n",
+                 argv[0], optopt);
+         print_usage(argv[0], stderr);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (optind >= argc) {
+      print_usage(argv[0], stderr);
+      return EXIT_FAILURE;
+   }
+
+   glsl_type_singleton_init_or_ref();
+#ifdef HAVE_SHADER_BENCH_GLSL
+   /* Keep the built-in functions around instead of building them again for
+    * each GLSL shader, like a GL driver does.
+    */
+   _mesa_glsl_builtin_functions_init_or_ref();
+#endif
+
+   if (!backend->init(target))
+      return EXIT_FAILURE;
+
+   shader_csv = shader_csv_path ? fopen(shader_csv_path, "w") : stdout;
+   if (shader_csv == NULL) {
+      fprintf(stderr, "%s: failed to open %s\n", argv[0], shader_csv_path);
+      return EXIT_FAILURE;
+   }
+
+   if (step_csv_path) {
+      step_csv = fopen(step_csv_path, "w");
+      if (step_csv == NULL) {
+         fprintf(stderr, "%s: failed to open %s\n", argv[0], step_csv_path);
+         return EXIT_FAILURE;
+      }
+      fprintf(step_csv, "shader,stage,step,time_ns\n");
+   }
+
+   if (pass_csv_path) {
+      pass_csv = fopen(pass_csv_path, "w");
+      if (pass_csv == NULL) {
+         fprintf(stderr, "%s: failed to open %s\n", argv[0], pass_csv_path);
+         return EXIT_FAILURE;
+      }
+      fprintf(pass_csv, "shader,stage,pass,invocations,progress,no_progress,"
+                        "time_ns,self_time_ns,gc_bytes\n");
+      nir_pass_stats_enable();
+   }
+
+   fprintf(shader_csv, "shader,stage,target,variant");
+   for (unsigned i = 0; i < backend->stat_count; i++)
+      fprintf(shader_csv, ",%s", backend->stat_names[i]);
+   fprintf(shader_csv, ",frontend_ns,backend_ns,total_ns,peak_rss_kb\n");
+
+   unsigned failed = 0;
+   for (int i = optind; i < argc; i++)
+      failed += bench_path(argv[i]);
+
+   backend->finish();
+#ifdef HAVE_SHADER_BENCH_GLSL
+   _mesa_glsl_builtin_functions_decref();
+#endif
+   glsl_type_singleton_decref();
+
+   if (shader_csv != stdout)
+      fclose(shader_csv);
+   if (step_csv)
+      fclose(step_csv);
+   if (pass_csv)
+      fclose(pass_csv);
+
+   if (failed)
+      fprintf(stderr, "%u shader(s) failed to compile\n", failed);
+
+   return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
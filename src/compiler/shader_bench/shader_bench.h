@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SHADER_BENCH_H
+#define SHADER_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compiler/nir/nir.h"
+#include "compiler/spirv/nir_spirv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Driver-independent part of the offline compile-time benchmarks.
+ *
+ * The harness walks a corpus of SPIR-V and GLSL shaders, turns each of them
+ * into NIR (or hands the SPIR-V to backends which do that themselves), calls
+ * the backend and writes the results as CSV:
+ *
+ *  - one row per shader and compiled variant with the backend statistics,
+ *    the frontend, backend and total compile times and the peak memory
+ *  - with --steps, one row per shader and compile step with its time
+ *  - with --passes, one row per shader and NIR pass with its invocations,
+ *    progress, time and memory, from the NIR pass statistics
+ *
+ * Each backend is a small tool filling a shader_bench_backend and calling
+ * shader_bench_main().
+ */
+
+#define SHADER_BENCH_MAX_STATS    24
+#define SHADER_BENCH_MAX_STEPS    16
+#define SHADER_BENCH_MAX_VARIANTS 8
+
+enum shader_bench_input {
+   SHADER_BENCH_INPUT_SPIRV,
+   SHADER_BENCH_INPUT_GLSL,
+};
+
+struct shader_bench_step {
+   const char *name;
+   int64_t ns;
+   bool backend;
+};
+
+struct shader_bench_variant {
+   char name[16];
+   uint64_t stats[SHADER_BENCH_MAX_STATS];
+};
+
+/* One compile of one shader. */
+struct shader_bench_job {
+   const char *path;
+   enum shader_bench_input input;
+   gl_shader_stage stage;
+   const char *entrypoint;
+
+   /* Freed after the compile. */
+   void *mem_ctx;
+
+   struct shader_bench_step steps[SHADER_BENCH_MAX_STEPS];
+   unsigned step_count;
+
+   struct shader_bench_variant variants[SHADER_BENCH_MAX_VARIANTS];
+   unsigned variant_count;
+};
+
+struct shader_bench_backend {
+   /* Name of the compiler, used in the usage message. */
+   const char *name;
+
+   /* Target given to init() when there is no --target. */
+   const char *default_target;
+
+   /* Mask of the stages the backend compiles, other shaders are skipped. */
+   uint32_t stages;
+
+   /* Names of the per-variant statistics, as CSV columns. */
+   const char *const *stat_names;
+   unsigned stat_count;
+
+   /* Creates the compiler for a target (a GPU name or id), prints an error
+    * and returns false if it's not supported.
+    */
+   bool (*init)(const char *target);
+   void (*finish)(void);
+
+   /* Backends compiling NIR: the harness runs spirv_to_nir or the GLSL
+    * frontend, and only passes shaders it could turn into NIR.
+    */
+   const nir_shader_compiler_options *(*get_nir_options)(gl_shader_stage stage);
+   const struct spirv_to_nir_options *spirv_options;
+   bool (*compile_nir)(struct shader_bench_job *job, nir_shader *nir);
+
+   /* Backends compiling SPIR-V themselves, like Vulkan drivers.  GLSL is not
+    * supported with these.
+    */
+   bool (*compile_spirv)(struct shader_bench_job *job, const uint32_t *words,
+                         size_t word_count);
+};
+
+int shader_bench_main(int argc, char **argv,
+                      const struct shader_bench_backend *backend);
+
+/* Records the time of a backend step, since start (from os_time_get_nano()).
+ * The sum of these is reported as the backend time of the shader.
+ */
+void shader_bench_add_step(struct shader_bench_job *job, const char *name,
+                           int64_t start);
+
+struct shader_bench_variant *
+shader_bench_add_variant(struct shader_bench_job *job, const char *name);
+
+#ifdef HAVE_SHADER_BENCH_GLSL
+/* Compiles and links a single GLSL file and translates it to NIR, with the
+ * lowering every GL driver does.  Inputs, outputs and uniforms are left as
+ * variables for the backend to lay out.
+ */
+nir_shader *shader_bench_glsl_to_nir(const char *path, gl_shader_stage stage,
+                                     unsigned glsl_version,
+                                     const nir_shader_compiler_options *options);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADER_BENCH_H */
@@ -0,0 +1,85 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * GLSL frontend of the compile-time benchmarks: the standalone GLSL
+ * compiler, glsl_to_nir and the lowering of the GL specific constructs,
+ * following what ir3_compiler and the state tracker do.
+ */
+
+#include "shader_bench.h"
+
+#include "compiler/glsl/gl_nir.h"
+#include "compiler/glsl/glsl_to_nir.h"
+#include "compiler/glsl/standalone.h"
+#include "main/mtypes.h"
+
+nir_shader *
+shader_bench_glsl_to_nir(const char *path, gl_shader_stage stage,
+                         unsigned glsl_version,
+                         const nir_shader_compiler_options *options)
+{
+   const struct standalone_options standalone_options = {
+      .glsl_version = glsl_version,
+      .do_link = true,
+      .just_log = true,
+   };
+   static struct gl_context ctx;
+   char *files[] = { (char *)path };
+
+   struct gl_shader_program *prog =
+      standalone_compile_shader(&standalone_options, 1, files, &ctx);
+   if (prog == NULL)
+      return NULL;
+
+   struct gl_linked_shader *linked = prog->_LinkedShaders[stage];
+   if (!prog->data->LinkStatus || linked == NULL) {
+      standalone_compiler_cleanup(prog);
+      return NULL;
+   }
+
+   nir_shader *nir = glsl_to_nir(&ctx.Const, &linked->ir,
+                                 &linked->Program->info, stage, options);
+
+   if (stage == MESA_SHADER_FRAGMENT) {
+      nir->info.fs.pixel_center_integer =
+         linked->Program->info.fs.pixel_center_integer;
+      nir->info.fs.origin_upper_left =
+         linked->Program->info.fs.origin_upper_left;
+      nir->info.fs.advanced_blend_modes =
+         linked->Program->info.fs.advanced_blend_modes;
+   }
+
+   gl_nir_inline_functions(nir);
+
+   if (options->lower_all_io_to_temps ||
+       stage == MESA_SHADER_VERTEX || stage == MESA_SHADER_GEOMETRY) {
+      NIR_PASS(_, nir, nir_lower_io_to_temporaries,
+               nir_shader_get_entrypoint(nir), true, true);
+   } else if (stage == MESA_SHADER_TESS_EVAL ||
+              stage == MESA_SHADER_FRAGMENT) {
+      NIR_PASS(_, nir, nir_lower_io_to_temporaries,
+               nir_shader_get_entrypoint(nir), true, false);
+   }
+
+   NIR_PASS(_, nir, nir_lower_global_vars_to_local);
+   NIR_PASS(_, nir, nir_split_var_copies);
+   NIR_PASS(_, nir, nir_lower_var_copies);
+
+   NIR_PASS(_, nir, gl_nir_lower_atomics, prog, true);
+   NIR_PASS(_, nir, gl_nir_lower_buffers, prog);
+   NIR_PASS(_, nir, nir_lower_atomics_to_ssbo, 0);
+
+   NIR_PASS(_, nir, nir_lower_system_values);
+   NIR_PASS(_, nir, nir_lower_compute_system_values, NULL);
+
+   NIR_PASS(_, nir, gl_nir_lower_samplers, prog);
+   NIR_PASS(_, nir, gl_nir_lower_images, false);
+
+   /* The NIR shader doesn't reference the program anymore. */
+   standalone_compiler_cleanup(prog);
+
+   return nir;
+}
@@ -1068,19 +1068,17 @@ store_clip(struct gallivm_state *gallivm,
  * Transforms the outputs for viewport mapping
  */
 static void
-generate_viewport(struct draw_llvm_variant *variant,
+generate_viewport(struct gallivm_state *gallivm,
                   LLVMBuilderRef builder,
                   struct lp_type vs_type,
                   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
-                  LLVMValueRef context_ptr)
+                  unsigned pos,
+                  LLVMValueRef vp_ptr)
 {
-   struct gallivm_state *gallivm = variant->gallivm;
    struct lp_type f32_type = vs_type;
-   const unsigned pos = variant->llvm->draw->vs.position_output;
    LLVMTypeRef vs_type_llvm = lp_build_vec_type(gallivm, vs_type);
    LLVMValueRef out3 = LLVMBuildLoad2(builder, vs_type_llvm, outputs[pos][3], ""); /*w0 w1 .. wn*/
    LLVMValueRef const1 = lp_build_const_vec(gallivm, f32_type, 1.0);       /*1.0 1.0 1.0 1.0*/
-   LLVMValueRef vp_ptr = draw_vs_jit_context_viewports(variant, context_ptr);
 
    /* We treat pipe_viewport_state as a float array */
    const int scale_index_offset = offsetof(struct pipe_viewport_state, scale) / sizeof(float);
@@ -1124,15 +1122,32 @@ generate_viewport(struct draw_llvm_variant *variant,
 }
 
 
+/**
+ * The clip tests done by generate_clipmask(), from the vertex or tess eval
+ * shader variant key.
+ */
+struct draw_llvm_clip_state
+{
+   bool clip_xy;
+   bool guard_band_xy;
+   bool clip_z;
+   bool clip_user;
+   bool clip_halfz;
+   bool need_edgeflags;
+   unsigned ucp_enable;
+};
+
+
 /**
  * Returns clipmask as nxi32 bitmask for the n vertices
+ * of the last vertex processing stage (the vertex or the tess eval shader).
  */
 static LLVMValueRef
 generate_clipmask(struct draw_llvm *llvm,
                   struct gallivm_state *gallivm,
                   struct lp_type vs_type,
                   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
-                  struct draw_llvm_variant_key *key,
+                  const struct draw_llvm_clip_state *key,
                   LLVMTypeRef context_type,
                   LLVMValueRef context_ptr,
                   bool *have_clipdist)
@@ -1146,16 +1161,17 @@ generate_clipmask(struct draw_llvm *llvm,
    LLVMValueRef plane1, planes, plane_ptr;
    struct lp_type f32_type = vs_type;
    struct lp_type i32_type = lp_int_type(vs_type);
-   const unsigned pos = llvm->draw->vs.position_output;
-   const unsigned cv = llvm->draw->vs.clipvertex_output;
-   int num_written_clipdistance = llvm->draw->vs.vertex_shader->info.num_written_clipdistance;
+   const unsigned pos = draw_current_shader_position_output(llvm->draw);
+   const unsigned cv = draw_current_shader_clipvertex_output(llvm->draw);
+   int num_written_clipdistance =
+      draw_current_shader_num_written_clipdistances(llvm->draw);
    bool have_cd = false;
    bool clip_user = key->clip_user;
    unsigned ucp_enable = key->ucp_enable;
    unsigned cd[2];
 
-   cd[0] = llvm->draw->vs.ccdistance_output[0];
-   cd[1] = llvm->draw->vs.ccdistance_output[1];
+   cd[0] = draw_current_shader_ccdistance_output(llvm->draw, 0);
+   cd[1] = draw_current_shader_ccdistance_output(llvm->draw, 1);
 
    if (cd[0] != pos || cd[1] != pos)
       have_cd = true;
@@ -1199,31 +1215,41 @@ generate_clipmask(struct draw_llvm *llvm,
     */
    /* Cliptest, for hardwired planes */
    /*
-    * XXX should take guardband into account (currently not in key).
-    * Otherwise might run the draw pipeline stages for nothing.
+    * XXX the vertex shader key doesn't know about the guardband, which
+    * depends on the primitive type. Might run the draw pipeline stages
+    * for nothing.
     */
    if (key->clip_xy) {
+      LLVMValueRef x = pos_x, y = pos_y;
+
+      /* same planes as draw_pt_post_vs_prepare() */
+      if (key->guard_band_xy) {
+         LLVMValueRef half = lp_build_const_vec(gallivm, f32_type, 0.5);
+         x = LLVMBuildFMul(builder, x, half, "");
+         y = LLVMBuildFMul(builder, y, half, "");
+      }
+
       /* plane 1 */
-      test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, pos_x , pos_w);
+      test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, x, pos_w);
       temp = shift;
       test = LLVMBuildAnd(builder, test, temp, "");
       mask = test;
 
       /* plane 2 */
-      test = LLVMBuildFAdd(builder, pos_x, pos_w, "");
+      test = LLVMBuildFAdd(builder, x, pos_w, "");
       test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, zero, test);
       temp = LLVMBuildShl(builder, temp, shift, "");
       test = LLVMBuildAnd(builder, test, temp, "");
       mask = LLVMBuildOr(builder, mask, test, "");
 
       /* plane 3 */
-      test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, pos_y, pos_w);
+      test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, y, pos_w);
       temp = LLVMBuildShl(builder, temp, shift, "");
       test = LLVMBuildAnd(builder, test, temp, "");
       mask = LLVMBuildOr(builder, mask, test, "");
 
       /* plane 4 */
-      test = LLVMBuildFAdd(builder, pos_y, pos_w, "");
+      test = LLVMBuildFAdd(builder, y, pos_w, "");
       test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, zero, test);
       temp = LLVMBuildShl(builder, temp, shift, "");
       test = LLVMBuildAnd(builder, test, temp, "");
@@ -1974,11 +2000,19 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
          if (enable_cliptest) {
             LLVMValueRef temp = LLVMBuildLoad2(builder, blduivec.vec_type, clipmask_bool_ptr, "");
             /* allocate clipmask, assign it integer type */
+            const struct draw_llvm_clip_state clip = {
+               .clip_xy = key->clip_xy,
+               .clip_z = key->clip_z,
+               .clip_user = key->clip_user,
+               .clip_halfz = key->clip_halfz,
+               .need_edgeflags = key->need_edgeflags,
+               .ucp_enable = key->ucp_enable,
+            };
             clipmask = generate_clipmask(llvm,
                                          gallivm,
                                          vs_type,
                                          outputs,
-                                         key,
+                                         &clip,
                                          variant->context_type,
                                          context_ptr, &have_clipdist);
             temp = LLVMBuildOr(builder, clipmask, temp, "");
@@ -1990,7 +2024,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
 
          /* do viewport mapping */
          if (!bypass_viewport) {
-            generate_viewport(variant, builder, vs_type, outputs, context_ptr);
+            generate_viewport(gallivm, builder, vs_type, outputs, pos,
+                              draw_vs_jit_context_viewports(variant, context_ptr));
          }
       } else {
          clipmask = blduivec.zero;
@@ -3316,6 +3351,9 @@ create_tes_jit_types(struct draw_tes_llvm_variant *var)
 {
    struct gallivm_state *gallivm = var->gallivm;
 
+   var->context_type = create_vs_jit_context_type(gallivm, "draw_vs_jit_context");
+   var->context_ptr_type = LLVMPointerType(var->context_type, 0);
+
    var->resources_type = lp_build_jit_resources_type(gallivm);
    var->resources_ptr_type = LLVMPointerType(var->resources_type, 0);
    var->input_array_deref_type = create_tes_jit_input_deref_type(gallivm);
@@ -3474,9 +3512,10 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
    LLVMContextRef context = gallivm->context;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
    LLVMTypeRef flt_type = LLVMFloatTypeInContext(context);
-   LLVMTypeRef arg_types[11];
+   LLVMTypeRef arg_types[12];
    LLVMTypeRef func_type;
    LLVMValueRef variant_func;
+   LLVMValueRef context_ptr;
    LLVMValueRef resources_ptr;
    LLVMValueRef tess_coord[2], io_ptr, input_array, num_tess_coord;
    LLVMValueRef view_index;
@@ -3499,6 +3538,13 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
    struct lp_type tes_type;
    unsigned vector_length = variant->shader->base.vector_length;
    int primid_slot = -1;
+   const struct draw_tes_llvm_variant_key *key = &variant->key;
+   const unsigned pos = llvm->draw->tes.position_output;
+   const bool enable_cliptest = key->post_vs &&
+      (key->clip_xy || key->clip_z || key->clip_user ||
+       llvm->draw->tes.tess_eval_shader->info.num_written_clipdistance);
+   LLVMValueRef clipmask_bool_ptr;
+   bool have_clipdist = false;
 
    memset(&system_values, 0, sizeof(system_values));
    memset(&outputs, 0, sizeof(outputs));
@@ -3508,17 +3554,18 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
    LLVMTypeRef tess_outer_deref_type = LLVMArrayType(flt_type, 4);
    LLVMTypeRef tess_inner_deref_type = LLVMArrayType(flt_type, 2);
 
-   arg_types[0] = get_tes_resources_ptr_type(variant);    /* context */
-   arg_types[1] = variant->input_array_type;           /* input */
-   arg_types[2] = variant->vertex_header_ptr_type;
-   arg_types[3] = int32_type;
+   arg_types[0] = variant->context_ptr_type;           /* context */
+   arg_types[1] = get_tes_resources_ptr_type(variant); /* resources */
+   arg_types[2] = variant->input_array_type;           /* input */
+   arg_types[3] = variant->vertex_header_ptr_type;
    arg_types[4] = int32_type;
-   arg_types[5] = LLVMPointerType(flt_type, 0);
+   arg_types[5] = int32_type;
    arg_types[6] = LLVMPointerType(flt_type, 0);
-   arg_types[7] = LLVMPointerType(tess_outer_deref_type, 0);
-   arg_types[8] = LLVMPointerType(tess_inner_deref_type, 0);
-   arg_types[9] = int32_type;
+   arg_types[7] = LLVMPointerType(flt_type, 0);
+   arg_types[8] = LLVMPointerType(tess_outer_deref_type, 0);
+   arg_types[9] = LLVMPointerType(tess_inner_deref_type, 0);
    arg_types[10] = int32_type;
+   arg_types[11] = int32_type;
 
    func_type = LLVMFunctionType(int32_type, arg_types, ARRAY_SIZE(arg_types), 0);
    variant_func = LLVMAddFunction(gallivm->module, func_name, func_type);
@@ -3537,18 +3584,20 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
       return;
    }
 
-   resources_ptr               = LLVMGetParam(variant_func, 0);
-   input_array               = LLVMGetParam(variant_func, 1);
-   io_ptr                    = LLVMGetParam(variant_func, 2);
-   prim_id                   = LLVMGetParam(variant_func, 3);
-   num_tess_coord            = LLVMGetParam(variant_func, 4);
-   tess_coord[0]             = LLVMGetParam(variant_func, 5);
-   tess_coord[1]             = LLVMGetParam(variant_func, 6);
-   tess_outer                = LLVMGetParam(variant_func, 7);
-   tess_inner                = LLVMGetParam(variant_func, 8);
-   patch_vertices_in         = LLVMGetParam(variant_func, 9);
-   view_index                = LLVMGetParam(variant_func, 10);
+   context_ptr               = LLVMGetParam(variant_func, 0);
+   resources_ptr             = LLVMGetParam(variant_func, 1);
+   input_array               = LLVMGetParam(variant_func, 2);
+   io_ptr                    = LLVMGetParam(variant_func, 3);
+   prim_id                   = LLVMGetParam(variant_func, 4);
+   num_tess_coord            = LLVMGetParam(variant_func, 5);
+   tess_coord[0]             = LLVMGetParam(variant_func, 6);
+   tess_coord[1]             = LLVMGetParam(variant_func, 7);
+   tess_outer                = LLVMGetParam(variant_func, 8);
+   tess_inner                = LLVMGetParam(variant_func, 9);
+   patch_vertices_in         = LLVMGetParam(variant_func, 10);
+   view_index                = LLVMGetParam(variant_func, 11);
 
+   lp_build_name(context_ptr, "context");
    lp_build_name(resources_ptr, "resources");
    lp_build_name(input_array, "input");
    lp_build_name(io_ptr, "io");
@@ -3608,6 +3657,10 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
       }
       primid_slot = slot;
    }
+
+   /* hold temporary "bool" clipmask */
+   clipmask_bool_ptr = lp_build_alloca(gallivm, bldvec.vec_type, "");
+
    struct lp_build_loop_state lp_loop;
    lp_build_loop_begin(&lp_loop, gallivm, bld.zero);
    {
@@ -3670,6 +3723,39 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
       LLVMValueRef clipmask = lp_build_const_int_vec(gallivm,
                                                      lp_int_type(tes_type), 0);
 
+      if (key->post_vs) {
+         /* store original positions in clip before further manipulation */
+         store_clip(gallivm, tes_type, variant->vertex_header_type, io, outputs, pos);
+
+         if (enable_cliptest) {
+            const struct draw_llvm_clip_state clip = {
+               .clip_xy = key->clip_xy,
+               .guard_band_xy = key->guard_band_xy,
+               .clip_z = key->clip_z,
+               .clip_user = key->clip_user,
+               .clip_halfz = key->clip_halfz,
+               .ucp_enable = key->ucp_enable,
+            };
+            LLVMValueRef temp = LLVMBuildLoad2(builder, bldvec.vec_type,
+                                               clipmask_bool_ptr, "");
+            clipmask = generate_clipmask(llvm, gallivm, tes_type, outputs,
+                                         &clip, variant->context_type,
+                                         context_ptr, &have_clipdist);
+            /* the lanes past the last domain point don't count */
+            temp = LLVMBuildOr(builder, temp,
+                               LLVMBuildAnd(builder, clipmask, mask_val, ""), "");
+            LLVMBuildStore(builder, temp, clipmask_bool_ptr);
+         }
+
+         if (!key->bypass_viewport) {
+            generate_viewport(gallivm, builder, tes_type, outputs, pos,
+                              lp_build_struct_get2(gallivm, variant->context_type,
+                                                   context_ptr,
+                                                   DRAW_VS_JIT_CTX_VIEWPORT,
+                                                   "viewports"));
+         }
+      }
+
       convert_to_aos(gallivm, variant->vertex_header_type, io, NULL, outputs, clipmask,
                      draw_total_tes_outputs(llvm->draw), tes_type, primid_slot, false);
    }
@@ -3677,7 +3763,10 @@ draw_tes_llvm_generate(struct draw_llvm *llvm,
    lp_bld_llvm_sampler_soa_destroy(sampler);
    lp_bld_llvm_image_soa_destroy(image);
 
-   LLVMBuildRet(builder, lp_build_zero(gallivm, lp_type_uint(32)));
+   /* return clipping boolean value for function */
+   LLVMValueRef ret = clipmask_booli8(gallivm, tes_type, bldvec.vec_type,
+                                      clipmask_bool_ptr, false);
+   LLVMBuildRet(builder, LLVMBuildZExt(builder, ret, int32_type, ""));
    gallivm_verify_function(gallivm, variant_func);
 }
 
@@ -3795,6 +3884,32 @@ draw_tes_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    key->clamp_vertex_color = llvm->draw->rasterizer->clamp_vertex_color &&
       llvm->draw->gs.geometry_shader == NULL;
 
+   /* Like for the vertex shader the viewport index would need to be taken
+    * from the leading vertex of each primitive, and edge flags only come
+    * from the vertex shader, so leave those to draw_pt_post_vs.
+    */
+   struct draw_tess_eval_shader *tes = llvm->draw->tes.tess_eval_shader;
+   if (llvm->draw->gs.geometry_shader == NULL &&
+       tes->position_output != -1 &&
+       !tes->info.writes_viewport_index &&
+       !llvm->draw->vs.edgeflag_output) {
+      const struct pipe_rasterizer_state *rast = llvm->draw->rasterizer;
+      const bool point_line_clip =
+         rast->fill_front == PIPE_POLYGON_MODE_POINT ||
+         rast->fill_front == PIPE_POLYGON_MODE_LINE ||
+         u_reduced_prim(get_tes_output_prim(tes)) != MESA_PRIM_TRIANGLES;
+
+      key->post_vs = true;
+      key->clip_xy = llvm->draw->clip_xy;
+      key->guard_band_xy = point_line_clip ?
+         llvm->draw->guard_band_points_lines_xy : llvm->draw->guard_band_xy;
+      key->clip_z = llvm->draw->clip_z;
+      key->clip_user = llvm->draw->clip_user;
+      key->clip_halfz = llvm->draw->rasterizer->clip_halfz;
+      key->bypass_viewport = llvm->draw->bypass_viewport;
+      key->ucp_enable = llvm->draw->rasterizer->clip_plane_enable;
+   }
+
    /* All variants of this shader will have the same value for
     * nr_samplers.  Not yet trying to compact away holes in the
     * sampler array.
@@ -3842,6 +3957,16 @@ draw_tes_llvm_dump_variant_key(struct draw_tes_llvm_variant_key *key)
    if (key->primid_needed)
       debug_printf("prim id output %d\n", key->primid_output);
    debug_printf("clamp_vertex_color = %u\n", key->clamp_vertex_color);
+   debug_printf("post_vs = %u\n", key->post_vs);
+   if (key->post_vs) {
+      debug_printf("clip_xy = %u\n", key->clip_xy);
+      debug_printf("guard_band_xy = %u\n", key->guard_band_xy);
+      debug_printf("clip_z = %u\n", key->clip_z);
+      debug_printf("clip_user = %u\n", key->clip_user);
+      debug_printf("bypass_viewport = %u\n", key->bypass_viewport);
+      debug_printf("clip_halfz = %u\n", key->clip_halfz);
+      debug_printf("ucp_enable = %u\n", key->ucp_enable);
+   }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
       debug_printf("sampler[%i].src_format = %s\n", i,
                    util_format_name(sampler[i].texture_state.format));
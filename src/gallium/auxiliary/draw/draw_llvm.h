@@ -176,7 +176,8 @@ typedef int
                      unsigned view_id);
 
 typedef int
-(*draw_tes_jit_func)(const struct lp_jit_resources *resources,
+(*draw_tes_jit_func)(struct draw_vs_jit_context *context,
+                     const struct lp_jit_resources *resources,
                      float inputs[32][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS],
                      struct vertex_header *io,
                      uint32_t prim_id, uint32_t num_tess_coord,
@@ -243,6 +244,17 @@ struct draw_tes_llvm_variant_key
    unsigned primid_output:7;
    unsigned primid_needed:1;
    unsigned clamp_vertex_color:1;
+   /* Clip test and viewport transform are done by the variant, rather than
+    * by draw_pt_post_vs, when the tess eval shader is the last stage.
+    */
+   unsigned post_vs:1;
+   unsigned clip_xy:1;
+   unsigned guard_band_xy:1;
+   unsigned clip_z:1;
+   unsigned clip_user:1;
+   unsigned clip_halfz:1;
+   unsigned bypass_viewport:1;
+   unsigned ucp_enable:PIPE_MAX_CLIP_PLANES;
    struct lp_sampler_static_state samplers[1];
    /* Followed by variable number of images.*/
 };
@@ -477,6 +489,8 @@ struct draw_tes_llvm_variant
    struct gallivm_state *gallivm;
 
    /* LLVM JIT builder types */
+   LLVMTypeRef context_type;
+   LLVMTypeRef context_ptr_type;
    LLVMTypeRef resources_type;
    LLVMTypeRef resources_ptr_type;
    LLVMTypeRef vertex_header_ptr_type;
@@ -55,6 +55,7 @@ struct llvm_middle_end {
    unsigned vertex_size;
    enum mesa_prim input_prim;
    unsigned opt;
+   bool tes_post_vs;
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
@@ -307,8 +308,6 @@ llvm_middle_end_prepare(struct draw_pt_middle_end *middle,
                            draw->rasterizer->clip_halfz,
                            (draw->vs.edgeflag_output ? true : false));
 
-   draw_pt_so_emit_prepare(fpme->so_emit, (gs == NULL && tes == NULL));
-
    if (!(opt & PT_PIPELINE)) {
       draw_pt_emit_prepare(fpme->emit, out_prim, max_vertices);
 
@@ -402,6 +401,14 @@ llvm_middle_end_prepare(struct draw_pt_middle_end *middle,
    if (tes) {
       llvm_middle_end_prepare_tes(fpme);
    }
+
+   /* The positions are already transformed when they are streamed out,
+    * unless the viewport is left to draw_pt_post_vs.
+    */
+   fpme->tes_post_vs = tes && !gs && tes->current_variant &&
+                       tes->current_variant->key.post_vs;
+   draw_pt_so_emit_prepare(fpme->so_emit,
+                           gs == NULL && (tes == NULL || fpme->tes_post_vs));
 }
 
 
@@ -596,7 +603,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       }
 
       if (tes_shader) {
-         draw_tess_eval_shader_run(tes_shader,
+         clipped = draw_tess_eval_shader_run(tes_shader,
                                    tcs_shader ? tcs_shader->vertices_out : draw->pt.vertices_per_patch,
                                    vert_info,
                                    prim_info,
@@ -687,7 +694,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
        */
       if (draw_current_shader_position_output(draw) != -1) {
          if ((opt & PT_SHADE) &&
-             (gshader || tes_shader ||
+             (gshader || (tes_shader && !fpme->tes_post_vs) ||
               draw->vs.vertex_shader->info.writes_viewport_index)) {
             clipped = draw_pt_post_vs_run(fpme->post_vs, vert_info, prim_info);
          }
@@ -299,7 +299,7 @@ llvm_fetch_tess_factors(struct draw_tess_eval_shader *shader,
    }
 }
 
-static void
+static int
 llvm_tes_run(struct draw_tess_eval_shader *shader,
              uint32_t prim_id,
              uint32_t patch_vertices_in,
@@ -307,16 +307,23 @@ llvm_tes_run(struct draw_tess_eval_shader *shader,
              struct pipe_tessellation_factors *tess_factors,
              struct vertex_header *output)
 {
-   shader->current_variant->jit_func(shader->jit_resources,
-                                     shader->tes_input->data, output, prim_id,
-                                     tess_data->num_domain_points, tess_data->domain_points_u, tess_data->domain_points_v,
-                                     tess_factors->outer_tf, tess_factors->inner_tf, patch_vertices_in,
-                                     shader->draw->pt.user.viewid);
+   return shader->current_variant->jit_func(shader->jit_context,
+                                            shader->jit_resources,
+                                            shader->tes_input->data, output, prim_id,
+                                            tess_data->num_domain_points,
+                                            tess_data->domain_points_u,
+                                            tess_data->domain_points_v,
+                                            tess_factors->outer_tf,
+                                            tess_factors->inner_tf,
+                                            patch_vertices_in,
+                                            shader->draw->pt.user.viewid);
 }
 #endif
 
 /**
  * Execute tess eval shader.
+ * \return true if the variant did the clip test and some vertex needs
+ *         clipping, see draw_tes_llvm_variant_key::post_vs
  */
 int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
                               unsigned num_input_vertices_per_patch,
@@ -332,6 +339,7 @@ int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
    unsigned input_stride = input_verts->vertex_size;
    unsigned vertex_size = sizeof(struct vertex_header) + num_outputs * 4 * sizeof(float);
    uint16_t *elts = NULL;
+   int clipped = 0;
    output_verts->vertex_size = vertex_size;
    output_verts->stride = output_verts->vertex_size;
    output_verts->count = 0;
@@ -389,7 +397,8 @@ int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
       /* run once per primitive? */
       char *output = (char *)output_verts->verts;
       output += vert_start * vertex_size;
-      llvm_tes_run(shader, i, num_input_vertices_per_patch, &data, &factors, (struct vertex_header *)output);
+      clipped |= llvm_tes_run(shader, i, num_input_vertices_per_patch, &data, &factors,
+                              (struct vertex_header *)output);
 
       if (shader->draw->collect_statistics) {
          shader->draw->statistics.ds_invocations += data.num_domain_points;
@@ -408,7 +417,7 @@ int draw_tess_eval_shader_run(struct draw_tess_eval_shader *shader,
 
    *elts_out = elts;
    output_prims->elts = elts;
-   return 0;
+   return clipped;
 }
 
 struct draw_tess_ctrl_shader *
@@ -581,6 +590,7 @@ draw_create_tess_eval_shader(struct draw_context *draw,
       tes->tes_input = align_malloc(sizeof(struct draw_tes_inputs), 16);
       memset(tes->tes_input, 0, sizeof(struct draw_tes_inputs));
 
+      tes->jit_context = &draw->llvm->vs_jit_context;
       tes->jit_resources = &draw->llvm->jit_resources[PIPE_SHADER_TESS_EVAL];
       llvm_tes->variant_key_size =
          draw_tes_llvm_variant_key_size(
@@ -34,6 +34,8 @@
 struct draw_context;
 #if DRAW_LLVM_AVAILABLE
 
+struct draw_vs_jit_context;
+
 #define NUM_PATCH_INPUTS 32
 #define NUM_TCS_INPUTS (PIPE_MAX_SHADER_INPUTS - NUM_PATCH_INPUTS)
 
@@ -96,6 +98,7 @@ struct draw_tess_eval_shader {
 
 #if DRAW_LLVM_AVAILABLE
    struct draw_tes_inputs *tes_input;
+   struct draw_vs_jit_context *jit_context;
    struct lp_jit_resources *jit_resources;
    struct draw_tes_llvm_variant *current_variant;
 #endif
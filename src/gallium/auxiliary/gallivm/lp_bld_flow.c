@@ -31,6 +31,7 @@
  * @author Jose Fonseca <jfonseca@vmware.com>
  */
 
+#include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 
@@ -140,12 +141,28 @@ lp_build_mask_check(struct lp_build_mask_context *mask)
     * Not sure if llvm could figure that out on its own.
     */
 
-   /* cond = (mask == 0) */
-   cond = LLVMBuildICmp(builder,
-                        LLVMIntEQ,
-                        LLVMBuildBitCast(builder, value, mask->reg_type, ""),
-                        LLVMConstNull(mask->reg_type),
-                        "");
+   if (util_get_cpu_caps()->has_avx512f &&
+       LLVMGetIntTypeWidth(mask->reg_type) == 512) {
+      /*
+       * Compare lane-wise into a k register and test that instead
+       * (kortest), there is no ptest for 512 bit vectors.
+       */
+      LLVMTypeRef var_type = LLVMTypeOf(value);
+      unsigned length = LLVMGetVectorSize(var_type);
+      LLVMValueRef bits = LLVMBuildICmp(builder, LLVMIntNE, value,
+                                        LLVMConstNull(var_type), "");
+      bits = LLVMBuildBitCast(builder, bits,
+                              LLVMIntTypeInContext(mask->skip.gallivm->context, length), "");
+      cond = LLVMBuildICmp(builder, LLVMIntEQ, bits,
+                           LLVMConstNull(LLVMTypeOf(bits)), "");
+   } else {
+      /* cond = (mask == 0) */
+      cond = LLVMBuildICmp(builder,
+                           LLVMIntEQ,
+                           LLVMBuildBitCast(builder, value, mask->reg_type, ""),
+                           LLVMConstNull(mask->reg_type),
+                           "");
+   }
 
    /* if cond, goto end of block */
    lp_build_flow_skip_cond_break(&mask->skip, cond);
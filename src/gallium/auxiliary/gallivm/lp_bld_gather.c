@@ -272,8 +272,10 @@ lp_build_gather_elem_vec(struct gallivm_state *gallivm,
 }
 
 
-
-
+/**
+ * Gather with the AVX2 gather instructions, or the AVX-512 ones for
+ * 512 bit vectors.
+ */
 static LLVMValueRef
 lp_build_gather_avx2(struct gallivm_state *gallivm,
                      unsigned length,
@@ -335,6 +337,27 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
       LLVMValueRef args[] = { src_ptr, alignment, mask, passthru };
 
       res = lp_build_intrinsic(builder, intrinsic, src_vec_type, args, 4, 0);
+   } else if (length * src_width == 512) {
+      /*
+       * AVX-512 gathers take the mask as a vector of booleans (it ends up
+       * in a k register) and the scale as an i32.  Only 16 x 32-bit
+       * gathers get here.
+       */
+      LLVMTypeRef i32_type = LLVMIntTypeInContext(gallivm->context, 32);
+      LLVMTypeRef i1_type = LLVMIntTypeInContext(gallivm->context, 1);
+      const char *intrinsic = dst_type.floating ?
+         "llvm.x86.avx512.mask.gather.dps.512" :
+         "llvm.x86.avx512.mask.gather.dpi.512";
+
+      assert(src_width == 32);
+
+      LLVMValueRef passthru = LLVMGetUndef(src_vec_type);
+      LLVMValueRef mask = LLVMConstAllOnes(LLVMVectorType(i1_type, length));
+      LLVMValueRef scale = LLVMConstInt(i32_type, 1, 0);
+
+      LLVMValueRef args[] = { passthru, base_ptr, offsets, mask, scale };
+
+      res = lp_build_intrinsic(builder, intrinsic, src_vec_type, args, 5, 0);
    } else {
       LLVMTypeRef i8_type = LLVMIntTypeInContext(gallivm->context, 8);
       const char *intrinsic = NULL;
@@ -491,6 +514,10 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+   } else if (util_get_cpu_caps()->has_avx512f && !need_expansion &&
+              src_width == 32 && length == 16) {
+      return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
+                                  base_ptr, offsets);
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
@@ -80,6 +80,9 @@ struct gallivm_state
    LLVMValueRef sampler_descriptor;
 };
 
+bool
+lp_has_avx512_tier(void);
+
 unsigned
 lp_build_init_native_width(void);
 
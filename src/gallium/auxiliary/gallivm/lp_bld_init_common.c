@@ -65,6 +65,15 @@ DEBUG_GET_ONCE_FLAGS_OPTION(gallivm_debug, "GALLIVM_DEBUG", lp_bld_debug_flags,
 
 unsigned lp_native_vector_width;
 
+bool
+lp_has_avx512_tier(void)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   return caps->has_avx512f && caps->has_avx512bw &&
+          caps->has_avx512dq && caps->has_avx512vl;
+}
+
 unsigned
 lp_build_init_native_width(void)
 {
@@ -72,6 +81,14 @@ lp_build_init_native_width(void)
    lp_native_vector_width = MIN2(util_get_cpu_caps()->max_vector_bits, 256);
    assert(lp_native_vector_width);
 
+   /*
+    * The 16-wide tier needs BW/DQ/VL too, otherwise the 8/16 bit unorm
+    * paths and the mask conversions get split back into 256 bit halves.
+    * Like the rest of this, it applies to the whole process.
+    */
+   if (lp_has_avx512_tier() && debug_get_bool_option("LP_AVX512", false))
+      lp_native_vector_width = 512;
+
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH", lp_native_vector_width);
    assert(lp_native_vector_width);
 
@@ -350,6 +350,19 @@ lp_build_select(struct lp_build_context *bld,
 
       res = LLVMBuildSelect(builder, mask, a, b, "");
    }
+   else if (util_get_cpu_caps()->has_avx512f &&
+            type.width * type.length == 512 &&
+            (type.width >= 32 || util_get_cpu_caps()->has_avx512bw)) {
+      /*
+       * There is no blendv for 512 bit vectors, but AVX-512 can select
+       * through a k mask register.  Comparing the mask against zero gives
+       * LLVM the vector of booleans it needs to emit vptestm + a masked
+       * move, instead of materializing the mask for and/andnot/or.
+       */
+      mask = LLVMBuildICmp(builder, LLVMIntNE, mask,
+                           LLVMConstNull(LLVMTypeOf(mask)), "");
+      res = LLVMBuildSelect(builder, mask, a, b, "");
+   }
    else if (((util_get_cpu_caps()->has_sse4_1 &&
               type.width * type.length == 128) ||
              (util_get_cpu_caps()->has_avx &&
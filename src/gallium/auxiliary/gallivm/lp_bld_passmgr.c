@@ -218,6 +218,10 @@ lp_passmgr_run(struct lp_passmgr *mgr,
 void
 lp_passmgr_dispose(struct lp_passmgr *mgr)
 {
+   /* gallivm_destroy() ends up here again after gallivm_free_ir() */
+   if (!mgr)
+      return;
+
 #if USE_NEW_PASS == 0
    if (mgr->passmgr) {
       LLVMDisposePassManager(mgr->passmgr);
@@ -0,0 +1,277 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Offline compile-time benchmark for ir3.
+ *
+ * Compiles vertex, fragment and compute shaders for a given GPU id, with the
+ * same steps as ir3_compiler: driver specific IO lowering, ir3_finalize_nir,
+ * the variant lowering, ir3_compile_shader_nir and the assembler.  Only the
+ * default variant (an all zero key) is compiled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir3/ir3.h"
+#include "ir3/ir3_compiler.h"
+#include "ir3/ir3_nir.h"
+#include "ir3/ir3_shader.h"
+
+#include "compiler/spirv/spirv_info.h"
+
+#include "shader_bench.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+
+static struct ir3_compiler *compiler;
+
+static const char *const stat_names[] = {
+   "instructions", "nops", "movs", "covs", "loops", "max_reg",
+   "max_half_reg", "max_const", "max_waves", "ss", "sy", "sstall",
+   "systall", "size",
+};
+
+static const struct spirv_capabilities spirv_caps = {
+   .DrawParameters = true,
+   .Float64 = true,
+   .StorageImageReadWithoutFormat = true,
+   .StorageImageWriteWithoutFormat = true,
+   .Int64 = true,
+   .VariablePointers = true,
+};
+
+static const struct spirv_to_nir_options spirv_options = {
+   .capabilities = &spirv_caps,
+};
+
+static void
+lower_spirv_io(nir_shader *nir)
+{
+   const struct nir_lower_sysvals_to_varyings_options sysvals_to_varyings = {
+      .frag_coord = true,
+      .point_coord = true,
+   };
+   NIR_PASS(_, nir, nir_lower_sysvals_to_varyings, &sysvals_to_varyings);
+
+   nir_assign_io_var_locations(nir, nir_var_shader_in, &nir->num_inputs,
+                               nir->info.stage);
+   nir_assign_io_var_locations(nir, nir_var_shader_out, &nir->num_outputs,
+                               nir->info.stage);
+   NIR_PASS(_, nir, nir_lower_io, nir_var_shader_in | nir_var_shader_out,
+            ir3_glsl_type_size, (nir_lower_io_options)0);
+
+   NIR_PASS(_, nir, nir_lower_int64);
+   NIR_PASS(_, nir, nir_lower_system_values);
+   NIR_PASS(_, nir, nir_lower_compute_system_values, NULL);
+}
+
+#ifdef HAVE_SHADER_BENCH_GLSL
+/* The varying layout of GLSL shaders, from ir3_cmdline.c. */
+static void
+insert_sorted(struct exec_list *var_list, nir_variable *new_var)
+{
+   nir_foreach_variable_in_list (var, var_list) {
+      if (var->data.location > new_var->data.location) {
+         exec_node_insert_node_before(&var->node, &new_var->node);
+         return;
+      }
+   }
+   exec_list_push_tail(var_list, &new_var->node);
+}
+
+static void
+sort_varyings(nir_shader *nir, nir_variable_mode mode)
+{
+   struct exec_list new_list;
+   exec_list_make_empty(&new_list);
+   nir_foreach_variable_with_modes_safe (var, nir, mode) {
+      exec_node_remove(&var->node);
+      insert_sorted(&new_list, var);
+   }
+   exec_list_append(&nir->variables, &new_list);
+}
+
+static void
+fixup_varying_slots(nir_shader *nir, nir_variable_mode mode)
+{
+   nir_foreach_variable_with_modes (var, nir, mode) {
+      if (var->data.location >= VARYING_SLOT_VAR0) {
+         var->data.location += 9;
+      } else if ((var->data.location >= VARYING_SLOT_TEX0) &&
+                 (var->data.location <= VARYING_SLOT_TEX7)) {
+         var->data.location += VARYING_SLOT_VAR0 - VARYING_SLOT_TEX0;
+      }
+   }
+}
+
+static void
+lower_glsl_io(nir_shader *nir)
+{
+   switch (nir->info.stage) {
+   case MESA_SHADER_VERTEX:
+      nir_assign_var_locations(nir, nir_var_shader_in, &nir->num_inputs,
+                               ir3_glsl_type_size);
+
+      /* Re-lower global vars, to deal with any dead VS inputs. */
+      NIR_PASS(_, nir, nir_lower_global_vars_to_local);
+
+      sort_varyings(nir, nir_var_shader_out);
+      nir_assign_var_locations(nir, nir_var_shader_out, &nir->num_outputs,
+                               ir3_glsl_type_size);
+      fixup_varying_slots(nir, nir_var_shader_out);
+      break;
+   case MESA_SHADER_FRAGMENT:
+      sort_varyings(nir, nir_var_shader_in);
+      nir_assign_var_locations(nir, nir_var_shader_in, &nir->num_inputs,
+                               ir3_glsl_type_size);
+      fixup_varying_slots(nir, nir_var_shader_in);
+      nir_assign_var_locations(nir, nir_var_shader_out, &nir->num_outputs,
+                               ir3_glsl_type_size);
+      break;
+   default:
+      break;
+   }
+
+   nir_assign_var_locations(nir, nir_var_uniform, &nir->num_uniforms,
+                            ir3_glsl_type_size);
+
+   NIR_PASS(_, nir, nir_lower_frexp);
+   NIR_PASS(_, nir, nir_lower_io,
+            nir_var_shader_in | nir_var_shader_out | nir_var_uniform,
+            ir3_glsl_type_size, (nir_lower_io_options)0);
+}
+#endif
+
+static bool
+ir3_bench_compile(struct shader_bench_job *job, nir_shader *nir)
+{
+   int64_t t;
+
+   t = os_time_get_nano();
+   if (job->input == SHADER_BENCH_INPUT_SPIRV) {
+      lower_spirv_io(nir);
+   } else {
+#ifdef HAVE_SHADER_BENCH_GLSL
+      lower_glsl_io(nir);
+#endif
+   }
+   shader_bench_add_step(job, "lower_io", t);
+
+   t = os_time_get_nano();
+   ir3_nir_lower_io_to_temporaries(nir);
+   ir3_finalize_nir(compiler, nir);
+   shader_bench_add_step(job, "ir3_finalize_nir", t);
+
+   struct ir3_shader *shader = rzalloc_size(job->mem_ctx, sizeof(*shader));
+   shader->compiler = compiler;
+   shader->type = job->stage;
+   shader->nir = nir;
+
+   t = os_time_get_nano();
+   ir3_nir_post_finalize(shader);
+   shader_bench_add_step(job, "ir3_nir_post_finalize", t);
+
+   struct ir3_shader_variant *v = rzalloc_size(shader, sizeof(*v));
+   v->type = shader->type;
+   v->compiler = compiler;
+   v->const_state = rzalloc_size(v, sizeof(*v->const_state));
+
+   shader->variants = v;
+   shader->variant_count = 1;
+
+   t = os_time_get_nano();
+   ir3_nir_lower_variant(v, nir);
+   shader_bench_add_step(job, "ir3_nir_lower_variant", t);
+
+   t = os_time_get_nano();
+   int ret = ir3_compile_shader_nir(compiler, shader, v);
+   shader_bench_add_step(job, "ir3_compile_shader_nir", t);
+
+   if (ret) {
+      fprintf(stderr, "%s: compiler failed\n", job->path);
+      return false;
+   }
+
+   t = os_time_get_nano();
+   void *bin = ir3_shader_assemble(v);
+   shader_bench_add_step(job, "ir3_shader_assemble", t);
+
+   if (bin == NULL) {
+      fprintf(stderr, "%s: assembler failed\n", job->path);
+      return false;
+   }
+
+   const struct ir3_info *info = &v->info;
+   struct shader_bench_variant *variant =
+      shader_bench_add_variant(job, info->double_threadsize ? "double"
+                                                            : "single");
+   variant->stats[0] = info->instrs_count;
+   variant->stats[1] = info->nops_count;
+   variant->stats[2] = info->mov_count;
+   variant->stats[3] = info->cov_count;
+   variant->stats[4] = v->loops;
+   variant->stats[5] = info->max_reg + 1;
+   variant->stats[6] = info->max_half_reg + 1;
+   variant->stats[7] = info->max_const + 1;
+   variant->stats[8] = info->max_waves;
+   variant->stats[9] = info->ss;
+   variant->stats[10] = info->sy;
+   variant->stats[11] = info->sstall;
+   variant->stats[12] = info->systall;
+   variant->stats[13] = info->size;
+
+   return true;
+}
+
+static bool
+ir3_bench_init(const char *target)
+{
+   struct fd_dev_id dev_id = {
+      .gpu_id = strtol(target, NULL, 0),
+   };
+
+   if (dev_id.gpu_id == 0 || fd_dev_info_raw(&dev_id) == NULL) {
+      fprintf(stderr, "unknown GPU id: %s\n", target);
+      return false;
+   }
+
+   compiler = ir3_compiler_create(NULL, &dev_id, fd_dev_info_raw(&dev_id),
+                                  &(struct ir3_compiler_options) {});
+   return compiler != NULL;
+}
+
+static void
+ir3_bench_finish(void)
+{
+   ir3_compiler_destroy(compiler);
+}
+
+static const nir_shader_compiler_options *
+ir3_bench_get_nir_options(gl_shader_stage stage)
+{
+   return ir3_get_compiler_options(compiler);
+}
+
+static const struct shader_bench_backend ir3_bench = {
+   .name = "ir3",
+   .default_target = "630",
+   .stages = BITFIELD_BIT(MESA_SHADER_VERTEX) |
+             BITFIELD_BIT(MESA_SHADER_FRAGMENT) |
+             BITFIELD_BIT(MESA_SHADER_COMPUTE),
+   .stat_names = stat_names,
+   .stat_count = ARRAY_SIZE(stat_names),
+   .init = ir3_bench_init,
+   .finish = ir3_bench_finish,
+   .get_nir_options = ir3_bench_get_nir_options,
+   .spirv_options = &spirv_options,
+   .compile_nir = ir3_bench_compile,
+};
+
+int
+main(int argc, char **argv)
+{
+   return shader_bench_main(argc, argv, &ir3_bench);
+}
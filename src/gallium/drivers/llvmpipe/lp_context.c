@@ -48,6 +48,7 @@
 #include "lp_setup.h"
 #include "lp_screen.h"
 #include "lp_fence.h"
+#include "lp_warm_cache.h"
 
 static void
 llvmpipe_destroy(struct pipe_context *pipe)
@@ -347,6 +348,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    mtx_lock(&lp_screen->ctx_mutex);
    list_addtail(&llvmpipe->list, &lp_screen->ctx_list);
    mtx_unlock(&lp_screen->ctx_mutex);
+   lp_cache_warm(lp_screen);
+
    return &llvmpipe->pipe;
 
  fail:
@@ -164,6 +164,8 @@ struct llvmpipe_context {
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
+   /** Variants whose instructions aren't counted in nr_fs_instrs yet */
+   unsigned nr_fs_variants_pending;
 
    bool permit_linear_rasterizer;
    bool single_vp;
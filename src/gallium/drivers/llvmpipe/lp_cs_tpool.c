@@ -30,12 +30,81 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_atomic.h"
 #include "lp_cs_tpool.h"
+#include "lp_rast.h"
+
+/* Number of chunks each slice is split into, bounds the imbalance that
+ * can remain once every slice has been drained.
+ */
+#define LP_CS_TPOOL_CHUNKS_PER_SLICE 8
+
+static unsigned
+lp_cs_tpool_slice_remaining(const struct lp_cs_tpool_slice *slice)
+{
+   unsigned next = p_atomic_read_relaxed(&slice->next);
+   return next < slice->end ? slice->end - next : 0;
+}
+
+static bool
+lp_cs_tpool_claim(struct lp_cs_tpool_task *task,
+                  struct lp_cs_tpool_slice *slice,
+                  unsigned *first, unsigned *count)
+{
+   if (!lp_cs_tpool_slice_remaining(slice))
+      return false;
+
+   unsigned start = p_atomic_fetch_add(&slice->next, task->chunk_size);
+   if (start >= slice->end)
+      return false;
+
+   *first = start;
+   *count = MIN2(task->chunk_size, slice->end - start);
+   return true;
+}
+
+static void
+lp_cs_tpool_run_task(struct lp_cs_tpool_task *task, unsigned idx,
+                     struct lp_cs_local_mem *lmem)
+{
+   unsigned first, count;
+
+   /* Drain our own slice first. */
+   if (idx < task->num_slices) {
+      while (lp_cs_tpool_claim(task, &task->slices[idx], &first, &count)) {
+         for (unsigned i = 0; i < count; i++)
+            task->work(task->data, first + i, lmem);
+      }
+   }
+
+   /* Then steal from whichever slice has the most work left. */
+   for (;;) {
+      struct lp_cs_tpool_slice *victim = NULL;
+      unsigned most = 0;
+
+      for (unsigned s = 0; s < task->num_slices; s++) {
+         unsigned remaining = lp_cs_tpool_slice_remaining(&task->slices[s]);
+         if (remaining > most) {
+            most = remaining;
+            victim = &task->slices[s];
+         }
+      }
+
+      if (!victim)
+         break;
+
+      if (lp_cs_tpool_claim(task, victim, &first, &count)) {
+         for (unsigned i = 0; i < count; i++)
+            task->work(task->data, first + i, lmem);
+      }
+   }
+}
 
 static int
 lp_cs_tpool_worker(void *data)
 {
-   struct lp_cs_tpool *pool = data;
+   struct lp_cs_tpool_thread *worker = data;
+   struct lp_cs_tpool *pool = worker->pool;
    struct lp_cs_local_mem lmem;
 
    memset(&lmem, 0, sizeof(lmem));
@@ -43,7 +112,6 @@ lp_cs_tpool_worker(void *data)
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -53,29 +121,18 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
-      }
-
-      task->iter_start += iter_per_thread;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
-
+      task->busy++;
       mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
+
+      lp_cs_tpool_run_task(task, worker->idx, &lmem);
 
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
+      /* Every iteration has been claimed, nobody else needs to join. */
+      if (!task->dequeued) {
+         list_del(&task->list);
+         task->dequeued = true;
+      }
+      if (--task->busy == 0)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -94,13 +151,22 @@ lp_cs_tpool_create(unsigned num_threads)
    (void) mtx_init(&pool->m, mtx_plain);
    cnd_init(&pool->new_work);
 
+   /* Compute threads follow the same pinning policy as the rasterizer. */
+   struct lp_thread_domains domains;
+   lp_thread_domains_init(&domains, num_threads);
+
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
    for (unsigned i = 0; i < num_threads; i++) {
-      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker, pool)) {
+      pool->workers[i].pool = pool;
+      pool->workers[i].idx = i;
+      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker,
+                                          &pool->workers[i])) {
          num_threads = i;  /* previous thread is max */
          break;
       }
+
+      lp_thread_domains_pin(&domains, pool->threads[i], i, num_threads);
    }
    pool->num_threads = num_threads;
    return pool;
@@ -142,7 +208,9 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       FREE(lmem.local_mem_ptr);
       return NULL;
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+   unsigned num_slices = pool->num_threads;
+   task = align_calloc(sizeof(*task) + num_slices * sizeof(task->slices[0]),
+                       CACHE_LINE_SIZE);
    if (!task) {
       return NULL;
    }
@@ -150,9 +218,17 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
-
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
+   task->num_slices = num_slices;
+   task->chunk_size = MAX2(num_iters / (num_slices * LP_CS_TPOOL_CHUNKS_PER_SLICE), 1);
+
+   unsigned iter_per_slice = num_iters / num_slices;
+   unsigned iter_remainder = num_iters % num_slices;
+   unsigned iter_start = 0;
+   for (unsigned s = 0; s < num_slices; s++) {
+      task->slices[s].next = iter_start;
+      iter_start += iter_per_slice + (s < iter_remainder ? 1 : 0);
+      task->slices[s].end = iter_start;
+   }
 
    cnd_init(&task->finish);
 
@@ -175,11 +251,11 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
       return;
 
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (!task->dequeued || task->busy)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
    cnd_destroy(&task->finish);
-   FREE(task);
+   align_free(task);
    *task_handle = NULL;
 }
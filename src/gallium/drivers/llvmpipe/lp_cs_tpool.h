@@ -28,6 +28,8 @@
  * The item is added to the work queue once, but it must execute
  * number of iterations times. This saves storing a bunch of queue
  * structs with just unique indexes in them.
+ * The iterations are split into one slice per thread; a thread that
+ * runs out of work in its own slice steals chunks from the others.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
  */
@@ -37,15 +39,24 @@
 #include "util/compiler.h"
 
 #include "util/u_thread.h"
+#include "util/u_memory.h"
 #include "util/list.h"
 
 #include "lp_limits.h"
 
+struct lp_cs_tpool;
+
+struct lp_cs_tpool_thread {
+   struct lp_cs_tpool *pool;
+   unsigned idx;
+};
+
 struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
    thrd_t threads[LP_MAX_THREADS];
+   struct lp_cs_tpool_thread workers[LP_MAX_THREADS];
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -58,16 +69,31 @@ struct lp_cs_local_mem {
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
 
+/* A contiguous range of iterations initially owned by one worker.
+ * Iterations are claimed by atomically bumping next, both by the owner
+ * and by any worker stealing from it, so no lock is needed.
+ */
+struct lp_cs_tpool_slice {
+   EXCLUSIVE_CACHELINE(struct {
+      unsigned next;
+      unsigned end;
+   });
+};
+
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+   unsigned chunk_size;
+
+   /* protected by pool->m */
+   unsigned busy;
+   bool dequeued;
+
+   unsigned num_slices;
+   struct lp_cs_tpool_slice slices[];
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
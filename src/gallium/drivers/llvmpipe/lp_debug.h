@@ -65,6 +65,10 @@
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
 #define PERF_NO_RAST_LINEAR 0x100  	/* disable linear rast */
 #define PERF_NO_SHADE       0x200  	/* disable fragment shaders */
+#define PERF_MORTON_TILES   0x400  	/* rasterize bins in Morton order */
+#define PERF_NO_SCENE_OVERLAP 0x800	/* finish each scene before the next */
+#define PERF_NO_FAST_CLEAR  0x1000	/* write cleared tiles right away */
+#define PERF_NO_HIZ         0x2000	/* no coarse depth rejection */
 
 
 extern int LP_PERF;
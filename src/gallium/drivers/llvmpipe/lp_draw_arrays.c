@@ -37,6 +37,7 @@
 #include "util/u_prim.h"
 
 #include "lp_context.h"
+#include "lp_fast_clear.h"
 #include "lp_state.h"
 #include "lp_query.h"
 
@@ -44,6 +45,82 @@
 
 
 
+/* Draws of an indirect buffer passed to the draw module at once */
+#define LP_INDIRECT_BATCH 256
+
+/**
+ * Execute the draws of an indirect buffer, with the vertex and index buffers
+ * already mapped.
+ *
+ * Consecutive draws with a single instance, and the same first instance, go
+ * to the draw module as one multi draw, which keeps their order and draw ids.
+ * Instanced draws are issued one at a time, since a multi draw would
+ * interleave their instances.
+ */
+static void
+lp_draw_indirect(struct llvmpipe_context *lp,
+                 const struct pipe_draw_info *info,
+                 unsigned drawid_offset,
+                 const struct pipe_draw_indirect_info *indirect)
+{
+   const uint8_t *params = llvmpipe_resource_data(indirect->buffer);
+   unsigned draw_count = indirect->draw_count;
+
+   if (indirect->indirect_draw_count) {
+      const uint8_t *count = llvmpipe_resource_data(indirect->indirect_draw_count);
+      draw_count = MIN2(draw_count,
+                        *(const uint32_t *)(count + indirect->indirect_draw_count_offset));
+   }
+
+   struct pipe_draw_start_count_bias draws[LP_INDIRECT_BATCH];
+   struct pipe_draw_info batch_info = *info;
+   batch_info.instance_count = 1;
+   batch_info.increment_draw_id = true;
+   batch_info.index_bias_varies = true;
+   /* the restart path does not advance the draw id */
+   unsigned max_batch = info->primitive_restart ? 1 : LP_INDIRECT_BATCH;
+   unsigned batch = 0, batch_drawid = 0;
+
+   params += indirect->offset;
+   for (unsigned i = 0; i < draw_count; i++, params += indirect->stride) {
+      const uint32_t *p = (const uint32_t *)params;
+      const unsigned instance_count = p[1];
+      const unsigned start_instance = info->index_size ? p[4] : p[3];
+      const struct pipe_draw_start_count_bias draw = {
+         .start = p[2],
+         .count = p[0],
+         .index_bias = info->index_size ? (int)p[3] : 0,
+      };
+
+      if (batch && (instance_count != 1 ||
+                    start_instance != batch_info.start_instance ||
+                    batch == max_batch)) {
+         draw_vbo(lp->draw, &batch_info, batch_drawid, NULL, draws, batch,
+                  lp->patch_vertices);
+         batch = 0;
+      }
+
+      if (instance_count == 1) {
+         if (!batch) {
+            batch_info.start_instance = start_instance;
+            batch_drawid = drawid_offset + i;
+         }
+         draws[batch++] = draw;
+      } else if (instance_count && draw.count) {
+         struct pipe_draw_info instanced_info = batch_info;
+         instanced_info.instance_count = instance_count;
+         instanced_info.start_instance = start_instance;
+         draw_vbo(lp->draw, &instanced_info, drawid_offset + i, NULL, &draw, 1,
+                  lp->patch_vertices);
+      }
+   }
+
+   if (batch)
+      draw_vbo(lp->draw, &batch_info, batch_drawid, NULL, draws, batch,
+               lp->patch_vertices);
+}
+
+
 /**
  * Draw vertex arrays, with optional indexing, optional instancing.
  * All the other drawing functions are implemented in terms of this function.
@@ -68,14 +145,11 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
    if (!llvmpipe_check_render_cond(lp))
       return;
 
-   if (indirect && indirect->buffer) {
-      util_draw_indirect(pipe, info, drawid_offset, indirect);
-      return;
-   }
-
    if (lp->dirty)
       llvmpipe_update_derived(lp);
 
+   llvmpipe_fast_clear_resolve_bound(lp, false);
+
    /*
     * Map vertex buffers
     */
@@ -147,8 +221,12 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
                                      !lp->queries_disabled);
 
    /* draw! */
-   draw_vbo(draw, info, drawid_offset, indirect, draws, num_draws,
-            lp->patch_vertices);
+   if (indirect && indirect->buffer) {
+      lp_draw_indirect(lp, info, drawid_offset, indirect);
+   } else {
+      draw_vbo(draw, info, drawid_offset, indirect, draws, num_draws,
+               lp->patch_vertices);
+   }
 
    /*
     * unmap vertex/index buffers
@@ -0,0 +1,491 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Fast clears: tiles which are only cleared in a scene keep the clear
+ * value on the side instead of writing the memory, see lp_fast_clear.h.
+ *
+ * Only the rasterizer puts tiles into the cleared state, and only for
+ * scenes which have a clear binned for the resource.  Those mark the
+ * resource pending from the context, which tells resolves on the same
+ * context to wait for its scenes first.  Tile state changes all happen
+ * under the lock of the resource, so resolving from another context, or
+ * without waiting at all, can't lose or half-apply a tile.
+ */
+
+#include "util/u_atomic.h"
+#include "util/box.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_surface.h"
+
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fast_clear.h"
+#include "lp_flush.h"
+#include "lp_perf.h"
+#include "lp_texture.h"
+
+
+static inline struct lp_fast_clear_tile *
+get_tile(struct lp_fast_clear *fc, unsigned x, unsigned y)
+{
+   assert(x < fc->tiles_x && y < fc->tiles_y);
+   return &fc->tiles[y * fc->tiles_x + x];
+}
+
+
+static void
+fill_rect(const struct lp_fast_clear *fc,
+          uint8_t *map, unsigned stride,
+          enum pipe_format format,
+          unsigned x, unsigned y,
+          union util_color *value)
+{
+   const unsigned x0 = x * TILE_SIZE, y0 = y * TILE_SIZE;
+
+   util_fill_rect(map, format, stride, x0, y0,
+                  MIN2(TILE_SIZE, fc->width - x0),
+                  MIN2(TILE_SIZE, fc->height - y0),
+                  value);
+}
+
+
+/**
+ * Take a tile out of the cleared state.  Must be called with the lock held.
+ * \return true and the clear value if the tile was cleared
+ */
+static bool
+take_tile(struct lp_fast_clear *fc, unsigned x, unsigned y,
+          union util_color *value)
+{
+   struct lp_fast_clear_tile *tile = get_tile(fc, x, y);
+
+   if (!tile->cleared)
+      return false;
+
+   if (value)
+      *value = tile->value;
+   tile->cleared = false;
+   p_atomic_dec(&fc->num_cleared);
+
+   return true;
+}
+
+
+/**
+ * Put a tile into the cleared state.  Called by the rasterizer, which
+ * writes the tile instead if the state has been disabled since the scene
+ * started.
+ * \param map  the level 0, layer 0 image
+ */
+void
+lp_fast_clear_set_tile(struct lp_fast_clear *fc,
+                       uint8_t *map, unsigned stride,
+                       enum pipe_format format,
+                       unsigned x, unsigned y,
+                       const union util_color *value)
+{
+   simple_mtx_lock(&fc->lock);
+
+   if (fc->disabled) {
+      union util_color uc = *value;
+
+      simple_mtx_unlock(&fc->lock);
+      fill_rect(fc, map, stride, format, x, y, &uc);
+      return;
+   }
+
+   struct lp_fast_clear_tile *tile = get_tile(fc, x, y);
+
+   tile->value = *value;
+   if (!tile->cleared) {
+      tile->cleared = true;
+      p_atomic_inc(&fc->num_cleared);
+   }
+
+   simple_mtx_unlock(&fc->lock);
+
+   LP_COUNT(nr_fast_clear_tiles);
+}
+
+
+/**
+ * Get the clear value of a tile.
+ * \return false if the tile isn't in the cleared state
+ */
+bool
+lp_fast_clear_get_tile_value(struct lp_fast_clear *fc,
+                             unsigned x, unsigned y,
+                             union util_color *value)
+{
+   const struct lp_fast_clear_tile *tile;
+   bool cleared;
+
+   simple_mtx_lock(&fc->lock);
+   tile = get_tile(fc, x, y);
+   cleared = tile->cleared;
+   if (cleared)
+      *value = tile->value;
+   simple_mtx_unlock(&fc->lock);
+
+   return cleared;
+}
+
+
+/**
+ * Mark a tile as holding its contents in memory again, without writing
+ * them, for when they are about to be overwritten anyway.
+ */
+void
+lp_fast_clear_drop_tile(struct lp_fast_clear *fc,
+                        unsigned x, unsigned y)
+{
+   if (!p_atomic_read(&fc->num_cleared))
+      return;
+
+   simple_mtx_lock(&fc->lock);
+   take_tile(fc, x, y, NULL);
+   simple_mtx_unlock(&fc->lock);
+}
+
+
+/**
+ * Write the clear value of a cleared tile to memory.  Called by the
+ * rasterizer, the memory is written outside of the lock.
+ * \param map  the level 0, layer 0 image
+ */
+void
+lp_fast_clear_fill_tile(struct lp_fast_clear *fc,
+                        uint8_t *map, unsigned stride,
+                        enum pipe_format format,
+                        unsigned x, unsigned y)
+{
+   union util_color value;
+   bool taken;
+
+   if (!p_atomic_read(&fc->num_cleared))
+      return;
+
+   simple_mtx_lock(&fc->lock);
+   taken = take_tile(fc, x, y, &value);
+   simple_mtx_unlock(&fc->lock);
+
+   if (!taken)
+      return;
+
+   fill_rect(fc, map, stride, format, x, y, &value);
+
+   LP_COUNT(nr_fast_clear_resolves);
+}
+
+
+/**
+ * Set up fast clears for a newly created resource, if it can use them.
+ *
+ * That's single level, single layer, single sample render targets with
+ * memory of their own.  Display targets, shared and imported resources
+ * are read behind our back, so they are always written.
+ */
+void
+llvmpipe_fast_clear_init(struct llvmpipe_resource *lpr)
+{
+   const struct pipe_resource *pt = &lpr->base;
+
+   if (LP_PERF & PERF_NO_FAST_CLEAR)
+      return;
+
+   if (!(pt->bind & (PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL)) ||
+       (pt->bind & (PIPE_BIND_DISPLAY_TARGET | PIPE_BIND_SCANOUT |
+                    PIPE_BIND_SHARED | PIPE_BIND_LINEAR)) ||
+       (pt->target != PIPE_TEXTURE_2D && pt->target != PIPE_TEXTURE_RECT) ||
+       pt->last_level != 0 || pt->array_size != 1 || pt->nr_samples > 1 ||
+       (pt->flags & PIPE_RESOURCE_FLAG_SPARSE) ||
+       !lpr->tex_data || lpr->dt || lpr->user_ptr || lpr->imported_memory)
+      return;
+
+   const unsigned tiles_x = DIV_ROUND_UP(pt->width0, TILE_SIZE);
+   const unsigned tiles_y = DIV_ROUND_UP(pt->height0, TILE_SIZE);
+   struct lp_fast_clear *fc =
+      CALLOC_VARIANT_LENGTH_STRUCT(lp_fast_clear,
+                                   tiles_x * tiles_y *
+                                   sizeof(struct lp_fast_clear_tile));
+   if (!fc)
+      return;
+
+   fc->width = pt->width0;
+   fc->height = pt->height0;
+   fc->tiles_x = tiles_x;
+   fc->tiles_y = tiles_y;
+   simple_mtx_init(&fc->lock, mtx_plain);
+
+   lpr->fast_clear = fc;
+}
+
+
+void
+llvmpipe_fast_clear_fini(struct llvmpipe_resource *lpr)
+{
+   if (!lpr->fast_clear)
+      return;
+
+   simple_mtx_destroy(&lpr->fast_clear->lock);
+   FREE(lpr->fast_clear);
+   lpr->fast_clear = NULL;
+}
+
+
+/**
+ * Note that a clear has been binned for the resource, so that tiles may
+ * be put into the cleared state.
+ */
+void
+llvmpipe_fast_clear_mark_pending(struct pipe_resource *resource)
+{
+   struct lp_fast_clear *fc = llvmpipe_resource(resource)->fast_clear;
+
+   if (fc && !p_atomic_read(&fc->pending))
+      p_atomic_set(&fc->pending, true);
+}
+
+
+/**
+ * Write out all the cleared tiles of a resource, before its memory is
+ * accessed by anything but the rasterizer.
+ *
+ * \param pipe  the context about to access the memory, whose scenes
+ *              are waited for, or NULL not to wait
+ */
+void
+llvmpipe_fast_clear_resolve(struct pipe_context *pipe,
+                            struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct lp_fast_clear *fc = lpr->fast_clear;
+
+   if (!fc)
+      return;
+
+   /* Wait for the scenes of this context which may still put tiles into
+    * the cleared state.  Scenes of other contexts are ordered by the
+    * frontend, their tiles are found below whichever context set them.
+    */
+   if (pipe && p_atomic_read(&fc->pending)) {
+      llvmpipe_flush_resource(pipe, resource, 0,
+                              false, /* read_only */
+                              false, /* cpu_access */
+                              false, /* do_not_block */
+                              "fast clear resolve");
+      p_atomic_set(&fc->pending, false);
+   }
+
+   if (!p_atomic_read(&fc->num_cleared))
+      return;
+
+   uint8_t *map = llvmpipe_resource_map(resource, 0, 0,
+                                        LP_TEX_USAGE_READ_WRITE);
+
+   simple_mtx_lock(&fc->lock);
+
+   for (unsigned y = 0; y < fc->tiles_y; y++) {
+      for (unsigned x = 0; x < fc->tiles_x; x++) {
+         union util_color value;
+
+         if (take_tile(fc, x, y, &value)) {
+            fill_rect(fc, map, lpr->row_stride[0], resource->format,
+                      x, y, &value);
+            LP_COUNT(nr_fast_clear_resolves);
+         }
+      }
+   }
+
+   assert(fc->num_cleared == 0);
+
+   simple_mtx_unlock(&fc->lock);
+
+   llvmpipe_resource_unmap(resource, 0, 0);
+}
+
+
+/**
+ * Forget about the cleared tiles of a resource whose contents are being
+ * discarded.  The caller must have waited for the rasterizer.
+ */
+void
+llvmpipe_fast_clear_discard(struct pipe_resource *resource)
+{
+   struct lp_fast_clear *fc = llvmpipe_resource(resource)->fast_clear;
+
+   if (!fc)
+      return;
+
+   p_atomic_set(&fc->pending, false);
+
+   simple_mtx_lock(&fc->lock);
+
+   for (unsigned i = 0; i < fc->tiles_x * fc->tiles_y; i++)
+      fc->tiles[i].cleared = false;
+
+   p_atomic_set(&fc->num_cleared, 0);
+
+   simple_mtx_unlock(&fc->lock);
+}
+
+
+/**
+ * Stop using fast clears for a resource whose memory is exported or
+ * mapped unsynchronized, and write out the tiles cleared so far.  Scenes
+ * still in flight write their clears from now on.
+ *
+ * \param pipe  the context to wait for, or NULL not to wait
+ */
+void
+llvmpipe_fast_clear_disable(struct pipe_context *pipe,
+                            struct pipe_resource *resource)
+{
+   struct lp_fast_clear *fc = llvmpipe_resource(resource)->fast_clear;
+
+   if (!fc)
+      return;
+
+   if (!p_atomic_read(&fc->disabled)) {
+      simple_mtx_lock(&fc->lock);
+      p_atomic_set(&fc->disabled, true);
+      simple_mtx_unlock(&fc->lock);
+   }
+
+   llvmpipe_fast_clear_resolve(pipe, resource);
+}
+
+
+static void
+resolve_stage(struct llvmpipe_context *lp, enum pipe_shader_type stage)
+{
+   struct pipe_context *pipe = &lp->pipe;
+
+   for (unsigned i = 0; i < lp->num_sampler_views[stage]; i++) {
+      struct pipe_sampler_view *view = lp->sampler_views[stage][i];
+
+      if (view && view->texture)
+         llvmpipe_fast_clear_resolve(pipe, view->texture);
+   }
+
+   for (unsigned i = 0; i < lp->num_images[stage]; i++) {
+      if (lp->images[stage][i].resource)
+         llvmpipe_fast_clear_resolve(pipe, lp->images[stage][i].resource);
+   }
+}
+
+
+/**
+ * Resolve the textures and images bound for a draw, or for a compute
+ * dispatch, as the shaders read their memory directly.
+ */
+void
+llvmpipe_fast_clear_resolve_bound(struct llvmpipe_context *lp,
+                                  bool compute)
+{
+   if (compute) {
+      resolve_stage(lp, PIPE_SHADER_COMPUTE);
+      return;
+   }
+
+   for (unsigned stage = 0; stage < PIPE_SHADER_MESH_TYPES; stage++) {
+      if (stage != PIPE_SHADER_COMPUTE)
+         resolve_stage(lp, stage);
+   }
+}
+
+
+/**
+ * Copy from a region which is entirely in the cleared state, with a
+ * single value, by filling the destination.
+ * \return false if the region isn't uniformly cleared
+ */
+bool
+llvmpipe_fast_clear_copy(struct pipe_context *pipe,
+                         struct pipe_resource *dst, unsigned dst_level,
+                         unsigned dstx, unsigned dsty, unsigned dstz,
+                         struct pipe_resource *src, unsigned src_level,
+                         const struct pipe_box *src_box)
+{
+   struct lp_fast_clear *fc = llvmpipe_resource(src)->fast_clear;
+
+   if (!fc || !p_atomic_read(&fc->num_cleared) ||
+       src_level != 0 || src_box->z != 0 || src_box->depth != 1 ||
+       src_box->width <= 0 || src_box->height <= 0 ||
+       dst->nr_samples > 1 || util_format_is_compressed(dst->format) ||
+       util_format_get_blocksize(dst->format) !=
+       util_format_get_blocksize(src->format))
+      return false;
+
+   const unsigned x0 = src_box->x / TILE_SIZE;
+   const unsigned y0 = src_box->y / TILE_SIZE;
+   const unsigned x1 = (src_box->x + src_box->width - 1) / TILE_SIZE;
+   const unsigned y1 = (src_box->y + src_box->height - 1) / TILE_SIZE;
+   const unsigned blocksize = util_format_get_blocksize(src->format);
+   const struct lp_fast_clear_tile *first = get_tile(fc, x0, y0);
+   union util_color value;
+   bool uniform = true;
+
+   /* The caller flushed the scenes rendering to src, the lock keeps the
+    * tiles from being resolved by another context meanwhile.
+    */
+   simple_mtx_lock(&fc->lock);
+
+   for (unsigned y = y0; y <= y1 && uniform; y++) {
+      for (unsigned x = x0; x <= x1 && uniform; x++) {
+         const struct lp_fast_clear_tile *tile = get_tile(fc, x, y);
+
+         uniform = tile->cleared &&
+                   memcmp(&tile->value, &first->value, blocksize) == 0;
+      }
+   }
+
+   value = first->value;
+
+   simple_mtx_unlock(&fc->lock);
+
+   if (!uniform)
+      return false;
+
+   struct pipe_box dst_box;
+   struct pipe_transfer *transfer;
+
+   u_box_3d(dstx, dsty, dstz, src_box->width, src_box->height, 1, &dst_box);
+
+   uint8_t *map = pipe->texture_map(pipe, dst, dst_level, PIPE_MAP_WRITE,
+                                    &dst_box, &transfer);
+   if (!map)
+      return false;
+
+   util_fill_rect(map, dst->format, transfer->stride, 0, 0,
+                  src_box->width, src_box->height, &value);
+
+   pipe->texture_unmap(pipe, transfer);
+
+   return true;
+}
@@ -0,0 +1,141 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Per-tile fast clear state of render targets.
+ *
+ * When all the rasterizer has to do to a tile in a scene is to clear it,
+ * it only records the clear value here and leaves the memory alone.  The
+ * tile is filled in ("resolved") when its contents are needed: by the
+ * rasterizer before rendering to it again, or by the context before the
+ * resource is mapped, sampled or copied from.
+ *
+ * The state lives on the resource and is guarded by its own lock, so
+ * whichever context touches the memory next can resolve tiles cleared by
+ * the scenes of any other context.
+ */
+
+#ifndef LP_FAST_CLEAR_H
+#define LP_FAST_CLEAR_H
+
+#include "util/format/u_format.h"
+#include "util/simple_mtx.h"
+#include "util/u_pack_color.h"
+
+#include "lp_limits.h"
+
+
+struct pipe_box;
+struct pipe_context;
+struct pipe_resource;
+struct llvmpipe_context;
+struct llvmpipe_resource;
+
+
+struct lp_fast_clear_tile
+{
+   /** The clear value, packed in the format of the surface */
+   union util_color value;
+   bool cleared;
+};
+
+
+struct lp_fast_clear
+{
+   unsigned width, height;
+   unsigned tiles_x, tiles_y;
+
+   /** Guards the tiles, and num_cleared and disabled against writes */
+   simple_mtx_t lock;
+
+   /** Number of tiles in the cleared state, may be read without the lock */
+   int num_cleared;
+
+   /** A clear has been binned for the resource since the last resolve */
+   bool pending;
+
+   /** The memory is shared or mapped behind our back, write every tile */
+   bool disabled;
+
+   struct lp_fast_clear_tile tiles[];
+};
+
+
+void
+lp_fast_clear_set_tile(struct lp_fast_clear *fc,
+                       uint8_t *map, unsigned stride,
+                       enum pipe_format format,
+                       unsigned x, unsigned y,
+                       const union util_color *value);
+
+bool
+lp_fast_clear_get_tile_value(struct lp_fast_clear *fc,
+                             unsigned x, unsigned y,
+                             union util_color *value);
+
+void
+lp_fast_clear_fill_tile(struct lp_fast_clear *fc,
+                        uint8_t *map, unsigned stride,
+                        enum pipe_format format,
+                        unsigned x, unsigned y);
+
+void
+lp_fast_clear_drop_tile(struct lp_fast_clear *fc,
+                        unsigned x, unsigned y);
+
+
+void
+llvmpipe_fast_clear_init(struct llvmpipe_resource *lpr);
+
+void
+llvmpipe_fast_clear_fini(struct llvmpipe_resource *lpr);
+
+void
+llvmpipe_fast_clear_mark_pending(struct pipe_resource *resource);
+
+void
+llvmpipe_fast_clear_resolve(struct pipe_context *pipe,
+                            struct pipe_resource *resource);
+
+void
+llvmpipe_fast_clear_discard(struct pipe_resource *resource);
+
+void
+llvmpipe_fast_clear_disable(struct pipe_context *pipe,
+                            struct pipe_resource *resource);
+
+void
+llvmpipe_fast_clear_resolve_bound(struct llvmpipe_context *lp,
+                                  bool compute);
+
+bool
+llvmpipe_fast_clear_copy(struct pipe_context *pipe,
+                         struct pipe_resource *dst, unsigned dst_level,
+                         unsigned dstx, unsigned dsty, unsigned dstz,
+                         struct pipe_resource *src, unsigned src_level,
+                         const struct pipe_box *src_box);
+
+
+#endif /* LP_FAST_CLEAR_H */
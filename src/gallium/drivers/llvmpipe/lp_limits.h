@@ -66,7 +66,19 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 32
+#define LP_MAX_THREADS 256
+
+/**
+ * Max number of L3 cache domains the rasterizer threads are spread over.
+ * Each domain gets its own band of tiles in every scene.
+ */
+#define LP_MAX_RAST_DOMAINS 32
+
+/**
+ * Max number of scenes, which is also the max number of scenes the
+ * rasterizer can have in flight at once.
+ */
+#define MAX_SCENES 64
 
 
 /**
@@ -117,10 +117,21 @@ lp_print_counters(void)
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
+      debug_printf("llvmpipe: nr_fast_clear_tiles:          %9u\n", lp_count.nr_fast_clear_tiles);
+      debug_printf("llvmpipe:   nr_fast_clear_resolves:     %9u\n", lp_count.nr_fast_clear_resolves);
+      debug_printf("llvmpipe: nr_hiz_rejected_64:           %9u\n", lp_count.nr_hiz_rejected_64);
+
+      debug_printf("llvmpipe: nr_scenes:                    %9u\n", lp_count.nr_scenes);
+      debug_printf("llvmpipe: nr_bins:                      %9u\n", lp_count.nr_bins);
+      debug_printf("llvmpipe:   nr_bin_steals:              %9u\n", lp_count.nr_bin_steals);
+      debug_printf("llvmpipe:   nr_bin_races:               %9u\n", lp_count.nr_bin_races);
 
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: nr_fs_variant_hits:           %9u\n", lp_count.nr_fs_variant_hits);
+      debug_printf("llvmpipe: nr_fs_variant_misses:         %9u\n", lp_count.nr_fs_variant_misses);
+      debug_printf("llvmpipe: fs compile stall time:        %.2f sec\n", lp_count.fs_compile_stall_time / 1000000.0);
 
    }
 }
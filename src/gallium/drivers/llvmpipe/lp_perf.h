@@ -64,10 +64,21 @@ struct lp_counters
    unsigned nr_non_empty_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_variant_hits;
+   unsigned nr_fs_variant_misses;
+   int64_t fs_compile_stall_time;  /**< rasterizer waits for LP_ASYNC_FS, in microseconds */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+   unsigned nr_fast_clear_tiles;     /**< tile clears only recorded */
+   unsigned nr_fast_clear_resolves;  /**< recorded clears written out */
+   unsigned nr_hiz_rejected_64;      /**< tiles a triangle is behind */
+
+   unsigned nr_scenes;
+   unsigned nr_bins;
+   unsigned nr_bin_steals;     /**< bins taken from another domain's band */
+   unsigned nr_bin_races;      /**< bin claims that lost to another thread */
 };
 
 
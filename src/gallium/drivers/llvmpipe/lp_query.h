@@ -42,8 +42,9 @@ struct llvmpipe_context;
 
 
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
+   unsigned num_threads;
    struct lp_fence *fence;          /* fence from last scene this was binned in */
    enum pipe_query_type type;
    unsigned index;
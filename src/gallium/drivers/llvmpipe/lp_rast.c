@@ -32,6 +32,8 @@
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_thread.h"
 #include "util/u_memset.h"
 #include "util/os_time.h"
@@ -39,6 +41,7 @@
 #include "lp_scene_queue.h"
 #include "lp_context.h"
 #include "lp_debug.h"
+#include "lp_fast_clear.h"
 #include "lp_fence.h"
 #include "lp_perf.h"
 #include "lp_query.h"
@@ -73,19 +76,24 @@ static void
 lp_rast_begin(struct lp_rasterizer *rast,
               struct lp_scene *scene)
 {
-   rast->curr_scene = scene;
-
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, rast->num_domains);
 }
 
 
 static void
-lp_rast_end(struct lp_rasterizer *rast)
+lp_rast_end(struct lp_rasterizer *rast,
+            struct lp_scene *scene)
 {
-   rast->curr_scene = NULL;
+   LP_DBG(DEBUG_SCENE, "scene %p: %u bins, %u stolen, %u claim races\n",
+          (void *) scene, lp_scene_get_num_bins(scene),
+          scene->bin_steals, scene->bin_races);
+   LP_COUNT(nr_scenes);
+   LP_COUNT_ADD(nr_bins, lp_scene_get_num_bins(scene));
+   LP_COUNT_ADD(nr_bin_steals, scene->bin_steals);
+   LP_COUNT_ADD(nr_bin_races, scene->bin_races);
 }
 
 
@@ -977,6 +985,188 @@ debug_rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Does the current tile of the scene cover the whole tile of the fast
+ * clear state?  The framebuffer may be smaller than its attachments.
+ */
+static bool
+fast_clear_covers_tile(const struct lp_rasterizer_task *task,
+                       const struct lp_fast_clear *fc)
+{
+   return fc &&
+          task->width == MIN2(TILE_SIZE, fc->width - task->x) &&
+          task->height == MIN2(TILE_SIZE, fc->height - task->y);
+}
+
+
+static uint64_t
+fast_clear_get_zs(const union util_color *uc, unsigned blocksize)
+{
+   uint64_t value;
+
+   switch (blocksize) {
+   case 1:
+      return uc->ub;
+   case 2:
+      return uc->us;
+   case 4:
+      return uc->ui[0];
+   default:
+      memcpy(&value, uc, sizeof value);
+      return value;
+   }
+}
+
+
+static void
+fast_clear_set_zs(union util_color *uc, unsigned blocksize, uint64_t value)
+{
+   switch (blocksize) {
+   case 1:
+      uc->ub = value;
+      break;
+   case 2:
+      uc->us = value;
+      break;
+   case 4:
+      uc->ui[0] = value;
+      break;
+   default:
+      memcpy(uc, &value, sizeof value);
+      break;
+   }
+}
+
+
+/**
+ * Deal with the fast clear state of the attachments at the start of a bin.
+ *
+ * Bins which do nothing but clear put the tiles into the cleared state
+ * instead of writing them.  Otherwise cleared tiles are written first,
+ * unless the bin begins by clearing them again.
+ *
+ * \return true if the bin has been handled entirely
+ */
+static bool
+fast_clear_tile_begin(struct lp_rasterizer_task *task,
+                      const struct cmd_bin *bin)
+{
+   const struct lp_scene *scene = task->scene;
+   const unsigned tx = task->x / TILE_SIZE, ty = task->y / TILE_SIZE;
+   const unsigned zs_bit = 1 << PIPE_MAX_COLOR_BUFS;
+   struct lp_fast_clear *zs_fc = scene->zsbuf.fast_clear;
+   uint64_t zs_full_mask = 0;
+   unsigned zs_blocksize = 0;
+   union util_color zs_value;
+   bool zs_cleared = false;
+   unsigned cleared = 0;
+   bool leading = true;
+   bool clear_only = scene->fb_max_layer == 0;
+
+   if (scene->fb.zsbuf) {
+      zs_full_mask = util_pack64_mask_z_stencil(scene->fb.zsbuf->format,
+                                                ~0, 0xff);
+      zs_blocksize = util_format_get_blocksize(scene->fb.zsbuf->format);
+   }
+
+   if (zs_fc)
+      zs_cleared = lp_fast_clear_get_tile_value(zs_fc, tx, ty, &zs_value);
+
+   for (const struct cmd_block *block = bin->head; block; block = block->next) {
+      for (unsigned k = 0; k < block->count; k++) {
+         const union lp_rast_cmd_arg arg = block->arg[k];
+
+         switch (block->cmd[k]) {
+         case LP_RAST_OP_CLEAR_COLOR: {
+            const unsigned cbuf = arg.clear_rb->cbuf;
+            if (!fast_clear_covers_tile(task, scene->cbufs[cbuf].fast_clear))
+               clear_only = false;
+            else if (leading)
+               cleared |= 1 << cbuf;
+            break;
+         }
+         case LP_RAST_OP_CLEAR_ZSTENCIL: {
+            const bool full = (arg.clear_zstencil.mask & zs_full_mask) ==
+                              zs_full_mask;
+            if (!fast_clear_covers_tile(task, zs_fc)) {
+               clear_only = false;
+            } else {
+               /* A partial clear needs the previous value */
+               if (!full && !(cleared & zs_bit) && !zs_cleared)
+                  clear_only = false;
+               if (leading && full)
+                  cleared |= zs_bit;
+            }
+            break;
+         }
+         case LP_RAST_OP_SET_STATE:
+            break;
+         default:
+            leading = false;
+            clear_only = false;
+            break;
+         }
+      }
+   }
+
+   if (clear_only) {
+      for (const struct cmd_block *block = bin->head; block; block = block->next) {
+         for (unsigned k = 0; k < block->count; k++) {
+            const union lp_rast_cmd_arg arg = block->arg[k];
+
+            if (block->cmd[k] == LP_RAST_OP_CLEAR_COLOR) {
+               const unsigned cbuf = arg.clear_rb->cbuf;
+               lp_fast_clear_set_tile(scene->cbufs[cbuf].fast_clear,
+                                      scene->cbufs[cbuf].map,
+                                      scene->cbufs[cbuf].stride,
+                                      scene->fb.cbufs[cbuf]->format, tx, ty,
+                                      &arg.clear_rb->color_val);
+            } else if (block->cmd[k] == LP_RAST_OP_CLEAR_ZSTENCIL) {
+               const uint64_t mask = arg.clear_zstencil.mask;
+               uint64_t value = arg.clear_zstencil.value & mask;
+
+               if (zs_cleared)
+                  value |= fast_clear_get_zs(&zs_value, zs_blocksize) & ~mask;
+               memset(&zs_value, 0, sizeof zs_value);
+               fast_clear_set_zs(&zs_value, zs_blocksize, value);
+               zs_cleared = true;
+               lp_fast_clear_set_tile(zs_fc, scene->zsbuf.map,
+                                      scene->zsbuf.stride,
+                                      scene->fb.zsbuf->format, tx, ty,
+                                      &zs_value);
+            }
+         }
+      }
+      return true;
+   }
+
+   for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
+      struct lp_fast_clear *fc = scene->cbufs[i].fast_clear;
+
+      if (!fc)
+         continue;
+
+      if (cleared & (1 << i))
+         lp_fast_clear_drop_tile(fc, tx, ty);
+      else
+         lp_fast_clear_fill_tile(fc, scene->cbufs[i].map,
+                                 scene->cbufs[i].stride,
+                                 scene->fb.cbufs[i]->format, tx, ty);
+   }
+
+   if (zs_fc) {
+      if (cleared & zs_bit)
+         lp_fast_clear_drop_tile(zs_fc, tx, ty);
+      else
+         lp_fast_clear_fill_tile(zs_fc, scene->zsbuf.map,
+                                 scene->zsbuf.stride,
+                                 scene->fb.zsbuf->format, tx, ty);
+   }
+
+   return false;
+}
+
+
 /**
  * Rasterize commands for a single bin.
  * \param x, y  position of the bin's tile in the framebuffer
@@ -991,6 +1181,11 @@ rasterize_bin(struct lp_rasterizer_task *task,
 
    lp_rast_tile_begin(task, bin, x, y);
 
+   if (task->scene->fast_clear && fast_clear_tile_begin(task, bin)) {
+      lp_rast_tile_end(task);
+      return;
+   }
+
    if (LP_DEBUG & DEBUG_NO_FASTPATH) {
       debug_rasterize_bin(task, bin);
    } else if (info.type & LP_RAST_FLAGS_BLIT) {
@@ -1034,13 +1229,169 @@ is_empty_bin(const struct cmd_bin *bin)
 }
 
 
+/**
+ * Retire the scenes which have all their bins done, in order.
+ * Called with rast->scene_mutex held.
+ */
+static void
+rast_retire_scenes(struct lp_rasterizer *rast)
+{
+   bool retired = false;
+
+   while (rast->completed_seq != rast->begun_seq) {
+      struct lp_rast_scene_slot *slot =
+         &rast->slots[rast->completed_seq % MAX_SCENES];
+
+      if (p_atomic_read(&slot->bins_done) != slot->num_bins)
+         break;
+
+      lp_rast_end(rast, slot->scene);
+      rast->completed_seq++;
+      retired = true;
+   }
+
+   if (retired)
+      cnd_broadcast(&rast->scene_done);
+}
+
+
+/**
+ * Get the scene with the given sequence number, beginning it if we are
+ * the first thread to get there.
+ */
+static struct lp_rast_scene_slot *
+rast_get_scene(struct lp_rasterizer *rast, unsigned seq)
+{
+   struct lp_rast_scene_slot *slot = &rast->slots[seq % MAX_SCENES];
+
+   mtx_lock(&rast->scene_mutex);
+
+   if (seq == rast->begun_seq) {
+      struct lp_scene *scene = lp_scene_dequeue(rast->full_scenes, true);
+
+      lp_rast_begin(rast, scene);
+
+      slot->scene = scene;
+      slot->seq = seq;
+      slot->num_bins = rast->no_rast ? 0 : lp_scene_get_num_bins(scene);
+      slot->bins_done = 0;
+      slot->overlap = false;
+
+      /* The previous scene can't have been recycled by setup yet if it
+       * isn't retired, as that happens before its last bin is done.
+       */
+      if (seq != rast->completed_seq && slot->num_bins &&
+          !(LP_PERF & PERF_NO_SCENE_OVERLAP)) {
+         const struct lp_rast_scene_slot *prev =
+            &rast->slots[(seq - 1) % MAX_SCENES];
+
+         slot->overlap = prev->num_bins == slot->num_bins &&
+                         lp_scene_can_overlap(prev->scene, scene);
+      }
+
+      rast->begun_seq++;
+
+      /* Scenes without bins are done as soon as they begin. */
+      rast_retire_scenes(rast);
+   }
+
+   mtx_unlock(&rast->scene_mutex);
+
+   assert(slot->seq == seq);
+   return slot;
+}
+
+
+static inline bool
+rast_tile_ready(unsigned *tile_seq, unsigned seq)
+{
+   /* Read with a read-modify-write, so that either rast_tile_done() sees
+    * the waiter count raised before it, or this sees its update.
+    */
+   return (int)(p_atomic_cmpxchg(tile_seq, 0, 0) - seq) >= 0;
+}
+
+
+/**
+ * Wait for the previous scene to be done with a tile before touching it.
+ *
+ * The previous scene usually finishes the tile shortly, so spin for a
+ * little while before going to sleep.  It may also be stuck for much
+ * longer, for instance waiting for a fragment shader to compile, and
+ * spinning all that time would take the CPU from the threads we are
+ * waiting for.
+ */
+static void
+rast_wait_for_tile(struct lp_rasterizer *rast,
+                   const struct lp_rast_scene_slot *slot,
+                   unsigned x, unsigned y)
+{
+   unsigned *tile_seq = &rast->tile_seq[y * TILES_X + x];
+
+   for (unsigned i = 0; i < LP_RAST_TILE_SPIN_COUNT; i++) {
+      if ((int)(p_atomic_read(tile_seq) - slot->seq) >= 0)
+         return;
+      thrd_yield();
+   }
+
+   p_atomic_inc(&rast->tile_waiters);
+   mtx_lock(&rast->tile_mutex);
+   while (!rast_tile_ready(tile_seq, slot->seq))
+      cnd_wait(&rast->tile_done, &rast->tile_mutex);
+   mtx_unlock(&rast->tile_mutex);
+   p_atomic_dec(&rast->tile_waiters);
+}
+
+
+/**
+ * Wait for all the previous scenes to be done.
+ */
+static void
+rast_wait_for_scene(struct lp_rasterizer *rast,
+                    const struct lp_rast_scene_slot *slot)
+{
+   mtx_lock(&rast->scene_mutex);
+   while ((int)(rast->completed_seq - slot->seq) < 0)
+      cnd_wait(&rast->scene_done, &rast->scene_mutex);
+   mtx_unlock(&rast->scene_mutex);
+}
+
+
+static void
+rast_tile_done(struct lp_rasterizer *rast,
+               struct lp_rast_scene_slot *slot,
+               unsigned x, unsigned y)
+{
+   /* Count the bin before publishing the tile, so that once the next
+    * scene has started on every tile this scene is complete.
+    */
+   unsigned bins_done = p_atomic_inc_return(&slot->bins_done);
+
+   p_atomic_xchg(&rast->tile_seq[y * TILES_X + x], slot->seq + 1);
+
+   if (p_atomic_read(&rast->tile_waiters)) {
+      mtx_lock(&rast->tile_mutex);
+      cnd_broadcast(&rast->tile_done);
+      mtx_unlock(&rast->tile_mutex);
+   }
+
+   if (bins_done == slot->num_bins) {
+      mtx_lock(&rast->scene_mutex);
+      rast_retire_scenes(rast);
+      mtx_unlock(&rast->scene_mutex);
+   }
+}
+
+
 /**
  * Rasterize/execute all bins within a scene.
- * Called per thread.
+ * Called per thread.  With threads, \p slot orders the bins after
+ * those of the previous scene.
  */
 static void
 rasterize_scene(struct lp_rasterizer_task *task,
-                struct lp_scene *scene)
+                struct lp_scene *scene,
+                struct lp_rast_scene_slot *slot)
 {
    task->scene = scene;
 
@@ -1062,10 +1413,25 @@ rasterize_scene(struct lp_rasterizer_task *task,
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+
+      lp_scene_wait_frag_shaders(scene);
+
+      if (slot && !slot->overlap)
+         rast_wait_for_scene(task->rast, slot);
+
+      while ((bin = lp_scene_bin_iter_next(scene, task->domain, &i, &j))) {
+         if (slot && slot->overlap)
+            rast_wait_for_tile(task->rast, slot, i, j);
+
          if (!is_empty_bin(bin))
             rasterize_bin(task, bin, i, j);
+
+         if (slot)
+            rast_tile_done(task->rast, slot, i, j);
       }
+   } else if (slot) {
+      /* Keep the scenes in order even when not rasterizing. */
+      rast_wait_for_scene(task->rast, slot);
    }
 
 #if LP_BUILD_FORMAT_CACHE_DEBUG
@@ -1114,13 +1480,11 @@ lp_rast_queue_scene(struct lp_rasterizer *rast,
 
       lp_rast_begin(rast, scene);
 
-      rasterize_scene(&rast->tasks[0], scene);
+      rasterize_scene(&rast->tasks[0], scene, NULL);
 
-      lp_rast_end(rast);
+      lp_rast_end(rast, scene);
 
       util_fpstate_set(fpstate);
-
-      rast->curr_scene = NULL;
    } else {
       /* threaded rendering! */
       lp_scene_enqueue(rast->full_scenes, scene);
@@ -1182,33 +1546,18 @@ thread_function(void *init_data)
       if (rast->exit_flag)
          break;
 
-      if (task->thread_index == 0) {
-         /* thread[0]:
-          *  - get next scene to rasterize
-          *  - map the framebuffer surfaces
-          */
-         lp_rast_begin(rast, lp_scene_dequeue(rast->full_scenes, true));
-      }
-
-      /* Wait for all threads to get here so that threads[1+] don't
-       * get a null rast->curr_scene pointer.
-       */
-      util_barrier_wait(&rast->barrier);
-
       /* do work */
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task, rast->curr_scene);
-
-      /* wait for all threads to finish with this scene */
-      util_barrier_wait(&rast->barrier);
-
-      /* XXX: shouldn't be necessary:
+      /* Whoever gets to a scene first begins it, and nobody waits for
+       * the other threads to be done with the previous scene, unless
+       * the two scenes conflict.
        */
-      if (task->thread_index == 0) {
-         lp_rast_end(rast);
-      }
+      struct lp_rast_scene_slot *slot =
+         rast_get_scene(rast, task->scene_seq++);
+
+      rasterize_scene(task, slot->scene, slot);
 
       /* signal done with work */
       if (debug)
@@ -1225,11 +1574,73 @@ thread_function(void *init_data)
 }
 
 
+/**
+ * Decide which L3 cache domains the threads are spread over.
+ *
+ * Pinning is opt-in with LP_PIN_THREADS, as it overrides whatever
+ * placement the application, the container or the scheduler would have
+ * picked.  Even then, threads are only pinned when there is more than one
+ * L3 cache, ie. on multi-socket or multi-CCX machines where a remote cache
+ * or memory node is noticeably more expensive, and only to the CPUs of
+ * the affinity mask inherited from the creating thread.  If that mask
+ * spans a single L3 cache, nothing is pinned.
+ */
+void
+lp_thread_domains_init(struct lp_thread_domains *domains,
+                       unsigned num_threads)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   util_affinity_mask inherited = {0};
+
+   domains->count = 1;
+
+   if (num_threads < 2 || caps->num_L3_caches < 2 ||
+       !caps->L3_affinity_mask ||
+       !debug_get_bool_option("LP_PIN_THREADS", false) ||
+       !util_get_thread_affinity(thrd_current(), inherited,
+                                 caps->num_cpu_mask_bits))
+      return;
+
+   unsigned count = 0;
+   for (unsigned l3 = 0; l3 < caps->num_L3_caches; l3++) {
+      bool empty = true;
+
+      for (unsigned i = 0; i < ARRAY_SIZE(inherited); i++) {
+         domains->masks[count][i] = caps->L3_affinity_mask[l3][i] & inherited[i];
+         empty &= !domains->masks[count][i];
+      }
+
+      if (!empty && ++count == LP_MAX_RAST_DOMAINS)
+         break;
+   }
+
+   domains->count = MAX2(1, MIN2(count, num_threads));
+}
+
+
+/**
+ * Pin the i-th of num_threads threads to its domain.  Consecutive threads
+ * share a domain, so every domain gets an equal share of the threads.
+ */
+void
+lp_thread_domains_pin(const struct lp_thread_domains *domains,
+                      thrd_t thread, unsigned i, unsigned num_threads)
+{
+   const unsigned domain = i * domains->count / MAX2(1, num_threads);
+
+   if (domains->count > 1) {
+      util_set_thread_affinity(thread, domains->masks[domain], NULL,
+                               util_get_cpu_caps()->num_cpu_mask_bits);
+   }
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
 static void
-create_rast_threads(struct lp_rasterizer *rast)
+create_rast_threads(struct lp_rasterizer *rast,
+                    const struct lp_thread_domains *domains)
 {
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (unsigned i = 0; i < rast->num_threads; i++) {
@@ -1243,6 +1654,8 @@ create_rast_threads(struct lp_rasterizer *rast)
          rast->num_threads = i; /* previous thread is max */
          break;
       }
+
+      lp_thread_domains_pin(domains, rast->threads[i], i, rast->num_threads);
    }
 }
 
@@ -1265,10 +1678,31 @@ lp_rast_create(unsigned num_threads)
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof(*rast->tasks));
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof(*rast->threads));
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
+   if (num_threads > 0) {
+      rast->tile_seq = CALLOC(TILES_X * TILES_Y, sizeof(*rast->tile_seq));
+      if (!rast->tile_seq) {
+         goto no_tasks;
+      }
+   }
+
+   /* Every domain gets an equal share of the threads and one band of each
+    * scene's tiles.
+    */
+   struct lp_thread_domains domains;
+   lp_thread_domains_init(&domains, num_threads);
+   rast->num_domains = domains.count;
+
    for (unsigned i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->domain = i * rast->num_domains / MAX2(1, num_threads);
       task->thread_data.cache =
          align_malloc(sizeof(struct lp_build_format_cache), 16);
       if (!task->thread_data.cache) {
@@ -1280,24 +1714,28 @@ lp_rast_create(unsigned num_threads)
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", false);
 
-   create_rast_threads(rast);
+   /* for ordering the scenes between rasterization threads */
+   (void) mtx_init(&rast->scene_mutex, mtx_plain);
+   cnd_init(&rast->scene_done);
+   (void) mtx_init(&rast->tile_mutex, mtx_plain);
+   cnd_init(&rast->tile_done);
 
-   /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_init(&rast->barrier, rast->num_threads);
-   }
+   create_rast_threads(rast, &domains);
 
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
 
    return rast;
 
 no_thread_data_cache:
-   for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (unsigned i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
-
+no_tasks:
+   FREE(rast->tile_seq);
+   FREE(rast->tasks);
+   FREE(rast->threads);
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -1352,13 +1790,16 @@ lp_rast_destroy(struct lp_rasterizer *rast)
 
    lp_fence_reference(&rast->last_fence, NULL);
 
-   /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_destroy(&rast->barrier);
-   }
+   cnd_destroy(&rast->tile_done);
+   mtx_destroy(&rast->tile_mutex);
+   cnd_destroy(&rast->scene_done);
+   mtx_destroy(&rast->scene_mutex);
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->tile_seq);
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 }
 
@@ -40,6 +40,9 @@
 #include "util/compiler.h"
 #include "util/u_pack_color.h"
 #include "util/u_rect.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_thread.h"
+#include "lp_limits.h"
 #include "lp_jit.h"
 
 
@@ -230,6 +233,22 @@ GET_PLANES(const struct lp_rast_triangle *tri)
 }
 
 
+/**
+ * L3 cache domains the rasterizer and compute threads are pinned to.
+ */
+struct lp_thread_domains {
+   unsigned count;
+   util_affinity_mask masks[LP_MAX_RAST_DOMAINS];
+};
+
+void
+lp_thread_domains_init(struct lp_thread_domains *domains,
+                       unsigned num_threads);
+
+void
+lp_thread_domains_pin(const struct lp_thread_domains *domains,
+                      thrd_t thread, unsigned i, unsigned num_threads);
+
 struct lp_rasterizer *
 lp_rast_create(unsigned num_threads);
 
@@ -42,6 +42,11 @@
 #define TILE_VECTOR_HEIGHT 4
 #define TILE_VECTOR_WIDTH 4
 
+/* How many times to yield while waiting for another scene to release a
+ * tile before sleeping.
+ */
+#define LP_RAST_TILE_SPIN_COUNT 64
+
 /* If we crash in a jitted function, we can examine jit_line and jit_state
  * to get some info.  This is not thread-safe, however.
  */
@@ -97,6 +102,12 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** L3 cache domain this thread is pinned to */
+   unsigned domain;
+
+   /** Sequence number of the next scene this thread will rasterize */
+   unsigned scene_seq;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
@@ -108,6 +119,21 @@ struct lp_rasterizer_task
 };
 
 
+/**
+ * A scene the threads have started on, see lp_rasterizer::slots.
+ */
+struct lp_rast_scene_slot
+{
+   struct lp_scene *scene;
+   unsigned seq;
+   unsigned num_bins;
+   unsigned bins_done;
+
+   /** Only wait for the previous scene per tile, not as a whole */
+   bool overlap;
+};
+
+
 /**
  * This is the state required while rasterizing tiles.
  * Note that this contains per-thread information too.
@@ -121,17 +147,40 @@ struct lp_rasterizer
    /** The incoming queue of scenes ready to rasterize */
    struct lp_scene_queue *full_scenes;
 
-   /** The scene currently being rasterized by the threads */
-   struct lp_scene *curr_scene;
-
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
+
+   /** Number of L3 cache domains the threads are spread over */
+   unsigned num_domains;
 
-   /** For synchronizing the rasterization threads */
-   util_barrier barrier;
+   /**
+    * Scenes are started by whichever thread gets to them first and each
+    * thread works through them in order, so a thread which runs out of
+    * bins in one scene can move on to the next one while the others are
+    * still busy.  Scene N lives in slots[N % MAX_SCENES].
+    */
+   mtx_t scene_mutex;
+   cnd_t scene_done;
+   struct lp_rast_scene_slot slots[MAX_SCENES];
+   unsigned begun_seq;      /**< number of scenes started */
+   unsigned completed_seq;  /**< number of scenes with all bins done */
+
+   /**
+    * Per tile, one past the sequence number of the last scene that
+    * finished it.  Indexed with TILES_X as the stride.
+    */
+   unsigned *tile_seq;
+
+   /**
+    * Threads which gave up spinning on a tile sleep on tile_done, which is
+    * only signalled while tile_waiters is non-zero.
+    */
+   mtx_t tile_mutex;
+   cnd_t tile_done;
+   unsigned tile_waiters;
 
    struct lp_fence *last_fence;
 };
@@ -28,12 +28,16 @@
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_atomic.h"
+#include "util/os_time.h"
 #include "util/reallocarray.h"
 #include "util/u_inlines.h"
 #include "util/format/u_format.h"
 #include "lp_scene.h"
+#include "lp_fast_clear.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 #include "lp_context.h"
 #include "lp_state_fs.h"
 #include "lp_setup_context.h"
@@ -103,6 +107,7 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   FREE(scene->bin_order);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -158,6 +163,8 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
 static void
 init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
 {
+   ssurf->fast_clear = NULL;
+
    if (!psurf) {
       ssurf->stride = 0;
       ssurf->layer_stride = 0;
@@ -180,6 +187,14 @@ init_scene_texture(struct lp_scene_surface *ssurf, struct pipe_surface *psurf)
                                          LP_TEX_USAGE_READ_WRITE);
       ssurf->format_bytes = util_format_get_blocksize(psurf->format);
       ssurf->nr_samples = util_res_sample_count(psurf->texture);
+
+      /* The tile state covers level 0 of single layer resources only */
+      struct lp_fast_clear *fc = llvmpipe_resource(psurf->texture)->fast_clear;
+      if (fc && !p_atomic_read(&fc->disabled) &&
+          psurf->u.tex.level == 0 && psurf->u.tex.first_layer == 0 &&
+          ssurf->format_bytes ==
+          util_format_get_blocksize(psurf->texture->format))
+         ssurf->fast_clear = fc;
    } else {
       struct llvmpipe_resource *lpr = llvmpipe_resource(psurf->texture);
       unsigned pixstride = util_format_get_blocksize(psurf->format);
@@ -201,14 +216,20 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
    //LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
+   scene->fast_clear = false;
+
    for (unsigned i = 0; i < scene->fb.nr_cbufs; i++) {
       struct pipe_surface *cbuf = scene->fb.cbufs[i];
       init_scene_texture(&scene->cbufs[i], cbuf);
+      scene->fast_clear |= scene->cbufs[i].fast_clear != NULL;
    }
 
    if (fb->zsbuf) {
       struct pipe_surface *zsbuf = scene->fb.zsbuf;
       init_scene_texture(&scene->zsbuf, zsbuf);
+      scene->fast_clear |= scene->zsbuf.fast_clear != NULL;
+   } else {
+      scene->zsbuf.fast_clear = NULL;
    }
 }
 
@@ -463,6 +484,79 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
    return flush;
 }
 
+static bool
+resource_list_references(const struct resource_ref *refs,
+                         const struct pipe_resource *resource)
+{
+   for (const struct resource_ref *ref = refs; ref; ref = ref->next) {
+      for (int i = 0; i < ref->count; i++)
+         if (ref->resource[i] == resource)
+            return true;
+   }
+   return false;
+}
+
+
+/**
+ * Can the bins of \p next be rasterized while \p prev is still in
+ * flight, as long as each tile of \p prev is finished before the same
+ * tile of \p next is started?
+ *
+ * That is only the case when both scenes render to the same framebuffer
+ * and neither touches anything the other one writes, other than through
+ * the framebuffer itself.
+ */
+bool
+lp_scene_can_overlap(const struct lp_scene *prev,
+                     const struct lp_scene *next)
+{
+   if (prev->fb.width != next->fb.width ||
+       prev->fb.height != next->fb.height ||
+       prev->fb.layers != next->fb.layers ||
+       prev->fb.samples != next->fb.samples ||
+       prev->fb.nr_cbufs != next->fb.nr_cbufs ||
+       prev->fb.zsbuf != next->fb.zsbuf ||
+       prev->fb.resolve || next->fb.resolve)
+      return false;
+
+   for (unsigned i = 0; i < prev->fb.nr_cbufs; i++) {
+      if (prev->fb.cbufs[i] != next->fb.cbufs[i])
+         return false;
+   }
+
+   /* The framebuffer is only ordered per tile, so it must not be
+    * sampled or written through an image by either scene.
+    */
+   for (unsigned i = 0; i <= prev->fb.nr_cbufs; i++) {
+      struct pipe_surface *surf =
+         i < prev->fb.nr_cbufs ? prev->fb.cbufs[i] : prev->fb.zsbuf;
+      if (!surf)
+         continue;
+      if (resource_list_references(prev->resources, surf->texture) ||
+          resource_list_references(prev->writeable_resources, surf->texture) ||
+          resource_list_references(next->resources, surf->texture) ||
+          resource_list_references(next->writeable_resources, surf->texture))
+         return false;
+   }
+
+   for (const struct resource_ref *ref = prev->writeable_resources;
+        ref; ref = ref->next) {
+      for (int i = 0; i < ref->count; i++)
+         if (lp_scene_is_resource_referenced(next, ref->resource[i]))
+            return false;
+   }
+
+   for (const struct resource_ref *ref = next->writeable_resources;
+        ref; ref = ref->next) {
+      for (int i = 0; i < ref->count; i++)
+         if (resource_list_references(prev->resources, ref->resource[i]))
+            return false;
+   }
+
+   return true;
+}
+
+
 /**
  * Add a reference to a fragment shader variant
  * Return FALSE if out of memory, TRUE otherwise.
@@ -512,6 +606,31 @@ lp_scene_add_frag_shader_reference(struct lp_scene *scene,
 }
 
 
+/**
+ * Wait for the code of all the fragment shader variants used by the
+ * scene, which may still be generated in the background (LP_ASYNC_FS).
+ */
+void
+lp_scene_wait_frag_shaders(const struct lp_scene *scene)
+{
+   for (struct shader_ref *ref = scene->frag_shaders; ref; ref = ref->next) {
+      for (int i = 0; i < ref->count; i++) {
+         /* No variant is referenced when nothing was drawn yet */
+         if (!ref->variant[i])
+            continue;
+
+         struct util_queue_fence *ready = &ref->variant[i]->ready;
+
+         if (!util_queue_fence_is_signalled(ready)) {
+            int64_t t0 = os_time_get();
+            util_queue_fence_wait(ready);
+            LP_COUNT_ADD(fs_compile_stall_time, os_time_get() - t0);
+         }
+      }
+   }
+}
+
+
 /**
  * Does this scene have a reference to the given resource?
  * Returns bitmask of LP_REFERENCED_FOR_READ/WRITE bits.
@@ -547,60 +666,139 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static bool
-next_bin(struct lp_scene *scene)
+static unsigned
+morton_spread(unsigned v)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   v &= 0xffff;
+   v = (v | (v << 8)) & 0x00ff00ff;
+   v = (v | (v << 4)) & 0x0f0f0f0f;
+   v = (v | (v << 2)) & 0x33333333;
+   v = (v | (v << 1)) & 0x55555555;
+   return v;
+}
+
+
+static int
+compare_u64(const void *a, const void *b)
+{
+   const uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+   return ka < kb ? -1 : ka > kb;
+}
+
+
+/**
+ * (Re)build the Morton order table so that consecutive claims within a
+ * band return neighbouring tiles, which share more texels and so keep
+ * the texture cache of each thread warm.
+ */
+static void
+build_bin_order(struct lp_scene *scene)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   if (scene->bin_order &&
+       scene->bin_order_tiles_x == scene->tiles_x &&
+       scene->bin_order_tiles_y == scene->tiles_y &&
+       scene->bin_order_bands == scene->num_bands)
+      return;
+
+   FREE(scene->bin_order);
+   scene->bin_order = MALLOC(num_bins * sizeof(*scene->bin_order));
+   uint64_t *keys = MALLOC(num_bins * sizeof(*keys));
+   if (!scene->bin_order || !keys) {
+      FREE(scene->bin_order);
+      FREE(keys);
+      scene->bin_order = NULL;
+      return;
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
+
+   for (unsigned b = 0; b < scene->num_bands; b++) {
+      const unsigned start = scene->bands[b].next, end = scene->bands[b].end;
+      const unsigned y0 = start / MAX2(scene->tiles_x, 1);
+
+      for (unsigned idx = start; idx < end; idx++) {
+         unsigned x = idx % scene->tiles_x, y = idx / scene->tiles_x - y0;
+         uint64_t key = morton_spread(x) | (morton_spread(y) << 1);
+         keys[idx - start] = (key << 32) | idx;
+      }
+
+      qsort(keys, end - start, sizeof(*keys), compare_u64);
+
+      for (unsigned i = 0; i < end - start; i++)
+         scene->bin_order[start + i] = (unsigned)keys[i];
    }
-   return true;
+
+   FREE(keys);
+   scene->bin_order_tiles_x = scene->tiles_x;
+   scene->bin_order_tiles_y = scene->tiles_y;
+   scene->bin_order_bands = scene->num_bands;
 }
 
 
+/**
+ * Split the tile rows into num_bands bands, one per rasterizer domain.
+ * Threads start on the band of their own domain so the same tiles tend
+ * to be rasterized from the same L3 cache / memory node every frame.
+ * Called by a single thread before the rasterizer threads start.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_bands)
 {
-   scene->curr_x = scene->curr_y = -1;
+   assert(num_bands >= 1 && num_bands <= LP_MAX_RAST_DOMAINS);
+
+   scene->num_bands = num_bands;
+   for (unsigned b = 0; b < num_bands; b++) {
+      scene->bands[b].next = (scene->tiles_y * b / num_bands) * scene->tiles_x;
+      scene->bands[b].end = (scene->tiles_y * (b + 1) / num_bands) * scene->tiles_x;
+   }
+
+   scene->bin_steals = 0;
+   scene->bin_races = 0;
+
+   if (LP_PERF & PERF_MORTON_TILES)
+      build_bin_order(scene);
+   else if (scene->bin_order) {
+      FREE(scene->bin_order);
+      scene->bin_order = NULL;
+   }
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Bins are taken from the given band first, and from the other bands
+ * once it has been exhausted.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  This is lock-free: a bin is claimed by
+ * atomically bumping the band's next position.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned band, int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   for (unsigned i = 0; i < scene->num_bands; i++) {
+      unsigned b = (band + i) % scene->num_bands;
+      const unsigned end = scene->bands[b].end;
+
+      if (p_atomic_read_relaxed(&scene->bands[b].next) >= end)
+         continue;
+
+      unsigned pos = p_atomic_fetch_add(&scene->bands[b].next, 1);
+      if (pos >= end) {
+         /* Somebody else took the last bin(s) of this band. */
+         p_atomic_inc(&scene->bin_races);
+         continue;
+      }
 
-   mtx_lock(&scene->mutex);
+      if (i)
+         p_atomic_inc(&scene->bin_steals);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+      unsigned idx = scene->bin_order ? scene->bin_order[pos] : pos;
+      *x = idx % scene->tiles_x;
+      *y = idx / scene->tiles_x;
+      return lp_scene_get_bin(scene, *x, *y);
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
-
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   return NULL;
 }
 
 
@@ -36,9 +36,12 @@
 #define LP_SCENE_H
 
 #include "util/u_thread.h"
+#include "util/u_memory.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
 
+struct lp_fast_clear;
+
 struct lp_scene_queue;
 struct lp_rast_state;
 
@@ -127,6 +130,7 @@ struct lp_scene_surface {
    unsigned format_bytes;
    unsigned sample_stride;
    unsigned nr_samples;
+   struct lp_fast_clear *fast_clear;  /**< tile clear state, or NULL */
 };
 
 
@@ -157,6 +161,9 @@ struct lp_scene {
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* Some attachment has fast clear state, see lp_fast_clear.h */
+   bool fast_clear;
+
    /* fixed point sample positions. */
    int32_t fixed_sample_pos[LP_MAX_SAMPLES][2];
 
@@ -195,7 +202,27 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
+   /**
+    * For iterating over bins.  The tile rows are split into one band per
+    * rasterizer domain, given as [next, end) positions in bin_order (or
+    * linear bin indices if bin_order is NULL).  Threads claim bins by
+    * atomically incrementing next, each band on its own cache line.
+    */
+   struct {
+      EXCLUSIVE_CACHELINE(struct {
+         unsigned next;
+         unsigned end;
+      });
+   } bands[LP_MAX_RAST_DOMAINS];
+   unsigned num_bands;
+
+   /** Morton ordered linear bin indices for each band, see LP_PERF */
+   unsigned *bin_order;
+   unsigned bin_order_tiles_x, bin_order_tiles_y, bin_order_bands;
+
+   /** Bins taken from another domain's band / claims that lost a race */
+   unsigned bin_steals, bin_races;
+
    mtx_t mutex;
 
    unsigned num_alloced_tiles;
@@ -226,9 +253,14 @@ bool lp_scene_add_resource_reference(struct lp_scene *scene,
 unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                          const struct pipe_resource *resource);
 
+bool lp_scene_can_overlap(const struct lp_scene *prev,
+                          const struct lp_scene *next);
+
 bool lp_scene_add_frag_shader_reference(struct lp_scene *scene,
                                         struct lp_fragment_shader_variant *variant);
 
+void lp_scene_wait_frag_shaders(const struct lp_scene *scene);
+
 
 
 /**
@@ -396,10 +428,10 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_bands);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned band, int *x, int *y);
 
 
 
@@ -101,6 +101,10 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "morton_tiles",   PERF_MORTON_TILES, NULL },
+   { "no_scene_overlap", PERF_NO_SCENE_OVERLAP, NULL },
+   { "no_fast_clear",  PERF_NO_FAST_CLEAR, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -916,6 +920,9 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
 
+   if (screen->async_fs)
+      util_queue_destroy(&screen->fs_queue);
+
    if (screen->cs_tpool)
       lp_cs_tpool_destroy(screen->cs_tpool);
 
@@ -1110,6 +1117,19 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
    lp_build_init(); /* get lp_native_vector_width initialised */
 
    lp_disk_cache_create(screen);
+
+   if (debug_get_bool_option("LP_ASYNC_FS", false)) {
+      /* Leave a core for the application and the rasterizer threads. */
+      unsigned num_compile_threads =
+         CLAMP(util_get_cpu_caps()->nr_cpus - 1, 1, 4);
+
+      screen->async_fs = util_queue_init(&screen->fs_queue, "lpfs", 64,
+                                         num_compile_threads,
+                                         UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                                         UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY,
+                                         NULL);
+   }
+
    screen->late_init_done = true;
 out:
    mtx_unlock(&screen->late_mutex);
@@ -1169,6 +1189,8 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
    screen->allow_cl = !!getenv("LP_CL");
+   screen->cache_capture_dir = debug_get_option("LP_CACHE_CAPTURE", NULL);
+   screen->cache_warm_dir = debug_get_option("LP_CACHE_WARM", NULL);
    screen->num_threads = util_get_cpu_caps()->nr_cpus > 1
       ? util_get_cpu_caps()->nr_cpus : 0;
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS",
@@ -38,6 +38,7 @@
 #include "pipe/p_defines.h"
 #include "util/u_thread.h"
 #include "util/list.h"
+#include "util/u_queue.h"
 #include "util/vma.h"
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_misc.h"
@@ -75,6 +76,15 @@ struct llvmpipe_screen
 
    struct disk_cache *disk_shader_cache;
 
+   /** See LP_CACHE_CAPTURE and LP_CACHE_WARM */
+   const char *cache_capture_dir;
+   const char *cache_warm_dir;
+   bool cache_warm_started;
+
+   /** Fragment shader variants compiled in the background, see LP_ASYNC_FS */
+   struct util_queue fs_queue;
+   bool async_fs;
+
 #ifdef HAVE_LIBDRM
    int udmabuf_fd;
 #endif
@@ -44,6 +44,7 @@
 #include "draw/draw_pipe.h"
 #include "util/os_time.h"
 #include "lp_context.h"
+#include "lp_fast_clear.h"
 #include "lp_memory.h"
 #include "lp_scene.h"
 #include "lp_texture.h"
@@ -68,12 +69,25 @@ try_update_scene_state(struct lp_setup_context *setup);
 static unsigned
 lp_setup_wait_empty_scene(struct lp_setup_context *setup)
 {
-   /* just use the first scene if we run out */
-   if (setup->scenes[0]->fence) {
-      lp_fence_wait(setup->scenes[0]->fence);
-      lp_scene_end_rasterization(setup->scenes[0]);
+   unsigned oldest = 0;
+
+   /* Wait for the scene that was queued first, the rasterizer finishes
+    * scenes in order so it is the first one to become available.
+    */
+   for (unsigned i = 1; i < setup->num_active_scenes; i++) {
+      if (!setup->scenes[i]->fence)
+         continue;
+      if (!setup->scenes[oldest]->fence ||
+          (int)(setup->scenes[i]->fence->id -
+                setup->scenes[oldest]->fence->id) < 0)
+         oldest = i;
+   }
+
+   if (setup->scenes[oldest]->fence) {
+      lp_fence_wait(setup->scenes[oldest]->fence);
+      lp_scene_end_rasterization(setup->scenes[oldest]);
    }
-   return 0;
+   return oldest;
 }
 
 
@@ -95,9 +109,11 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       }
    }
 
-   if (setup->num_active_scenes + 1 > MAX_SCENES) {
+   if (i < setup->num_active_scenes) {
+      /* found an idle scene above */
+   } else if (setup->num_active_scenes + 1 > MAX_SCENES) {
       i = lp_setup_wait_empty_scene(setup);
-   } else if (i == setup->num_active_scenes) {
+   } else {
       /* allocate a new scene */
       struct lp_scene *scene = lp_scene_create(setup);
       if (!scene) {
@@ -233,6 +249,10 @@ begin_binning(struct lp_setup_context *setup)
    if (!scene->fence)
       return false;
 
+   /* The depth bounds are only known after a depth clear */
+   if (!(setup->clear.flags & PIPE_CLEAR_DEPTH))
+      setup->hiz.valid = false;
+
    if (!try_update_scene_state(setup)) {
       return false;
    }
@@ -516,6 +536,9 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
                                    LP_RAST_OP_CLEAR_ZSTENCIL,
                                    lp_rast_arg_clearzs(zsvalue, zsmask)))
          return false;
+
+      if (flags & PIPE_CLEAR_DEPTH)
+         lp_setup_hiz_clear(setup, depth);
    } else {
       /* Put ourselves into the 'pre-clear' state, specifically to try
        * and accumulate multiple clears to color and depth_stencil
@@ -529,6 +552,9 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
       setup->clear.zsmask |= zsmask;
       setup->clear.zsvalue =
          (setup->clear.zsvalue & ~zsmask) | (zsvalue & zsmask);
+
+      if (flags & PIPE_CLEAR_DEPTH)
+         lp_setup_hiz_clear(setup, depth);
    }
 
    return true;
@@ -548,6 +574,14 @@ lp_setup_clear(struct lp_setup_context *setup,
     * clears again (we still clear tiles twice if a clear command succeeded
     * partially for one buffer).
     */
+   if ((flags & PIPE_CLEAR_DEPTHSTENCIL) && setup->fb.zsbuf)
+      llvmpipe_fast_clear_mark_pending(setup->fb.zsbuf->texture);
+
+   for (unsigned i = 0; i < setup->fb.nr_cbufs; i++) {
+      if ((flags & (PIPE_CLEAR_COLOR0 << i)) && setup->fb.cbufs[i])
+         llvmpipe_fast_clear_mark_pending(setup->fb.cbufs[i]->texture);
+   }
+
    if (flags & PIPE_CLEAR_DEPTHSTENCIL) {
       unsigned flagszs = flags & PIPE_CLEAR_DEPTHSTENCIL;
       if (!lp_setup_try_clear_zs(setup, depth, stencil, flagszs)) {
@@ -1112,6 +1146,9 @@ try_update_scene_state(struct lp_setup_context *setup)
 
          setup->fs.stored = stored;
 
+         if (stored->variant && stored->variant->hiz_invalidate)
+            setup->hiz.valid = false;
+
          /* The scene now references the textures in the rasterization
           * state record.  Note that now.
           */
@@ -1284,6 +1321,8 @@ lp_setup_destroy(struct lp_setup_context *setup)
 
    util_unreference_framebuffer_state(&setup->fb);
 
+   lp_setup_hiz_destroy(setup);
+
    for (unsigned i = 0; i < ARRAY_SIZE(setup->fs.current_tex); i++) {
       struct pipe_resource **res_ptr = &setup->fs.current_tex[i];
       if (*res_ptr)
@@ -38,6 +38,7 @@
 #include "lp_setup.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
+#include "lp_limits.h"
 #include "lp_bld_interp.h"	/* for struct lp_shader_input */
 
 #include "draw/draw_vbuf.h"
@@ -55,9 +56,32 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
+/**
+ * Coarse depth rejection, see lp_setup_hiz.c.
+ */
+struct lp_setup_hiz {
+   bool valid;          /**< zmax bounds the depth buffer in this scene */
+   float margin;        /**< depth buffer precision */
+   unsigned tiles_x;
+   unsigned size;       /**< number of zmax entries allocated */
+   float *zmax;         /**< farthest depth value in each tile */
+};
+
+
+/**
+ * Depth plane of a triangle, for testing it against lp_setup_hiz.
+ */
+struct lp_hiz_plane {
+   float a0, dzdx, dzdy;
+   float err;           /**< bound on the rounding errors */
+   float min_depth;     /**< the depth range fragments may be clamped to */
+   float max_depth;
+   bool update;         /**< whole tiles covered get the triangle's depth */
+};
+
+
+/** Initial number of scenes, see MAX_SCENES for the max */
 #define INITIAL_SCENES 4
-#define MAX_SCENES 64
 
 
 
@@ -172,6 +196,8 @@ struct lp_setup_context
       const struct lp_setup_variant *variant;
    } setup;
 
+   struct lp_setup_hiz hiz;
+
    unsigned dirty;   /**< bitmask of LP_SETUP_NEW_x bits */
 
    void (*point)(struct lp_setup_context *,
@@ -298,7 +324,80 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       bool opaque,
                       const struct u_rect *bbox,
                       int nr_planes,
-                      unsigned scissor_index);
+                      unsigned scissor_index,
+                      const struct lp_hiz_plane *hiz);
+
+void
+lp_setup_hiz_clear(struct lp_setup_context *setup, double depth);
+
+void
+lp_setup_hiz_destroy(struct lp_setup_context *setup);
+
+bool
+lp_setup_hiz_plane(const struct lp_setup_context *setup,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned viewport_index,
+                   struct lp_hiz_plane *plane);
+
+
+/**
+ * Range of the triangle's depth plane over a tile, widened by the
+ * rounding errors.
+ */
+static inline void
+lp_hiz_tile_range(const struct lp_hiz_plane *plane, int tx, int ty,
+                  float *zmin, float *zmax)
+{
+   const float z = plane->a0 +
+                   plane->dzdx * (float)(tx * TILE_SIZE) +
+                   plane->dzdy * (float)(ty * TILE_SIZE);
+   const float ex = plane->dzdx * TILE_SIZE;
+   const float ey = plane->dzdy * TILE_SIZE;
+
+   *zmin = z + MIN2(ex, 0.0f) + MIN2(ey, 0.0f) - plane->err;
+   *zmax = z + MAX2(ex, 0.0f) + MAX2(ey, 0.0f) + plane->err;
+}
+
+
+/**
+ * Would all of the triangle's fragments in the tile fail the depth test?
+ */
+static inline bool
+lp_hiz_reject_tile(const struct lp_setup_context *setup,
+                   const struct lp_hiz_plane *plane, int tx, int ty)
+{
+   const struct lp_setup_hiz *hiz = &setup->hiz;
+   float zmin, zmax;
+
+   lp_hiz_tile_range(plane, tx, ty, &zmin, &zmax);
+
+   /* Clamping can only bring fragments closer down to the far end of the
+    * depth range.
+    */
+   zmin = MIN3(zmin, plane->max_depth, 1.0f);
+
+   return zmin > hiz->zmax[ty * hiz->tiles_x + tx] + hiz->margin;
+}
+
+
+/**
+ * Lower the farthest depth of a tile the triangle covers entirely.
+ */
+static inline void
+lp_hiz_update_tile(struct lp_setup_context *setup,
+                   const struct lp_hiz_plane *plane, int tx, int ty)
+{
+   struct lp_setup_hiz *hiz = &setup->hiz;
+   float *tile_zmax = &hiz->zmax[ty * hiz->tiles_x + tx];
+   float zmin, zmax;
+
+   lp_hiz_tile_range(plane, tx, ty, &zmin, &zmax);
+
+   /* Likewise clamping only pushes fragments up to the near end */
+   zmax = MAX3(zmax, plane->min_depth, 0.0f);
+
+   *tile_zmax = MIN2(*tile_zmax, zmax);
+}
 
 bool
 lp_setup_bin_rectangle(struct lp_setup_context *setup,
@@ -0,0 +1,163 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Coarse depth rejection at binning time.
+ *
+ * For each tile of the scene we keep an upper bound of the depth values in
+ * the depth buffer.  It starts out as the depth clear value, and gets
+ * lowered by triangles which cover a whole tile and write their depth
+ * unconditionally, other than through the depth test.  Triangles with a
+ * LESS or LEQUAL depth test which are entirely behind the bound of a tile
+ * aren't binned for that tile at all, so neither rasterized nor shaded.
+ *
+ * The bounds only hold while depth writes can't move values farther
+ * away, anything else invalidates them until the next depth clear.  They
+ * are not carried over from one scene to the next.
+ */
+
+#include <float.h>
+
+#include "util/format/u_format.h"
+#include "util/u_framebuffer.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+#include "lp_debug.h"
+#include "lp_setup_context.h"
+#include "lp_state_fs.h"
+
+
+/**
+ * The depth buffer has been cleared to the given depth, for the whole
+ * framebuffer.
+ */
+void
+lp_setup_hiz_clear(struct lp_setup_context *setup, double depth)
+{
+   struct lp_setup_hiz *hiz = &setup->hiz;
+   const struct pipe_surface *zsbuf = setup->fb.zsbuf;
+
+   hiz->valid = false;
+
+   if ((LP_PERF & PERF_NO_HIZ) || !zsbuf ||
+       zsbuf->texture->nr_samples > 1 ||
+       util_framebuffer_get_num_layers(&setup->fb) > 1)
+      return;
+
+   /* The state used by the draws binned next is only checked when it
+    * changes.
+    */
+   if (setup->fs.stored && setup->fs.stored->variant &&
+       setup->fs.stored->variant->hiz_invalidate)
+      return;
+
+   const unsigned tiles_x = DIV_ROUND_UP(setup->fb.width, TILE_SIZE);
+   const unsigned tiles_y = DIV_ROUND_UP(setup->fb.height, TILE_SIZE);
+   const unsigned size = tiles_x * tiles_y;
+
+   if (size > hiz->size) {
+      float *zmax = REALLOC(hiz->zmax, hiz->size * sizeof *zmax,
+                            size * sizeof *zmax);
+      if (!zmax)
+         return;
+      hiz->zmax = zmax;
+      hiz->size = size;
+   }
+
+   for (unsigned i = 0; i < size; i++)
+      hiz->zmax[i] = (float)depth;
+
+   /* Fragments are only known to be behind the stored value when they
+    * round to a different one.
+    */
+   const struct util_format_description *desc =
+      util_format_description(zsbuf->format);
+   const int chan = desc->swizzle[0];
+
+   if (chan < 4 && desc->channel[chan].type == UTIL_FORMAT_TYPE_FLOAT) {
+      hiz->margin = 0.0f;
+   } else {
+      const unsigned bits =
+         util_format_get_component_bits(zsbuf->format,
+                                        UTIL_FORMAT_COLORSPACE_ZS, 0);
+      hiz->margin = (float)(1.0 / (double)((1ull << bits) - 1)) +
+                    2.0f * FLT_EPSILON;
+   }
+
+   hiz->tiles_x = tiles_x;
+   hiz->valid = true;
+}
+
+
+void
+lp_setup_hiz_destroy(struct lp_setup_context *setup)
+{
+   FREE(setup->hiz.zmax);
+   setup->hiz.zmax = NULL;
+   setup->hiz.size = 0;
+   setup->hiz.valid = false;
+}
+
+
+/**
+ * Get the depth plane of a triangle whose interpolants have been set up.
+ * \return false if the triangle can't be tested against the tile bounds
+ */
+bool
+lp_setup_hiz_plane(const struct lp_setup_context *setup,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned viewport_index,
+                   struct lp_hiz_plane *plane)
+{
+   const struct lp_fragment_shader_variant *variant =
+      setup->fs.current.variant;
+
+   if (!setup->hiz.valid || !variant->hiz_test)
+      return false;
+
+   const float (*a0)[4] = (const float (*)[4])GET_A0(inputs);
+   const float (*dadx)[4] = (const float (*)[4])GET_DADX(inputs);
+   const float (*dady)[4] = (const float (*)[4])GET_DADY(inputs);
+
+   /* The polygon offset is kept in the X component of the position a0 */
+   plane->a0 = a0[0][2] + a0[0][0];
+   plane->dzdx = dadx[0][2];
+   plane->dzdy = dady[0][2];
+
+   const float extent = MAX2(setup->fb.width, setup->fb.height);
+   plane->err = 8.0f * FLT_EPSILON *
+                (fabsf(a0[0][2]) + fabsf(a0[0][0]) +
+                 (fabsf(plane->dzdx) + fabsf(plane->dzdy)) * extent);
+
+   if (!isfinite(plane->a0) || !isfinite(plane->err))
+      return false;
+
+   plane->min_depth = setup->viewports[viewport_index].min_depth;
+   plane->max_depth = setup->viewports[viewport_index].max_depth;
+   plane->update = variant->hiz_update;
+
+   return true;
+}
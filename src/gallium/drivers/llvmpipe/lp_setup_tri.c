@@ -744,9 +744,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
                                   s_planes, setup->multisample);
    }
 
+   struct lp_hiz_plane hiz;
+   const bool use_hiz = lp_setup_hiz_plane(setup, &tri->inputs,
+                                           viewport_index, &hiz);
+
    return lp_setup_bin_triangle(setup, tri, use_32bits,
                                 check_opaque(setup, v0, v1, v2),
-                                &bbox, nr_planes, viewport_index);
+                                &bbox, nr_planes, viewport_index,
+                                use_hiz ? &hiz : NULL);
 }
 
 /*
@@ -784,7 +789,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                       bool opaque,
                       const struct u_rect *bbox,
                       int nr_planes,
-                      unsigned viewport_index)
+                      unsigned viewport_index,
+                      const struct lp_hiz_plane *hiz)
 {
    struct lp_scene *scene = setup->scene;
    unsigned cmd;
@@ -828,6 +834,11 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
              ix0 == bbox->x1 / TILE_SIZE);
 
+      if (hiz && lp_hiz_reject_tile(setup, hiz, ix0, iy0)) {
+         LP_COUNT(nr_hiz_rejected_64);
+         return true;
+      }
+
       if (nr_planes == 3) {
          if (sz < 4) {
             /* Triangle is contained in a single 4x4 stamp:
@@ -949,6 +960,10 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                if (in)
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
+            } else if (hiz && lp_hiz_reject_tile(setup, hiz, x, y)) {
+               /* behind everything already in the tile */
+               in = true;
+               LP_COUNT(nr_hiz_rejected_64);
             } else if (partial) {
                /* Not trivially accepted by at least one plane -
                 * rasterize/shade partial tile
@@ -972,6 +987,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                in = true;
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y, opaque))
                   goto fail;
+               if (hiz && hiz->update)
+                  lp_hiz_update_tile(setup, hiz, x, y);
             }
 
             /* Iterate cx values across the region: */
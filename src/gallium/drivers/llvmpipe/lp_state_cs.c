@@ -40,9 +40,11 @@
 #include "lp_context.h"
 #include "lp_setup_context.h"
 #include "lp_debug.h"
+#include "lp_fast_clear.h"
 #include "lp_state.h"
 #include "lp_perf.h"
 #include "lp_screen.h"
+#include "lp_warm_cache.h"
 #include "lp_memory.h"
 #include "lp_query.h"
 #include "lp_cs_tpool.h"
@@ -944,6 +946,7 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
       pipe->screen->finalize_nir(pipe->screen, shader->base.ir.nir);
    } else if (templ->ir_type == PIPE_SHADER_IR_NIR) {
       shader->base.ir.nir = (struct nir_shader *)templ->prog;
+      lp_cache_capture_shader(llvmpipe_screen(pipe->screen), templ->prog);
    }
 
    nir = (struct nir_shader *)shader->base.ir.nir;
@@ -1738,6 +1741,7 @@ llvmpipe_launch_grid(struct pipe_context *pipe,
    memset(&job_info, 0, sizeof(job_info));
 
    llvmpipe_cs_update_derived(llvmpipe, info->input);
+   llvmpipe_fast_clear_resolve_bound(llvmpipe, true);
 
    fill_grid_size(pipe, 0, info, job_info.grid_size);
 
@@ -2088,6 +2092,8 @@ llvmpipe_draw_mesh_tasks(struct pipe_context *pipe,
    if (lp->dirty)
       llvmpipe_update_derived(lp);
 
+   llvmpipe_fast_clear_resolve_bound(lp, false);
+
    unsigned draw_count = info->draw_count;
    if (info->indirect && info->indirect_draw_count) {
       struct pipe_transfer *dc_transfer;
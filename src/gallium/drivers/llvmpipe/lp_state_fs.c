@@ -106,6 +106,7 @@
 #include "nir/nir_to_tgsi_info.h"
 
 #include "lp_screen.h"
+#include "lp_warm_cache.h"
 #include "compiler/nir/nir_serialize.h"
 #include "util/mesa-sha1.h"
 
@@ -636,6 +637,7 @@ fs_fb_fetch(const struct lp_build_fs_iface *iface,
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_fragment_shader *shader,
+                 struct nir_shader *nir,
                  const struct lp_fragment_shader_variant_key *key,
                  LLVMBuilderRef builder,
                  struct lp_type type,
@@ -671,7 +673,6 @@ generate_fs_loop(struct gallivm_state *gallivm,
    LLVMValueRef z_out = NULL, s_out = NULL;
    struct lp_build_for_loop_state loop_state, sample_loop_state = {0};
    struct lp_build_mask_context mask;
-   struct nir_shader *nir = shader->base.ir.nir;
    const bool dual_source_blend = key->blend.rt[0].blend_enable &&
                                   util_blend_state_is_dual(&key->blend, 0);
    const bool post_depth_coverage = nir->info.fs.post_depth_coverage;
@@ -3105,15 +3106,14 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
+                  struct nir_shader *nir,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
    assert(partial_mask == RAST_WHOLE ||
           partial_mask == RAST_EDGE_TEST);
 
-   struct nir_shader *nir = shader->base.ir.nir;
    struct gallivm_state *gallivm = variant->gallivm;
    struct lp_fragment_shader_variant_key *key = &variant->key;
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
@@ -3399,7 +3399,7 @@ generate_fragment(struct llvmpipe_context *lp,
       }
 
       generate_fs_loop(gallivm,
-                       shader, key,
+                       shader, nir, key,
                        builder,
                        fs_type,
                        variant->jit_context_type,
@@ -3711,9 +3711,134 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 }
 
 
+/**
+ * Code generation state for a fragment shader variant.  This is either
+ * run directly or, with LP_ASYNC_FS, as a job on the screen's fs_queue.
+ */
+struct lp_fs_compile_job {
+   /* Background compiles may outlive the context, so only the screen is
+    * kept here.
+    */
+   struct llvmpipe_screen *screen;
+   struct lp_fragment_shader_variant *variant;
+   /* The shader's NIR, or a private clone for background compiles */
+   struct nir_shader *nir;
+   struct lp_cached_code cached;
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching;
+   bool linear_pipeline;
+};
+
+
+/**
+ * Generate and compile the LLVM IR for a variant whose key dependent
+ * analysis has already been done by generate_variant().
+ */
+static void
+generate_variant_code(struct lp_fs_compile_job *job)
+{
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader *shader = variant->shader;
+   struct llvmpipe_screen *screen = job->screen;
+   int64_t t0 = os_time_get();
+
+   lp_jit_init_types(variant);
+
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(shader, job->nir, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, job->nir, variant, RAST_WHOLE);
+      }
+   }
+
+   /* If the original fastpath doesn't cover this variant, try the new
+    * code:
+    */
+   if (job->linear_pipeline && variant->jit_linear == NULL) {
+      if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
+          shader->kind == LP_FS_KIND_BLIT_RGB1 ||
+          shader->kind == LP_FS_KIND_LLVM_LINEAR) {
+         llvmpipe_fs_variant_linear_llvm(shader, job->nir, variant);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+#if GALLIVM_USE_ORCJIT
+/* module has been moved into ORCJIT after gallivm_compile_module */
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   gallivm_compile_module(variant->gallivm);
+#else
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+#endif
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST],
+                                 variant->function_name[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+         gallivm_jit_function(variant->gallivm,
+                              variant->function[RAST_WHOLE],
+                              variant->function_name[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+         variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   if (job->linear_pipeline) {
+      if (variant->linear_function) {
+         variant->jit_linear_llvm = (lp_jit_linear_llvm_func)
+            gallivm_jit_function(variant->gallivm, variant->linear_function,
+                                 variant->linear_function_name);
+      }
+
+      /*
+       * This must be done after LLVM compilation, as it will call the JIT'ed
+       * code to determine active inputs.
+       */
+      lp_linear_check_variant(variant);
+   }
+
+   if (job->needs_caching) {
+      lp_disk_cache_insert_shader(screen, &job->cached, job->ir_sha1_cache_key);
+   }
+
+   gallivm_free_ir(variant->gallivm);
+
+   LP_COUNT_ADD(llvm_compile_time, os_time_get() - t0);
+}
+
+
+static void
+generate_variant_code_job(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+
+   generate_variant_code(job);
+
+   ralloc_free(job->nir);
+   FREE(job);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * With LP_ASYNC_FS the code generation is queued on the screen's fs_queue
+ * and the variant is returned before its ready fence has been signalled.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
@@ -3728,32 +3853,51 @@ generate_variant(struct llvmpipe_context *lp,
 
    memset(variant, 0, sizeof(*variant));
 
+   struct lp_fs_compile_job *job = CALLOC_STRUCT(lp_fs_compile_job);
+   if (!job) {
+      FREE(variant);
+      return NULL;
+   }
+
    pipe_reference_init(&variant->reference, 1);
    lp_fs_reference(lp, &variant->shader, shader);
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
    struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-   struct lp_cached_code cached = { 0 };
-   unsigned char ir_sha1_cache_key[20];
-   bool needs_caching = false;
+   job->screen = screen;
+   job->variant = variant;
    if (shader->base.ir.nir) {
-      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+      lp_fs_get_ir_cache_key(variant, job->ir_sha1_cache_key);
 
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
-         needs_caching = true;
+      lp_disk_cache_find_shader(screen, &job->cached, job->ir_sha1_cache_key);
+      if (!job->cached.data_size)
+         job->needs_caching = true;
+   }
+
+   /* Background compiles each need their own LLVM context, the context's
+    * one may only be used by a single thread.
+    */
+   lp_context_ref *context = &lp->context;
+   if (screen->async_fs) {
+      lp_context_create(&variant->context);
+      context = &variant->context;
    }
 
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
             shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
+   variant->gallivm = gallivm_create(module_name, context, &job->cached);
    if (!variant->gallivm) {
+      lp_context_destroy(&variant->context);
+      lp_fs_reference(lp, &variant->shader, NULL);
+      FREE(job);
       FREE(variant);
       return NULL;
    }
 
+   util_queue_fence_init(&variant->ready);
+
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    variant->no = shader->variants_created++;
@@ -3807,6 +3951,41 @@ generate_variant(struct llvmpipe_context *lp,
          shader->info.cbuf[0][3].file != TGSI_FILE_NULL
          ? true : false;
 
+   const bool depth_less = key->depth.func == PIPE_FUNC_LESS ||
+                           key->depth.func == PIPE_FUNC_LEQUAL;
+   bool stencil_keep = true;
+   for (unsigned i = 0; i < 2; i++) {
+      if (key->stencil[i].enabled &&
+          (key->stencil[i].fail_op != PIPE_STENCIL_OP_KEEP ||
+           key->stencil[i].zfail_op != PIPE_STENCIL_OP_KEEP))
+         stencil_keep = false;
+   }
+
+   variant->hiz_test =
+         key->depth.enabled &&
+         depth_less &&
+         stencil_keep &&
+         !key->multisample &&
+         key->zsbuf_nr_samples <= 1 &&
+         !(nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_DEPTH)) &&
+         (!nir->info.writes_memory || nir->info.fs.early_fragment_tests);
+
+   variant->hiz_update =
+         variant->hiz_test &&
+         key->depth.writemask &&
+         !key->stencil[0].enabled &&
+         !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage &&
+         !nir->info.fs.uses_discard &&
+         !(nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_SAMPLE_MASK));
+
+   variant->hiz_invalidate =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         !depth_less &&
+         key->depth.func != PIPE_FUNC_EQUAL &&
+         key->depth.func != PIPE_FUNC_NEVER;
+
    /* We only care about opaque blits for now */
    if (variant->opaque &&
        (shader->kind == LP_FS_KIND_BLIT_RGBA ||
@@ -3864,18 +4043,6 @@ generate_variant(struct llvmpipe_context *lp,
 
    llvmpipe_fs_variant_fastpath(variant);
 
-   lp_jit_init_types(variant);
-
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
    if (linear_pipeline) {
       /* Currently keeping both the old fastpaths and new linear path
        * active.  The older code is still somewhat faster for the cases
@@ -3888,17 +4055,6 @@ generate_variant(struct llvmpipe_context *lp,
           !key->blend.alpha_to_coverage) {
          llvmpipe_fs_variant_linear_fastpath(variant);
       }
-
-      /* If the original fastpath doesn't cover this variant, try the new
-       * code:
-       */
-      if (variant->jit_linear == NULL) {
-         if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
-             shader->kind == LP_FS_KIND_BLIT_RGB1 ||
-             shader->kind == LP_FS_KIND_LLVM_LINEAR) {
-            llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
-         }
-      }
    } else {
       if (LP_DEBUG & DEBUG_LINEAR) {
          lp_debug_fs_variant(variant);
@@ -3906,58 +4062,21 @@ generate_variant(struct llvmpipe_context *lp,
       }
    }
 
-   /*
-    * Compile everything
-    */
-
-#if GALLIVM_USE_ORCJIT
-/* module has been moved into ORCJIT after gallivm_compile_module */
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   gallivm_compile_module(variant->gallivm);
-#else
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-#endif
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST],
-                                 variant->function_name[RAST_EDGE_TEST]);
-   }
+   job->linear_pipeline = linear_pipeline;
 
-   if (variant->function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-         gallivm_jit_function(variant->gallivm,
-                              variant->function[RAST_WHOLE],
-                              variant->function_name[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-         variant->jit_function[RAST_EDGE_TEST];
-   }
-
-   if (linear_pipeline) {
-      if (variant->linear_function) {
-         variant->jit_linear_llvm = (lp_jit_linear_llvm_func)
-            gallivm_jit_function(variant->gallivm, variant->linear_function,
-                                 variant->linear_function_name);
-      }
-
-      /*
-       * This must be done after LLVM compilation, as it will call the JIT'ed
-       * code to determine active inputs.
+   if (screen->async_fs) {
+      /* Code generation runs the NIR prepasses, which modify the shader,
+       * so the job gets its own copy.
        */
-      lp_linear_check_variant(variant);
-   }
-
-   if (needs_caching) {
-      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+      job->nir = nir_shader_clone(NULL, nir);
+      util_queue_add_job(&screen->fs_queue, job, &variant->ready,
+                         generate_variant_code_job, NULL, 0);
+   } else {
+      job->nir = nir;
+      generate_variant_code(job);
+      FREE(job);
    }
 
-   gallivm_free_ir(variant->gallivm);
-
    return variant;
 }
 
@@ -3982,6 +4101,7 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
       shader->base.ir.nir = tgsi_to_nir(templ->tokens, pipe->screen, false);
    } else {
       shader->base.ir.nir = templ->ir.nir;
+      lp_cache_capture_shader(llvmpipe_screen(pipe->screen), templ->ir.nir);
    }
 
    /* lower FRAG_RESULT_COLOR -> DATA[0-7] to correctly handle unused attachments */
@@ -4108,7 +4228,37 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
    /* remove from context's list */
    list_del(&variant->list_item_global.list);
    lp->nr_fs_variants--;
-   lp->nr_fs_instrs -= variant->nr_instrs;
+   if (variant->nr_instrs_counted)
+      lp->nr_fs_instrs -= variant->nr_instrs;
+   else
+      lp->nr_fs_variants_pending--;
+}
+
+
+/**
+ * Count the instructions of the variants whose background compile
+ * finished, so that the eviction limit covers all the generated code and
+ * not only the variants that were looked up again since.
+ */
+static void
+llvmpipe_count_fs_variant_instrs(struct llvmpipe_context *lp)
+{
+   struct lp_fs_variant_list_item *li;
+
+   if (!lp->nr_fs_variants_pending)
+      return;
+
+   LIST_FOR_EACH_ENTRY(li, &lp->fs_variants_list.list, list) {
+      struct lp_fragment_shader_variant *variant = li->base;
+
+      if (!variant->nr_instrs_counted &&
+          util_queue_fence_is_signalled(&variant->ready)) {
+         lp->nr_fs_instrs += variant->nr_instrs;
+         variant->nr_instrs_counted = true;
+         if (--lp->nr_fs_variants_pending == 0)
+            break;
+      }
+   }
 }
 
 
@@ -4116,7 +4266,10 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
+   util_queue_fence_wait(&variant->ready);
+   util_queue_fence_destroy(&variant->ready);
    gallivm_destroy(variant->gallivm);
+   lp_context_destroy(&variant->context);
    lp_fs_reference(lp, &variant->shader, NULL);
    if (variant->function_name[RAST_EDGE_TEST])
       FREE(variant->function_name[RAST_EDGE_TEST]);
@@ -4652,13 +4805,22 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    if (variant) {
+      LP_COUNT(nr_fs_variant_hits);
+
       /* Move this variant to the head of the list to implement LRU
        * deletion of shader's when we have too many.
        */
       list_move_to(&variant->list_item_global.list, &lp->fs_variants_list.list);
    } else {
+      LP_COUNT(nr_fs_variant_misses);
+
       /* variant not found, create it now */
 
+      /* Variants compiled in the background only count towards the
+       * instruction limit once they are done.
+       */
+      llvmpipe_count_fs_variant_instrs(lp);
+
       if (LP_DEBUG & DEBUG_FS) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
                       lp->nr_fs_variants,
@@ -4710,11 +4872,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       /*
        * Generate the new variant.
        */
-      int64_t t0 = os_time_get();
       variant = generate_variant(lp, shader, key);
-      int64_t t1 = os_time_get();
-      int64_t dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
@@ -4722,7 +4880,12 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
          list_add(&variant->list_item_local.list, &shader->variants.list);
          list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
+         if (util_queue_fence_is_signalled(&variant->ready)) {
+            lp->nr_fs_instrs += variant->nr_instrs;
+            variant->nr_instrs_counted = true;
+         } else {
+            lp->nr_fs_variants_pending++;
+         }
          shader->variants_cached++;
       }
    }
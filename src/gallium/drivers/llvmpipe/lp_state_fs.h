@@ -38,9 +38,11 @@
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "lp_jit.h"
 
 struct lp_fragment_shader;
+struct nir_shader;
 
 
 /** Indexes into jit_function[] array */
@@ -150,6 +152,16 @@ struct lp_fragment_shader_variant
 
    unsigned opaque:1;
    unsigned blit:1;
+
+   /*
+    * Coarse depth rejection, see lp_setup_hiz.c: whether primitives may
+    * be dropped from tiles where they'd fail the depth test, whether
+    * covering a whole tile leaves it no farther than the primitive, and
+    * whether depth writes may move values farther away.
+    */
+   unsigned hiz_test:1;
+   unsigned hiz_update:1;
+   unsigned hiz_invalidate:1;
    unsigned linear_input_mask:16;
    struct pipe_reference reference;
 
@@ -186,6 +198,16 @@ struct lp_fragment_shader_variant
 
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
+   bool nr_instrs_counted;
+
+   /* Signalled once the code has been generated, which happens on the
+    * screen's fs_queue with LP_ASYNC_FS.  The rasterizer waits for it
+    * before running a scene using this variant.
+    */
+   struct util_queue_fence ready;
+
+   /* LLVM context for variants compiled on the fs_queue */
+   lp_context_ref context;
 
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
@@ -234,8 +256,8 @@ void
 llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant);
 
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
-                                struct lp_fragment_shader *shader,
+llvmpipe_fs_variant_linear_llvm(struct lp_fragment_shader *shader,
+                                struct nir_shader *nir,
                                 struct lp_fragment_shader_variant *variant);
 
 void
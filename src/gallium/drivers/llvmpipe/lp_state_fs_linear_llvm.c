@@ -125,7 +125,7 @@ emit_fetch_texel_linear(const struct lp_build_sampler_aos *base,
  */
 static LLVMValueRef
 llvm_fragment_body(struct lp_build_context *bld,
-                   struct lp_fragment_shader *shader,
+                   struct nir_shader *nir,
                    struct lp_fragment_shader_variant *variant,
                    struct linear_sampler* sampler,
                    LLVMValueRef *inputs_ptrs,
@@ -144,7 +144,6 @@ llvm_fragment_body(struct lp_build_context *bld,
    LLVMValueRef result = NULL;
    bool rgba_order = (variant->key.cbuf_format[0] == PIPE_FORMAT_R8G8B8A8_UNORM ||
                       variant->key.cbuf_format[0] == PIPE_FORMAT_R8G8B8X8_UNORM);
-   struct nir_shader *nir = shader->base.ir.nir;
    sampler->instance = 0;
 
    /*
@@ -236,15 +235,14 @@ llvm_fragment_body(struct lp_build_context *bld,
  * See lp_state_fs_analysis for the "linear" conditions.
  */
 void
-llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
-                                struct lp_fragment_shader *shader,
+llvmpipe_fs_variant_linear_llvm(struct lp_fragment_shader *shader,
+                                struct nir_shader *nir,
                                 struct lp_fragment_shader_variant *variant)
 {
    assert(shader->kind == LP_FS_KIND_BLIT_RGBA ||
           shader->kind == LP_FS_KIND_BLIT_RGB1 ||
           shader->kind == LP_FS_KIND_LLVM_LINEAR);
 
-   struct nir_shader *nir = shader->base.ir.nir;
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMTypeRef int8t = LLVMInt8TypeInContext(gallivm->context);
    LLVMTypeRef int32t = LLVMInt32TypeInContext(gallivm->context);
@@ -261,8 +259,8 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
    fs_type.length = 16;
 
    if (LP_DEBUG & DEBUG_TGSI) {
-      if (shader->base.ir.nir) {
-         nir_print_shader(shader->base.ir.nir, stderr);
+      if (nir) {
+         nir_print_shader(nir, stderr);
       }
    }
 
@@ -473,7 +471,7 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
                                               loop.counter, 4);
 
       /* Perform fragment shader body */
-      value = llvm_fragment_body(&bld, shader, variant, &sampler, inputs_ptrs,
+      value = llvm_fragment_body(&bld, nir, variant, &sampler, inputs_ptrs,
                                  consts_ptr, blend_color, alpha_ref, fs_type,
                                  value);
 
@@ -519,7 +517,7 @@ llvmpipe_fs_variant_linear_llvm(struct llvmpipe_context *lp,
       buf = LLVMBuildLoad2(gallivm->builder, pixelt, buf_ptr, "");
       buf = LLVMBuildBitCast(builder, buf, bld.vec_type, "");
 
-      result = llvm_fragment_body(&bld, shader, variant, &sampler,
+      result = llvm_fragment_body(&bld, nir, variant, &sampler,
                                   inputs_ptrs, consts_ptr, blend_color,
                                   alpha_ref, fs_type, buf);
       result = LLVMBuildBitCast(builder, result, pixelt, "");
@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
 #include "gallivm/lp_bld_const.h"
@@ -53,6 +54,8 @@
 /** Setup shader number (for debugging) */
 static unsigned setup_no = 0;
 
+static const char *setup_function_base_hash = "5c2fb709d8a40936d55647b3d34bf596f7c5bc12120d94aa21f5db7763b97d66";
+
 
 /* currently organized to interpolate full float[4] attributes even
  * when some elements are unused.  Later, can pack vertex data more
@@ -647,12 +650,32 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   char func_name[64];
-   snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+   /* The setup code only depends on the key. */
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   unsigned char cache_key[SHA1_DIGEST_LENGTH];
+   struct mesa_sha1 hash_ctx;
+   _mesa_sha1_init(&hash_ctx);
+   _mesa_sha1_update(&hash_ctx, setup_function_base_hash,
+                     strlen(setup_function_base_hash));
+   _mesa_sha1_update(&hash_ctx, key, key->size);
+   _mesa_sha1_final(&hash_ctx, cache_key);
+
+   struct lp_cached_code cached = { 0 };
+   lp_disk_cache_find_shader(screen, &cached, cache_key);
+   bool needs_caching = !cached.data_size;
+
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "setup_variant_%u",
             variant->no);
 
+   /* The function name has to be the same in every process for cached
+    * code to be found again.
+    */
+   const char *func_name = "setup_variant";
+
    struct gallivm_state *gallivm;
-   variant->gallivm = gallivm = gallivm_create(func_name, &lp->context, NULL);
+   variant->gallivm = gallivm = gallivm_create(module_name, &lp->context,
+                                               &cached);
    if (!variant->gallivm) {
       goto fail;
    }
@@ -715,21 +738,25 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    lp_build_name(args.dady, "out_dady");
    lp_build_name(args.key, "key");
 
-   /*
-    * Function body
-    */
-   LLVMBasicBlockRef block =
-      LLVMAppendBasicBlockInContext(gallivm->context,
-                                    variant->function, "entry");
-   LLVMPositionBuilderAtEnd(builder, block);
+   if (cached.data_size) {
+      gallivm_stub_func(gallivm, variant->function);
+   } else {
+      /*
+       * Function body
+       */
+      LLVMBasicBlockRef block =
+         LLVMAppendBasicBlockInContext(gallivm->context,
+                                       variant->function, "entry");
+      LLVMPositionBuilderAtEnd(builder, block);
 
-   set_noalias(builder, variant->function, arg_types, ARRAY_SIZE(arg_types));
-   init_args(gallivm, &variant->key, &args);
-   emit_tri_coef(gallivm, &variant->key, &args);
+      set_noalias(builder, variant->function, arg_types, ARRAY_SIZE(arg_types));
+      init_args(gallivm, &variant->key, &args);
+      emit_tri_coef(gallivm, &variant->key, &args);
 
-   LLVMBuildRetVoid(builder);
+      LLVMBuildRetVoid(builder);
 
-   gallivm_verify_function(gallivm, variant->function);
+      gallivm_verify_function(gallivm, variant->function);
+   }
 
    gallivm_compile_module(gallivm);
 
@@ -738,6 +765,9 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   if (needs_caching)
+      lp_disk_cache_insert_shader(screen, &cached, cache_key);
+
    gallivm_free_ir(variant->gallivm);
 
    /*
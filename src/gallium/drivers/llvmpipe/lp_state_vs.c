@@ -35,13 +35,18 @@
 
 #include "lp_context.h"
 #include "lp_debug.h"
+#include "lp_screen.h"
 #include "lp_state.h"
+#include "lp_warm_cache.h"
 
 
 static void *
 llvmpipe_create_vs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
 {
+   if (templ->type == PIPE_SHADER_IR_NIR)
+      lp_cache_capture_shader(llvmpipe_screen(pipe->screen), templ->ir.nir);
+
    llvmpipe_register_shader(pipe, templ);
 
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
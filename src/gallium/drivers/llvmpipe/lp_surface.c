@@ -29,6 +29,7 @@
 #include "util/u_surface.h"
 #include "util/u_memset.h"
 #include "lp_context.h"
+#include "lp_fast_clear.h"
 #include "lp_flush.h"
 #include "lp_limits.h"
 #include "lp_surface.h"
@@ -104,6 +105,10 @@ lp_resource_copy(struct pipe_context *pipe,
                            false, /* do_not_block */
                            "blit src");
 
+   if (llvmpipe_fast_clear_copy(pipe, dst, dst_level, dstx, dsty, dstz,
+                                src, src_level, src_box))
+      return;
+
    if (dst->nr_samples > 1 &&
        (dst->nr_samples == src->nr_samples ||
        (src->nr_samples == 1 && dst->nr_samples > 1))) {
@@ -448,6 +448,13 @@ test_one(unsigned verbose,
    unsigned i, j;
    const unsigned stride = lp_type_width(type)/8;
 
+   /*
+    * The wider types are there to compare the 8 and 16 wide (AVX-512)
+    * code, e.g. with LP_NATIVE_VECTOR_WIDTH=256 vs 512 and -o.
+    */
+   if (lp_type_width(type) > lp_native_vector_width)
+      return true;
+
    if (verbose >= 1)
       dump_blend_type(stdout, blend, type);
 
@@ -625,6 +632,9 @@ const struct lp_type blend_types[] = {
    /* float, fixed,  sign,  norm, width, len */
    {   true, false,  true, false,    32,   4 }, /* f32 x 4 */
    {  false, false, false,  true,     8,  16 }, /* u8n x 16 */
+   /* only run when they fit lp_native_vector_width, see test_one() */
+   {   true, false,  true, false,    32,   8 }, /* f32 x 8 */
+   {   true, false,  true, false,    32,  16 }, /* f32 x 16 */
 };
 
 
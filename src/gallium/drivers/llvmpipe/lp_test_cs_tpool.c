@@ -0,0 +1,188 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Compute thread pool scaling test.
+ *
+ * Dispatches a grid of fake workgroups through lp_cs_tpool with both a
+ * uniform and a skewed per-workgroup cost, checks every workgroup ran
+ * exactly once and reports the wall time for each thread count.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_test.h"
+
+
+struct cs_tpool_test_case {
+   const char *name;
+   unsigned num_iters;
+   /* every skew_period'th workgroup costs skew_factor times more */
+   unsigned skew_period;
+   unsigned skew_factor;
+};
+
+static const struct cs_tpool_test_case test_cases[] = {
+   { "uniform", 4096, 0, 1 },
+   { "skewed", 4096, 64, 64 },
+   { "front-loaded", 4096, 1, 1 },
+};
+
+struct cs_tpool_test_job {
+   const struct cs_tpool_test_case *testcase;
+   unsigned *executed;
+};
+
+
+static unsigned
+workgroup_cost(const struct cs_tpool_test_case *testcase, unsigned iter)
+{
+   if (testcase->skew_period == 1) {
+      /* All the work sits in the first eighth of the grid. */
+      return iter < testcase->num_iters / 8 ? 64 : 1;
+   }
+   if (testcase->skew_period && (iter % testcase->skew_period) == 0)
+      return testcase->skew_factor;
+   return 1;
+}
+
+
+static void
+cs_tpool_test_work(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct cs_tpool_test_job *job = data;
+   unsigned cost = workgroup_cost(job->testcase, iter_idx);
+   volatile unsigned x = iter_idx;
+
+   for (unsigned i = 0; i < cost * 2000; i++)
+      x = x * 1664525u + 1013904223u;
+
+   p_atomic_inc(&job->executed[iter_idx]);
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "threads\t"
+           "ms\t"
+           "case\n");
+
+   fflush(fp);
+}
+
+
+static bool
+test_cs_tpool(unsigned verbose, FILE *fp,
+              const struct cs_tpool_test_case *testcase,
+              unsigned num_threads)
+{
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(num_threads);
+   struct cs_tpool_test_job job;
+   struct lp_cs_tpool_task *task;
+   bool success = true;
+
+   if (!pool)
+      return false;
+
+   job.testcase = testcase;
+   job.executed = CALLOC(testcase->num_iters, sizeof(*job.executed));
+
+   int64_t start = os_time_get_nano();
+   task = lp_cs_tpool_queue_task(pool, cs_tpool_test_work, &job,
+                                 testcase->num_iters);
+   lp_cs_tpool_wait_for_task(pool, &task);
+   int64_t end = os_time_get_nano();
+
+   for (unsigned i = 0; i < testcase->num_iters; i++) {
+      if (job.executed[i] != 1) {
+         success = false;
+         break;
+      }
+   }
+
+   double ms = (end - start) / 1000000.0;
+
+   if (!success || verbose >= 1) {
+      printf("%s: %u threads, %.3f ms %s\n", testcase->name, num_threads, ms,
+             success ? "" : "FAILED");
+      fflush(stdout);
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\t%f\t%s\n", success ? "pass" : "fail",
+              num_threads, ms, testcase->name);
+      fflush(fp);
+   }
+
+   FREE(job.executed);
+   lp_cs_tpool_destroy(pool);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   unsigned max_threads = MIN2(util_get_cpu_caps()->nr_cpus, LP_MAX_THREADS);
+   bool success = true;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(test_cases); i++) {
+      for (unsigned t = 1; t <= max_threads; t *= 2) {
+         if (!test_cs_tpool(verbose, fp, &test_cases[i], t))
+            success = false;
+      }
+      if (!util_is_power_of_two_nonzero(max_threads) &&
+          !test_cs_tpool(verbose, fp, &test_cases[i], max_threads))
+         success = false;
+   }
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_cs_tpool(verbose, fp, &test_cases[1],
+                        MIN2(util_get_cpu_caps()->nr_cpus, LP_MAX_THREADS));
+}
@@ -49,6 +49,7 @@
 #endif
 
 #include "lp_context.h"
+#include "lp_fast_clear.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
@@ -321,6 +322,8 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
          if (!llvmpipe_texture_layout(screen, lpr, alloc_backing))
             goto fail;
 
+         llvmpipe_fast_clear_init(lpr);
+
          if (templat->flags & PIPE_RESOURCE_FLAG_SPARSE) {
 #if DETECT_OS_LINUX
             lpr->tex_data = os_mmap(NULL, lpr->size_required, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_SHARED,
@@ -582,6 +585,8 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
 
    free(lpr->residency);
 
+   llvmpipe_fast_clear_fini(lpr);
+
 #if MESA_DEBUG
    simple_mtx_lock(&resource_list_mutex);
    if (!list_is_empty(&lpr->list))
@@ -797,6 +802,8 @@ llvmpipe_resource_get_handle(struct pipe_screen *_screen,
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *lpr = llvmpipe_resource(pt);
 
+   llvmpipe_fast_clear_disable(ctx, pt);
+
 #ifdef HAVE_LINUX_UDMABUF_H
    if (!lpr->dt && whandle->type == WINSYS_HANDLE_TYPE_FD) {
       if (!lpr->dmabuf_alloc) {
@@ -921,6 +928,19 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       }
    }
 
+   /*
+    * Memory mapped unsynchronized or persistently is accessed while scenes
+    * may be rendering to it, so stop deferring clears of the resource
+    * instead of waiting for them.
+    */
+   if (usage & (PIPE_MAP_UNSYNCHRONIZED | PIPE_MAP_PERSISTENT))
+      llvmpipe_fast_clear_disable((usage & PIPE_MAP_UNSYNCHRONIZED) ?
+                                  NULL : pipe, resource);
+   else if (usage & PIPE_MAP_DISCARD_WHOLE_RESOURCE)
+      llvmpipe_fast_clear_discard(resource);
+   else
+      llvmpipe_fast_clear_resolve(pipe, resource);
+
    /* Check if we're mapping a current constant buffer */
    if ((usage & PIPE_MAP_WRITE) &&
        (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
@@ -115,6 +115,9 @@ struct llvmpipe_resource
    bool backable;
    bool imported_memory;
    bool dmabuf;
+
+   /** Per-tile fast clear state, for render targets which can use it */
+   struct lp_fast_clear *fast_clear;
 #if MESA_DEBUG
    struct list_head list;
 #endif
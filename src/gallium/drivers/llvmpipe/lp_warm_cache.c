@@ -0,0 +1,558 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Shader cache warming.
+ *
+ * With LP_CACHE_CAPTURE=<dir>, every NIR shader a frontend hands to
+ * llvmpipe is serialized into <dir>, as it is before llvmpipe touches it.
+ *
+ * With LP_CACHE_WARM=<dir>, the first context created on the screen
+ * compiles every shader captured in <dir> for a set of common pipeline
+ * states, so that the fragment, setup, vertex and compute code ends up in
+ * the on-disk shader cache.
+ *
+ * The warming runs inside the driver that will later look the code up, so
+ * the cache is keyed by the build id of that same binary and any rebuild,
+ * committed or not, gets a fresh cache.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/detect_os.h"
+
+#if !DETECT_OS_WINDOWS
+#include <dirent.h>
+#endif
+
+#include "compiler/nir/nir.h"
+#include "compiler/nir/nir_serialize.h"
+#include "cso_cache/cso_context.h"
+#include "pipe/p_context.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_from_mesa.h"
+#include "util/blob.h"
+#include "util/disk_cache.h"
+#include "util/log.h"
+#include "util/mesa-sha1.h"
+#include "util/os_file.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_draw_quad.h"
+#include "util/u_inlines.h"
+#include "util/u_sampler.h"
+#include "util/u_simple_shaders.h"
+#include "util/u_surface.h"
+
+#include "lp_screen.h"
+#include "lp_warm_cache.h"
+
+
+#define WARM_SIZE 64
+
+struct warm_state {
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct cso_context *cso;
+
+   struct pipe_surface *cbufs[2];
+   struct pipe_surface *zsbuf;
+   struct pipe_sampler_view *view;
+   struct pipe_resource *constbuf;
+
+   void *passthrough_vs;
+   void *passthrough_fs;
+
+   unsigned num_shaders;
+   unsigned num_skipped;
+   unsigned num_failed;
+};
+
+
+#if !DETECT_OS_WINDOWS
+
+void
+lp_cache_capture_shader(struct llvmpipe_screen *screen,
+                        const struct nir_shader *nir)
+{
+   if (!screen->cache_capture_dir)
+      return;
+
+   struct blob blob;
+   blob_init(&blob);
+   blob_write_uint32(&blob, nir->info.stage);
+   nir_serialize(&blob, nir, false);
+
+   if (blob.out_of_memory) {
+      blob_finish(&blob);
+      return;
+   }
+
+   unsigned char sha1[20];
+   char sha1_str[41];
+   _mesa_sha1_compute(blob.data, blob.size, sha1);
+   _mesa_sha1_format(sha1_str, sha1);
+
+   char path[PATH_MAX];
+   snprintf(path, sizeof(path), "%s/%s.nir", screen->cache_capture_dir,
+            sha1_str);
+
+   /* The same shader is often created again, keep the first copy. */
+   FILE *f = fopen(path, "wbx");
+   if (f) {
+      fwrite(blob.data, 1, blob.size, f);
+      fclose(f);
+   }
+
+   blob_finish(&blob);
+}
+
+
+static const enum pipe_format cbuf_formats[] = {
+   PIPE_FORMAT_B8G8R8A8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+};
+
+
+static struct pipe_surface *
+create_surface(struct warm_state *state, enum pipe_format format,
+               unsigned bind)
+{
+   struct pipe_resource templ = {0};
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = format;
+   templ.width0 = WARM_SIZE;
+   templ.height0 = WARM_SIZE;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = bind;
+
+   struct pipe_resource *tex =
+      state->screen->resource_create(state->screen, &templ);
+   if (!tex)
+      return NULL;
+
+   struct pipe_surface surf_templ;
+   u_surface_default_template(&surf_templ, tex);
+   struct pipe_surface *surf =
+      state->pipe->create_surface(state->pipe, tex, &surf_templ);
+   pipe_resource_reference(&tex, NULL);
+   return surf;
+}
+
+
+static bool
+init_state(struct warm_state *state)
+{
+   state->pipe = state->screen->context_create(state->screen, NULL, 0);
+   if (!state->pipe)
+      return false;
+
+   state->cso = cso_create_context(state->pipe, 0);
+   if (!state->cso)
+      return false;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(cbuf_formats); i++) {
+      state->cbufs[i] = create_surface(state, cbuf_formats[i],
+                                       PIPE_BIND_RENDER_TARGET);
+      if (!state->cbufs[i])
+         return false;
+   }
+
+   state->zsbuf = create_surface(state, PIPE_FORMAT_Z24_UNORM_S8_UINT,
+                                 PIPE_BIND_DEPTH_STENCIL);
+   if (!state->zsbuf)
+      return false;
+
+   struct pipe_resource templ = {0};
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+   templ.width0 = templ.height0 = 4;
+   templ.depth0 = templ.array_size = 1;
+   templ.bind = PIPE_BIND_SAMPLER_VIEW;
+   struct pipe_resource *tex =
+      state->screen->resource_create(state->screen, &templ);
+   if (!tex)
+      return false;
+
+   struct pipe_sampler_view view_templ;
+   u_sampler_view_default_template(&view_templ, tex, tex->format);
+   state->view = state->pipe->create_sampler_view(state->pipe, tex,
+                                                  &view_templ);
+   pipe_resource_reference(&tex, NULL);
+
+   state->constbuf = pipe_buffer_create(state->screen,
+                                        PIPE_BIND_CONSTANT_BUFFER,
+                                        PIPE_USAGE_DEFAULT, 65536);
+   if (!state->view || !state->constbuf)
+      return false;
+
+   const enum tgsi_semantic names[] = { TGSI_SEMANTIC_POSITION,
+                                        TGSI_SEMANTIC_GENERIC };
+   const unsigned indices[] = { 0, 0 };
+   state->passthrough_vs =
+      util_make_vertex_passthrough_shader(state->pipe, 2, names, indices,
+                                          false);
+   state->passthrough_fs =
+      util_make_fragment_passthrough_shader(state->pipe,
+                                            TGSI_SEMANTIC_GENERIC,
+                                            TGSI_INTERPOLATE_PERSPECTIVE,
+                                            true);
+
+   struct pipe_rasterizer_state rs = {0};
+   rs.half_pixel_center = 1;
+   rs.depth_clip_near = rs.depth_clip_far = 1;
+   cso_set_rasterizer(state->cso, &rs);
+
+   struct pipe_viewport_state vp = {
+      .scale = { WARM_SIZE / 2.0f, WARM_SIZE / 2.0f, 0.5f },
+      .translate = { WARM_SIZE / 2.0f, WARM_SIZE / 2.0f, 0.5f },
+   };
+   cso_set_viewport(state->cso, &vp);
+
+   return true;
+}
+
+
+static void
+fini_state(struct warm_state *state)
+{
+   if (state->pipe) {
+      state->pipe->bind_vs_state(state->pipe, NULL);
+      state->pipe->bind_fs_state(state->pipe, NULL);
+      if (state->passthrough_vs)
+         state->pipe->delete_vs_state(state->pipe, state->passthrough_vs);
+      if (state->passthrough_fs)
+         state->pipe->delete_fs_state(state->pipe, state->passthrough_fs);
+      pipe_sampler_view_reference(&state->view, NULL);
+      for (unsigned i = 0; i < ARRAY_SIZE(state->cbufs); i++)
+         pipe_surface_reference(&state->cbufs[i], NULL);
+      pipe_surface_reference(&state->zsbuf, NULL);
+      pipe_resource_reference(&state->constbuf, NULL);
+   }
+   if (state->cso)
+      cso_destroy_context(state->cso);
+   if (state->pipe)
+      state->pipe->destroy(state->pipe);
+}
+
+
+/**
+ * Bind the same dummy constant buffer, texture and sampler to every slot
+ * the shader uses, so the code only varies by the shader itself.
+ */
+static void
+bind_resources(struct warm_state *state, enum pipe_shader_type stage,
+               const struct nir_shader *nir)
+{
+   struct pipe_constant_buffer cb = {
+      .buffer = state->constbuf,
+      .buffer_size = state->constbuf->width0,
+   };
+   for (unsigned i = 0; i <= MIN2(nir->info.num_ubos, PIPE_MAX_CONSTANT_BUFFERS - 1); i++)
+      state->pipe->set_constant_buffer(state->pipe, stage, i, false, &cb);
+
+   unsigned num_views = BITSET_LAST_BIT(nir->info.textures_used);
+   unsigned num_samplers = BITSET_LAST_BIT(nir->info.samplers_used);
+   struct pipe_sampler_view *views[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   const struct pipe_sampler_state *samplers[PIPE_MAX_SAMPLERS];
+   struct pipe_sampler_state sampler = {0};
+   sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+
+   for (unsigned i = 0; i < num_views; i++)
+      views[i] = state->view;
+   for (unsigned i = 0; i < num_samplers; i++)
+      samplers[i] = &sampler;
+
+   if (num_views)
+      state->pipe->set_sampler_views(state->pipe, stage, 0, num_views, 0,
+                                     false, views);
+   if (num_samplers)
+      cso_set_samplers(state->cso, stage, num_samplers, samplers);
+}
+
+
+static void
+draw_triangle(struct warm_state *state, unsigned num_attribs)
+{
+   float verts[3][PIPE_MAX_ATTRIBS][4] = {0};
+   const float pos[3][2] = { { -1, -1 }, { 1, -1 }, { -1, 1 } };
+
+   for (unsigned v = 0; v < 3; v++) {
+      verts[v][0][0] = pos[v][0];
+      verts[v][0][1] = pos[v][1];
+      verts[v][0][3] = 1.0f;
+   }
+
+   struct cso_velems_state ve = {0};
+   ve.count = num_attribs;
+   for (unsigned i = 0; i < num_attribs; i++) {
+      ve.velems[i].src_offset = i * 4 * sizeof(float);
+      ve.velems[i].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+      ve.velems[i].src_stride = sizeof(verts[0]);
+   }
+
+   util_draw_user_vertices(state->cso, &ve, verts, MESA_PRIM_TRIANGLES, 3);
+}
+
+
+static void
+warm_fragment_shader(struct warm_state *state, void *fs,
+                     const struct nir_shader *nir)
+{
+   state->pipe->bind_vs_state(state->pipe, state->passthrough_vs);
+   state->pipe->bind_fs_state(state->pipe, fs);
+   bind_resources(state, PIPE_SHADER_FRAGMENT, nir);
+
+   for (unsigned c = 0; c < ARRAY_SIZE(cbuf_formats); c++) {
+      for (unsigned depth = 0; depth < 2; depth++) {
+         struct pipe_framebuffer_state fb = {0};
+         fb.width = fb.height = WARM_SIZE;
+         fb.nr_cbufs = 1;
+         fb.cbufs[0] = state->cbufs[c];
+         fb.zsbuf = depth ? state->zsbuf : NULL;
+         cso_set_framebuffer(state->cso, &fb);
+
+         struct pipe_depth_stencil_alpha_state dsa = {0};
+         dsa.depth_enabled = depth;
+         dsa.depth_writemask = depth;
+         dsa.depth_func = PIPE_FUNC_LESS;
+         cso_set_depth_stencil_alpha(state->cso, &dsa);
+
+         for (unsigned blend_enable = 0; blend_enable < 2; blend_enable++) {
+            struct pipe_blend_state blend = {0};
+            blend.rt[0].colormask = PIPE_MASK_RGBA;
+            if (blend_enable) {
+               blend.rt[0].blend_enable = 1;
+               blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+               blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+               blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+               blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+               blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+               blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+            }
+            cso_set_blend(state->cso, &blend);
+
+            draw_triangle(state, 2);
+         }
+      }
+   }
+}
+
+
+static void
+warm_vertex_shader(struct warm_state *state, void *vs,
+                   const struct nir_shader *nir)
+{
+   state->pipe->bind_vs_state(state->pipe, vs);
+   state->pipe->bind_fs_state(state->pipe, state->passthrough_fs);
+   bind_resources(state, PIPE_SHADER_VERTEX, nir);
+
+   struct pipe_framebuffer_state fb = {0};
+   fb.width = fb.height = WARM_SIZE;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = state->cbufs[0];
+   cso_set_framebuffer(state->cso, &fb);
+
+   struct pipe_depth_stencil_alpha_state dsa = {0};
+   cso_set_depth_stencil_alpha(state->cso, &dsa);
+
+   struct pipe_blend_state blend = {0};
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   cso_set_blend(state->cso, &blend);
+
+   const unsigned num_inputs = util_bitcount64(nir->info.inputs_read);
+   draw_triangle(state, CLAMP(num_inputs, 1, PIPE_MAX_ATTRIBS));
+}
+
+
+static void
+warm_compute_shader(struct warm_state *state, void *cs,
+                    const struct nir_shader *nir)
+{
+   state->pipe->bind_compute_state(state->pipe, cs);
+   bind_resources(state, PIPE_SHADER_COMPUTE, nir);
+
+   /* An empty grid compiles the variant without running it. */
+   struct pipe_grid_info grid = {0};
+   grid.work_dim = 1;
+   grid.block[0] = grid.block[1] = grid.block[2] = 1;
+   state->pipe->launch_grid(state->pipe, &grid);
+}
+
+
+static bool
+warm_shader(struct warm_state *state, const char *path)
+{
+   size_t size;
+   char *data = os_read_file(path, &size);
+   if (!data) {
+      mesa_logw("llvmpipe: %s: failed to read", path);
+      return false;
+   }
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, data, size);
+   const gl_shader_stage stage = blob_read_uint32(&reader);
+   nir_shader *nir = NULL;
+   if (!reader.overrun && stage < MESA_SHADER_STAGES) {
+      const struct nir_shader_compiler_options *options =
+         state->screen->get_compiler_options(state->screen,
+                                             PIPE_SHADER_IR_NIR,
+                                             pipe_shader_type_from_mesa(stage));
+      nir = nir_deserialize(NULL, options, &reader);
+   }
+   free(data);
+
+   if (!nir || nir->info.stage != stage) {
+      mesa_logw("llvmpipe: %s: not a captured shader", path);
+      ralloc_free(nir);
+      return false;
+   }
+
+   /* Anything besides constants and textures would have to be bound
+    * to real memory before the vertex or compute code may run.
+    */
+   if (stage != MESA_SHADER_FRAGMENT &&
+       (nir->info.num_images || nir->info.num_ssbos || nir->info.num_abos)) {
+      ralloc_free(nir);
+      state->num_skipped++;
+      return true;
+   }
+
+   /* The state objects take ownership of the NIR. */
+   struct pipe_shader_state templ = {0};
+   templ.type = PIPE_SHADER_IR_NIR;
+   templ.ir.nir = nir;
+
+   switch (stage) {
+   case MESA_SHADER_FRAGMENT: {
+      void *fs = state->pipe->create_fs_state(state->pipe, &templ);
+      warm_fragment_shader(state, fs, nir);
+      state->pipe->bind_fs_state(state->pipe, NULL);
+      state->pipe->delete_fs_state(state->pipe, fs);
+      break;
+   }
+   case MESA_SHADER_VERTEX: {
+      void *vs = state->pipe->create_vs_state(state->pipe, &templ);
+      warm_vertex_shader(state, vs, nir);
+      state->pipe->bind_vs_state(state->pipe, NULL);
+      state->pipe->delete_vs_state(state->pipe, vs);
+      break;
+   }
+   case MESA_SHADER_COMPUTE: {
+      struct pipe_compute_state cs_templ = {0};
+      cs_templ.ir_type = PIPE_SHADER_IR_NIR;
+      cs_templ.prog = nir;
+      void *cs = state->pipe->create_compute_state(state->pipe, &cs_templ);
+      warm_compute_shader(state, cs, nir);
+      state->pipe->bind_compute_state(state->pipe, NULL);
+      state->pipe->delete_compute_state(state->pipe, cs);
+      break;
+   }
+   default:
+      ralloc_free(nir);
+      state->num_skipped++;
+      return true;
+   }
+
+   /* Fragment variants referenced by pending scenes are only freed once
+    * those have been rasterized.
+    */
+   state->pipe->flush(state->pipe, NULL, 0);
+
+   state->num_shaders++;
+   return true;
+}
+
+
+void
+lp_cache_warm(struct llvmpipe_screen *screen)
+{
+   /* Contexts created while warming must not start over. */
+   if (!screen->cache_warm_dir || !screen->disk_shader_cache ||
+       p_atomic_xchg(&screen->cache_warm_started, true))
+      return;
+
+   struct warm_state state = {0};
+   state.screen = &screen->base;
+
+   DIR *dir = opendir(screen->cache_warm_dir);
+   if (!dir) {
+      mesa_logw("llvmpipe: %s: failed to open", screen->cache_warm_dir);
+      return;
+   }
+
+   if (!init_state(&state)) {
+      mesa_logw("llvmpipe: failed to create a context to warm the cache");
+      fini_state(&state);
+      closedir(dir);
+      return;
+   }
+
+   int64_t start = os_time_get_nano();
+
+   struct dirent *entry;
+   while ((entry = readdir(dir))) {
+      const char *ext = strrchr(entry->d_name, '.');
+      if (!ext || strcmp(ext, ".nir") != 0)
+         continue;
+
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%s/%s", screen->cache_warm_dir,
+               entry->d_name);
+      if (!warm_shader(&state, path))
+         state.num_failed++;
+   }
+   closedir(dir);
+
+   fini_state(&state);
+#ifdef ENABLE_SHADER_CACHE
+   disk_cache_wait_for_idle(screen->disk_shader_cache);
+#endif
+
+   mesa_logi("llvmpipe: warmed the shader cache with %u shaders "
+             "(%u skipped, %u failed) in %.2f s",
+             state.num_shaders, state.num_skipped, state.num_failed,
+             (os_time_get_nano() - start) / 1e9);
+}
+
+#else
+
+void
+lp_cache_capture_shader(struct llvmpipe_screen *screen,
+                        const struct nir_shader *nir)
+{
+}
+
+void
+lp_cache_warm(struct llvmpipe_screen *screen)
+{
+}
+
+#endif
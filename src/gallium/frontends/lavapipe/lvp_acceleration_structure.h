@@ -72,9 +72,17 @@ struct lvp_bvh_instance_node {
    lvp_mat3x4 otw_matrix;
 };
 
+/* Number of children of an internal node. */
+#define LVP_BVH_WIDTH 4
+
 struct lvp_bvh_box_node {
-   lvp_aabb bounds[2];
-   uint32_t children[2];
+   /* The bounds of the children, transposed so that the same coordinate of
+    * all children can be loaded and tested at once. Unused children are
+    * LVP_BVH_INVALID_NODE and come last.
+    */
+   float min[3][LVP_BVH_WIDTH];
+   float max[3][LVP_BVH_WIDTH];
+   uint32_t children[LVP_BVH_WIDTH];
 };
 
 struct lvp_bvh_header {
@@ -101,8 +109,35 @@ struct lvp_accel_struct_serialization_header {
 #define LVP_BVH_ROOT_NODE        (LVP_BVH_ROOT_NODE_OFFSET | lvp_bvh_node_internal)
 #define LVP_BVH_INVALID_NODE     0xFFFFFFFF
 
+/* Maximum number of internal nodes from the root to a leaf, enough for
+ * maxPrimitiveCount leaves. Traversal pushes all but one child of a node,
+ * so its stack has room for a TLAS and a BLAS of that depth.
+ */
+#define LVP_BVH_MAX_DEPTH        12
+#define LVP_BVH_STACK_SIZE       (LVP_BVH_MAX_DEPTH * (LVP_BVH_WIDTH - 1) * 2)
+
+void
+lvp_get_bvh_build_sizes(const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                        const uint32_t *max_primitive_counts,
+                        VkAccelerationStructureBuildSizesInfoKHR *sizes);
+
 void
 lvp_build_acceleration_structure(VkAccelerationStructureBuildGeometryInfoKHR *info,
                                  const VkAccelerationStructureBuildRangeInfoKHR *ranges);
 
+/* Returns the thread pool of the BVH builder, or NULL on single cpu
+ * systems. It is created the first time this is called.
+ */
+struct util_queue *
+lvp_get_bvh_build_queue(void);
+
+/* Builds the BVH of info into dst, using the scratch memory, with the jobs
+ * of queue if it isn't NULL.
+ */
+void
+lvp_build_bvh(void *dst, uint64_t size, void *scratch,
+              const VkAccelerationStructureBuildGeometryInfoKHR *info,
+              const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+              struct util_queue *queue);
+
 #endif
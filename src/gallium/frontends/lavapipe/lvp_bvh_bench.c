@@ -0,0 +1,395 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Builds the BVH of a mesh in each of the build modes and traces primary
+ * rays through it, with a C version of lvp_build_ray_traversal().
+ *
+ *   lvp_bvh_bench [mesh.obj]
+ *
+ * Without a mesh, a torus knot is used. The triangles are shuffled first,
+ * like a triangle soup. For each mode it prints the build time, the rays
+ * per second and the nodes visited per ray, and a checksum of the hits
+ * which only changes between modes on ties.
+ */
+
+#include <float.h>
+#include <stdio.h>
+
+#include "lvp_acceleration_structure.h"
+
+#include "util/os_time.h"
+#include "util/u_dynarray.h"
+
+#define RAYS_X 512
+#define RAYS_Y 512
+#define BUILD_RUNS 3
+
+struct mesh {
+   struct util_dynarray vertices; /* float[3] */
+   struct util_dynarray indices;  /* uint32_t[3] */
+};
+
+static void
+torus_knot(struct mesh *mesh)
+{
+   const unsigned segments = 2048, sides = 64;
+   const float tube = 0.35f;
+
+   for (unsigned i = 0; i < segments; i++) {
+      float c[2][3];
+      for (unsigned k = 0; k < 2; k++) {
+         float t = (i + k * 0.01f) * 2.0f * M_PI / segments;
+         float r = cosf(3.0f * t) + 2.0f;
+         c[k][0] = r * cosf(2.0f * t);
+         c[k][1] = r * sinf(2.0f * t);
+         c[k][2] = -sinf(3.0f * t);
+      }
+
+      float tangent[3], normal[3], binormal[3];
+      for (unsigned k = 0; k < 3; k++) {
+         tangent[k] = c[1][k] - c[0][k];
+         normal[k] = c[1][k] + c[0][k];
+      }
+      binormal[0] = tangent[1] * normal[2] - tangent[2] * normal[1];
+      binormal[1] = tangent[2] * normal[0] - tangent[0] * normal[2];
+      binormal[2] = tangent[0] * normal[1] - tangent[1] * normal[0];
+      normal[0] = binormal[1] * tangent[2] - binormal[2] * tangent[1];
+      normal[1] = binormal[2] * tangent[0] - binormal[0] * tangent[2];
+      normal[2] = binormal[0] * tangent[1] - binormal[1] * tangent[0];
+
+      float nl = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      float bl = sqrtf(binormal[0] * binormal[0] + binormal[1] * binormal[1] +
+                       binormal[2] * binormal[2]);
+
+      for (unsigned j = 0; j < sides; j++) {
+         float a = j * 2.0f * M_PI / sides;
+         float *v = util_dynarray_grow(&mesh->vertices, float, 3);
+         for (unsigned k = 0; k < 3; k++) {
+            v[k] = c[0][k] + tube * (cosf(a) * normal[k] / nl + sinf(a) * binormal[k] / bl);
+         }
+
+         uint32_t i1 = (i + 1) % segments, j1 = (j + 1) % sides;
+         uint32_t quad[6] = {
+            i * sides + j, i1 * sides + j, i1 * sides + j1,
+            i * sides + j, i1 * sides + j1, i * sides + j1,
+         };
+         memcpy(util_dynarray_grow(&mesh->indices, uint32_t, 6), quad, sizeof(quad));
+      }
+   }
+}
+
+/* Only the positions and faces, which are triangulated as fans. */
+static bool
+load_obj(struct mesh *mesh, const char *path)
+{
+   FILE *f = fopen(path, "r");
+   if (!f)
+      return false;
+
+   char line[1024];
+   while (fgets(line, sizeof(line), f)) {
+      if (line[0] == 'v' && line[1] == ' ') {
+         float *v = util_dynarray_grow(&mesh->vertices, float, 3);
+         if (sscanf(line + 2, "%f %f %f", &v[0], &v[1], &v[2]) != 3)
+            v[0] = v[1] = v[2] = 0.0f;
+      } else if (line[0] == 'f' && line[1] == ' ') {
+         const uint32_t vertex_count = util_dynarray_num_elements(&mesh->vertices, float) / 3;
+         uint32_t face[3], n = 0;
+         char *tok = strtok(line + 2, " \t\r\n");
+
+         for (; tok; tok = strtok(NULL, " \t\r\n")) {
+            long index = strtol(tok, NULL, 10);
+            index = index < 0 ? vertex_count + index : index - 1;
+            if (index < 0 || index >= vertex_count)
+               break;
+
+            face[MIN2(n, 2)] = index;
+            if (++n >= 3) {
+               memcpy(util_dynarray_grow(&mesh->indices, uint32_t, 3), face, sizeof(face));
+               face[1] = face[2];
+            }
+         }
+      }
+   }
+
+   fclose(f);
+   return util_dynarray_num_elements(&mesh->indices, uint32_t) > 0;
+}
+
+static void
+shuffle_triangles(struct mesh *mesh)
+{
+   uint32_t (*tris)[3] = mesh->indices.data;
+   uint32_t count = util_dynarray_num_elements(&mesh->indices, uint32_t) / 3;
+   uint64_t state = 0x9e3779b97f4a7c15ull;
+
+   for (uint32_t i = count - 1; i > 0; i--) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+
+      uint32_t j = state % (i + 1);
+      uint32_t tmp[3];
+      memcpy(tmp, tris[i], sizeof(tmp));
+      memcpy(tris[i], tris[j], sizeof(tmp));
+      memcpy(tris[j], tmp, sizeof(tmp));
+   }
+}
+
+static bool
+intersect_box(const struct lvp_bvh_box_node *box, unsigned child, const float origin[3],
+              const float inv_dir[3], float tmax, float *dist)
+{
+   if (box->children[child] == LVP_BVH_INVALID_NODE || isnan(box->min[0][child]))
+      return false;
+
+   float near = -INFINITY, far = INFINITY;
+   for (unsigned i = 0; i < 3; i++) {
+      float a = (box->min[i][child] - origin[i]) * inv_dir[i];
+      float b = (box->max[i][child] - origin[i]) * inv_dir[i];
+      near = MAX2(near, MIN2(a, b));
+      far = MIN2(far, MAX2(a, b));
+   }
+
+   *dist = near;
+   return far >= MAX2(0.0f, near) && near < tmax;
+}
+
+static bool
+intersect_triangle(const struct lvp_bvh_triangle_node *tri, const float origin[3],
+                   const float dir[3], float *t)
+{
+   float e1[3], e2[3], s[3], p[3], q[3];
+
+   for (unsigned i = 0; i < 3; i++) {
+      e1[i] = tri->coords[1][i] - tri->coords[0][i];
+      e2[i] = tri->coords[2][i] - tri->coords[0][i];
+      s[i] = origin[i] - tri->coords[0][i];
+   }
+
+   p[0] = dir[1] * e2[2] - dir[2] * e2[1];
+   p[1] = dir[2] * e2[0] - dir[0] * e2[2];
+   p[2] = dir[0] * e2[1] - dir[1] * e2[0];
+
+   float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+   if (det == 0.0f)
+      return false;
+
+   float inv_det = 1.0f / det;
+   float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+   if (u < 0.0f || u > 1.0f)
+      return false;
+
+   q[0] = s[1] * e1[2] - s[2] * e1[1];
+   q[1] = s[2] * e1[0] - s[0] * e1[2];
+   q[2] = s[0] * e1[1] - s[1] * e1[0];
+
+   float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv_det;
+   if (v < 0.0f || u + v > 1.0f)
+      return false;
+
+   *t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+   return *t >= 0.0f;
+}
+
+/* Closest hit, with the same node order as lvp_build_ray_traversal(). */
+static uint32_t
+trace(const uint8_t *bvh, const float origin[3], const float dir[3], uint64_t *nodes)
+{
+   uint32_t stack[LVP_BVH_STACK_SIZE];
+   unsigned stack_ptr = 0;
+   uint32_t node = LVP_BVH_ROOT_NODE;
+   uint32_t hit = LVP_BVH_INVALID_NODE;
+   float tmax = INFINITY;
+
+   float inv_dir[3];
+   for (unsigned i = 0; i < 3; i++)
+      inv_dir[i] = dir[i] == 0.0f ? FLT_MAX : 1.0f / dir[i];
+
+   while (true) {
+      if (node == LVP_BVH_INVALID_NODE) {
+         if (!stack_ptr)
+            break;
+         node = stack[--stack_ptr];
+      }
+
+      (*nodes)++;
+      const void *ptr = bvh + (node & ~3u);
+      const uint32_t type = node & 3u;
+      node = LVP_BVH_INVALID_NODE;
+
+      if (type == lvp_bvh_node_internal) {
+         const struct lvp_bvh_box_node *box = ptr;
+         float dist[LVP_BVH_WIDTH];
+         uint32_t children[LVP_BVH_WIDTH];
+
+         for (unsigned i = 0; i < LVP_BVH_WIDTH; i++) {
+            if (intersect_box(box, i, origin, inv_dir, tmax, &dist[i])) {
+               children[i] = box->children[i];
+            } else {
+               children[i] = LVP_BVH_INVALID_NODE;
+               dist[i] = INFINITY;
+            }
+         }
+
+         /* Same sorting network */
+         static const unsigned sort_pairs[][2] = {{0, 1}, {2, 3}, {0, 2}, {1, 3}, {1, 2}};
+         for (unsigned i = 0; i < ARRAY_SIZE(sort_pairs); i++) {
+            const unsigned lo = sort_pairs[i][0], hi = sort_pairs[i][1];
+            if (dist[hi] < dist[lo]) {
+               float d = dist[lo];
+               uint32_t c = children[lo];
+               dist[lo] = dist[hi];
+               children[lo] = children[hi];
+               dist[hi] = d;
+               children[hi] = c;
+            }
+         }
+
+         node = children[0];
+         for (unsigned i = LVP_BVH_WIDTH - 1; i > 0; i--) {
+            if (children[i] != LVP_BVH_INVALID_NODE) {
+               assert(stack_ptr < LVP_BVH_STACK_SIZE);
+               stack[stack_ptr++] = children[i];
+            }
+         }
+      } else if (type == lvp_bvh_node_triangle) {
+         const struct lvp_bvh_triangle_node *tri = ptr;
+         float t;
+
+         if (intersect_triangle(tri, origin, dir, &t) && t < tmax) {
+            tmax = t;
+            hit = tri->primitive_id;
+         }
+      }
+   }
+
+   return hit;
+}
+
+static void
+run(const struct mesh *mesh, const char *name, VkBuildAccelerationStructureFlagsKHR flags,
+    struct util_queue *queue)
+{
+   const uint32_t tri_count = util_dynarray_num_elements(&mesh->indices, uint32_t) / 3;
+
+   VkAccelerationStructureGeometryKHR geometry = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+      .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+      .geometry.triangles = {
+         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+         .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+         .vertexData.hostAddress = mesh->vertices.data,
+         .vertexStride = 3 * sizeof(float),
+         .maxVertex = util_dynarray_num_elements(&mesh->vertices, float) / 3 - 1,
+         .indexType = VK_INDEX_TYPE_UINT32,
+         .indexData.hostAddress = mesh->indices.data,
+      },
+      .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+   };
+   VkAccelerationStructureBuildGeometryInfoKHR info = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+      .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+      .flags = flags,
+      .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+      .geometryCount = 1,
+      .pGeometries = &geometry,
+   };
+   const VkAccelerationStructureBuildRangeInfoKHR range = {
+      .primitiveCount = tri_count,
+   };
+   VkAccelerationStructureBuildSizesInfoKHR sizes = {
+      .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+   };
+
+   lvp_get_bvh_build_sizes(&info, &tri_count, &sizes);
+
+   uint8_t *bvh = malloc(sizes.accelerationStructureSize);
+   void *scratch = malloc(sizes.buildScratchSize);
+
+   int64_t build_ns = INT64_MAX;
+   for (unsigned i = 0; i < BUILD_RUNS; i++) {
+      int64_t start = os_time_get_nano();
+      lvp_build_bvh(bvh, sizes.accelerationStructureSize, scratch, &info, &range, queue);
+      build_ns = MIN2(build_ns, os_time_get_nano() - start);
+   }
+
+   /* Primary rays from in front of the mesh, covering its bounds */
+   const struct lvp_bvh_header *header = (const void *)bvh;
+   const struct lvp_aabb *bounds = &header->bounds;
+   const float size = MAX2(bounds->max.x - bounds->min.x, bounds->max.y - bounds->min.y);
+   const float origin[3] = {
+      (bounds->min.x + bounds->max.x) * 0.5f,
+      (bounds->min.y + bounds->max.y) * 0.5f,
+      bounds->max.z + size,
+   };
+
+   uint64_t nodes = 0, hits = 0, checksum = 0;
+   int64_t start = os_time_get_nano();
+
+   for (unsigned y = 0; y < RAYS_Y; y++) {
+      for (unsigned x = 0; x < RAYS_X; x++) {
+         float target[3] = {
+            bounds->min.x + (x + 0.5f) * (bounds->max.x - bounds->min.x) / RAYS_X,
+            bounds->min.y + (y + 0.5f) * (bounds->max.y - bounds->min.y) / RAYS_Y,
+            (bounds->min.z + bounds->max.z) * 0.5f,
+         };
+         float dir[3];
+         for (unsigned i = 0; i < 3; i++)
+            dir[i] = target[i] - origin[i];
+
+         uint32_t hit = trace(bvh, origin, dir, &nodes);
+         if (hit != LVP_BVH_INVALID_NODE) {
+            hits++;
+            checksum = checksum * 31 + hit;
+         }
+      }
+   }
+
+   const int64_t trace_ns = os_time_get_nano() - start;
+   const unsigned rays = RAYS_X * RAYS_Y;
+
+   printf("%-10s build %8.2f ms, %6.2f Mrays/s, %6.1f nodes/ray, %" PRIu64 " hits, "
+          "checksum %016" PRIx64 "\n",
+          name, build_ns * 1e-6, rays / (trace_ns * 1e-3), (double)nodes / rays, hits,
+          checksum);
+
+   free(scratch);
+   free(bvh);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct mesh mesh;
+   util_dynarray_init(&mesh.vertices, NULL);
+   util_dynarray_init(&mesh.indices, NULL);
+
+   if (argc > 1) {
+      if (!load_obj(&mesh, argv[1])) {
+         fprintf(stderr, "%s: can't load %s\n", argv[0], argv[1]);
+         return 1;
+      }
+   } else {
+      torus_knot(&mesh);
+   }
+
+   shuffle_triangles(&mesh);
+
+   printf("%u triangles, %ux%u rays\n",
+          (unsigned)util_dynarray_num_elements(&mesh.indices, uint32_t) / 3, RAYS_X, RAYS_Y);
+
+   /* Build in parallel like the device */
+   struct util_queue *queue = lvp_get_bvh_build_queue();
+
+   run(&mesh, "default", 0, queue);
+   run(&mesh, "fast-build", VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR, queue);
+   run(&mesh, "fast-trace", VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR, queue);
+
+   util_dynarray_fini(&mesh.vertices);
+   util_dynarray_fini(&mesh.indices);
+   return 0;
+}
@@ -0,0 +1,1140 @@
+/*
+ * Copyright © 2023 Valve Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Host side BVH build, done by the queue when executing the command buffer.
+ */
+
+#include "lvp_acceleration_structure.h"
+
+#include "util/format/format_utils.h"
+#include "util/half_float.h"
+#include "util/u_call_once.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_queue.h"
+
+static_assert(sizeof(struct lvp_bvh_triangle_node) % 8 == 0, "lvp_bvh_triangle_node is not padded");
+static_assert(sizeof(struct lvp_bvh_aabb_node) % 8 == 0, "lvp_bvh_aabb_node is not padded");
+static_assert(sizeof(struct lvp_bvh_instance_node) % 8 == 0, "lvp_bvh_instance_node is not padded");
+static_assert(sizeof(struct lvp_bvh_box_node) % 8 == 0, "lvp_bvh_box_node is not padded");
+
+/* Nodes with more leaves are built by their own job of the queue, down to
+ * the depth giving one subtree per CPU.
+ */
+#define LVP_BVH_THREAD_MIN_LEAVES 4096
+
+/* Number of bins for the SAH split, per axis. */
+#define LVP_BVH_SAH_BINS 16
+
+/* Nodes with fewer leaves are split at their Morton codes rather than with
+ * SAH binning, unless fast trace was asked for.
+ */
+#define LVP_BVH_SAH_MIN_LEAVES 64
+
+/**
+ * Upper bound of the internal nodes of a subtree of leaf_count leaves.
+ *
+ * Every node with four leaves or more has LVP_BVH_WIDTH children, only
+ * nodes of two or three leaves have fewer, and those don't share leaves.
+ * The bound of a node is at least one more than the sum of the bounds of
+ * its children, which lets the children be placed before they are built.
+ */
+static uint32_t
+lvp_bvh_max_internal_nodes(uint32_t leaf_count)
+{
+   return leaf_count ? (2 * leaf_count - 1) / 3 : 0;
+}
+
+static uint64_t
+lvp_bvh_build_scratch_size(uint32_t leaf_count)
+{
+   /* The sort keys, twice, and the bounds of each leaf */
+   return (uint64_t)leaf_count * (2 * sizeof(uint64_t) + sizeof(struct lvp_aabb));
+}
+
+void
+lvp_get_bvh_build_sizes(const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                        const uint32_t *max_primitive_counts,
+                        VkAccelerationStructureBuildSizesInfoKHR *sizes)
+{
+   uint32_t leaf_count = 0;
+   for (uint32_t i = 0; i < info->geometryCount; i++)
+      leaf_count += max_primitive_counts[i];
+
+   sizes->buildScratchSize = MAX2(lvp_bvh_build_scratch_size(leaf_count), 64);
+   sizes->updateScratchSize = sizes->buildScratchSize;
+
+   uint32_t internal_count = MAX2(lvp_bvh_max_internal_nodes(leaf_count), 1);
+
+   VkGeometryTypeKHR geometry_type = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+   if (info->geometryCount) {
+      if (info->pGeometries)
+         geometry_type = info->pGeometries[0].geometryType;
+      else
+         geometry_type = info->ppGeometries[0]->geometryType;
+   }
+
+   uint32_t leaf_size;
+   switch (geometry_type) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+      leaf_size = sizeof(struct lvp_bvh_triangle_node);
+      break;
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      leaf_size = sizeof(struct lvp_bvh_aabb_node);
+      break;
+   case VK_GEOMETRY_TYPE_INSTANCES_KHR:
+      leaf_size = sizeof(struct lvp_bvh_instance_node);
+      break;
+   default:
+      unreachable("Unknown VkGeometryTypeKHR");
+   }
+
+   uint32_t bvh_size = sizeof(struct lvp_bvh_header);
+   bvh_size += leaf_count * leaf_size;
+   bvh_size += internal_count * sizeof(struct lvp_bvh_box_node);
+
+   sizes->accelerationStructureSize = bvh_size;
+}
+
+static uint32_t
+lvp_pack_geometry_id_and_flags(uint32_t geometry_id, uint32_t flags)
+{
+   uint32_t geometry_id_and_flags = geometry_id;
+   if (flags & VK_GEOMETRY_OPAQUE_BIT_KHR)
+      geometry_id_and_flags |= LVP_GEOMETRY_OPAQUE;
+
+   return geometry_id_and_flags;
+}
+
+static uint32_t
+lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR flags)
+{
+   uint32_t ret = sbt_offset;
+   if (flags & VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR)
+      ret |= LVP_INSTANCE_FORCE_OPAQUE;
+   if (!(flags & VK_GEOMETRY_INSTANCE_FORCE_NO_OPAQUE_BIT_KHR))
+      ret |= LVP_INSTANCE_NO_FORCE_NOT_OPAQUE;
+   if (flags & VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR)
+      ret |= LVP_INSTANCE_TRIANGLE_FACING_CULL_DISABLE;
+   if (flags & VK_GEOMETRY_INSTANCE_TRIANGLE_FLIP_FACING_BIT_KHR)
+      ret |= LVP_INSTANCE_TRIANGLE_FLIP_FACING;
+   return ret;
+}
+
+struct lvp_build_internal_ctx {
+   uint8_t *dst;
+
+   void *leaf_nodes;
+   uint32_t leaf_nodes_offset;
+   uint32_t leaf_node_type;
+   uint32_t leaf_node_size;
+
+   struct lvp_aabb *leaf_bounds;
+
+   /* The Morton code of the leaf centroid in the upper 32 bits and the leaf
+    * index in the lower ones, so that the keys are unique.
+    */
+   uint64_t *keys;
+   uint64_t *tmp_keys;
+
+   uint32_t sah_min_leaves;
+   unsigned thread_depth;
+
+   /* Builds the upper levels in parallel, NULL to build on the caller */
+   struct util_queue *queue;
+};
+
+static const struct lvp_aabb lvp_aabb_empty = {
+   .min = {INFINITY, INFINITY, INFINITY},
+   .max = {-INFINITY, -INFINITY, -INFINITY},
+};
+
+static inline float
+lvp_vec3_get(const lvp_vec3 *v, unsigned axis)
+{
+   return axis == 0 ? v->x : axis == 1 ? v->y : v->z;
+}
+
+/* fminf/fmaxf, so that inactive aabbs with NaN bounds don't spread */
+static inline void
+lvp_aabb_extend(struct lvp_aabb *aabb, const struct lvp_aabb *other)
+{
+   aabb->min.x = fminf(aabb->min.x, other->min.x);
+   aabb->min.y = fminf(aabb->min.y, other->min.y);
+   aabb->min.z = fminf(aabb->min.z, other->min.z);
+   aabb->max.x = fmaxf(aabb->max.x, other->max.x);
+   aabb->max.y = fmaxf(aabb->max.y, other->max.y);
+   aabb->max.z = fmaxf(aabb->max.z, other->max.z);
+}
+
+static inline float
+lvp_aabb_half_area(const struct lvp_aabb *aabb)
+{
+   if (!(aabb->min.x <= aabb->max.x))
+      return 0.0f;
+
+   float dx = aabb->max.x - aabb->min.x;
+   float dy = aabb->max.y - aabb->min.y;
+   float dz = aabb->max.z - aabb->min.z;
+   return dx * dy + dy * dz + dz * dx;
+}
+
+static inline void
+lvp_aabb_centroid(const struct lvp_aabb *aabb, float centroid[3])
+{
+   for (unsigned i = 0; i < 3; i++) {
+      float c = (lvp_vec3_get(&aabb->min, i) + lvp_vec3_get(&aabb->max, i)) * 0.5f;
+      centroid[i] = isfinite(c) ? c : 0.0f;
+   }
+}
+
+static void
+lvp_leaf_bounds(const struct lvp_build_internal_ctx *ctx, uint32_t leaf, struct lvp_aabb *aabb)
+{
+   void *child_node = (uint8_t *)ctx->leaf_nodes + leaf * ctx->leaf_node_size;
+
+   switch (ctx->leaf_node_type) {
+   case lvp_bvh_node_triangle: {
+      struct lvp_bvh_triangle_node *triangle = child_node;
+
+      aabb->min.x = MIN3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
+      aabb->min.y = MIN3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
+      aabb->min.z = MIN3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+
+      aabb->max.x = MAX3(triangle->coords[0][0], triangle->coords[1][0], triangle->coords[2][0]);
+      aabb->max.y = MAX3(triangle->coords[0][1], triangle->coords[1][1], triangle->coords[2][1]);
+      aabb->max.z = MAX3(triangle->coords[0][2], triangle->coords[1][2], triangle->coords[2][2]);
+
+      break;
+   }
+   case lvp_bvh_node_instance: {
+      struct lvp_bvh_instance_node *instance = child_node;
+      struct lvp_bvh_header *instance_header = (void *)(uintptr_t)instance->bvh_ptr;
+
+      float bounds[2][3];
+
+      float header_bounds[2][3];
+      memcpy(header_bounds, &instance_header->bounds, sizeof(struct lvp_aabb));
+
+      for (unsigned j = 0; j < 3; ++j) {
+         bounds[0][j] = instance->otw_matrix.values[j][3];
+         bounds[1][j] = instance->otw_matrix.values[j][3];
+         for (unsigned k = 0; k < 3; ++k) {
+            bounds[0][j] += MIN2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
+                                 instance->otw_matrix.values[j][k] * header_bounds[1][k]);
+            bounds[1][j] += MAX2(instance->otw_matrix.values[j][k] * header_bounds[0][k],
+                                 instance->otw_matrix.values[j][k] * header_bounds[1][k]);
+         }
+      }
+
+      memcpy(aabb, bounds, sizeof(struct lvp_aabb));
+
+      break;
+   }
+   case lvp_bvh_node_aabb: {
+      struct lvp_bvh_aabb_node *aabb_node = child_node;
+
+      memcpy(aabb, &aabb_node->bounds, sizeof(struct lvp_aabb));
+
+      break;
+   }
+   default:
+      unreachable("Invalid node type");
+   }
+}
+
+/* Spreads the lower 10 bits of v to every third bit. */
+static inline uint32_t
+lvp_morton_expand_bits(uint32_t v)
+{
+   v = (v * 0x00010001u) & 0xFF0000FFu;
+   v = (v * 0x00000101u) & 0x0F00F00Fu;
+   v = (v * 0x00000011u) & 0xC30C30C3u;
+   v = (v * 0x00000005u) & 0x49249249u;
+   return v;
+}
+
+/**
+ * Computes the bounds of the leaves and sorts them along a Morton curve
+ * through their centroids.
+ */
+static void
+lvp_sort_leaves(struct lvp_build_internal_ctx *ctx, uint32_t leaf_count)
+{
+   struct lvp_aabb centroid_bounds = lvp_aabb_empty;
+
+   for (uint32_t i = 0; i < leaf_count; i++) {
+      lvp_leaf_bounds(ctx, i, &ctx->leaf_bounds[i]);
+
+      float c[3];
+      lvp_aabb_centroid(&ctx->leaf_bounds[i], c);
+      struct lvp_aabb point = {{c[0], c[1], c[2]}, {c[0], c[1], c[2]}};
+      lvp_aabb_extend(&centroid_bounds, &point);
+   }
+
+   float scale[3];
+   for (unsigned i = 0; i < 3; i++) {
+      float extent = lvp_vec3_get(&centroid_bounds.max, i) - lvp_vec3_get(&centroid_bounds.min, i);
+      scale[i] = extent > 0.0f ? 1024.0f / extent : 0.0f;
+   }
+
+   for (uint32_t i = 0; i < leaf_count; i++) {
+      float c[3];
+      lvp_aabb_centroid(&ctx->leaf_bounds[i], c);
+
+      uint32_t code = 0;
+      for (unsigned j = 0; j < 3; j++) {
+         float v = (c[j] - lvp_vec3_get(&centroid_bounds.min, j)) * scale[j];
+         code |= lvp_morton_expand_bits((uint32_t)CLAMP(v, 0.0f, 1023.0f)) << (2 - j);
+      }
+
+      ctx->keys[i] = ((uint64_t)code << 32) | i;
+   }
+
+   /* LSD radix sort of the codes, the leaf indices are in order already */
+   uint64_t *src = ctx->keys, *dst = ctx->tmp_keys;
+   for (unsigned shift = 32; shift < 64; shift += 8) {
+      uint32_t offsets[256] = {0};
+
+      for (uint32_t i = 0; i < leaf_count; i++)
+         offsets[(src[i] >> shift) & 0xff]++;
+
+      uint32_t sum = 0;
+      for (unsigned i = 0; i < 256; i++) {
+         uint32_t n = offsets[i];
+         offsets[i] = sum;
+         sum += n;
+      }
+
+      for (uint32_t i = 0; i < leaf_count; i++)
+         dst[offsets[(src[i] >> shift) & 0xff]++] = src[i];
+
+      uint64_t *tmp = src;
+      src = dst;
+      dst = tmp;
+   }
+   assert(src == ctx->keys);
+}
+
+/**
+ * Splits the leaves at the highest bit where their keys differ, like
+ * a linear BVH.
+ *
+ * \return the number of leaves in the first child
+ */
+static uint32_t
+lvp_morton_split(const struct lvp_build_internal_ctx *ctx, uint32_t first, uint32_t count)
+{
+   const uint64_t *keys = ctx->keys + first;
+   const unsigned bit = util_last_bit64(keys[0] ^ keys[count - 1]) - 1;
+
+   /* The keys are sorted and unique, so the bit is set from some key on */
+   uint32_t lo = 1, hi = count - 1;
+   while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      if ((keys[mid] >> bit) & 1)
+         hi = mid;
+      else
+         lo = mid + 1;
+   }
+
+   return lo;
+}
+
+static inline unsigned
+lvp_sah_bin(float centroid, float min, float scale)
+{
+   return MIN2((unsigned)((centroid - min) * scale), LVP_BVH_SAH_BINS - 1);
+}
+
+/**
+ * Splits the leaves where the surface area heuristic is the lowest, among
+ * LVP_BVH_SAH_BINS bins along each axis. The leaves stay sorted by their
+ * keys on both sides.
+ *
+ * \return the number of leaves in the first child, 0 if the centroids can't
+ * be told apart
+ */
+static uint32_t
+lvp_sah_split(struct lvp_build_internal_ctx *ctx, uint32_t first, uint32_t count)
+{
+   uint64_t *keys = ctx->keys + first;
+   struct lvp_aabb centroid_bounds = lvp_aabb_empty;
+
+   for (uint32_t i = 0; i < count; i++) {
+      float c[3];
+      lvp_aabb_centroid(&ctx->leaf_bounds[(uint32_t)keys[i]], c);
+      struct lvp_aabb point = {{c[0], c[1], c[2]}, {c[0], c[1], c[2]}};
+      lvp_aabb_extend(&centroid_bounds, &point);
+   }
+
+   float best_cost = INFINITY;
+   unsigned best_axis = 0, best_bin = 0;
+   float best_min = 0.0f, best_scale = 0.0f;
+
+   for (unsigned axis = 0; axis < 3; axis++) {
+      const float min = lvp_vec3_get(&centroid_bounds.min, axis);
+      const float extent = lvp_vec3_get(&centroid_bounds.max, axis) - min;
+      if (!(extent > 0.0f))
+         continue;
+
+      const float scale = LVP_BVH_SAH_BINS / extent;
+      struct lvp_aabb bin_bounds[LVP_BVH_SAH_BINS];
+      uint32_t bin_count[LVP_BVH_SAH_BINS] = {0};
+
+      for (unsigned i = 0; i < LVP_BVH_SAH_BINS; i++)
+         bin_bounds[i] = lvp_aabb_empty;
+
+      for (uint32_t i = 0; i < count; i++) {
+         const struct lvp_aabb *bounds = &ctx->leaf_bounds[(uint32_t)keys[i]];
+         float c[3];
+         lvp_aabb_centroid(bounds, c);
+
+         unsigned bin = lvp_sah_bin(c[axis], min, scale);
+         bin_count[bin]++;
+         lvp_aabb_extend(&bin_bounds[bin], bounds);
+      }
+
+      /* cost of the leaves right of each split */
+      float right_cost[LVP_BVH_SAH_BINS];
+      struct lvp_aabb right = lvp_aabb_empty;
+      uint32_t right_count = 0;
+      for (unsigned i = LVP_BVH_SAH_BINS - 1; i > 0; i--) {
+         lvp_aabb_extend(&right, &bin_bounds[i]);
+         right_count += bin_count[i];
+         right_cost[i] = lvp_aabb_half_area(&right) * right_count;
+      }
+
+      struct lvp_aabb left = lvp_aabb_empty;
+      uint32_t left_count = 0;
+      for (unsigned i = 0; i < LVP_BVH_SAH_BINS - 1; i++) {
+         lvp_aabb_extend(&left, &bin_bounds[i]);
+         left_count += bin_count[i];
+         if (!left_count || left_count == count)
+            continue;
+
+         float cost = lvp_aabb_half_area(&left) * left_count + right_cost[i + 1];
+         if (cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_bin = i;
+            best_min = min;
+            best_scale = scale;
+         }
+      }
+   }
+
+   if (best_cost == INFINITY)
+      return 0;
+
+   /* Stable partition through the temporary keys */
+   uint64_t *tmp_keys = ctx->tmp_keys + first;
+   uint32_t left_count = 0, right_index = count;
+   for (uint32_t i = 0; i < count; i++) {
+      float c[3];
+      lvp_aabb_centroid(&ctx->leaf_bounds[(uint32_t)keys[i]], c);
+
+      if (lvp_sah_bin(c[best_axis], best_min, best_scale) <= best_bin)
+         tmp_keys[left_count++] = keys[i];
+      else
+         tmp_keys[--right_index] = keys[i];
+   }
+
+   memcpy(keys, tmp_keys, left_count * sizeof(*keys));
+   for (uint32_t i = left_count; i < count; i++)
+      keys[i] = tmp_keys[count - 1 - (i - left_count)];
+
+   return left_count;
+}
+
+struct lvp_build_node_args {
+   struct lvp_build_internal_ctx *ctx;
+   uint32_t dst_offset;
+   uint32_t first_leaf;
+   uint32_t leaf_count;
+   unsigned depth;
+
+   /* out */
+   struct lvp_aabb bounds;
+};
+
+static void
+lvp_box_node_set_child(struct lvp_bvh_box_node *node, uint32_t i, uint32_t child,
+                       const struct lvp_aabb *bounds)
+{
+   node->children[i] = child;
+   for (unsigned axis = 0; axis < 3; axis++) {
+      node->min[axis][i] = lvp_vec3_get(&bounds->min, axis);
+      node->max[axis][i] = lvp_vec3_get(&bounds->max, axis);
+   }
+}
+
+static uint32_t
+lvp_split(struct lvp_build_internal_ctx *ctx, uint32_t first, uint32_t count)
+{
+   uint32_t split = 0;
+   if (count >= ctx->sah_min_leaves)
+      split = lvp_sah_split(ctx, first, count);
+   if (!split)
+      split = lvp_morton_split(ctx, first, count);
+   return split;
+}
+
+/**
+ * Splits the leaves of the node of at least two leaves at args->dst_offset
+ * into its children, and returns their number.
+ *
+ * The leaves are split in two, and the child with the most leaves is split
+ * again until there are LVP_BVH_WIDTH children, which collapses the levels
+ * of a binary tree. The subtree of each child is placed right after the
+ * node, at most lvp_bvh_max_internal_nodes() of its leaves apart. The
+ * bounds of leaf children are set, the others are left to be built.
+ */
+static uint32_t
+lvp_split_internal_node(const struct lvp_build_node_args *args,
+                        struct lvp_build_node_args child_args[LVP_BVH_WIDTH])
+{
+   struct lvp_build_internal_ctx *ctx = args->ctx;
+
+   uint32_t first_leaf[LVP_BVH_WIDTH + 1] = {args->first_leaf, args->first_leaf + args->leaf_count};
+   uint32_t child_count = 1;
+
+   while (child_count < LVP_BVH_WIDTH) {
+      uint32_t largest = 0;
+      for (uint32_t i = 1; i < child_count; i++) {
+         if (first_leaf[i + 1] - first_leaf[i] > first_leaf[largest + 1] - first_leaf[largest])
+            largest = i;
+      }
+
+      const uint32_t count = first_leaf[largest + 1] - first_leaf[largest];
+      if (count < 2)
+         break;
+
+      memmove(&first_leaf[largest + 2], &first_leaf[largest + 1],
+              (child_count - largest) * sizeof(*first_leaf));
+      first_leaf[largest + 1] = first_leaf[largest] + lvp_split(ctx, first_leaf[largest], count);
+      child_count++;
+   }
+
+   /* Fall back to equal parts when a child wouldn't fit in the maximum depth */
+   const uint32_t max_child_leaves =
+      1u << (util_logbase2(LVP_BVH_WIDTH) * (LVP_BVH_MAX_DEPTH - 1 - args->depth));
+   for (uint32_t i = 0; i < child_count; i++) {
+      if (first_leaf[i + 1] - first_leaf[i] > max_child_leaves) {
+         for (uint32_t j = 1; j < child_count; j++)
+            first_leaf[j] = args->first_leaf + (uint64_t)args->leaf_count * j / child_count;
+         break;
+      }
+   }
+
+   uint32_t dst_offset = args->dst_offset + sizeof(struct lvp_bvh_box_node);
+
+   for (uint32_t i = 0; i < child_count; i++) {
+      child_args[i] = (struct lvp_build_node_args){
+         .ctx = ctx,
+         .dst_offset = dst_offset,
+         .first_leaf = first_leaf[i],
+         .leaf_count = first_leaf[i + 1] - first_leaf[i],
+         .depth = args->depth + 1,
+      };
+      dst_offset += sizeof(struct lvp_bvh_box_node) *
+                    lvp_bvh_max_internal_nodes(child_args[i].leaf_count);
+
+      if (child_args[i].leaf_count == 1) {
+         uint32_t leaf = (uint32_t)ctx->keys[child_args[i].first_leaf];
+         child_args[i].bounds = ctx->leaf_bounds[leaf];
+      }
+   }
+
+   return child_count;
+}
+
+/**
+ * Writes the node at args->dst_offset once its children are built, and
+ * sets args->bounds.
+ */
+static void
+lvp_finish_internal_node(struct lvp_build_node_args *args,
+                         const struct lvp_build_node_args *child_args,
+                         uint32_t child_count)
+{
+   struct lvp_build_internal_ctx *ctx = args->ctx;
+   struct lvp_bvh_box_node *node = (void *)(ctx->dst + args->dst_offset);
+
+   args->bounds = lvp_aabb_empty;
+   for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++) {
+      if (i >= child_count) {
+         lvp_box_node_set_child(node, i, LVP_BVH_INVALID_NODE, &lvp_aabb_empty);
+         continue;
+      }
+
+      uint32_t child;
+      if (child_args[i].leaf_count == 1) {
+         uint32_t leaf = (uint32_t)ctx->keys[child_args[i].first_leaf];
+         child = (ctx->leaf_nodes_offset + (leaf * ctx->leaf_node_size)) | ctx->leaf_node_type;
+      } else {
+         child = child_args[i].dst_offset | lvp_bvh_node_internal;
+      }
+
+      lvp_box_node_set_child(node, i, child, &child_args[i].bounds);
+      lvp_aabb_extend(&args->bounds, &child_args[i].bounds);
+   }
+}
+
+/* Builds the subtree of at least two leaves at args->dst_offset. */
+static void
+lvp_build_internal_node(struct lvp_build_node_args *args)
+{
+   struct lvp_build_node_args child_args[LVP_BVH_WIDTH];
+   uint32_t child_count = lvp_split_internal_node(args, child_args);
+
+   for (uint32_t i = 0; i < child_count; i++) {
+      if (child_args[i].leaf_count > 1)
+         lvp_build_internal_node(&child_args[i]);
+   }
+
+   lvp_finish_internal_node(args, child_args, child_count);
+}
+
+/**
+ * A node of the upper levels of the tree, which are built one level at a
+ * time by jobs of the queue. The nodes of the last of those levels are
+ * built entirely by their job, the ones above are only split, leaving
+ * their large children to the next level.
+ */
+struct lvp_build_job {
+   struct util_queue_fence fence;
+   struct lvp_build_node_args args;
+   bool split_only;
+
+   struct lvp_build_node_args child_args[LVP_BVH_WIDTH];
+   uint32_t child_count;
+   /* The job of each child in the next level, or -1 */
+   int child_jobs[LVP_BVH_WIDTH];
+};
+
+static bool
+lvp_build_job_child_queued(const struct lvp_build_job *job, uint32_t i)
+{
+   const struct lvp_build_internal_ctx *ctx = job->args.ctx;
+
+   return job->child_args[i].leaf_count >= LVP_BVH_THREAD_MIN_LEAVES &&
+          job->child_args[i].depth <= ctx->thread_depth;
+}
+
+static void
+lvp_build_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lvp_build_job *job = data;
+
+   if (!job->split_only) {
+      lvp_build_internal_node(&job->args);
+      return;
+   }
+
+   job->child_count = lvp_split_internal_node(&job->args, job->child_args);
+
+   /* Children too small for a job of their own are built right away */
+   for (uint32_t i = 0; i < job->child_count; i++) {
+      if (job->child_args[i].leaf_count > 1 && !lvp_build_job_child_queued(job, i))
+         lvp_build_internal_node(&job->child_args[i]);
+   }
+}
+
+/**
+ * Builds the tree of at least two leaves from the root at args->dst_offset,
+ * with jobs of ctx->queue for the upper levels.
+ *
+ * Only the calling thread adds jobs and waits for them, so the jobs never
+ * wait on the queue themselves. The first job of each level runs on the
+ * calling thread.
+ */
+static void
+lvp_build_internal_node_queued(struct lvp_build_node_args *root)
+{
+   struct lvp_build_internal_ctx *ctx = root->ctx;
+   struct lvp_build_job *levels[LVP_BVH_MAX_DEPTH] = {0};
+   uint32_t level_counts[LVP_BVH_MAX_DEPTH] = {0};
+   uint32_t level_count = 0;
+
+   levels[0] = calloc(1, sizeof(struct lvp_build_job));
+   if (!levels[0]) {
+      lvp_build_internal_node(root);
+      return;
+   }
+   levels[0][0].args = *root;
+   level_counts[0] = 1;
+
+   while (level_counts[level_count]) {
+      struct lvp_build_job *jobs = levels[level_count];
+      const uint32_t count = level_counts[level_count];
+      const bool split_only = jobs[0].args.depth < ctx->thread_depth &&
+                              level_count + 1 < LVP_BVH_MAX_DEPTH;
+
+      for (uint32_t i = 0; i < count; i++) {
+         jobs[i].split_only = split_only;
+         util_queue_fence_init(&jobs[i].fence);
+         if (i)
+            util_queue_add_job(ctx->queue, &jobs[i], &jobs[i].fence,
+                               lvp_build_job_execute, NULL, 0);
+      }
+
+      lvp_build_job_execute(&jobs[0], NULL, 0);
+
+      for (uint32_t i = 1; i < count; i++)
+         util_queue_fence_wait(&jobs[i].fence);
+
+      level_count++;
+      if (!split_only)
+         break;
+
+      /* Queue the large children of this level as the next one */
+      uint32_t next_count = 0;
+      for (uint32_t i = 0; i < count; i++) {
+         for (uint32_t c = 0; c < jobs[i].child_count; c++) {
+            jobs[i].child_jobs[c] = -1;
+            if (lvp_build_job_child_queued(&jobs[i], c))
+               jobs[i].child_jobs[c] = next_count++;
+         }
+      }
+
+      if (next_count) {
+         levels[level_count] = calloc(next_count, sizeof(struct lvp_build_job));
+
+         for (uint32_t i = 0; i < count; i++) {
+            for (uint32_t c = 0; c < jobs[i].child_count; c++) {
+               if (jobs[i].child_jobs[c] < 0)
+                  continue;
+
+               /* Build it on this thread if the next level is out of memory */
+               if (!levels[level_count]) {
+                  lvp_build_internal_node(&jobs[i].child_args[c]);
+                  jobs[i].child_jobs[c] = -1;
+               } else {
+                  levels[level_count][jobs[i].child_jobs[c]].args = jobs[i].child_args[c];
+               }
+            }
+         }
+
+         if (levels[level_count])
+            level_counts[level_count] = next_count;
+      }
+   }
+
+   /* Write the split nodes, with the bounds of the levels below */
+   for (uint32_t l = level_count; l-- > 0;) {
+      struct lvp_build_job *jobs = levels[l];
+
+      for (uint32_t i = 0; i < level_counts[l]; i++) {
+         util_queue_fence_destroy(&jobs[i].fence);
+
+         if (!jobs[i].split_only)
+            continue;
+
+         for (uint32_t c = 0; c < jobs[i].child_count; c++) {
+            if (jobs[i].child_jobs[c] >= 0)
+               jobs[i].child_args[c].bounds = levels[l + 1][jobs[i].child_jobs[c]].args.bounds;
+         }
+         lvp_finish_internal_node(&jobs[i].args, jobs[i].child_args, jobs[i].child_count);
+      }
+   }
+
+   root->bounds = levels[0][0].args.bounds;
+
+   for (uint32_t l = 0; l < level_count; l++)
+      free(levels[l]);
+}
+
+static util_once_flag build_queue_once = UTIL_ONCE_FLAG_INIT;
+static struct util_queue build_queue;
+
+static void
+lvp_init_bvh_build_queue(void)
+{
+   /* The thread building a BVH runs one job of each level itself. */
+   const unsigned threads = util_get_cpu_caps()->nr_cpus - 1;
+   if (threads)
+      util_queue_init(&build_queue, "lvp_bvh", 64, threads, UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+}
+
+struct util_queue *
+lvp_get_bvh_build_queue(void)
+{
+   util_call_once(&build_queue_once, lvp_init_bvh_build_queue);
+   return util_queue_is_initialized(&build_queue) ? &build_queue : NULL;
+}
+
+void
+lvp_build_bvh(void *dst, uint64_t size, void *scratch,
+              const VkAccelerationStructureBuildGeometryInfoKHR *info,
+              const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+              struct util_queue *queue)
+{
+   memset(dst, 0, size);
+
+   struct lvp_bvh_header *header = dst;
+   header->instance_count = 0;
+
+   struct lvp_bvh_box_node *root = (void *)((uint8_t *)dst + sizeof(struct lvp_bvh_header));
+
+   uint32_t leaf_count = 0;
+   for (unsigned i = 0; i < info->geometryCount; i++)
+      leaf_count += ranges[i].primitiveCount;
+
+   if (!leaf_count) {
+      for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++)
+         lvp_box_node_set_child(root, i, LVP_BVH_INVALID_NODE, &lvp_aabb_empty);
+      return;
+   }
+
+   uint32_t internal_count = MAX2(lvp_bvh_max_internal_nodes(leaf_count), 1);
+
+   uint32_t primitive_index = 0;
+
+   header->leaf_nodes_offset =
+      sizeof(struct lvp_bvh_header) + sizeof(struct lvp_bvh_box_node) * internal_count;
+   void *leaf_nodes = (void *)((uint8_t *)dst + header->leaf_nodes_offset);
+
+   for (unsigned i = 0; i < info->geometryCount; i++) {
+      const VkAccelerationStructureGeometryKHR *geom =
+         info->pGeometries ? &info->pGeometries[i] : info->ppGeometries[i];
+
+      const VkAccelerationStructureBuildRangeInfoKHR *range = &ranges[i];
+
+      uint32_t geometry_id_and_flags = lvp_pack_geometry_id_and_flags(i, geom->flags);
+
+      switch (geom->geometryType) {
+      case VK_GEOMETRY_TYPE_TRIANGLES_KHR: {
+         assert(info->type == VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR);
+
+         const uint8_t *vertex_data_base = geom->geometry.triangles.vertexData.hostAddress;
+         vertex_data_base += range->firstVertex * geom->geometry.triangles.vertexStride;
+
+         const uint8_t *index_data = geom->geometry.triangles.indexData.hostAddress;
+
+         if (geom->geometry.triangles.indexType == VK_INDEX_TYPE_NONE_KHR)
+            vertex_data_base += range->primitiveOffset;
+         else
+            index_data += range->primitiveOffset;
+
+         VkTransformMatrixKHR transform_matrix = {
+            .matrix =
+               {
+                  {1.0, 0.0, 0.0, 0.0},
+                  {0.0, 1.0, 0.0, 0.0},
+                  {0.0, 0.0, 1.0, 0.0},
+               },
+         };
+
+         const uint8_t *transform = geom->geometry.triangles.transformData.hostAddress;
+         if (transform) {
+            transform += range->transformOffset;
+            transform_matrix = *(VkTransformMatrixKHR *)transform;
+         }
+
+         VkDeviceSize stride = geom->geometry.triangles.vertexStride;
+         VkFormat vertex_format = geom->geometry.triangles.vertexFormat;
+         VkIndexType index_type = geom->geometry.triangles.indexType;
+
+         for (uint32_t j = 0; j < range->primitiveCount; j++) {
+            struct lvp_bvh_triangle_node *node = leaf_nodes;
+            node += primitive_index;
+
+            node->primitive_id = j;
+            node->geometry_id_and_flags = geometry_id_and_flags;
+
+            for (uint32_t v = 0; v < 3; v++) {
+               uint32_t index = range->firstVertex;
+               switch (index_type) {
+               case VK_INDEX_TYPE_NONE_KHR:
+                  index += j * 3 + v;
+                  break;
+               case VK_INDEX_TYPE_UINT8_EXT:
+                  index += *(const uint8_t *)index_data;
+                  index_data += 1;
+                  break;
+               case VK_INDEX_TYPE_UINT16:
+                  index += *(const uint16_t *)index_data;
+                  index_data += 2;
+                  break;
+               case VK_INDEX_TYPE_UINT32:
+                  index += *(const uint32_t *)index_data;
+                  index_data += 4;
+                  break;
+               case VK_INDEX_TYPE_MAX_ENUM:
+                  unreachable("Unhandled VK_INDEX_TYPE_MAX_ENUM");
+                  break;
+               }
+
+               const uint8_t *vertex_data = vertex_data_base + index * stride;
+               float coords[4];
+               switch (vertex_format) {
+               case VK_FORMAT_R32G32_SFLOAT:
+                  coords[0] = *(const float *)(vertex_data + 0);
+                  coords[1] = *(const float *)(vertex_data + 4);
+                  coords[2] = 0.0f;
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R32G32B32_SFLOAT:
+                  coords[0] = *(const float *)(vertex_data + 0);
+                  coords[1] = *(const float *)(vertex_data + 4);
+                  coords[2] = *(const float *)(vertex_data + 8);
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R32G32B32A32_SFLOAT:
+                  coords[0] = *(const float *)(vertex_data + 0);
+                  coords[1] = *(const float *)(vertex_data + 4);
+                  coords[2] = *(const float *)(vertex_data + 8);
+                  coords[3] = *(const float *)(vertex_data + 12);
+                  break;
+               case VK_FORMAT_R16G16_SFLOAT:
+                  coords[0] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 0));
+                  coords[1] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 2));
+                  coords[2] = 0.0f;
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R16G16B16_SFLOAT:
+                  coords[0] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 0));
+                  coords[1] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 2));
+                  coords[2] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 4));
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R16G16B16A16_SFLOAT:
+                  coords[0] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 0));
+                  coords[1] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 2));
+                  coords[2] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 4));
+                  coords[3] = _mesa_half_to_float(*(const uint16_t *)(vertex_data + 6));
+                  break;
+               case VK_FORMAT_R16G16_SNORM:
+                  coords[0] = _mesa_snorm_to_float(*(const int16_t *)(vertex_data + 0), 16);
+                  coords[1] = _mesa_snorm_to_float(*(const int16_t *)(vertex_data + 2), 16);
+                  coords[2] = 0.0f;
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R16G16_UNORM:
+                  coords[0] = _mesa_unorm_to_float(*(const uint16_t *)(vertex_data + 0), 16);
+                  coords[1] = _mesa_unorm_to_float(*(const uint16_t *)(vertex_data + 2), 16);
+                  coords[2] = 0.0f;
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R16G16B16A16_SNORM:
+                  coords[0] = _mesa_snorm_to_float(*(const int16_t *)(vertex_data + 0), 16);
+                  coords[1] = _mesa_snorm_to_float(*(const int16_t *)(vertex_data + 2), 16);
+                  coords[2] = _mesa_snorm_to_float(*(const int16_t *)(vertex_data + 4), 16);
+                  coords[3] = _mesa_snorm_to_float(*(const int16_t *)(vertex_data + 6), 16);
+                  break;
+               case VK_FORMAT_R16G16B16A16_UNORM:
+                  coords[0] = _mesa_unorm_to_float(*(const uint16_t *)(vertex_data + 0), 16);
+                  coords[1] = _mesa_unorm_to_float(*(const uint16_t *)(vertex_data + 2), 16);
+                  coords[2] = _mesa_unorm_to_float(*(const uint16_t *)(vertex_data + 4), 16);
+                  coords[3] = _mesa_unorm_to_float(*(const uint16_t *)(vertex_data + 6), 16);
+                  break;
+               case VK_FORMAT_R8G8_SNORM:
+                  coords[0] = _mesa_snorm_to_float(*(const int8_t *)(vertex_data + 0), 8);
+                  coords[1] = _mesa_snorm_to_float(*(const int8_t *)(vertex_data + 1), 8);
+                  coords[2] = 0.0f;
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R8G8_UNORM:
+                  coords[0] = _mesa_unorm_to_float(*(const uint8_t *)(vertex_data + 0), 8);
+                  coords[1] = _mesa_unorm_to_float(*(const uint8_t *)(vertex_data + 1), 8);
+                  coords[2] = 0.0f;
+                  coords[3] = 1.0f;
+                  break;
+               case VK_FORMAT_R8G8B8A8_SNORM:
+                  coords[0] = _mesa_snorm_to_float(*(const int8_t *)(vertex_data + 0), 8);
+                  coords[1] = _mesa_snorm_to_float(*(const int8_t *)(vertex_data + 1), 8);
+                  coords[2] = _mesa_snorm_to_float(*(const int8_t *)(vertex_data + 2), 8);
+                  coords[3] = _mesa_snorm_to_float(*(const int8_t *)(vertex_data + 3), 8);
+                  break;
+               case VK_FORMAT_R8G8B8A8_UNORM:
+                  coords[0] = _mesa_unorm_to_float(*(const uint8_t *)(vertex_data + 0), 8);
+                  coords[1] = _mesa_unorm_to_float(*(const uint8_t *)(vertex_data + 1), 8);
+                  coords[2] = _mesa_unorm_to_float(*(const uint8_t *)(vertex_data + 2), 8);
+                  coords[3] = _mesa_unorm_to_float(*(const uint8_t *)(vertex_data + 3), 8);
+                  break;
+               case VK_FORMAT_A2B10G10R10_UNORM_PACK32: {
+                  uint32_t val = *(const uint32_t *)vertex_data;
+                  coords[0] = _mesa_unorm_to_float((val >> 0) & 0x3FF, 10);
+                  coords[1] = _mesa_unorm_to_float((val >> 10) & 0x3FF, 10);
+                  coords[2] = _mesa_unorm_to_float((val >> 20) & 0x3FF, 10);
+                  coords[3] = _mesa_unorm_to_float((val >> 30) & 0x3, 2);
+               } break;
+               default:
+                  unreachable("Unhandled vertex format in BVH build");
+               }
+
+               for (unsigned comp = 0; comp < 3; comp++) {
+                  float r = 0;
+                  for (unsigned col = 0; col < 4; col++)
+                     r += transform_matrix.matrix[comp][col] * coords[col];
+
+                  node->coords[v][comp] = r;
+               }
+            }
+
+            primitive_index++;
+         }
+
+         break;
+      }
+      case VK_GEOMETRY_TYPE_AABBS_KHR: {
+         assert(info->type == VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR);
+
+         const uint8_t *data = geom->geometry.aabbs.data.hostAddress;
+         data += range->primitiveOffset;
+
+         VkDeviceSize stride = geom->geometry.aabbs.stride;
+
+         for (uint32_t j = 0; j < range->primitiveCount; j++) {
+            struct lvp_bvh_aabb_node *node = leaf_nodes;
+            node += primitive_index;
+
+            node->primitive_id = j;
+            node->geometry_id_and_flags = geometry_id_and_flags;
+
+            const VkAabbPositionsKHR *aabb = (const VkAabbPositionsKHR *)(data + j * stride);
+            node->bounds.min.x = aabb->minX;
+            node->bounds.min.y = aabb->minY;
+            node->bounds.min.z = aabb->minZ;
+            node->bounds.max.x = aabb->maxX;
+            node->bounds.max.y = aabb->maxY;
+            node->bounds.max.z = aabb->maxZ;
+
+            primitive_index++;
+         }
+
+         break;
+      }
+      case VK_GEOMETRY_TYPE_INSTANCES_KHR: {
+         assert(info->type == VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR);
+
+         const uint8_t *data = geom->geometry.instances.data.hostAddress;
+         data += range->primitiveOffset;
+
+         for (uint32_t j = 0; j < range->primitiveCount; j++) {
+            struct lvp_bvh_instance_node *node = leaf_nodes;
+            node += primitive_index;
+
+            const VkAccelerationStructureInstanceKHR *instance =
+               geom->geometry.instances.arrayOfPointers
+                  ? (((const VkAccelerationStructureInstanceKHR *const *)data)[j])
+                  : &((const VkAccelerationStructureInstanceKHR *)data)[j];
+            if (!instance->accelerationStructureReference)
+               continue;
+
+            node->bvh_ptr = instance->accelerationStructureReference;
+
+            float transform[16], inv_transform[16];
+            memcpy(transform, &instance->transform.matrix, sizeof(instance->transform.matrix));
+            transform[12] = transform[13] = transform[14] = 0.0f;
+            transform[15] = 1.0f;
+
+            util_invert_mat4x4(inv_transform, transform);
+            memcpy(node->wto_matrix.values, inv_transform, sizeof(node->wto_matrix.values));
+
+            node->custom_instance_and_mask = instance->instanceCustomIndex | (instance->mask << 24);
+            node->sbt_offset_and_flags = lvp_pack_sbt_offset_and_flags(
+               instance->instanceShaderBindingTableRecordOffset, instance->flags);
+            node->instance_id = j;
+
+            memcpy(node->otw_matrix.values, instance->transform.matrix,
+                   sizeof(node->otw_matrix.values));
+
+            primitive_index++;
+            header->instance_count++;
+         }
+
+         break;
+      }
+      default:
+         unreachable("Unknown geometryType");
+      }
+   }
+
+   leaf_count = primitive_index;
+
+   struct lvp_build_internal_ctx internal_ctx = {
+      .dst = dst,
+
+      .leaf_nodes = leaf_nodes,
+      .leaf_nodes_offset = header->leaf_nodes_offset,
+
+      .keys = scratch,
+      .tmp_keys = (uint64_t *)scratch + leaf_count,
+      .leaf_bounds = (void *)((uint64_t *)scratch + 2 * leaf_count),
+   };
+
+   /* Fast trace: SAH for all nodes. Fast build: a linear BVH, only sorting
+    * by Morton code. Otherwise SAH for the large nodes, where it makes the
+    * most difference.
+    */
+   if (info->flags & VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR)
+      internal_ctx.sah_min_leaves = 2;
+   else if (info->flags & VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR)
+      internal_ctx.sah_min_leaves = UINT32_MAX;
+   else
+      internal_ctx.sah_min_leaves = LVP_BVH_SAH_MIN_LEAVES;
+
+   if (queue && util_queue_is_initialized(queue)) {
+      internal_ctx.queue = queue;
+      internal_ctx.thread_depth =
+         DIV_ROUND_UP(util_logbase2_ceil(queue->num_threads + 1), util_logbase2(LVP_BVH_WIDTH));
+   }
+
+   VkGeometryTypeKHR geometry_type = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+   if (info->geometryCount) {
+      if (info->pGeometries)
+         geometry_type = info->pGeometries[0].geometryType;
+      else
+         geometry_type = info->ppGeometries[0]->geometryType;
+   }
+
+   switch (geometry_type) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+      internal_ctx.leaf_node_type = lvp_bvh_node_triangle;
+      internal_ctx.leaf_node_size = sizeof(struct lvp_bvh_triangle_node);
+      break;
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      internal_ctx.leaf_node_type = lvp_bvh_node_aabb;
+      internal_ctx.leaf_node_size = sizeof(struct lvp_bvh_aabb_node);
+      break;
+   case VK_GEOMETRY_TYPE_INSTANCES_KHR:
+      internal_ctx.leaf_node_type = lvp_bvh_node_instance;
+      internal_ctx.leaf_node_size = sizeof(struct lvp_bvh_instance_node);
+      break;
+   default:
+      unreachable("Unknown VkGeometryTypeKHR");
+   }
+
+   if (leaf_count > 1) {
+      lvp_sort_leaves(&internal_ctx, leaf_count);
+
+      struct lvp_build_node_args root_args = {
+         .ctx = &internal_ctx,
+         .dst_offset = sizeof(struct lvp_bvh_header),
+         .first_leaf = 0,
+         .leaf_count = leaf_count,
+      };
+      if (internal_ctx.queue)
+         lvp_build_internal_node_queued(&root_args);
+      else
+         lvp_build_internal_node(&root_args);
+      header->bounds = root_args.bounds;
+   } else {
+      header->bounds = lvp_aabb_empty;
+      for (uint32_t i = 0; i < LVP_BVH_WIDTH; i++)
+         lvp_box_node_set_child(root, i, LVP_BVH_INVALID_NODE, &lvp_aabb_empty);
+
+      if (leaf_count) {
+         lvp_leaf_bounds(&internal_ctx, 0, &header->bounds);
+         lvp_box_node_set_child(root, 0, header->leaf_nodes_offset | internal_ctx.leaf_node_type,
+                                &header->bounds);
+      }
+   }
+
+   header->serialization_size = sizeof(struct lvp_accel_struct_serialization_header) +
+                                sizeof(uint64_t) * header->instance_count + size;
+}
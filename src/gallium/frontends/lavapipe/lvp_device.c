@@ -40,6 +40,7 @@
 #include "util/os_time.h"
 #include "util/u_thread.h"
 #include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "util/timespec.h"
 #include "util/ptralloc.h"
 #include "nir.h"
@@ -1468,7 +1469,18 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          VK_QUEUE_COMPUTE_BIT |
          VK_QUEUE_TRANSFER_BIT |
          (DETECT_OS_LINUX ? VK_QUEUE_SPARSE_BINDING_BIT : 0),
-         .queueCount = 1,
+         .queueCount = LVP_MAX_QUEUES,
+         .timestampValidBits = 64,
+         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
+      };
+   }
+
+   /* async compute */
+   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+      p->queueFamilyProperties = (VkQueueFamilyProperties) {
+         .queueFlags = VK_QUEUE_COMPUTE_BIT |
+         VK_QUEUE_TRANSFER_BIT,
+         .queueCount = LVP_MAX_QUEUES,
          .timestampValidBits = 64,
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
       };
@@ -1573,17 +1585,41 @@ destroy_pipelines(struct lvp_queue *queue)
    simple_mtx_unlock(&queue->lock);
 }
 
+static void
+prepare_cmds_job(void *data, void *gdata, int thread_index)
+{
+   lvp_prepare_cmds(data);
+}
+
 static VkResult
 lvp_queue_submit(struct vk_queue *vk_queue,
                  struct vk_queue_submit *submit)
 {
    struct lvp_queue *queue = container_of(vk_queue, struct lvp_queue, vk);
+   struct lvp_device *device = queue->device;
+
+   /* The preparation only reads what the host writes, so it doesn't need to
+    * wait for the semaphores.
+    */
+   struct lvp_cmd_prep *preps = NULL;
+   if (submit->command_buffer_count &&
+       util_queue_is_initialized(&device->cmd_prep_queue))
+      preps = calloc(submit->command_buffer_count, sizeof(*preps));
+
+   for (uint32_t i = 0; preps && i < submit->command_buffer_count; i++) {
+      struct lvp_cmd_buffer *cmd_buffer =
+         container_of(submit->command_buffers[i], struct lvp_cmd_buffer, vk);
+
+      lvp_cmd_prep_init(&preps[i], device, cmd_buffer);
+      util_queue_add_job(&device->cmd_prep_queue, &preps[i], &preps[i].fence,
+                         prepare_cmds_job, NULL, 0);
+   }
 
    VkResult result = vk_sync_wait_many(&queue->device->vk,
                                        submit->wait_count, submit->waits,
                                        VK_SYNC_WAIT_COMPLETE, UINT64_MAX);
    if (result != VK_SUCCESS)
-      return result;
+      goto out;
 
    simple_mtx_lock(&queue->lock);
 
@@ -1608,8 +1644,13 @@ lvp_queue_submit(struct vk_queue *vk_queue,
    for (uint32_t i = 0; i < submit->command_buffer_count; i++) {
       struct lvp_cmd_buffer *cmd_buffer =
          container_of(submit->command_buffers[i], struct lvp_cmd_buffer, vk);
+      struct lvp_cmd_prep *prep = preps ? &preps[i] : NULL;
+
+      /* prepare it here if no thread got to it yet */
+      if (prep && !lvp_prepare_cmds(prep))
+         util_queue_fence_wait(&prep->fence);
 
-      lvp_execute_cmds(queue->device, queue, cmd_buffer);
+      lvp_execute_cmds(queue->device, queue, cmd_buffer, prep);
    }
 
    simple_mtx_unlock(&queue->lock);
@@ -1622,9 +1663,16 @@ lvp_queue_submit(struct vk_queue *vk_queue,
          vk_sync_as_lvp_pipe_sync(submit->signals[i].sync);
       lvp_pipe_sync_signal_with_fence(queue->device, sync, queue->last_fence);
    }
-   destroy_pipelines(queue);
+   destroy_pipelines(&queue->device->queue);
 
-   return VK_SUCCESS;
+out:
+   for (uint32_t i = 0; preps && i < submit->command_buffer_count; i++) {
+      util_queue_fence_wait(&preps[i].fence);
+      lvp_cmd_prep_finish(&preps[i]);
+   }
+   free(preps);
+
+   return result;
 }
 
 static VkResult
@@ -1654,6 +1702,15 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
    simple_mtx_init(&queue->lock, mtx_plain);
    util_dynarray_init(&queue->pipeline_destroys, NULL);
 
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
+   struct pipe_shader_state shstate = {0};
+   shstate.type = PIPE_SHADER_IR_NIR;
+   shstate.ir.nir = b.shader;
+   queue->noop_fs = queue->ctx->create_fs_state(queue->ctx, &shstate);
+
+   if (queue != &device->queue)
+      queue->shader_csos = _mesa_pointer_hash_table_create(NULL);
+
    return VK_SUCCESS;
 }
 
@@ -1666,11 +1723,134 @@ lvp_queue_finish(struct lvp_queue *queue)
    simple_mtx_destroy(&queue->lock);
    util_dynarray_fini(&queue->pipeline_destroys);
 
+   if (queue->shader_csos) {
+      /* the shaders which were not destroyed */
+      hash_table_foreach(queue->shader_csos, entry) {
+         const nir_shader *nir = entry->key;
+         switch (nir->info.stage) {
+         case MESA_SHADER_VERTEX:
+            queue->ctx->delete_vs_state(queue->ctx, entry->data);
+            break;
+         case MESA_SHADER_TESS_CTRL:
+            queue->ctx->delete_tcs_state(queue->ctx, entry->data);
+            break;
+         case MESA_SHADER_TESS_EVAL:
+            queue->ctx->delete_tes_state(queue->ctx, entry->data);
+            break;
+         case MESA_SHADER_GEOMETRY:
+            queue->ctx->delete_gs_state(queue->ctx, entry->data);
+            break;
+         case MESA_SHADER_FRAGMENT:
+            queue->ctx->delete_fs_state(queue->ctx, entry->data);
+            break;
+         case MESA_SHADER_TASK:
+            queue->ctx->delete_ts_state(queue->ctx, entry->data);
+            break;
+         case MESA_SHADER_MESH:
+            queue->ctx->delete_ms_state(queue->ctx, entry->data);
+            break;
+         default:
+            queue->ctx->delete_compute_state(queue->ctx, entry->data);
+            break;
+         }
+      }
+      _mesa_hash_table_destroy(queue->shader_csos, NULL);
+   }
+
+   queue->ctx->delete_fs_state(queue->ctx, queue->noop_fs);
+
+   if (queue->last_fence)
+      queue->ctx->screen->fence_reference(queue->ctx->screen, &queue->last_fence, NULL);
+
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
 }
 
+static void
+lvp_device_finish_queues(struct lvp_device *device)
+{
+   /* The pipelines waiting to be destroyed may have states on every queue */
+   destroy_pipelines(&device->queue);
+
+   for (uint32_t i = 0; i < device->queue_count; i++) {
+      lvp_queue_finish(device->queues[i]);
+      vk_free(&device->vk.alloc, device->queues[i]);
+   }
+   vk_free(&device->vk.alloc, device->queues);
+   device->queue_count = 0;
+   device->queues = NULL;
+}
+
+static VkResult
+lvp_device_init_queues(struct lvp_device *device,
+                       const VkDeviceCreateInfo *create_info)
+{
+   /* The device queue always exists, as it owns the objects created through
+    * the device. It is the first queue of the first family when the
+    * application asks for it.
+    */
+   const VkDeviceQueueCreateInfo *device_queue_info = &(VkDeviceQueueCreateInfo) {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+   };
+   uint32_t queue_count = 0;
+
+   for (uint32_t i = 0; i < create_info->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *info = &create_info->pQueueCreateInfos[i];
+
+      assert(info->queueFamilyIndex < 2);
+      assert(info->queueCount <= LVP_MAX_QUEUES);
+      queue_count += info->queueCount;
+      if (info->queueFamilyIndex == 0) {
+         device_queue_info = info;
+         queue_count--;
+      }
+   }
+
+   VkResult result = lvp_queue_init(device, &device->queue, device_queue_info, 0);
+   if (result != VK_SUCCESS)
+      return result;
+
+   if (!queue_count)
+      return VK_SUCCESS;
+
+   device->queues = vk_zalloc(&device->vk.alloc, queue_count * sizeof(*device->queues), 8,
+                              VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+   if (!device->queues) {
+      lvp_device_finish_queues(device);
+      lvp_queue_finish(&device->queue);
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
+   size_t state_size = lvp_get_rendering_state_size();
+   for (uint32_t i = 0; i < create_info->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *info = &create_info->pQueueCreateInfos[i];
+
+      for (uint32_t j = info->queueFamilyIndex == 0 ? 1 : 0; j < info->queueCount; j++) {
+         struct lvp_queue *queue = vk_zalloc(&device->vk.alloc, sizeof(*queue) + state_size, 8,
+                                             VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+         if (!queue)
+            result = vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+         else
+            result = lvp_queue_init(device, queue, info, j);
+
+         if (result != VK_SUCCESS) {
+            vk_free(&device->vk.alloc, queue);
+            lvp_device_finish_queues(device);
+            lvp_queue_finish(&device->queue);
+            return result;
+         }
+
+         queue->state = queue + 1;
+         device->queues[device->queue_count++] = queue;
+      }
+   }
+
+   return VK_SUCCESS;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
    VkPhysicalDevice                            physicalDevice,
    const VkDeviceCreateInfo*                   pCreateInfo,
@@ -1717,20 +1897,12 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   result = lvp_device_init_queues(device, pCreateInfo);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, device);
       return result;
    }
 
-   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
-   struct pipe_shader_state shstate = {0};
-   shstate.type = PIPE_SHADER_IR_NIR;
-   shstate.ir.nir = b.shader;
-   device->noop_fs = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
    _mesa_hash_table_init(&device->bda, NULL, _mesa_hash_pointer, _mesa_key_pointer_equal);
    simple_mtx_init(&device->bda_lock, mtx_plain);
 
@@ -1747,6 +1919,16 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->group_handle_alloc = 1;
 
+   /* The thread creating the pipelines compiles too */
+   unsigned compile_threads = debug_get_num_option("LVP_COMPILE_THREADS",
+                                                   util_get_cpu_caps()->nr_cpus - 1);
+   if (compile_threads) {
+      util_queue_init(&device->compile_queue, "lvp_compile", 64, compile_threads,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+      util_queue_init(&device->cmd_prep_queue, "lvp_cmd_prep", 64, compile_threads,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+   }
+
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
@@ -1759,6 +1941,11 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
 
+   if (util_queue_is_initialized(&device->compile_queue))
+      util_queue_destroy(&device->compile_queue);
+   if (util_queue_is_initialized(&device->cmd_prep_queue))
+      util_queue_destroy(&device->cmd_prep_queue);
+
    util_dynarray_foreach(&device->bda_texture_handles, struct lp_texture_handle *, handle)
       device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)*handle);
 
@@ -1772,14 +1959,11 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
    device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_texture_handle);
    device->queue.ctx->delete_image_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_image_handle);
 
-   device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
-
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
+   lvp_device_finish_queues(device);
    lvp_queue_finish(&device->queue);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
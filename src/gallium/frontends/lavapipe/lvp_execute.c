@@ -82,6 +82,7 @@ struct lvp_render_attachment {
 struct rendering_state {
    struct pipe_context *pctx;
    struct lvp_device *device; //for uniform inlining only
+   struct lvp_queue *queue;
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
 
@@ -203,6 +204,8 @@ struct rendering_state {
    struct util_dynarray push_desc_sets;
    struct util_dynarray internal_buffers;
 
+   struct lvp_cmd_prep *prep;
+
    struct lvp_pipeline *exec_graph;
 };
 
@@ -295,60 +298,46 @@ update_pcbuf(struct rendering_state *state, enum pipe_shader_type pstage,
    state->pcbuf_dirty[api_stage] = false;
 }
 
+static void *
+get_shader_cso(struct rendering_state *state, struct lvp_shader *shader, bool tess_ccw)
+{
+   if (state->queue == &state->device->queue)
+      return tess_ccw ? shader->tess_ccw_cso : shader->shader_cso;
+
+   struct lvp_pipeline_nir *pipeline_nir = tess_ccw ? shader->tess_ccw : shader->pipeline_nir;
+   return pipeline_nir ? lvp_queue_get_shader_cso(state->queue, shader, pipeline_nir->nir) : NULL;
+}
+
 static void
-update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type sh, bool pcbuf_dirty)
+update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type sh)
 {
    unsigned stage = tgsi_processor_to_shader_stage(sh);
    state->inlines_dirty[sh] = false;
    struct lvp_shader *shader = state->shaders[stage];
    if (!shader || !shader->inlines.can_inline)
       return;
-   struct lvp_inline_variant v;
-   v.mask = shader->inlines.can_inline;
-   /* these buffers have already been flushed in llvmpipe, so they're safe to read */
-   nir_shader *base_nir = shader->pipeline_nir->nir;
-   if (stage == MESA_SHADER_TESS_EVAL && state->tess_ccw)
-      base_nir = shader->tess_ccw->nir;
-   nir_function_impl *impl = nir_shader_get_entrypoint(base_nir);
-   unsigned ssa_alloc = impl->ssa_alloc;
-   unsigned count = shader->inlines.count[0];
-   if (count && pcbuf_dirty) {
-      unsigned push_size = get_pcbuf_size(state, sh);
-      for (unsigned i = 0; i < count; i++) {
-         unsigned offset = shader->inlines.uniform_offsets[0][i];
-         if (offset < push_size) {
-            memcpy(&v.vals[0][i], &state->push_constants[offset], sizeof(uint32_t));
-         }
-      }
-      for (unsigned i = count; i < MAX_INLINABLE_UNIFORMS; i++)
-         v.vals[0][i] = 0;
-   }
-   bool found = false;
-   struct set_entry *entry = _mesa_set_search_or_add_pre_hashed(&shader->inlines.variants, v.mask, &v, &found);
    void *shader_state;
-   if (found) {
-      const struct lvp_inline_variant *variant = entry->key;
-      shader_state = variant->cso;
-   } else {
-      nir_shader *nir = nir_shader_clone(NULL, base_nir);
-      NIR_PASS_V(nir, lvp_inline_uniforms, shader, v.vals[0], 0);
-      lvp_shader_optimize(nir);
-      impl = nir_shader_get_entrypoint(nir);
-      if (ssa_alloc - impl->ssa_alloc < ssa_alloc / 2 &&
-         !shader->inlines.must_inline) {
-         /* not enough change; don't inline further */
-         shader->inlines.can_inline = 0;
-         ralloc_free(nir);
-         shader->shader_cso = lvp_shader_compile(state->device, shader, nir_shader_clone(NULL, shader->pipeline_nir->nir), true);
-         _mesa_set_remove(&shader->inlines.variants, entry);
-         shader_state = shader->shader_cso;
-      } else {
-         shader_state = lvp_shader_compile(state->device, shader, nir, true);
-         struct lvp_inline_variant *variant = mem_dup(&v, sizeof(v));
-         variant->cso = shader_state;
-         entry->key = variant;
-      }
-   }
+   bool tess_ccw = stage == MESA_SHADER_TESS_EVAL && state->tess_ccw;
+   if (state->queue != &state->device->queue) {
+      /* the variants are only compiled for the device queue */
+      shader_state = get_shader_cso(state, shader, tess_ccw);
+      goto bind;
+   }
+   struct lvp_inline_variant v = {
+      .mask = shader->inlines.can_inline,
+      .tess_ccw = tess_ccw,
+   };
+   unsigned push_size = get_pcbuf_size(state, sh);
+   for (unsigned i = 0; i < shader->inlines.count[0]; i++) {
+      unsigned offset = shader->inlines.uniform_offsets[0][i];
+      if (offset < push_size)
+         memcpy(&v.vals[0][i], &state->push_constants[offset], sizeof(uint32_t));
+   }
+   bool pending;
+   shader_state = lvp_shader_get_inline_variant(state->device, shader, &v, &pending);
+   /* try again at the next draw until the variant is compiled */
+   state->inlines_dirty[sh] = pending;
+bind:
    switch (sh) {
    case MESA_SHADER_VERTEX:
       state->pctx->bind_vs_state(state->pctx, shader_state);
@@ -381,7 +370,6 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
 
 static void emit_compute_state(struct rendering_state *state)
 {
-   bool pcbuf_dirty = state->pcbuf_dirty[MESA_SHADER_COMPUTE];
    if (state->pcbuf_dirty[MESA_SHADER_COMPUTE])
       update_pcbuf(state, MESA_SHADER_COMPUTE, MESA_SHADER_COMPUTE);
 
@@ -394,9 +382,9 @@ static void emit_compute_state(struct rendering_state *state)
 
    if (state->inlines_dirty[MESA_SHADER_COMPUTE] &&
        state->shaders[MESA_SHADER_COMPUTE]->inlines.can_inline) {
-      update_inline_shader_state(state, MESA_SHADER_COMPUTE, pcbuf_dirty);
+      update_inline_shader_state(state, MESA_SHADER_COMPUTE);
    } else if (state->compute_shader_dirty) {
-      state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_COMPUTE]->shader_cso);
+      state->pctx->bind_compute_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_COMPUTE], false));
    }
 
    state->compute_shader_dirty = false;
@@ -449,7 +437,7 @@ static void update_vertex_elements_buffer_index(struct rendering_state *state)
 static void emit_state(struct rendering_state *state)
 {
    if (!state->shaders[MESA_SHADER_FRAGMENT] && !state->noop_fs_bound) {
-      state->pctx->bind_fs_state(state->pctx, state->device->noop_fs);
+      state->pctx->bind_fs_state(state->pctx, state->queue->noop_fs);
       state->noop_fs_bound = true;
    }
    if (state->blend_dirty) {
@@ -563,8 +551,6 @@ static void emit_state(struct rendering_state *state)
       state->vb_dirty = false;
    }
 
-   bool pcbuf_dirty[LVP_SHADER_STAGES] = {false};
-
    lvp_forall_gfx_stage(sh) {
       if (state->constbuf_dirty[sh]) {
          for (unsigned idx = 0; idx < state->num_const_bufs[sh]; idx++)
@@ -575,14 +561,13 @@ static void emit_state(struct rendering_state *state)
    }
 
    lvp_forall_gfx_stage(sh) {
-      pcbuf_dirty[sh] = state->pcbuf_dirty[sh];
       if (state->pcbuf_dirty[sh])
          update_pcbuf(state, sh, sh);
    }
 
    lvp_forall_gfx_stage(sh) {
       if (state->inlines_dirty[sh])
-         update_inline_shader_state(state, sh, pcbuf_dirty[sh]);
+         update_inline_shader_state(state, sh);
    }
 
    if (state->vp_dirty) {
@@ -698,25 +683,25 @@ handle_graphics_stages(struct rendering_state *state, VkShaderStageFlagBits shad
       case VK_SHADER_STAGE_FRAGMENT_BIT:
          state->inlines_dirty[MESA_SHADER_FRAGMENT] = state->shaders[MESA_SHADER_FRAGMENT]->inlines.can_inline;
          if (!state->shaders[MESA_SHADER_FRAGMENT]->inlines.can_inline) {
-            state->pctx->bind_fs_state(state->pctx, state->shaders[MESA_SHADER_FRAGMENT]->shader_cso);
+            state->pctx->bind_fs_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_FRAGMENT], false));
             state->noop_fs_bound = false;
          }
          break;
       case VK_SHADER_STAGE_VERTEX_BIT:
          state->inlines_dirty[MESA_SHADER_VERTEX] = state->shaders[MESA_SHADER_VERTEX]->inlines.can_inline;
          if (!state->shaders[MESA_SHADER_VERTEX]->inlines.can_inline)
-            state->pctx->bind_vs_state(state->pctx, state->shaders[MESA_SHADER_VERTEX]->shader_cso);
+            state->pctx->bind_vs_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_VERTEX], false));
          break;
       case VK_SHADER_STAGE_GEOMETRY_BIT:
          state->inlines_dirty[MESA_SHADER_GEOMETRY] = state->shaders[MESA_SHADER_GEOMETRY]->inlines.can_inline;
          if (!state->shaders[MESA_SHADER_GEOMETRY]->inlines.can_inline)
-            state->pctx->bind_gs_state(state->pctx, state->shaders[MESA_SHADER_GEOMETRY]->shader_cso);
+            state->pctx->bind_gs_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_GEOMETRY], false));
          state->gs_output_lines = state->shaders[MESA_SHADER_GEOMETRY]->pipeline_nir->nir->info.gs.output_primitive == MESA_PRIM_LINES ? GS_OUTPUT_LINES : GS_OUTPUT_NOT_LINES;
          break;
       case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
          state->inlines_dirty[MESA_SHADER_TESS_CTRL] = state->shaders[MESA_SHADER_TESS_CTRL]->inlines.can_inline;
          if (!state->shaders[MESA_SHADER_TESS_CTRL]->inlines.can_inline)
-            state->pctx->bind_tcs_state(state->pctx, state->shaders[MESA_SHADER_TESS_CTRL]->shader_cso);
+            state->pctx->bind_tcs_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_TESS_CTRL], false));
          break;
       case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
          state->inlines_dirty[MESA_SHADER_TESS_EVAL] = state->shaders[MESA_SHADER_TESS_EVAL]->inlines.can_inline;
@@ -724,11 +709,11 @@ handle_graphics_stages(struct rendering_state *state, VkShaderStageFlagBits shad
          state->tess_states[1] = NULL;
          if (!state->shaders[MESA_SHADER_TESS_EVAL]->inlines.can_inline) {
             if (dynamic_tess_origin) {
-               state->tess_states[0] = state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso;
-               state->tess_states[1] = state->shaders[MESA_SHADER_TESS_EVAL]->tess_ccw_cso;
+               state->tess_states[0] = get_shader_cso(state, state->shaders[MESA_SHADER_TESS_EVAL], false);
+               state->tess_states[1] = get_shader_cso(state, state->shaders[MESA_SHADER_TESS_EVAL], true);
                state->pctx->bind_tes_state(state->pctx, state->tess_states[state->tess_ccw]);
             } else {
-               state->pctx->bind_tes_state(state->pctx, state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso);
+               state->pctx->bind_tes_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_TESS_EVAL], false));
             }
          }
          if (!dynamic_tess_origin)
@@ -737,12 +722,12 @@ handle_graphics_stages(struct rendering_state *state, VkShaderStageFlagBits shad
       case VK_SHADER_STAGE_TASK_BIT_EXT:
          state->inlines_dirty[MESA_SHADER_TASK] = state->shaders[MESA_SHADER_TASK]->inlines.can_inline;
          if (!state->shaders[MESA_SHADER_TASK]->inlines.can_inline)
-            state->pctx->bind_ts_state(state->pctx, state->shaders[MESA_SHADER_TASK]->shader_cso);
+            state->pctx->bind_ts_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_TASK], false));
          break;
       case VK_SHADER_STAGE_MESH_BIT_EXT:
          state->inlines_dirty[MESA_SHADER_MESH] = state->shaders[MESA_SHADER_MESH]->inlines.can_inline;
          if (!state->shaders[MESA_SHADER_MESH]->inlines.can_inline)
-            state->pctx->bind_ms_state(state->pctx, state->shaders[MESA_SHADER_MESH]->shader_cso);
+            state->pctx->bind_ms_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_MESH], false));
          break;
       default:
          assert(0);
@@ -808,7 +793,8 @@ static void handle_graphics_pipeline(struct lvp_pipeline *pipeline,
                                      struct rendering_state *state)
 {
    const struct vk_graphics_pipeline_state *ps = &pipeline->graphics_state;
-   lvp_pipeline_shaders_compile(pipeline, true);
+   if (state->queue == &state->device->queue)
+      lvp_pipeline_shaders_compile(pipeline, true);
    bool dynamic_tess_origin = BITSET_TEST(ps->dynamic, MESA_VK_DYNAMIC_TS_DOMAIN_ORIGIN);
    unbind_graphics_stages(state,
                           (~pipeline->graphics_state.shader_stages) &
@@ -1213,24 +1199,41 @@ static void handle_set_stage(struct rendering_state *state,
    handle_set_stage_buffer(state, set->bo, 0, stage, index);
 }
 
-static void
-apply_dynamic_offsets(struct lvp_descriptor_set **out_set, const uint32_t *offsets, uint32_t offset_count,
-                      struct rendering_state *state)
+/* A descriptor set created by lvp_prepare_cmds() for the command cmd. src is
+ * the set it was copied from for dynamic offsets, or the set layout for push
+ * descriptors.
+ */
+struct lvp_prepared_set {
+   const void *cmd;
+   const void *src;
+   struct lvp_descriptor_set *set;
+};
+
+static struct lvp_descriptor_set *
+take_prepared_set(struct rendering_state *state, const void *cmd, const void *src)
 {
-   if (!offset_count)
-      return;
+   struct lvp_cmd_prep *prep = state->prep;
+   if (!prep || prep->next_set == util_dynarray_num_elements(&prep->sets, struct lvp_prepared_set))
+      return NULL;
 
-   struct lvp_descriptor_set *in_set = *out_set;
+   struct lvp_prepared_set *prepared =
+      util_dynarray_element(&prep->sets, struct lvp_prepared_set, prep->next_set);
+   if (prepared->cmd != cmd || prepared->src != src)
+      return NULL;
 
-   struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, in_set->layout, &set);
+   prep->next_set++;
+   return prepared->set;
+}
 
-   util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
+static struct lvp_descriptor_set *
+create_offset_set(struct lvp_device *device, struct lvp_descriptor_set *in_set,
+                  const uint32_t *offsets, uint32_t offset_count)
+{
+   struct lvp_descriptor_set *set;
+   lvp_descriptor_set_create(device, in_set->layout, &set);
 
    memcpy(set->map, in_set->map, in_set->bo->width0);
 
-   *out_set = set;
-
    for (uint32_t i = 0; i < set->layout->binding_count; i++) {
       const struct lvp_descriptor_set_binding_layout *binding = &set->layout->binding[i];
       if (binding->type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC &&
@@ -1243,11 +1246,32 @@ apply_dynamic_offsets(struct lvp_descriptor_set **out_set, const uint32_t *offse
       for (uint32_t j = 0; j < binding->array_size; j++) {
          uint32_t offset_index = binding->dynamic_index + j;
          if (offset_index >= offset_count)
-            return;
+            return set;
 
          desc[j].buffer.u = (uint32_t *)((uint8_t *)desc[j].buffer.u + offsets[offset_index]);
       }
    }
+
+   return set;
+}
+
+static void
+apply_dynamic_offsets(const void *cmd, struct lvp_descriptor_set **out_set,
+                      const uint32_t *offsets, uint32_t offset_count,
+                      struct rendering_state *state)
+{
+   if (!offset_count)
+      return;
+
+   struct lvp_descriptor_set *in_set = *out_set;
+
+   struct lvp_descriptor_set *set = take_prepared_set(state, cmd, in_set);
+   if (!set)
+      set = create_offset_set(state->device, in_set, offsets, offset_count);
+
+   util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
+
+   *out_set = set;
 }
 
 static void
@@ -1282,8 +1306,8 @@ handle_descriptor_sets(VkBindDescriptorSetsInfoKHR *bds, struct rendering_state
          if (!set)
             continue;
 
-         apply_dynamic_offsets(&set, bds->pDynamicOffsets + dynamic_offset_index,
-                              bds->dynamicOffsetCount - dynamic_offset_index, state);
+         apply_dynamic_offsets(bds, &set, bds->pDynamicOffsets + dynamic_offset_index,
+                               bds->dynamicOffsetCount - dynamic_offset_index, state);
 
          dynamic_offset_index += set->layout->dynamic_offset_count;
 
@@ -3285,8 +3309,9 @@ static void handle_push_descriptor_set(struct vk_cmd_queue_entry *cmd,
    LVP_FROM_HANDLE(lvp_pipeline_layout, layout, pds->layout);
    struct lvp_descriptor_set_layout *set_layout = (struct lvp_descriptor_set_layout *)layout->vk.set_layouts[pds->set];
 
-   struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, set_layout, &set);
+   struct lvp_descriptor_set *set = take_prepared_set(state, pds, set_layout);
+   if (!set)
+      lvp_descriptor_set_create(state->device, set_layout, &set);
 
    util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
 
@@ -3323,8 +3348,9 @@ static void handle_push_descriptor_set_with_template(struct vk_cmd_queue_entry *
    LVP_FROM_HANDLE(lvp_pipeline_layout, layout, pds->layout);
    struct lvp_descriptor_set_layout *set_layout = (struct lvp_descriptor_set_layout *)layout->vk.set_layouts[pds->set];
 
-   struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, set_layout, &set);
+   struct lvp_descriptor_set *set = take_prepared_set(state, pds, set_layout);
+   if (!set)
+      lvp_descriptor_set_create(state->device, set_layout, &set);
 
    util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
 
@@ -4079,6 +4105,24 @@ process_sequence(struct rendering_state *state,
    return size;
 }
 
+/* Whether the sequences of a layout are the draws of one indirect multi draw:
+ * the layout only has a draw token, and the pipeline does not tell the draws
+ * apart by their draw id, which is 0 for every sequence.
+ */
+static bool
+dgc_is_multi_draw(const struct lvp_indirect_command_layout_nv *dlayout, VkPipeline _pipeline)
+{
+   if (dlayout->token_count != 1 ||
+       (dlayout->tokens[0].tokenType != VK_INDIRECT_COMMANDS_TOKEN_TYPE_DRAW_NV &&
+        dlayout->tokens[0].tokenType != VK_INDIRECT_COMMANDS_TOKEN_TYPE_DRAW_INDEXED_NV))
+      return false;
+
+   LVP_FROM_HANDLE(lvp_pipeline, pipeline, _pipeline);
+   const struct lvp_shader *vs = &pipeline->shaders[MESA_SHADER_VERTEX];
+   return vs->pipeline_nir &&
+          !BITSET_TEST(vs->pipeline_nir->nir->info.system_values_read, SYSTEM_VALUE_DRAW_ID);
+}
+
 static void
 handle_preprocess_generated_commands(struct vk_cmd_queue_entry *cmd, struct rendering_state *state, bool print_cmds)
 {
@@ -4119,9 +4163,23 @@ handle_preprocess_generated_commands(struct vk_cmd_queue_entry *cmd, struct rend
    list_inithead(list);
 
    size_t offset = size;
-   for (unsigned i = 0; i < seq_count; i++) {
-      uint32_t s = seq ? seq[i] : i;
-      offset += process_sequence(state, pre->pipeline, dlayout, list, p + offset, max_size, streams, pre->pStreams, s, print_cmds);
+   if (!seq && seq_count && dgc_is_multi_draw(dlayout, pre->pipeline)) {
+      /* record the first draw, and extend it to all the sequences */
+      process_sequence(state, pre->pipeline, dlayout, list, p + offset, max_size, streams, pre->pStreams, 0, print_cmds);
+      struct vk_cmd_queue_entry *draw = list_last_entry(list, struct vk_cmd_queue_entry, cmd_link);
+      uint32_t stride = dlayout->stream_strides[dlayout->tokens[0].stream];
+      if (draw->type == VK_CMD_DRAW_INDEXED_INDIRECT) {
+         draw->u.draw_indexed_indirect.draw_count = seq_count;
+         draw->u.draw_indexed_indirect.stride = stride;
+      } else {
+         draw->u.draw_indirect.draw_count = seq_count;
+         draw->u.draw_indirect.stride = stride;
+      }
+   } else {
+      for (unsigned i = 0; i < seq_count; i++) {
+         uint32_t s = seq ? seq[i] : i;
+         offset += process_sequence(state, pre->pipeline, dlayout, list, p + offset, max_size, streams, pre->pStreams, s, print_cmds);
+      }
    }
 
    /* vk_cmd_queue will copy the binary and break the list, so null the tail pointer */
@@ -4541,7 +4599,7 @@ static void emit_ray_tracing_state(struct rendering_state *state)
       state->constbuf_dirty[MESA_SHADER_RAYGEN] = false;
    }
 
-   state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_RAYGEN]->shader_cso);
+   state->pctx->bind_compute_state(state->pctx, get_shader_cso(state, state->shaders[MESA_SHADER_RAYGEN], false));
 
    state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
    state->constbuf_dirty[MESA_SHADER_COMPUTE] = true;
@@ -5216,14 +5274,146 @@ static void lvp_execute_cmd_buffer(struct list_head *cmds,
    }
 }
 
+static void
+prepare_set(struct lvp_cmd_prep *prep, const void *cmd, const void *src,
+            struct lvp_descriptor_set *set)
+{
+   struct lvp_prepared_set prepared = {
+      .cmd = cmd,
+      .src = src,
+      .set = set,
+   };
+   util_dynarray_append(&prep->sets, struct lvp_prepared_set, prepared);
+}
+
+/* This has to create the same sets as handle_descriptor_sets() */
+static void
+prepare_descriptor_sets(struct lvp_cmd_prep *prep, const VkBindDescriptorSetsInfoKHR *bds)
+{
+   LVP_FROM_HANDLE(lvp_pipeline_layout, layout, bds->layout);
+
+   uint32_t dynamic_offset_index = 0;
+
+   uint32_t type_count = util_bitcount(lvp_pipeline_types_from_shader_stages(bds->stageFlags));
+   for (uint32_t t = 0; t < type_count; t++) {
+      for (uint32_t i = 0; i < bds->descriptorSetCount; i++) {
+         if (!layout->vk.set_layouts[bds->firstSet + i])
+            continue;
+
+         struct lvp_descriptor_set *set = lvp_descriptor_set_from_handle(bds->pDescriptorSets[i]);
+         if (!set)
+            continue;
+
+         uint32_t offset_count = bds->dynamicOffsetCount - dynamic_offset_index;
+         if (offset_count) {
+            prepare_set(prep, bds, set,
+                        create_offset_set(prep->device, set,
+                                          bds->pDynamicOffsets + dynamic_offset_index,
+                                          offset_count));
+         }
+
+         dynamic_offset_index += set->layout->dynamic_offset_count;
+      }
+   }
+}
+
+static void
+prepare_push_set(struct lvp_cmd_prep *prep, const void *cmd,
+                 VkPipelineLayout _layout, uint32_t set_index)
+{
+   LVP_FROM_HANDLE(lvp_pipeline_layout, layout, _layout);
+   struct lvp_descriptor_set_layout *set_layout =
+      (struct lvp_descriptor_set_layout *)layout->vk.set_layouts[set_index];
+
+   struct lvp_descriptor_set *set;
+   lvp_descriptor_set_create(prep->device, set_layout, &set);
+
+   prepare_set(prep, cmd, set_layout, set);
+}
+
+static void
+prepare_cmd_buffer(struct lvp_cmd_prep *prep, struct list_head *cmds)
+{
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, cmds, cmd_link) {
+      switch (cmd->type) {
+      case VK_CMD_BIND_DESCRIPTOR_SETS2_KHR:
+         prepare_descriptor_sets(prep, cmd->u.bind_descriptor_sets2_khr.bind_descriptor_sets_info);
+         break;
+      case VK_CMD_PUSH_DESCRIPTOR_SET2_KHR: {
+         VkPushDescriptorSetInfoKHR *pds = cmd->u.push_descriptor_set2_khr.push_descriptor_set_info;
+         prepare_push_set(prep, pds, pds->layout, pds->set);
+         break;
+      }
+      case VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE2_KHR: {
+         VkPushDescriptorSetWithTemplateInfoKHR *pds =
+            cmd->u.push_descriptor_set_with_template2_khr.push_descriptor_set_with_template_info;
+         prepare_push_set(prep, pds, pds->layout, pds->set);
+         break;
+      }
+      case VK_CMD_EXECUTE_COMMANDS:
+         for (unsigned i = 0; i < cmd->u.execute_commands.command_buffer_count; i++) {
+            LVP_FROM_HANDLE(lvp_cmd_buffer, secondary_buf, cmd->u.execute_commands.command_buffers[i]);
+            prepare_cmd_buffer(prep, &secondary_buf->vk.cmd_queue.cmds);
+         }
+         break;
+      default:
+         break;
+      }
+   }
+}
+
+void
+lvp_cmd_prep_init(struct lvp_cmd_prep *prep, struct lvp_device *device,
+                  struct lvp_cmd_buffer *cmd_buffer)
+{
+   util_queue_fence_init(&prep->fence);
+   prep->device = device;
+   prep->cmd_buffer = cmd_buffer;
+   prep->started = false;
+   util_dynarray_init(&prep->sets, NULL);
+   prep->next_set = 0;
+}
+
+void
+lvp_cmd_prep_finish(struct lvp_cmd_prep *prep)
+{
+   /* the sets which the execution did not take */
+   unsigned count = util_dynarray_num_elements(&prep->sets, struct lvp_prepared_set);
+   for (unsigned i = prep->next_set; i < count; i++) {
+      struct lvp_prepared_set *prepared =
+         util_dynarray_element(&prep->sets, struct lvp_prepared_set, i);
+      lvp_descriptor_set_destroy(prep->device, prepared->set);
+   }
+
+   util_dynarray_fini(&prep->sets);
+   util_queue_fence_destroy(&prep->fence);
+}
+
+/**
+ * Prepare the command buffer unless another thread has started to. Returns
+ * whether this call did it.
+ */
+bool
+lvp_prepare_cmds(struct lvp_cmd_prep *prep)
+{
+   if (p_atomic_xchg(&prep->started, true))
+      return false;
+
+   prepare_cmd_buffer(prep, &prep->cmd_buffer->vk.cmd_queue.cmds);
+   return true;
+}
+
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
-                          struct lvp_cmd_buffer *cmd_buffer)
+                          struct lvp_cmd_buffer *cmd_buffer,
+                          struct lvp_cmd_prep *prep)
 {
    struct rendering_state *state = queue->state;
    memset(state, 0, sizeof(*state));
    state->pctx = queue->ctx;
+   state->prep = prep;
    state->device = device;
+   state->queue = queue;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
    state->blend_dirty = true;
@@ -57,86 +57,83 @@ lvp_load_vertex_position(nir_builder *b, nir_def *instance_addr, nir_def *primit
    return nir_build_load_global(b, 3, 32, nir_iadd(b, bvh_addr, nir_u2u64(b, offset)));
 }
 
+/* Tests the ray against all children of a box node, and returns the children
+ * that were hit, nearest first, followed by LVP_BVH_INVALID_NODE.
+ */
 static nir_def *
 lvp_build_intersect_ray_box(nir_builder *b, nir_def *node_addr, nir_def *ray_tmax,
                             nir_def *origin, nir_def *dir, nir_def *inv_dir)
 {
-   const struct glsl_type *vec2_type = glsl_vector_type(GLSL_TYPE_FLOAT, 2);
-   const struct glsl_type *uvec2_type = glsl_vector_type(GLSL_TYPE_UINT, 2);
-
-   nir_variable *distances =
-      nir_variable_create(b->shader, nir_var_shader_temp, vec2_type, "distances");
-   nir_store_var(b, distances, nir_imm_vec2(b, INFINITY, INFINITY), 0xf);
-
-   nir_variable *child_indices =
-      nir_variable_create(b->shader, nir_var_shader_temp, uvec2_type, "child_indices");
-   nir_store_var(b, child_indices, nir_imm_ivec2(b, 0xffffffffu, 0xffffffffu), 0xf);
-
    inv_dir = nir_bcsel(b, nir_feq_imm(b, dir, 0), nir_imm_float(b, FLT_MAX), inv_dir);
 
-   for (int i = 0; i < 2; i++) {
-      const uint32_t child_offset = offsetof(struct lvp_bvh_box_node, children[i]);
-      const uint32_t coord_offsets[2] = {
-         offsetof(struct lvp_bvh_box_node, bounds[i].min.x),
-         offsetof(struct lvp_bvh_box_node, bounds[i].max.x),
-      };
+   nir_def *children = nir_build_load_global(
+      b, LVP_BVH_WIDTH, 32, nir_iadd_imm(b, node_addr, offsetof(struct lvp_bvh_box_node, children)));
 
-      nir_def *child_index =
-         nir_build_load_global(b, 1, 32, nir_iadd_imm(b, node_addr, child_offset));
+   nir_def *hit = nir_ine_imm(b, children, LVP_BVH_INVALID_NODE);
+   nir_def *tmin = NULL;
+   nir_def *tmax = NULL;
 
+   for (unsigned i = 0; i < 3; i++) {
       nir_def *node_coords[2] = {
-         nir_build_load_global(b, 3, 32, nir_iadd_imm(b, node_addr, coord_offsets[0])),
-         nir_build_load_global(b, 3, 32, nir_iadd_imm(b, node_addr, coord_offsets[1])),
+         nir_build_load_global(b, LVP_BVH_WIDTH, 32,
+            nir_iadd_imm(b, node_addr, offsetof(struct lvp_bvh_box_node, min[i]))),
+         nir_build_load_global(b, LVP_BVH_WIDTH, 32,
+            nir_iadd_imm(b, node_addr, offsetof(struct lvp_bvh_box_node, max[i]))),
       };
 
       /* If x of the aabb min is NaN, then this is an inactive aabb.
        * We don't need to care about any other components being NaN as that is UB.
        * https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/chap36.html#VkAabbPositionsKHR
        */
-      nir_def *min_x = nir_channel(b, node_coords[0], 0);
-      nir_def *min_x_is_not_nan =
-         nir_inot(b, nir_fneu(b, min_x, min_x)); /* NaN != NaN -> true */
-
-      nir_def *bound0 = nir_fmul(b, nir_fsub(b, node_coords[0], origin), inv_dir);
-      nir_def *bound1 = nir_fmul(b, nir_fsub(b, node_coords[1], origin), inv_dir);
-
-      nir_def *tmin =
-         nir_fmax(b,
-                  nir_fmax(b, nir_fmin(b, nir_channel(b, bound0, 0), nir_channel(b, bound1, 0)),
-                           nir_fmin(b, nir_channel(b, bound0, 1), nir_channel(b, bound1, 1))),
-                  nir_fmin(b, nir_channel(b, bound0, 2), nir_channel(b, bound1, 2)));
-
-      nir_def *tmax =
-         nir_fmin(b,
-                  nir_fmin(b, nir_fmax(b, nir_channel(b, bound0, 0), nir_channel(b, bound1, 0)),
-                           nir_fmax(b, nir_channel(b, bound0, 1), nir_channel(b, bound1, 1))),
-                  nir_fmax(b, nir_channel(b, bound0, 2), nir_channel(b, bound1, 2)));
-
-      nir_push_if(b,
-                  nir_iand(b, min_x_is_not_nan,
-                           nir_iand(b, nir_fge(b, tmax, nir_fmax(b, nir_imm_float(b, 0.0f), tmin)),
-                                    nir_flt(b, tmin, ray_tmax))));
-      {
-         nir_def *new_child_indices[2] = {child_index, child_index};
-         nir_store_var(b, child_indices, nir_vec(b, new_child_indices, 2), 1u << i);
+      if (i == 0)
+         hit = nir_iand(b, hit, nir_feq(b, node_coords[0], node_coords[0]));
 
-         nir_def *new_distances[2] = {tmin, tmin};
-         nir_store_var(b, distances, nir_vec(b, new_distances, 2), 1u << i);
-      }
-      nir_pop_if(b, NULL);
+      nir_def *o = nir_channel(b, origin, i);
+      nir_def *inv = nir_channel(b, inv_dir, i);
+
+      nir_def *bound0 = nir_fmul(b, nir_fsub(b, node_coords[0], o), inv);
+      nir_def *bound1 = nir_fmul(b, nir_fsub(b, node_coords[1], o), inv);
+
+      nir_def *near = nir_fmin(b, bound0, bound1);
+      nir_def *far = nir_fmax(b, bound0, bound1);
+
+      tmin = tmin ? nir_fmax(b, tmin, near) : near;
+      tmax = tmax ? nir_fmin(b, tmax, far) : far;
    }
 
-   nir_def *ssa_distances = nir_load_var(b, distances);
-   nir_def *ssa_indices = nir_load_var(b, child_indices);
-   nir_push_if(b, nir_flt(b, nir_channel(b, ssa_distances, 1), nir_channel(b, ssa_distances, 0)));
-   {
-      nir_store_var(b, child_indices,
-                    nir_vec2(b, nir_channel(b, ssa_indices, 1), nir_channel(b, ssa_indices, 0)),
-                    0b11);
+   hit = nir_iand(b, hit,
+                  nir_iand(b, nir_fge(b, tmax, nir_fmax(b, nir_imm_float(b, 0.0f), tmin)),
+                           nir_flt(b, tmin, ray_tmax)));
+
+   nir_def *distances = nir_bcsel(b, hit, tmin, nir_imm_float(b, INFINITY));
+   children = nir_bcsel(b, hit, children, nir_imm_int(b, LVP_BVH_INVALID_NODE));
+
+   /* Sort the children by distance, with a sorting network so that there is
+    * no control flow.
+    */
+   static const unsigned sort_pairs[][2] = {{0, 1}, {2, 3}, {0, 2}, {1, 3}, {1, 2}};
+   static_assert(LVP_BVH_WIDTH == 4, "the sorting network is for 4 children");
+
+   nir_def *dist[LVP_BVH_WIDTH];
+   nir_def *child[LVP_BVH_WIDTH];
+   for (unsigned i = 0; i < LVP_BVH_WIDTH; i++) {
+      dist[i] = nir_channel(b, distances, i);
+      child[i] = nir_channel(b, children, i);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(sort_pairs); i++) {
+      const unsigned lo = sort_pairs[i][0], hi = sort_pairs[i][1];
+      nir_def *swap = nir_flt(b, dist[hi], dist[lo]);
+
+      nir_def *lo_dist = nir_bcsel(b, swap, dist[hi], dist[lo]);
+      nir_def *lo_child = nir_bcsel(b, swap, child[hi], child[lo]);
+      dist[hi] = nir_bcsel(b, swap, dist[lo], dist[hi]);
+      child[hi] = nir_bcsel(b, swap, child[lo], child[hi]);
+      dist[lo] = lo_dist;
+      child[lo] = lo_child;
    }
-   nir_pop_if(b, NULL);
 
-   return nir_load_var(b, child_indices);
+   return nir_vec(b, child, LVP_BVH_WIDTH);
 }
 
 static nir_def *
@@ -497,11 +494,14 @@ lvp_build_ray_traversal(nir_builder *b, const struct lvp_ray_traversal_args *arg
 
             nir_store_deref(b, args->vars.current_node, nir_channel(b, result, 0), 0x1);
 
-            nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, 1), LVP_BVH_INVALID_NODE));
-            {
-               lvp_build_push_stack(b, args, nir_channel(b, result, 1));
+            /* Push the farthest first, so that the nearest is popped next */
+            for (unsigned i = LVP_BVH_WIDTH - 1; i > 0; i--) {
+               nir_push_if(b, nir_ine_imm(b, nir_channel(b, result, i), LVP_BVH_INVALID_NODE));
+               {
+                  lvp_build_push_stack(b, args, nir_channel(b, result, i));
+               }
+               nir_pop_if(b, NULL);
             }
-            nir_pop_if(b, NULL);
          }
          nir_pop_if(b, NULL);
       }
@@ -24,10 +24,13 @@
 #include "lvp_private.h"
 #include "vk_nir_convert_ycbcr.h"
 #include "vk_pipeline.h"
+#include "vk_pipeline_cache.h"
 #include "vk_render_pass.h"
 #include "vk_util.h"
 #include "glsl_types.h"
+#include "util/mesa-sha1.h"
 #include "util/os_time.h"
+#include "util/u_thread.h"
 #include "spirv/nir_spirv.h"
 #include "nir/nir_builder.h"
 #include "nir/nir_serialize.h"
@@ -42,43 +45,95 @@
 
 typedef void (*cso_destroy_func)(struct pipe_context*, void*);
 
+static void
+shader_cso_destroy(struct pipe_context *ctx, gl_shader_stage stage, void *cso)
+{
+   /* The contexts share the same functions */
+   cso_destroy_func destroy[] = {
+      ctx->delete_vs_state,
+      ctx->delete_tcs_state,
+      ctx->delete_tes_state,
+      ctx->delete_gs_state,
+      ctx->delete_fs_state,
+      ctx->delete_compute_state,
+      ctx->delete_ts_state,
+      ctx->delete_ms_state,
+   };
+
+   destroy[stage](ctx, cso);
+}
+
+static void
+queue_shader_destroy(struct lvp_queue *queue, nir_shader *nir)
+{
+   simple_mtx_lock(&queue->lock);
+
+   struct hash_entry *entry = _mesa_hash_table_search(queue->shader_csos, nir);
+   if (entry) {
+      shader_cso_destroy(queue->ctx, nir->info.stage, entry->data);
+      _mesa_hash_table_remove(queue->shader_csos, entry);
+   }
+
+   simple_mtx_unlock(&queue->lock);
+}
+
+/* Drop a reference of a shader, together with the states compiled for it on
+ * every queue once it is unused. The caller holds the device queue lock.
+ */
+static void
+pipeline_nir_unref(struct lvp_device *device, struct lvp_pipeline_nir **pipeline_nir)
+{
+   struct lvp_pipeline_nir *old = *pipeline_nir;
+   if (!old)
+      return;
+
+   *pipeline_nir = NULL;
+   if (!p_atomic_dec_zero(&old->ref_cnt))
+      return;
+
+   for (uint32_t i = 0; i < device->queue_count; i++)
+      queue_shader_destroy(device->queues[i], old->nir);
+
+   if (old->cso)
+      shader_cso_destroy(device->queue.ctx, old->nir->info.stage, old->cso);
+
+   ralloc_free(old->nir);
+   ralloc_free(old);
+}
+
 static void
 shader_destroy(struct lvp_device *device, struct lvp_shader *shader, bool locked)
 {
    if (!shader->pipeline_nir)
       return;
    gl_shader_stage stage = shader->pipeline_nir->nir->info.stage;
-   cso_destroy_func destroy[] = {
-      device->queue.ctx->delete_vs_state,
-      device->queue.ctx->delete_tcs_state,
-      device->queue.ctx->delete_tes_state,
-      device->queue.ctx->delete_gs_state,
-      device->queue.ctx->delete_fs_state,
-      device->queue.ctx->delete_compute_state,
-      device->queue.ctx->delete_ts_state,
-      device->queue.ctx->delete_ms_state,
-   };
+   struct pipe_context *ctx = device->queue.ctx;
 
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
    set_foreach(&shader->inlines.variants, entry) {
       struct lvp_inline_variant *variant = (void*)entry->key;
-      destroy[stage](device->queue.ctx, variant->cso);
+      util_queue_drop_job(&device->compile_queue, &variant->fence);
+      util_queue_fence_destroy(&variant->fence);
+      ralloc_free(variant->nir);
+      if (variant->cso)
+         shader_cso_destroy(ctx, stage, variant->cso);
       free(variant);
    }
    ralloc_free(shader->inlines.variants.table);
 
-   if (shader->shader_cso)
-      destroy[stage](device->queue.ctx, shader->shader_cso);
-   if (shader->tess_ccw_cso)
-      destroy[stage](device->queue.ctx, shader->tess_ccw_cso);
+   /* the states shared through the nir go away with it */
+   if (shader->shader_cso && shader->shader_cso != shader->pipeline_nir->cso)
+      shader_cso_destroy(ctx, stage, shader->shader_cso);
+   if (shader->tess_ccw_cso && shader->tess_ccw_cso != shader->tess_ccw->cso)
+      shader_cso_destroy(ctx, stage, shader->tess_ccw_cso);
+
+   pipeline_nir_unref(device, &shader->pipeline_nir);
+   pipeline_nir_unref(device, &shader->tess_ccw);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
-
-   lvp_pipeline_nir_ref(&shader->pipeline_nir, NULL);
-   lvp_pipeline_nir_ref(&shader->tess_ccw, NULL);
 }
 
 void
@@ -223,50 +278,55 @@ lvp_nir_fixup_indirect_tex(nir_shader *shader)
 static void
 optimize(nir_shader *nir)
 {
+   struct set *skip = _mesa_pointer_set_create(NULL);
+
    bool progress = false;
    do {
       progress = false;
 
-      NIR_PASS(progress, nir, nir_lower_flrp, 32|64, true);
-      NIR_PASS(progress, nir, nir_split_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_vars_to_ssa);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_lower_flrp, 32|64, true);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_split_array_vars, nir_var_function_temp);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_deref);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_lower_vars_to_ssa);
 
-      NIR_PASS(progress, nir, nir_opt_copy_prop_vars);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_copy_prop_vars);
 
-      NIR_PASS(progress, nir, nir_copy_prop);
-      NIR_PASS(progress, nir, nir_opt_dce);
-      NIR_PASS(progress, nir, nir_opt_peephole_select, 8, true, true);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_copy_prop);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_dce);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_peephole_select, 8, true, true);
 
-      NIR_PASS(progress, nir, nir_opt_algebraic);
-      NIR_PASS(progress, nir, nir_opt_constant_folding);
+      NIR_LOOP_SITE_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_algebraic);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_constant_folding);
 
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_remove_phis);
       bool loop = false;
-      NIR_PASS(loop, nir, nir_opt_loop);
+      NIR_LOOP_SITE_PASS_NOT_IDEMPOTENT(loop, skip, nir, nir_opt_loop);
       progress |= loop;
       if (loop) {
          /* If nir_opt_loop makes progress, then we need to clean
           * things up if we want any hope of nir_opt_if or nir_opt_loop_unroll
           * to make progress.
           */
-         NIR_PASS(progress, nir, nir_copy_prop);
-         NIR_PASS(progress, nir, nir_opt_dce);
-         NIR_PASS(progress, nir, nir_opt_remove_phis);
+         NIR_LOOP_SITE_PASS(progress, skip, nir, nir_copy_prop);
+         NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_dce);
+         NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_remove_phis);
       }
-      NIR_PASS(progress, nir, nir_opt_if, nir_opt_if_optimize_phi_true_false);
-      NIR_PASS(progress, nir, nir_opt_dead_cf);
-      NIR_PASS(progress, nir, nir_opt_conditional_discard);
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
-      NIR_PASS(progress, nir, nir_opt_cse);
-      NIR_PASS(progress, nir, nir_opt_undef);
-
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_alu_to_scalar, NULL, NULL);
-      NIR_PASS(progress, nir, nir_opt_loop_unroll);
-      NIR_PASS(progress, nir, lvp_nir_fixup_indirect_tex);
+      NIR_LOOP_SITE_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_if,
+                                        nir_opt_if_optimize_phi_true_false);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_dead_cf);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_conditional_discard);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_remove_phis);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_cse);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_undef);
+
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_opt_deref);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, nir_lower_alu_to_scalar, NULL, NULL);
+      NIR_LOOP_SITE_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_loop_unroll);
+      NIR_LOOP_SITE_PASS(progress, skip, nir, lvp_nir_fixup_indirect_tex);
    } while (progress);
+
+   _mesa_set_destroy(skip, NULL);
 }
 
 void
@@ -285,6 +345,7 @@ lvp_create_pipeline_nir(nir_shader *nir)
    struct lvp_pipeline_nir *pipeline_nir = ralloc(NULL, struct lvp_pipeline_nir);
    pipeline_nir->nir = nir;
    pipeline_nir->ref_cnt = 1;
+   pipeline_nir->cso = NULL;
    return pipeline_nir;
 }
 
@@ -319,11 +380,23 @@ compile_spirv(struct lvp_device *pdevice, const VkPipelineShaderStageCreateInfo
    return result;
 }
 
+static uint32_t
+inline_variant_hash(const void *key)
+{
+   const struct lvp_inline_variant *v = key;
+   uint32_t hash = v->tess_ccw;
+   u_foreach_bit(slot, v->mask)
+      hash = _mesa_hash_data_with_seed(v->vals[slot], sizeof(v->vals[slot]), hash);
+   return hash;
+}
+
 static bool
 inline_variant_equals(const void *a, const void *b)
 {
    const struct lvp_inline_variant *av = a, *bv = b;
    assert(av->mask == bv->mask);
+   if (av->tess_ccw != bv->tess_ccw)
+      return false;
    u_foreach_bit(slot, av->mask) {
       if (memcmp(av->vals[slot], bv->vals[slot], sizeof(av->vals[slot])))
          return false;
@@ -331,6 +404,17 @@ inline_variant_equals(const void *a, const void *b)
    return true;
 }
 
+static void
+inline_variants_init(struct lvp_shader *shader)
+{
+   _mesa_set_init(&shader->inlines.variants, NULL, inline_variant_hash, inline_variant_equals);
+   list_inithead(&shader->inlines.lru);
+   shader->inlines.variant_count = 0;
+   shader->inlines.pending = 0;
+   shader->inlines.lookups = 0;
+   shader->inlines.misses = 0;
+}
+
 static const struct vk_ycbcr_conversion_state *
 lvp_ycbcr_conversion_lookup(const void *data, uint32_t set, uint32_t binding, uint32_t array_index)
 {
@@ -487,17 +571,83 @@ lvp_shader_init(struct lvp_shader *shader, nir_shader *nir)
       shader->inlines.must_inline = lvp_find_inlinable_uniforms(shader, nir);
    shader->pipeline_nir = lvp_create_pipeline_nir(nir);
    if (shader->inlines.can_inline)
-      _mesa_set_init(&shader->inlines.variants, NULL, NULL, inline_variant_equals);
+      inline_variants_init(shader);
+}
+
+/* Everything of the pipeline layout which lvp_shader_lower looks at */
+static void
+hash_pipeline_layout(struct mesa_sha1 *ctx, const struct lvp_pipeline_layout *layout)
+{
+   if (!layout)
+      return;
+
+   _mesa_sha1_update(ctx, &layout->vk.set_count, sizeof(layout->vk.set_count));
+   _mesa_sha1_update(ctx, &layout->push_constant_size, sizeof(layout->push_constant_size));
+
+   for (uint32_t s = 0; s < layout->vk.set_count; s++) {
+      if (!layout->vk.set_layouts[s]) {
+         _mesa_sha1_update(ctx, &s, sizeof(s));
+         continue;
+      }
+
+      const struct lvp_descriptor_set_layout *set_layout =
+         container_of(layout->vk.set_layouts[s], struct lvp_descriptor_set_layout, vk);
+      _mesa_sha1_update(ctx, &set_layout->binding_count, sizeof(set_layout->binding_count));
+      _mesa_sha1_update(ctx, &set_layout->size, sizeof(set_layout->size));
+      _mesa_sha1_update(ctx, &set_layout->dynamic_offset_count, sizeof(set_layout->dynamic_offset_count));
+
+      for (uint32_t b = 0; b < set_layout->binding_count; b++) {
+         const struct lvp_descriptor_set_binding_layout *binding = &set_layout->binding[b];
+         _mesa_sha1_update(ctx, binding, offsetof(struct lvp_descriptor_set_binding_layout, immutable_samplers));
+
+         if (!binding->immutable_samplers)
+            continue;
+
+         for (uint32_t i = 0; i < binding->array_size; i++) {
+            const struct vk_ycbcr_conversion *conversion =
+               binding->immutable_samplers[i]->vk.ycbcr_conversion;
+            if (conversion)
+               _mesa_sha1_update(ctx, &conversion->state, sizeof(conversion->state));
+         }
+      }
+   }
 }
 
 static VkResult
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct vk_pipeline_cache *cache,
                          const VkPipelineShaderStageCreateInfo *sinfo)
 {
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= LVP_SHADER_STAGES && stage != MESA_SHADER_NONE);
-   nir_shader *nir;
-   VkResult result = lvp_spirv_to_nir(pipeline, sinfo, &nir);
+   nir_shader *nir = NULL;
+   VkResult result = VK_SUCCESS;
+
+   /* The cache holds the lowered NIR, a hit skips the translation and all
+    * of lvp_shader_lower.
+    */
+   unsigned char key[SHA1_DIGEST_LENGTH];
+   if (cache) {
+      struct mesa_sha1 ctx;
+      unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+
+      vk_pipeline_hash_shader_stage(sinfo, NULL, stage_sha1);
+      _mesa_sha1_init(&ctx);
+      _mesa_sha1_update(&ctx, stage_sha1, sizeof(stage_sha1));
+      hash_pipeline_layout(&ctx, pipeline->layout);
+      _mesa_sha1_final(&ctx, key);
+
+      nir = vk_pipeline_cache_lookup_nir(cache, key, sizeof(key),
+                                         pipeline->device->physical_device->drv_options[stage],
+                                         NULL, NULL);
+   }
+
+   if (!nir) {
+      result = lvp_spirv_to_nir(pipeline, sinfo, &nir);
+      if (result == VK_SUCCESS && cache)
+         vk_pipeline_cache_add_nir(cache, key, sizeof(key), nir);
+   }
+
    if (result == VK_SUCCESS) {
       struct lvp_shader *shader = &pipeline->shaders[stage];
       lvp_shader_init(shader, nir);
@@ -505,6 +655,20 @@ lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
    return result;
 }
 
+struct lvp_stage_job {
+   struct lvp_pipeline *pipeline;
+   struct vk_pipeline_cache *cache;
+   const VkPipelineShaderStageCreateInfo *sinfo;
+   VkResult result;
+};
+
+static void
+compile_to_ir_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_stage_job *job = data;
+   job->result = lvp_shader_compile_to_ir(job->pipeline, job->cache, job->sinfo);
+}
+
 static void
 merge_tess_info(struct shader_info *tes_info,
                 const struct shader_info *tcs_info)
@@ -591,14 +755,14 @@ lvp_pipeline_xfb_init(struct lvp_pipeline *pipeline)
 }
 
 static void *
-lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir)
+lvp_shader_compile_stage(struct pipe_context *ctx, struct lvp_shader *shader, nir_shader *nir)
 {
    if (nir->info.stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
       shstate.prog = nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
       shstate.static_shared_mem = nir->info.shared_size;
-      return device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
@@ -607,19 +771,19 @@ lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, n
 
       switch (nir->info.stage) {
       case MESA_SHADER_FRAGMENT:
-         return device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         return device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         return device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         return device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         return device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
+         return ctx->create_tes_state(ctx, &shstate);
       case MESA_SHADER_TASK:
-         return device->queue.ctx->create_ts_state(device->queue.ctx, &shstate);
+         return ctx->create_ts_state(ctx, &shstate);
       case MESA_SHADER_MESH:
-         return device->queue.ctx->create_ms_state(device->queue.ctx, &shstate);
+         return ctx->create_ms_state(ctx, &shstate);
       default:
          unreachable("illegal shader");
          break;
@@ -636,7 +800,7 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
-   void *state = lvp_shader_compile_stage(device, shader, nir);
+   void *state = lvp_shader_compile_stage(device->queue.ctx, shader, nir);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -644,6 +808,237 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    return state;
 }
 
+/**
+ * Get the state of a shader compiled for the context of a queue other than
+ * device->queue, compiling it on first use. Uniforms are never inlined in
+ * those. The caller holds the queue lock.
+ */
+void *
+lvp_queue_get_shader_cso(struct lvp_queue *queue, struct lvp_shader *shader, nir_shader *nir)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(queue->shader_csos, nir);
+   if (entry)
+      return entry->data;
+
+   nir_shader *clone = nir_shader_clone(NULL, nir);
+   queue->device->pscreen->finalize_nir(queue->device->pscreen, clone);
+
+   void *state = lvp_shader_compile_stage(queue->ctx, shader, clone);
+   _mesa_hash_table_insert(queue->shader_csos, nir, state);
+
+   return state;
+}
+
+static void
+inline_variant_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_inline_variant *variant = data;
+   struct lvp_shader *shader = variant->shader;
+   nir_shader *base_nir = variant->tess_ccw ? shader->tess_ccw->nir : shader->pipeline_nir->nir;
+   unsigned ssa_alloc = nir_shader_get_entrypoint(base_nir)->ssa_alloc;
+
+   nir_shader *nir = nir_shader_clone(NULL, base_nir);
+   NIR_PASS_V(nir, lvp_inline_uniforms, shader, variant->vals[0], 0);
+   lvp_shader_optimize(nir);
+   if (ssa_alloc - nir_shader_get_entrypoint(nir)->ssa_alloc < ssa_alloc / 2 &&
+       !shader->inlines.must_inline) {
+      ralloc_free(nir);
+   } else {
+      variant->device->pscreen->finalize_nir(variant->device->pscreen, nir);
+      variant->nir = nir;
+   }
+
+   p_atomic_dec(&shader->inlines.pending);
+}
+
+static void
+inline_variant_destroy(struct lvp_device *device, struct lvp_shader *shader,
+                       struct lvp_inline_variant *variant)
+{
+   assert(util_queue_fence_is_signalled(&variant->fence));
+   _mesa_set_remove_key(&shader->inlines.variants, variant);
+   list_del(&variant->link);
+   shader->inlines.variant_count--;
+
+   util_queue_fence_destroy(&variant->fence);
+   ralloc_free(variant->nir);
+   if (variant->cso)
+      shader_cso_destroy(device->queue.ctx, shader->pipeline_nir->nir->info.stage, variant->cso);
+   free(variant);
+}
+
+static struct lvp_inline_variant *
+inline_variant_create(struct lvp_device *device, struct lvp_shader *shader,
+                      const struct lvp_inline_variant *key)
+{
+   /* Make room by dropping the least recently used variant which is not
+    * compiling. That is never the bound one, which was used last.
+    */
+   if (shader->inlines.variant_count >= LVP_MAX_INLINE_VARIANTS) {
+      list_for_each_entry_rev(struct lvp_inline_variant, old, &shader->inlines.lru, link) {
+         if (util_queue_fence_is_signalled(&old->fence)) {
+            inline_variant_destroy(device, shader, old);
+            break;
+         }
+      }
+   }
+
+   struct lvp_inline_variant *variant = calloc(1, sizeof(*variant));
+   if (!variant)
+      return NULL;
+
+   variant->mask = key->mask;
+   variant->tess_ccw = key->tess_ccw;
+   memcpy(variant->vals, key->vals, sizeof(variant->vals));
+   variant->device = device;
+   variant->shader = shader;
+   util_queue_fence_init(&variant->fence);
+
+   _mesa_set_add(&shader->inlines.variants, variant);
+   list_add(&variant->link, &shader->inlines.lru);
+   shader->inlines.variant_count++;
+
+   p_atomic_inc(&shader->inlines.pending);
+   if (util_queue_is_initialized(&device->compile_queue)) {
+      util_queue_add_job(&device->compile_queue, variant, &variant->fence,
+                         inline_variant_job, NULL, 0);
+   } else {
+      inline_variant_job(variant, NULL, 0);
+   }
+
+   return variant;
+}
+
+static void *
+get_generic_cso(struct lvp_device *device, struct lvp_shader *shader, bool tess_ccw)
+{
+   struct lvp_pipeline_nir *pipeline_nir = tess_ccw ? shader->tess_ccw : shader->pipeline_nir;
+   void **cso = tess_ccw ? &shader->tess_ccw_cso : &shader->shader_cso;
+
+   if (!*cso && pipeline_nir) {
+      *cso = pipeline_nir->cso ? pipeline_nir->cso :
+             lvp_shader_compile(device, shader, nir_shader_clone(NULL, pipeline_nir->nir), true);
+   }
+   return *cso;
+}
+
+/* The pipeline binds shader_cso and tess_ccw_cso once inlining is off */
+static void
+stop_inlining(struct lvp_device *device, struct lvp_shader *shader)
+{
+   shader->inlines.can_inline = 0;
+   get_generic_cso(device, shader, false);
+   get_generic_cso(device, shader, true);
+}
+
+/**
+ * Get the state of the shader with the uniform values of key inlined, for
+ * device->queue. The caller holds its lock.
+ *
+ * Variants are compiled on the compile threads, and kept for the last
+ * LVP_MAX_INLINE_VARIANTS value sets. Until the variant is ready, this
+ * returns the state without inlining and sets *pending. Shaders whose
+ * values keep changing, or which inlining does not simplify, stop inlining.
+ */
+void *
+lvp_shader_get_inline_variant(struct lvp_device *device, struct lvp_shader *shader,
+                              const struct lvp_inline_variant *key, bool *pending)
+{
+   struct set_entry *entry = _mesa_set_search(&shader->inlines.variants, key);
+   struct lvp_inline_variant *variant = entry ? (void *)entry->key : NULL;
+
+   shader->inlines.lookups++;
+   if (!variant) {
+      shader->inlines.misses++;
+      if (p_atomic_read(&shader->inlines.pending) < LVP_MAX_PENDING_INLINE_VARIANTS)
+         variant = inline_variant_create(device, shader, key);
+   } else {
+      list_move_to(&variant->link, &shader->inlines.lru);
+   }
+
+   if (variant && !variant->cso && util_queue_fence_is_signalled(&variant->fence)) {
+      if (variant->nir) {
+         variant->cso = lvp_shader_compile_stage(device->queue.ctx, shader, variant->nir);
+         variant->nir = NULL;
+      } else {
+         /* not enough change; don't inline further */
+         stop_inlining(device, shader);
+      }
+   }
+
+   if (shader->inlines.lookups == LVP_INLINE_MISS_WINDOW) {
+      if (shader->inlines.misses > LVP_INLINE_MISS_WINDOW / 2)
+         stop_inlining(device, shader);
+      shader->inlines.lookups = 0;
+      shader->inlines.misses = 0;
+   }
+
+   /* once inlining stopped, the state stays bound for the following draws */
+   *pending = shader->inlines.can_inline && !(variant && variant->cso);
+   if (shader->inlines.can_inline && variant && variant->cso)
+      return variant->cso;
+
+   return get_generic_cso(device, shader, key->tess_ccw);
+}
+
+/* Whether this is a thread of the compile queue, which must not wait for
+ * other jobs of the queue.
+ */
+static thread_local bool lvp_compile_thread;
+
+struct lvp_compile_job {
+   struct util_queue_fence fence;
+   util_queue_execute_func execute;
+   void *data;
+};
+
+static void
+compile_job_execute(void *data, void *gdata, int thread_index)
+{
+   struct lvp_compile_job *job = data;
+
+   lvp_compile_thread = true;
+   job->execute(job->data, gdata, thread_index);
+}
+
+/**
+ * Run count jobs of job_size bytes each, in parallel when possible, and
+ * wait for all of them. The first one runs on the calling thread.
+ */
+static void
+lvp_run_compile_jobs(struct lvp_device *device, void *jobs, size_t job_size,
+                     unsigned count, util_queue_execute_func execute)
+{
+   struct lvp_compile_job *queued = NULL;
+
+   if (count > 1 && !lvp_compile_thread &&
+       util_queue_is_initialized(&device->compile_queue))
+      queued = calloc(count - 1, sizeof(*queued));
+
+   if (!queued) {
+      for (unsigned i = 0; i < count; i++)
+         execute((uint8_t *)jobs + i * job_size, NULL, 0);
+      return;
+   }
+
+   for (unsigned i = 1; i < count; i++) {
+      struct lvp_compile_job *job = &queued[i - 1];
+      util_queue_fence_init(&job->fence);
+      job->execute = execute;
+      job->data = (uint8_t *)jobs + i * job_size;
+      util_queue_add_job(&device->compile_queue, job, &job->fence,
+                         compile_job_execute, NULL, 0);
+   }
+
+   execute(jobs, NULL, 0);
+
+   for (unsigned i = 0; i < count - 1; i++) {
+      util_queue_fence_wait(&queued[i].fence);
+      util_queue_fence_destroy(&queued[i].fence);
+   }
+   free(queued);
+}
+
 #ifndef NDEBUG
 static bool
 layouts_equal(const struct lvp_descriptor_set_layout *a, const struct lvp_descriptor_set_layout *b)
@@ -754,16 +1149,17 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
    *dst = *src;
    dst->pipeline_nir = NULL; //this gets handled later
    dst->tess_ccw = NULL; //this gets handled later
-   assert(!dst->shader_cso);
-   assert(!dst->tess_ccw_cso);
+   /* these are found again through the pipeline_nir */
+   dst->shader_cso = NULL;
+   dst->tess_ccw_cso = NULL;
    if (src->inlines.can_inline)
-      _mesa_set_init(&dst->inlines.variants, NULL, NULL, inline_variant_equals);
+      inline_variants_init(dst);
 }
 
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
+                           struct vk_pipeline_cache *cache,
                            const VkGraphicsPipelineCreateInfo *pCreateInfo,
                            VkPipelineCreateFlagBits2KHR flags)
 {
@@ -846,6 +1242,8 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->device = device;
 
+   struct lvp_stage_job jobs[MESA_SHADER_STAGES];
+   unsigned job_count = 0;
    for (uint32_t i = 0; i < pCreateInfo->stageCount; i++) {
       const VkPipelineShaderStageCreateInfo *sinfo = &pCreateInfo->pStages[i];
       gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
@@ -856,11 +1254,22 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, sinfo);
-      if (result != VK_SUCCESS)
+      assert(job_count < ARRAY_SIZE(jobs));
+      jobs[job_count++] = (struct lvp_stage_job) {
+         .pipeline = pipeline,
+         .cache = cache,
+         .sinfo = sinfo,
+      };
+   }
+   /* the stages are independent until they get linked below */
+   lvp_run_compile_jobs(device, jobs, sizeof(jobs[0]), job_count, compile_to_ir_job);
+   for (unsigned i = 0; i < job_count; i++) {
+      if (jobs[i].result != VK_SUCCESS) {
+         result = jobs[i].result;
          goto fail;
+      }
 
-      switch (stage) {
+      switch (vk_to_mesa_shader_stage(jobs[i].sinfo->stage)) {
       case MESA_SHADER_FRAGMENT:
          if (pipeline->shaders[MESA_SHADER_FRAGMENT].pipeline_nir->nir->info.fs.uses_sample_shading)
             pipeline->force_min_sample = true;
@@ -910,7 +1319,10 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          pipeline->line_rectangular = true;
       lvp_pipeline_xfb_init(pipeline);
    }
-   if (!libstate && !pipeline->library)
+   /* Libraries are compiled right away so that the pipelines linked with
+    * them only have to compile their own stages, when they are first bound.
+    */
+   if (!libstate || pipeline->library)
       lvp_pipeline_shaders_compile(pipeline, false);
 
    return VK_SUCCESS;
@@ -924,26 +1336,72 @@ fail:
    return result;
 }
 
+struct lvp_cso_job {
+   struct lvp_device *device;
+   struct lvp_shader *shader;
+   struct lvp_pipeline_nir *pipeline_nir;
+   void **cso;
+   bool locked;
+};
+
+static void
+compile_cso_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_cso_job *job = data;
+   *job->cso = lvp_shader_compile(job->device, job->shader,
+                                  nir_shader_clone(NULL, job->pipeline_nir->nir), job->locked);
+   job->pipeline_nir->cso = *job->cso;
+}
+
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline, bool locked)
 {
    if (pipeline->compiled)
       return;
+
+   struct lvp_cso_job jobs[MESA_SHADER_STAGES + 1];
+   unsigned job_count = 0;
    for (uint32_t i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
-      if (!pipeline->shaders[i].pipeline_nir)
+      struct lvp_shader *shader = &pipeline->shaders[i];
+      if (!shader->pipeline_nir)
          continue;
 
       gl_shader_stage stage = i;
-      assert(stage == pipeline->shaders[i].pipeline_nir->nir->info.stage);
-
-      if (!pipeline->shaders[stage].inlines.can_inline) {
-         pipeline->shaders[stage].shader_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
-            nir_shader_clone(NULL, pipeline->shaders[stage].pipeline_nir->nir), locked);
-         if (pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw)
-            pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
-               nir_shader_clone(NULL, pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw->nir), locked);
+      assert(stage == shader->pipeline_nir->nir->info.stage);
+
+      if (shader->inlines.can_inline)
+         continue;
+
+      struct lvp_pipeline_nir *pipeline_nirs[] = { shader->pipeline_nir, shader->tess_ccw };
+      void **csos[] = { &shader->shader_cso, &shader->tess_ccw_cso };
+      for (unsigned j = 0; j < ARRAY_SIZE(pipeline_nirs); j++) {
+         if (!pipeline_nirs[j])
+            continue;
+
+         /* already compiled for a library this pipeline is linked with */
+         if (pipeline_nirs[j]->cso) {
+            *csos[j] = pipeline_nirs[j]->cso;
+            continue;
+         }
+
+         assert(job_count < ARRAY_SIZE(jobs));
+         jobs[job_count++] = (struct lvp_cso_job) {
+            .device = pipeline->device,
+            .shader = shader,
+            .pipeline_nir = pipeline_nirs[j],
+            .cso = csos[j],
+            .locked = locked,
+         };
       }
    }
+
+   /* With the lock held, the jobs could only run one after the other */
+   if (locked) {
+      for (unsigned i = 0; i < job_count; i++)
+         compile_cso_job(&jobs[i], NULL, 0);
+   } else {
+      lvp_run_compile_jobs(pipeline->device, jobs, sizeof(jobs[0]), job_count, compile_cso_job);
+   }
    pipeline->compiled = true;
 }
 
@@ -957,7 +1415,7 @@ lvp_graphics_pipeline_create(
    bool group)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1013,6 +1471,55 @@ lvp_graphics_pipeline_create(
    return VK_SUCCESS;
 }
 
+struct lvp_pipeline_job {
+   VkDevice device;
+   VkPipelineCache cache;
+   const void *create_info;
+   VkPipelineCreateFlagBits2KHR flags;
+   VkPipeline *pipeline;
+   VkResult result;
+};
+
+static void
+graphics_pipeline_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_pipeline_job *job = data;
+
+   if (job->flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR)
+      job->result = VK_PIPELINE_COMPILE_REQUIRED;
+   else
+      job->result = lvp_graphics_pipeline_create(job->device, job->cache, job->create_info,
+                                                 job->flags, job->pipeline, false);
+}
+
+/**
+ * Create the pipelines of a batch in parallel, then report the results as
+ * if they had been created one after the other.
+ */
+static VkResult
+lvp_create_pipelines(struct lvp_device *device, struct lvp_pipeline_job *jobs,
+                     uint32_t count, util_queue_execute_func create)
+{
+   lvp_run_compile_jobs(device, jobs, sizeof(jobs[0]), count, create);
+
+   VkResult result = VK_SUCCESS;
+   bool early_return = false;
+   for (uint32_t i = 0; i < count; i++) {
+      if (early_return) {
+         if (jobs[i].result == VK_SUCCESS)
+            lvp_pipeline_destroy(device, lvp_pipeline_from_handle(*jobs[i].pipeline), false);
+         *jobs[i].pipeline = VK_NULL_HANDLE;
+      } else if (jobs[i].result != VK_SUCCESS) {
+         result = jobs[i].result;
+         *jobs[i].pipeline = VK_NULL_HANDLE;
+         if (jobs[i].flags & VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR)
+            early_return = true;
+      }
+   }
+
+   return result;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    VkDevice                                    _device,
    VkPipelineCache                             pipelineCache,
@@ -1021,39 +1528,33 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
-   VkResult result = VK_SUCCESS;
-   unsigned i = 0;
-
-   for (; i < count; i++) {
-      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
-      VkPipelineCreateFlagBits2KHR flags = vk_graphics_pipeline_create_flags(&pCreateInfos[i]);
+   LVP_FROM_HANDLE(lvp_device, device, _device);
 
-      if (!(flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR))
-         r = lvp_graphics_pipeline_create(_device,
-                                          pipelineCache,
-                                          &pCreateInfos[i],
-                                          flags,
-                                          &pPipelines[i],
-                                          false);
-      if (r != VK_SUCCESS) {
-         result = r;
-         pPipelines[i] = VK_NULL_HANDLE;
-         if (flags & VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR)
-            break;
-      }
-   }
-   if (result != VK_SUCCESS) {
-      for (; i < count; i++)
-         pPipelines[i] = VK_NULL_HANDLE;
+   if (!count)
+      return VK_SUCCESS;
+
+   STACK_ARRAY(struct lvp_pipeline_job, jobs, count);
+   for (uint32_t i = 0; i < count; i++) {
+      jobs[i] = (struct lvp_pipeline_job) {
+         .device = _device,
+         .cache = pipelineCache,
+         .create_info = &pCreateInfos[i],
+         .flags = vk_graphics_pipeline_create_flags(&pCreateInfos[i]),
+         .pipeline = &pPipelines[i],
+      };
    }
 
+   VkResult result = lvp_create_pipelines(device, jobs, count, graphics_pipeline_job);
+
+   STACK_ARRAY_FINISH(jobs);
+
    return result;
 }
 
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
+                          struct vk_pipeline_cache *cache,
                           const VkComputePipelineCreateInfo *pCreateInfo)
 {
    pipeline->device = device;
@@ -1063,7 +1564,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->type = LVP_PIPELINE_COMPUTE;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, &pCreateInfo->stage);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1083,7 +1584,7 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1115,6 +1616,18 @@ lvp_compute_pipeline_create(
    return VK_SUCCESS;
 }
 
+static void
+compute_pipeline_job(void *data, void *gdata, int thread_index)
+{
+   struct lvp_pipeline_job *job = data;
+
+   if (job->flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR)
+      job->result = VK_PIPELINE_COMPILE_REQUIRED;
+   else
+      job->result = lvp_compute_pipeline_create(job->device, job->cache, job->create_info,
+                                                job->flags, job->pipeline);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    VkDevice                                    _device,
    VkPipelineCache                             pipelineCache,
@@ -1123,31 +1636,25 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateComputePipelines(
    const VkAllocationCallbacks*                pAllocator,
    VkPipeline*                                 pPipelines)
 {
-   VkResult result = VK_SUCCESS;
-   unsigned i = 0;
-
-   for (; i < count; i++) {
-      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
-      VkPipelineCreateFlagBits2KHR flags = vk_compute_pipeline_create_flags(&pCreateInfos[i]);
+   LVP_FROM_HANDLE(lvp_device, device, _device);
 
-      if (!(flags & VK_PIPELINE_CREATE_2_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_KHR))
-         r = lvp_compute_pipeline_create(_device,
-                                         pipelineCache,
-                                         &pCreateInfos[i],
-                                         flags,
-                                         &pPipelines[i]);
-      if (r != VK_SUCCESS) {
-         result = r;
-         pPipelines[i] = VK_NULL_HANDLE;
-         if (flags & VK_PIPELINE_CREATE_2_EARLY_RETURN_ON_FAILURE_BIT_KHR)
-            break;
-      }
-   }
-   if (result != VK_SUCCESS) {
-      for (; i < count; i++)
-         pPipelines[i] = VK_NULL_HANDLE;
+   if (!count)
+      return VK_SUCCESS;
+
+   STACK_ARRAY(struct lvp_pipeline_job, jobs, count);
+   for (uint32_t i = 0; i < count; i++) {
+      jobs[i] = (struct lvp_pipeline_job) {
+         .device = _device,
+         .cache = pipelineCache,
+         .create_info = &pCreateInfos[i],
+         .flags = vk_compute_pipeline_create_flags(&pCreateInfos[i]),
+         .pipeline = &pPipelines[i],
+      };
    }
 
+   VkResult result = lvp_create_pipelines(device, jobs, count, compute_pipeline_job);
+
+   STACK_ARRAY_FINISH(jobs);
 
    return result;
 }
@@ -1374,7 +1881,8 @@ lvp_exec_graph_pipeline_create(VkDevice _device, VkPipelineCache _cache,
          .layout = create_info->layout,
       };
 
-      result = lvp_compute_pipeline_create(_device, _cache, &stage_create_info, flags, &pipeline->groups[i]);
+      /* not cached, the lowering of the nodes records the payloads in the pipeline */
+      result = lvp_compute_pipeline_create(_device, VK_NULL_HANDLE, &stage_create_info, flags, &pipeline->groups[i]);
       if (result != VK_SUCCESS)
          goto fail;
 
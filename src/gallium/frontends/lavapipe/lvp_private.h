@@ -104,6 +104,7 @@ extern "C" {
 #define MAX_PER_STAGE_DESCRIPTOR_UNIFORM_BLOCKS 8
 #define MAX_DGC_STREAMS 16
 #define MAX_DGC_TOKENS 16
+#define LVP_MAX_QUEUES 4
 /* Currently lavapipe does not support more than 1 image plane */
 #define LVP_MAX_PLANE_COUNT 1
 
@@ -194,22 +195,39 @@ struct lvp_queue {
    void *state;
    struct util_dynarray pipeline_destroys;
    simple_mtx_t lock;
-};
+   void *noop_fs;
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
+   /* Gallium shader states are tied to the context they were created with,
+    * so every queue but device->queue compiles its own from the shader NIR.
+    * nir_shader -> CSO, protected by the queue lock.
+    */
+   struct hash_table *shader_csos;
 };
 
 struct lvp_device {
    struct vk_device vk;
 
+   /* The first queue, whose context is also used for the objects created
+    * through the device.
+    */
    struct lvp_queue queue;
+   uint32_t queue_count;
+   struct lvp_queue **queues;
+
+   /* Compiles the stages of a pipeline, and the pipelines of a batch, in
+    * parallel. Not initialized on single cpu systems.
+    */
+   struct util_queue compile_queue;
+
+   /* Prepares the command buffers of a submission, see lvp_cmd_prep. Kept
+    * apart from compile_queue so that submissions never wait for pipeline
+    * compiles. Not initialized on single cpu systems.
+    */
+   struct util_queue cmd_prep_queue;
+
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
-   void *noop_fs;
    simple_mtx_t bda_lock;
    struct hash_table bda;
    struct pipe_resource *zero_buffer; /* for zeroed bda */
@@ -418,6 +436,10 @@ lvp_pipeline_layout_create(struct lvp_device *device,
 struct lvp_pipeline_nir {
    int ref_cnt;
    nir_shader *nir;
+   /* the state compiled on the device queue, shared by every pipeline using
+    * this nir and freed with it
+    */
+   void *cso;
 };
 
 struct lvp_pipeline_nir *
@@ -431,6 +453,8 @@ lvp_pipeline_nir_ref(struct lvp_pipeline_nir **dst, struct lvp_pipeline_nir *src
       return;
 
    if (old_dst && p_atomic_dec_zero(&old_dst->ref_cnt)) {
+      /* compiled ones are released by the shader which holds them */
+      assert(!old_dst->cso);
       ralloc_free(old_dst->nir);
       ralloc_free(old_dst);
    }
@@ -439,10 +463,32 @@ lvp_pipeline_nir_ref(struct lvp_pipeline_nir **dst, struct lvp_pipeline_nir *src
    *dst = src;
 }
 
+/* Variants with inlined uniforms, per shader */
+#define LVP_MAX_INLINE_VARIANTS 16
+/* Variants of a shader which may be compiling at the same time */
+#define LVP_MAX_PENDING_INLINE_VARIANTS 2
+/* Lookups after which a shader stops inlining if most of them missed */
+#define LVP_INLINE_MISS_WINDOW 64
+
 struct lvp_inline_variant {
+   /* the key */
    uint32_t mask;
+   bool tess_ccw;
    uint32_t vals[PIPE_MAX_CONSTANT_BUFFERS][MAX_INLINABLE_UNIFORMS];
+
    void *cso;
+
+   /* in lvp_shader::inlines.lru */
+   struct list_head link;
+
+   /* Signaled when the compile thread is done with nir */
+   struct util_queue_fence fence;
+   struct lvp_device *device;
+   struct lvp_shader *shader;
+   /* The finalized shader until the cso is created from it, NULL if
+    * inlining did not simplify the shader enough
+    */
+   nir_shader *nir;
 };
 
 struct lvp_shader {
@@ -458,6 +504,13 @@ struct lvp_shader {
       bool must_inline;
       uint32_t can_inline; //bitmask
       struct set variants;
+      /* the variants, most recently used first */
+      struct list_head lru;
+      unsigned variant_count;
+      uint32_t pending;
+      /* since the last check for values which change all the time */
+      uint16_t lookups;
+      uint16_t misses;
    } inlines;
    struct pipe_stream_output_info stream_output;
    struct blob blob; //preserved for GetShaderBinaryDataEXT
@@ -630,6 +683,25 @@ struct lvp_cmd_buffer {
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
 };
 
+/* The part of executing a command buffer which does not need the queue's
+ * pipe_context: creating the descriptor sets for push descriptors and
+ * dynamic offsets, including in the secondaries. lvp_queue_submit() prepares
+ * the command buffers of a submission on the cmd_prep_queue threads while it
+ * waits for the semaphores and executes the preceding ones.
+ */
+struct lvp_cmd_prep {
+   struct util_queue_fence fence;
+   struct lvp_device *device;
+   struct lvp_cmd_buffer *cmd_buffer;
+
+   /* Set by the thread doing the preparation */
+   uint32_t started;
+
+   /* struct lvp_prepared_set, in the order the execution uses them */
+   struct util_dynarray sets;
+   unsigned next_set;
+};
+
 struct lvp_indirect_command_layout_nv {
    struct vk_object_base base;
    uint8_t stream_count;
@@ -683,8 +755,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_shader, base, VkShaderEXT,
@@ -710,9 +780,15 @@ VkResult lvp_image_bind_sparse(struct lvp_device *device,
                                struct lvp_queue *queue,
                                VkSparseImageMemoryBindInfo *bind);
 
+void lvp_cmd_prep_init(struct lvp_cmd_prep *prep,
+                       struct lvp_device *device,
+                       struct lvp_cmd_buffer *cmd_buffer);
+void lvp_cmd_prep_finish(struct lvp_cmd_prep *prep);
+bool lvp_prepare_cmds(struct lvp_cmd_prep *prep);
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
-                          struct lvp_cmd_buffer *cmd_buffer);
+                          struct lvp_cmd_buffer *cmd_buffer,
+                          struct lvp_cmd_prep *prep);
 size_t
 lvp_get_rendering_state_size(void);
 struct lvp_image *lvp_swapchain_get_image(VkSwapchainKHR swapchain,
@@ -781,6 +857,11 @@ void
 lvp_inline_uniforms(nir_shader *nir, const struct lvp_shader *shader, const uint32_t *uniform_values, uint32_t ubo);
 void *
 lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir, bool locked);
+void *
+lvp_queue_get_shader_cso(struct lvp_queue *queue, struct lvp_shader *shader, nir_shader *nir);
+void *
+lvp_shader_get_inline_variant(struct lvp_device *device, struct lvp_shader *shader,
+                              const struct lvp_inline_variant *key, bool *pending);
 bool
 lvp_nir_lower_ray_queries(struct nir_shader *shader);
 bool
@@ -0,0 +1,425 @@
+/**************************************************************************
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Vertex throughput of the draw module, for the drivers using it.
+ *
+ * Draws a grid of triangles with rasterization discarded, and prints the
+ * number of vertices processed per second.  Options:
+ *
+ *   tess    run the triangles through a tess eval shader
+ *   clip    make the grid cross the viewport edges, so some get clipped
+ *   raster  rasterize as well, and print a checksum of the result
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* constant state object helper */
+#include "cso_cache/cso_context.h"
+
+/* util_draw_vertex_buffer helper */
+#include "util/u_draw_quad.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* util_make_[fragment|vertex]_passthrough_shader */
+#include "util/u_simple_shaders.h"
+/* os_time_get_nano */
+#include "util/os_time.h"
+/* _mesa_hash_data */
+#include "util/hash_table.h"
+/* nir_builder_init_simple_shader */
+#include "compiler/nir/nir_builder.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+#define WIDTH 512
+#define HEIGHT 512
+#define GRID 128
+#define NUM_VERTS (GRID * GRID * 6)
+#define DURATION_NS 2000000000ll
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	bool tess;
+	bool clip;
+	bool raster;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct cso_velems_state velem;
+
+	void *vs;
+	void *tes;
+	void *fs;
+
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+};
+
+/* interpolates the position and color of the patch corners */
+static void *create_tes(struct program *p)
+{
+	const nir_shader_compiler_options *options =
+		p->screen->get_compiler_options(p->screen, PIPE_SHADER_IR_NIR,
+						PIPE_SHADER_TESS_EVAL);
+	nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_TESS_EVAL,
+						       options, "draw-bench tes");
+	struct pipe_shader_state state = {0};
+
+	b.shader->info.tess._primitive_mode = TESS_PRIMITIVE_TRIANGLES;
+	b.shader->info.tess.spacing = TESS_SPACING_EQUAL;
+	b.shader->info.tess.ccw = true;
+
+	nir_def *coord = nir_load_tess_coord(&b);
+
+	for (unsigned i = 0; i < 2; i++) {
+		const gl_varying_slot slot = i ? VARYING_SLOT_COL0 : VARYING_SLOT_POS;
+		nir_variable *in = nir_variable_create(b.shader, nir_var_shader_in,
+						       glsl_array_type(glsl_vec4_type(), 32, 0),
+						       "in");
+		nir_variable *out = nir_variable_create(b.shader, nir_var_shader_out,
+							glsl_vec4_type(), "out");
+		nir_def *value = nir_imm_vec4(&b, 0.0, 0.0, 0.0, 0.0);
+
+		in->data.location = out->data.location = slot;
+		in->data.driver_location = out->data.driver_location = i;
+
+		for (unsigned v = 0; v < 3; v++) {
+			value = nir_ffma(&b, nir_load_array_var_imm(&b, in, v),
+					 nir_replicate(&b, nir_channel(&b, coord, v), 4),
+					 value);
+		}
+		nir_store_var(&b, out, value, 0xf);
+	}
+	b.shader->num_inputs = 2;
+	b.shader->num_outputs = 2;
+
+	p->screen->finalize_nir(p->screen, b.shader);
+
+	state.type = PIPE_SHADER_IR_NIR;
+	state.ir.nir = b.shader;
+
+	return p->pipe->create_tes_state(p->pipe, &state);
+}
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	ASSERTED int ret;
+
+	/* the types used to build the tess eval shader */
+	glsl_type_singleton_init_or_ref();
+
+	/* find a hardware device */
+	ret = pipe_loader_probe(&p->dev, 1, false);
+	assert(ret);
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev, false);
+	assert(p->screen);
+
+	/* create the pipe driver context and cso context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe, 0);
+
+	/* vertex buffer, a grid of quads made of two triangles each */
+	{
+		const float extent = p->clip ? 1.2f : 0.9f;
+		float (*vertices)[2][4] = MALLOC(NUM_VERTS * sizeof(*vertices));
+		unsigned n = 0;
+
+		for (unsigned y = 0; y < GRID; y++) {
+			for (unsigned x = 0; x < GRID; x++) {
+				static const unsigned corners[6][2] = {
+					{ 0, 0 }, { 1, 0 }, { 0, 1 },
+					{ 0, 1 }, { 1, 0 }, { 1, 1 },
+				};
+
+				for (unsigned i = 0; i < 6; i++) {
+					const float fx = (float)(x + corners[i][0]) / GRID;
+					const float fy = (float)(y + corners[i][1]) / GRID;
+
+					vertices[n][0][0] = (2.0f * fx - 1.0f) * extent;
+					vertices[n][0][1] = (2.0f * fy - 1.0f) * extent;
+					vertices[n][0][2] = fx * fy;
+					vertices[n][0][3] = 1.0f;
+					vertices[n][1][0] = fx;
+					vertices[n][1][1] = fy;
+					vertices[n][1][2] = 1.0f - fx;
+					vertices[n][1][3] = 1.0f;
+					n++;
+				}
+			}
+		}
+
+		p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+					     PIPE_USAGE_DEFAULT, NUM_VERTS * sizeof(*vertices));
+		pipe_buffer_write(p->pipe, p->vbuf, 0, NUM_VERTS * sizeof(*vertices), vertices);
+		FREE(vertices);
+	}
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* disabled blending/masking */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	/* no-op depth/stencil/alpha */
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	/* rasterizer, only the draw module runs unless asked otherwise */
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip_near = 1;
+	p->rasterizer.depth_clip_far = 1;
+	p->rasterizer.rasterizer_discard = !p->raster;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	/* drawing destination */
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	/* viewport */
+	p->viewport.scale[0] = WIDTH / 2.0f;
+	p->viewport.scale[1] = HEIGHT / 2.0f;
+	p->viewport.scale[2] = 0.5f;
+	p->viewport.translate[0] = WIDTH / 2.0f;
+	p->viewport.translate[1] = HEIGHT / 2.0f;
+	p->viewport.translate[2] = 0.5f;
+	p->viewport.swizzle_x = PIPE_VIEWPORT_SWIZZLE_POSITIVE_X;
+	p->viewport.swizzle_y = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Y;
+	p->viewport.swizzle_z = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Z;
+	p->viewport.swizzle_w = PIPE_VIEWPORT_SWIZZLE_POSITIVE_W;
+
+	/* vertex elements state */
+	memset(&p->velem, 0, sizeof(p->velem));
+	p->velem.count = 2;
+
+	p->velem.velems[0].src_offset = 0 * 4 * sizeof(float); /* offset 0, first element */
+	p->velem.velems[0].instance_divisor = 0;
+	p->velem.velems[0].vertex_buffer_index = 0;
+	p->velem.velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	p->velem.velems[0].src_stride = 2 * 4 * sizeof(float);
+
+	p->velem.velems[1].src_offset = 1 * 4 * sizeof(float); /* offset 16, second element */
+	p->velem.velems[1].instance_divisor = 0;
+	p->velem.velems[1].vertex_buffer_index = 0;
+	p->velem.velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	p->velem.velems[1].src_stride = 2 * 4 * sizeof(float);
+
+	/* vertex shader */
+	{
+		const enum tgsi_semantic semantic_names[] =
+			{ TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, false);
+	}
+
+	/* tess eval shader, interpolating the patch corners */
+	if (p->tess) {
+		p->tes = create_tes(p);
+		assert(p->tes);
+	}
+
+	/* fragment shader */
+	p->fs = util_make_fragment_passthrough_shader(p->pipe,
+		TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, true);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	if (p->tes)
+		p->pipe->delete_tes_state(p->pipe, p->tes);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	glsl_type_singleton_decref();
+
+	FREE(p);
+}
+
+static void finish(struct program *p)
+{
+	struct pipe_fence_handle *fence = NULL;
+
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, OS_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+static void draw(struct program *p)
+{
+	const float tess_levels[4] = { 4.0f, 4.0f, 4.0f, 4.0f };
+	union pipe_query_result result;
+	struct pipe_query *query;
+	unsigned frames = 0;
+	int64_t start, elapsed;
+
+	/* set the render target */
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	/* set misc state we care about */
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	/* shaders */
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+	if (p->tes) {
+		p->pipe->bind_tes_state(p->pipe, p->tes);
+		p->pipe->set_tess_state(p->pipe, tess_levels, tess_levels);
+		p->pipe->set_patch_vertices(p->pipe, 3);
+	}
+
+	/* vertex element data */
+	cso_set_vertex_elements(p->cso, &p->velem);
+
+	query = p->pipe->create_query(p->pipe, PIPE_QUERY_PIPELINE_STATISTICS, 0);
+	p->pipe->begin_query(p->pipe, query);
+
+	start = os_time_get_nano();
+	do {
+		union pipe_color_union clear_color = { .f = { 0.3, 0.1, 0.3, 1.0 } };
+
+		p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, NULL, &clear_color, 0, 0);
+
+		util_draw_vertex_buffer(p->pipe, p->cso,
+		                        p->vbuf, 0, false,
+		                        p->tess ? MESA_PRIM_PATCHES : MESA_PRIM_TRIANGLES,
+		                        NUM_VERTS,
+		                        2); /* attribs/vert */
+		finish(p);
+
+		frames++;
+		elapsed = os_time_get_nano() - start;
+	} while (elapsed < DURATION_NS);
+
+	p->pipe->end_query(p->pipe, query);
+	p->pipe->get_query_result(p->pipe, query, true, &result);
+	p->pipe->destroy_query(p->pipe, query);
+
+	/* the vertices going to clipping and the rasterizer */
+	const uint64_t vertices = p->tess ?
+		result.pipeline_statistics.ds_invocations :
+		result.pipeline_statistics.vs_invocations;
+
+	printf("draw-bench:%s%s%s %u frames, %" PRIu64 " vertices in %.3f s, "
+	       "%.2f Mvertices/s\n",
+	       p->tess ? " tess" : "", p->clip ? " clip" : "",
+	       p->raster ? " raster" : "", frames, vertices, elapsed * 1e-9,
+	       vertices / (elapsed * 1e-3));
+
+	if (p->raster) {
+		struct pipe_transfer *transfer;
+		const void *map = pipe_texture_map(p->pipe, p->target, 0, 0,
+						   PIPE_MAP_READ, 0, 0,
+						   WIDTH, HEIGHT, &transfer);
+
+		printf("draw-bench: checksum %08x\n",
+		       _mesa_hash_data(map, transfer->stride * HEIGHT));
+		pipe_texture_unmap(p->pipe, transfer);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "tess"))
+			p->tess = true;
+		else if (!strcmp(argv[i], "clip"))
+			p->clip = true;
+		else if (!strcmp(argv[i], "raster"))
+			p->raster = true;
+		else {
+			fprintf(stderr, "usage: %s [tess] [clip] [raster]\n", argv[0]);
+			FREE(p);
+			return 1;
+		}
+	}
+
+	init_prog(p);
+	draw(p);
+	close_prog(p);
+
+	return 0;
+}
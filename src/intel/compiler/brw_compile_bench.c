@@ -0,0 +1,522 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Offline compile-time benchmark for the brw backend.
+ *
+ * Compiles compute and fragment shaders for a given platform without any GPU
+ * or kernel driver.  SPIR-V shaders go through the same steps as anv: the
+ * generic Vulkan lowering, brw_preprocess_nir, resource lowering and
+ * brw_compile_cs/fs.  Descriptors are mapped to a flat binding table
+ * (set * 32 + binding) instead of a real pipeline layout, so the generated
+ * code is representative but not identical to what anv emits.  GLSL shaders
+ * have their uniforms pushed and otherwise take the same path.
+ *
+ * The corpus walk and the CSV output are in shader_bench.c.  There is one
+ * row per compiled SIMD variant.
+ *
+ * Compiling SIMD variants on worker threads makes the brw_compile step
+ * measure wall time; set INTEL_SIMD_COMPILE_THREADS=0 to get
+ * single-threaded numbers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "brw_compiler.h"
+#include "brw_nir.h"
+#include "compiler/nir/nir_builder.h"
+#include "dev/intel_debug.h"
+#include "dev/intel_device_info.h"
+#include "shader_bench.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+
+#define BINDINGS_PER_SET 32
+
+/* The compiler keeps a pointer to the device info. */
+static struct intel_device_info devinfo;
+static struct brw_compiler *compiler;
+
+static const char *const stat_names[] = {
+   "instructions", "sends", "loops", "cycles", "spills", "fills",
+   "max_live_registers", "code_size",
+};
+
+static void
+bench_log(void *data, unsigned *id, const char *fmt, ...)
+{
+}
+
+static unsigned
+binding_table_index(nir_variable *var)
+{
+   return var->data.descriptor_set * BINDINGS_PER_SET + var->data.binding;
+}
+
+static bool
+lower_resource_intrinsic(nir_builder *b, nir_intrinsic_instr *intrin,
+                         void *data)
+{
+   b->cursor = nir_before_instr(&intrin->instr);
+
+   switch (intrin->intrinsic) {
+   case nir_intrinsic_vulkan_resource_index: {
+      const unsigned index =
+         nir_intrinsic_desc_set(intrin) * BINDINGS_PER_SET +
+         nir_intrinsic_binding(intrin);
+      nir_def *surface = nir_iadd_imm(b, intrin->src[0].ssa, index);
+      nir_def_rewrite_uses(&intrin->def,
+                           nir_vec2(b, surface, nir_imm_int(b, 0)));
+      break;
+   }
+
+   case nir_intrinsic_vulkan_resource_reindex: {
+      nir_def *surface = nir_iadd(b, nir_channel(b, intrin->src[0].ssa, 0),
+                                  intrin->src[1].ssa);
+      nir_def_rewrite_uses(&intrin->def,
+                           nir_vector_insert_imm(b, intrin->src[0].ssa,
+                                                 surface, 0));
+      break;
+   }
+
+   case nir_intrinsic_load_vulkan_descriptor:
+      nir_def_rewrite_uses(&intrin->def, intrin->src[0].ssa);
+      break;
+
+   case nir_intrinsic_image_deref_load:
+   case nir_intrinsic_image_deref_store:
+   case nir_intrinsic_image_deref_atomic:
+   case nir_intrinsic_image_deref_atomic_swap:
+   case nir_intrinsic_image_deref_size:
+   case nir_intrinsic_image_deref_samples:
+   case nir_intrinsic_image_deref_load_raw_intel:
+   case nir_intrinsic_image_deref_store_raw_intel: {
+      nir_deref_instr *deref = nir_src_as_deref(intrin->src[0]);
+      nir_def *index = nir_imm_int(b, 0);
+      if (deref->deref_type == nir_deref_type_array) {
+         index = deref->arr.index.ssa;
+         deref = nir_deref_instr_parent(deref);
+      }
+      assert(deref->deref_type == nir_deref_type_var);
+      index = nir_iadd_imm(b, index, binding_table_index(deref->var));
+      nir_rewrite_image_intrinsic(intrin, index, false);
+      return true;
+   }
+
+   default:
+      return false;
+   }
+
+   nir_instr_remove(&intrin->instr);
+   return true;
+}
+
+static bool
+lower_tex_deref(nir_builder *b, nir_tex_instr *tex, nir_tex_src_type deref_type,
+                nir_tex_src_type offset_type, unsigned *index)
+{
+   const int src = nir_tex_instr_src_index(tex, deref_type);
+   if (src < 0)
+      return false;
+
+   nir_deref_instr *deref = nir_src_as_deref(tex->src[src].src);
+   nir_def *offset = NULL;
+   unsigned base = 0;
+   if (deref->deref_type == nir_deref_type_array) {
+      if (nir_src_is_const(deref->arr.index))
+         base = nir_src_as_uint(deref->arr.index);
+      else
+         offset = deref->arr.index.ssa;
+      deref = nir_deref_instr_parent(deref);
+   }
+   assert(deref->deref_type == nir_deref_type_var);
+
+   *index = binding_table_index(deref->var) + base;
+
+   nir_tex_instr_remove_src(tex, src);
+   if (offset)
+      nir_tex_instr_add_src(tex, offset_type, offset);
+
+   return true;
+}
+
+static bool
+lower_resource_instr(nir_builder *b, nir_instr *instr, void *data)
+{
+   if (instr->type == nir_instr_type_intrinsic)
+      return lower_resource_intrinsic(b, nir_instr_as_intrinsic(instr), data);
+
+   if (instr->type != nir_instr_type_tex)
+      return false;
+
+   nir_tex_instr *tex = nir_instr_as_tex(instr);
+   b->cursor = nir_before_instr(instr);
+
+   bool progress = false;
+   progress |= lower_tex_deref(b, tex, nir_tex_src_texture_deref,
+                               nir_tex_src_texture_offset, &tex->texture_index);
+   progress |= lower_tex_deref(b, tex, nir_tex_src_sampler_deref,
+                               nir_tex_src_sampler_offset, &tex->sampler_index);
+   return progress;
+}
+
+/* Push constants are all pushed, as load_uniform. */
+static bool
+lower_push_constant(nir_builder *b, nir_intrinsic_instr *intrin, void *data)
+{
+   if (intrin->intrinsic != nir_intrinsic_load_push_constant)
+      return false;
+
+   unsigned *size = data;
+   *size = MAX2(*size, nir_intrinsic_base(intrin) + nir_intrinsic_range(intrin));
+
+   b->cursor = nir_before_instr(&intrin->instr);
+   nir_def *load =
+      nir_load_uniform(b, intrin->def.num_components, intrin->def.bit_size,
+                       intrin->src[0].ssa,
+                       .base = nir_intrinsic_base(intrin),
+                       .range = nir_intrinsic_range(intrin));
+   nir_def_replace(&intrin->def, load);
+   return true;
+}
+
+static void
+shared_type_info(const struct glsl_type *type, unsigned *size, unsigned *align)
+{
+   assert(glsl_type_is_vector_or_scalar(type));
+
+   uint32_t comp_size = glsl_type_is_boolean(type)
+      ? 4 : glsl_get_bit_size(type) / 8;
+   unsigned length = glsl_get_vector_elements(type);
+   *size = comp_size * length,
+   *align = comp_size * (length == 3 ? 4 : length);
+}
+
+/* Mirrors vk_spirv_to_nir() and the bits of anv_shader_stage_to_nir() that
+ * are not about the pipeline state.
+ */
+static void
+lower_vulkan(nir_shader *nir)
+{
+   NIR_PASS(_, nir, nir_lower_variable_initializers, nir_var_function_temp);
+   NIR_PASS(_, nir, nir_lower_returns);
+   NIR_PASS(_, nir, nir_inline_functions);
+   NIR_PASS(_, nir, nir_copy_prop);
+   NIR_PASS(_, nir, nir_opt_deref);
+
+   nir_remove_non_entrypoints(nir);
+
+   NIR_PASS(_, nir, nir_lower_variable_initializers, ~0);
+   NIR_PASS(_, nir, nir_split_var_copies);
+   NIR_PASS(_, nir, nir_split_per_member_structs);
+   NIR_PASS(_, nir, nir_remove_dead_variables,
+            nir_var_shader_in | nir_var_shader_out | nir_var_system_value,
+            NULL);
+   NIR_PASS(_, nir, nir_lower_clip_cull_distance_arrays);
+   NIR_PASS(_, nir, nir_propagate_invariant, false);
+
+   NIR_PASS(_, nir, nir_lower_io_to_temporaries,
+            nir_shader_get_entrypoint(nir), true, false);
+}
+
+/* Follows anv_pipeline_lower_nir() with a flat binding table in place of
+ * the pipeline layout.
+ */
+static void
+lower_resources(nir_shader *nir, struct brw_stage_prog_data *prog_data,
+                void *mem_ctx)
+{
+   const struct intel_device_info *devinfo = compiler->devinfo;
+
+   if (nir->info.stage == MESA_SHADER_COMPUTE) {
+      const nir_lower_compute_system_values_options options = {
+         .lower_cs_local_id_to_index = true,
+      };
+      NIR_PASS(_, nir, nir_lower_compute_system_values, &options);
+   }
+
+   nir_shader_gather_info(nir, nir_shader_get_entrypoint(nir));
+
+   NIR_PASS(_, nir, brw_nir_lower_storage_image,
+            &(struct brw_nir_lower_storage_image_opts) {
+               .devinfo = devinfo,
+               .lower_loads = true,
+            });
+
+   NIR_PASS(_, nir, nir_lower_explicit_io, nir_var_mem_global,
+            nir_address_format_64bit_global);
+   NIR_PASS(_, nir, nir_lower_explicit_io, nir_var_mem_push_const,
+            nir_address_format_32bit_offset);
+
+   NIR_PASS(_, nir, nir_shader_instructions_pass, lower_resource_instr,
+            nir_metadata_control_flow, NULL);
+
+   NIR_PASS(_, nir, nir_lower_explicit_io, nir_var_mem_ubo,
+            nir_address_format_32bit_index_offset);
+   NIR_PASS(_, nir, nir_lower_explicit_io, nir_var_mem_ssbo,
+            nir_address_format_32bit_index_offset);
+
+   bool progress;
+   do {
+      progress = false;
+      NIR_PASS(progress, nir, nir_opt_algebraic);
+      NIR_PASS(progress, nir, nir_copy_prop);
+      NIR_PASS(progress, nir, nir_opt_constant_folding);
+      NIR_PASS(progress, nir, nir_opt_dce);
+   } while (progress);
+
+   unsigned push_size = nir->num_uniforms;
+   NIR_PASS(_, nir, nir_shader_intrinsics_pass, lower_push_constant,
+            nir_metadata_control_flow, &push_size);
+   nir->num_uniforms = ALIGN(push_size, 4);
+   prog_data->nr_params = nir->num_uniforms / 4;
+   prog_data->param = rzalloc_array(mem_ctx, uint32_t, prog_data->nr_params);
+
+   if (gl_shader_stage_uses_workgroup(nir->info.stage)) {
+      if (!nir->info.shared_memory_explicit_layout) {
+         NIR_PASS(_, nir, nir_lower_vars_to_explicit_types,
+                  nir_var_mem_shared, shared_type_info);
+      }
+
+      NIR_PASS(_, nir, nir_lower_explicit_io,
+               nir_var_mem_shared, nir_address_format_32bit_offset);
+   }
+
+   if (nir->info.stage == MESA_SHADER_COMPUTE) {
+      NIR_PASS(_, nir, brw_nir_lower_cs_intrinsics, devinfo,
+               (struct brw_cs_prog_data *)prog_data);
+   }
+}
+
+
+/* Lays out the uniforms of GLSL shaders like push constants. */
+static int
+type_size_bytes(const struct glsl_type *type, bool bindless)
+{
+   return glsl_count_dword_slots(type, bindless) * 4;
+}
+
+static void
+lower_glsl_uniforms(nir_shader *nir)
+{
+   nir_assign_var_locations(nir, nir_var_uniform, &nir->num_uniforms,
+                            type_size_bytes);
+   NIR_PASS(_, nir, nir_lower_io, nir_var_uniform, type_size_bytes,
+            (nir_lower_io_options)0);
+}
+
+static const unsigned *
+compile_fs(nir_shader *nir, struct brw_compile_stats *stats,
+           struct brw_wm_prog_data *prog_data, char **error_str,
+           void *mem_ctx)
+{
+   const uint64_t color_outputs =
+      nir->info.outputs_written >> FRAG_RESULT_DATA0;
+
+   struct brw_wm_prog_key key = {
+      .input_slots_valid = nir->info.inputs_read | VARYING_BIT_POS,
+      .color_outputs_valid = color_outputs & BITFIELD_MASK(MAX_DRAW_BUFFERS),
+      .nr_color_regions = util_last_bit64(color_outputs),
+   };
+
+   struct intel_vue_map vue_map;
+   brw_compute_vue_map(compiler->devinfo, &vue_map, key.input_slots_valid,
+                       false, 1);
+
+   struct brw_compile_fs_params params = {
+      .base = {
+         .mem_ctx = mem_ctx,
+         .nir = nir,
+         .stats = stats,
+      },
+      .key = &key,
+      .prog_data = prog_data,
+      .vue_map = &vue_map,
+      .allow_spilling = true,
+      .max_polygons = 1,
+   };
+
+   const unsigned *program = brw_compile_fs(compiler, &params);
+   *error_str = params.base.error_str;
+   return program;
+}
+
+static const unsigned *
+compile_cs(nir_shader *nir, struct brw_compile_stats *stats,
+           struct brw_cs_prog_data *prog_data, char **error_str,
+           void *mem_ctx)
+{
+   struct brw_cs_prog_key key = {};
+
+   struct brw_compile_cs_params params = {
+      .base = {
+         .mem_ctx = mem_ctx,
+         .nir = nir,
+         .stats = stats,
+      },
+      .key = &key,
+      .prog_data = prog_data,
+   };
+
+   const unsigned *program = brw_compile_cs(compiler, &params);
+   *error_str = params.base.error_str;
+   return program;
+}
+
+static bool
+brw_bench_compile(struct shader_bench_job *job, nir_shader *nir)
+{
+   union {
+      struct brw_stage_prog_data base;
+      struct brw_wm_prog_data wm;
+      struct brw_cs_prog_data cs;
+   } prog_data = {};
+   int64_t t;
+
+   t = os_time_get_nano();
+   if (job->input == SHADER_BENCH_INPUT_SPIRV) {
+      lower_vulkan(nir);
+      shader_bench_add_step(job, "lower_vulkan", t);
+   } else {
+      lower_glsl_uniforms(nir);
+      shader_bench_add_step(job, "lower_uniforms", t);
+   }
+
+   t = os_time_get_nano();
+   brw_preprocess_nir(compiler, nir, &(struct brw_nir_compiler_opts) {});
+   shader_bench_add_step(job, "brw_preprocess_nir", t);
+
+   t = os_time_get_nano();
+   lower_resources(nir, &prog_data.base, job->mem_ctx);
+   shader_bench_add_step(job, "lower_resources", t);
+
+   struct brw_compile_stats stats[4] = {};
+   char *error_str = NULL;
+   const unsigned *program;
+
+   t = os_time_get_nano();
+   if (job->stage == MESA_SHADER_FRAGMENT) {
+      program = compile_fs(nir, stats, &prog_data.wm, &error_str,
+                           job->mem_ctx);
+   } else {
+      program = compile_cs(nir, stats, &prog_data.cs, &error_str,
+                           job->mem_ctx);
+   }
+   shader_bench_add_step(job, "brw_compile", t);
+
+   if (program == NULL) {
+      fprintf(stderr, "%s: %s\n", job->path,
+              error_str ? error_str : "unknown error");
+      return false;
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(stats); i++) {
+      if (stats[i].dispatch_width == 0)
+         break;
+
+      char name[16];
+      snprintf(name, sizeof(name), "simd%u", stats[i].dispatch_width);
+
+      struct shader_bench_variant *variant =
+         shader_bench_add_variant(job, name);
+      variant->stats[0] = stats[i].instructions;
+      variant->stats[1] = stats[i].sends;
+      variant->stats[2] = stats[i].loops;
+      variant->stats[3] = stats[i].cycles;
+      variant->stats[4] = stats[i].spills;
+      variant->stats[5] = stats[i].fills;
+      variant->stats[6] = stats[i].max_live_registers;
+      variant->stats[7] = prog_data.base.program_size;
+   }
+
+   return true;
+}
+
+static bool
+brw_bench_init(const char *target)
+{
+   int pci_id = intel_device_name_to_pci_device_id(target);
+   if (pci_id < 0)
+      pci_id = strtol(target, NULL, 0);
+
+   if (pci_id <= 0 || !intel_get_device_info_from_pci_id(pci_id, &devinfo)) {
+      fprintf(stderr, "can't find device information: %s\n", target);
+      return false;
+   }
+
+   if (devinfo.ver < 9) {
+      fprintf(stderr, "%s is not supported by brw\n", target);
+      return false;
+   }
+
+   process_intel_debug_variable();
+
+   compiler = brw_compiler_create(NULL, &devinfo);
+   compiler->shader_debug_log = bench_log;
+   compiler->shader_perf_log = bench_log;
+   return true;
+}
+
+static void
+brw_bench_finish(void)
+{
+   ralloc_free(compiler);
+}
+
+static const nir_shader_compiler_options *
+brw_bench_get_nir_options(gl_shader_stage stage)
+{
+   return compiler->nir_options[stage];
+}
+
+static const struct spirv_to_nir_options spirv_options = {
+   .environment = NIR_SPIRV_VULKAN,
+   .ubo_addr_format = nir_address_format_32bit_index_offset,
+   .ssbo_addr_format = nir_address_format_32bit_index_offset,
+   .phys_ssbo_addr_format = nir_address_format_64bit_global,
+   .push_const_addr_format = nir_address_format_logical,
+   .shared_addr_format = nir_address_format_32bit_offset,
+   .min_ubo_alignment = 64,
+   .min_ssbo_alignment = 4,
+};
+
+static const struct shader_bench_backend brw_bench = {
+   .name = "brw",
+   .default_target = "tgl",
+   .stages = BITFIELD_BIT(MESA_SHADER_COMPUTE) |
+             BITFIELD_BIT(MESA_SHADER_FRAGMENT),
+   .stat_names = stat_names,
+   .stat_count = ARRAY_SIZE(stat_names),
+   .init = brw_bench_init,
+   .finish = brw_bench_finish,
+   .get_nir_options = brw_bench_get_nir_options,
+   .spirv_options = &spirv_options,
+   .compile_nir = brw_bench_compile,
+};
+
+int
+main(int argc, char *argv[])
+{
+   return shader_bench_main(argc, argv, &brw_bench);
+}
@@ -60,7 +60,7 @@ cs_fill_push_const_info(const struct intel_device_info *devinfo,
 }
 
 static bool
-run_cs(fs_visitor &s, bool allow_spilling)
+run_cs_nir(fs_visitor &s)
 {
    assert(gl_shader_stage_is_compute(s.stage));
    const fs_builder bld = fs_builder(&s).at_end();
@@ -83,6 +83,17 @@ run_cs(fs_visitor &s, bool allow_spilling)
 
    brw_calculate_cfg(s);
 
+   /* Done by brw_fs_optimize() otherwise, but wider variants import the
+    * push constant layout before this one is optimized.
+    */
+   s.assign_constant_locations();
+
+   return !s.failed;
+}
+
+static void
+optimize_cs(fs_visitor &s)
+{
    brw_fs_optimize(s);
 
    s.assign_curb_setup();
@@ -90,7 +101,25 @@ run_cs(fs_visitor &s, bool allow_spilling)
    brw_fs_lower_3src_null_dest(s);
    brw_fs_workaround_memory_fence_before_eot(s);
    brw_fs_workaround_emit_dummy_mov_instruction(s);
+}
 
+/**
+ * Compiles a SIMD variant that may have been translated from NIR and handed
+ * to \p job ahead of time.
+ */
+static bool
+run_cs(fs_visitor &s, brw_simd_job &job, bool allow_spilling)
+{
+   if (job.started())
+      return job.finish();
+
+   if (s.failed)
+      return false;
+
+   if (s.cfg == NULL && !run_cs_nir(s))
+      return false;
+
+   optimize_cs(s);
    brw_allocate_registers(s, allow_spilling);
 
    return !s.failed;
@@ -127,10 +156,7 @@ brw_compile_cs(const struct brw_compiler *compiler,
 
    std::unique_ptr<fs_visitor> v[3];
 
-   for (unsigned simd = 0; simd < 3; simd++) {
-      if (!brw_simd_should_compile(simd_state, simd))
-         continue;
-
+   auto create_variant = [&](unsigned simd, void *mem_ctx) {
       const unsigned dispatch_width = 8u << simd;
 
       nir_shader *shader = nir_shader_clone(params->base.mem_ctx, nir);
@@ -146,20 +172,87 @@ brw_compile_cs(const struct brw_compiler *compiler,
       brw_postprocess_nir(shader, compiler, debug_enabled,
                           key->base.robust_flags);
 
-      v[simd] = std::make_unique<fs_visitor>(compiler, &params->base,
+      struct brw_compile_params variant_params = params->base;
+      variant_params.mem_ctx = mem_ctx;
+
+      v[simd] = std::make_unique<fs_visitor>(compiler, &variant_params,
                                              &key->base,
                                              &prog_data->base,
                                              shader, dispatch_width,
                                              params->base.stats != NULL,
                                              debug_enabled);
+   };
+
+   /* Unless the shader is being debugged, the variants expected to be
+    * compiled, assuming none of them fails or spills, are translated from
+    * NIR up front.  The wider ones are then optimized and register allocated
+    * on the compiler's thread pool while this thread compiles the narrowest.
+    * The loop below still decides which variants to compile as if this had
+    * not happened, and redoes those that imported the uniforms of a variant
+    * that then failed.
+    */
+   struct util_queue *queue =
+      debug_enabled ? NULL : brw_get_simd_queue(compiler);
+   int imported_from[3] = { -1, -1, -1 };
+   bool cancelled[3] = {};
+   brw_simd_job jobs[3];
+
+   if (queue) {
+      brw_simd_selection_state expected = simd_state;
+      unsigned expected_mask = 0;
+      for (unsigned simd = 0; simd < 3; simd++) {
+         if (brw_simd_should_compile(expected, simd)) {
+            expected.compiled[simd] = true;
+            expected_mask |= BITFIELD_BIT(simd);
+         }
+      }
+
+      if (util_bitcount(expected_mask) > 1) {
+         const int first = ffs(expected_mask) - 1;
+
+         create_variant(first, params->base.mem_ctx);
+         if (run_cs_nir(*v[first])) {
+            u_foreach_bit(simd, expected_mask & ~BITFIELD_BIT(first)) {
+               create_variant(simd, ralloc_context(params->base.mem_ctx));
+               v[simd]->import_uniforms(v[first].get());
+               imported_from[simd] = first;
+
+               if (run_cs_nir(*v[simd])) {
+                  jobs[simd].start(queue, v[simd].get(), simd,
+                                   nir->info.workgroup_size_variable,
+                                   optimize_cs, cancelled);
+               }
+            }
+         }
+      }
+   }
+
+   for (unsigned simd = 0; simd < 3; simd++) {
+      if (!brw_simd_should_compile(simd_state, simd)) {
+         if (jobs[simd].started())
+            jobs[simd].cancel();
+         v[simd].reset();
+         continue;
+      }
 
       const int first = brw_simd_first_compiled(simd_state);
-      if (first >= 0)
-         v[simd]->import_uniforms(v[first].get());
 
+      if (v[simd] && imported_from[simd] != first) {
+         if (jobs[simd].started())
+            jobs[simd].cancel();
+         v[simd].reset();
+      }
+
+      if (!v[simd]) {
+         create_variant(simd, params->base.mem_ctx);
+         if (first >= 0)
+            v[simd]->import_uniforms(v[first].get());
+      }
+
+      const unsigned dispatch_width = 8u << simd;
       const bool allow_spilling = first < 0 || nir->info.workgroup_size_variable;
 
-      if (run_cs(*v[simd], allow_spilling)) {
+      if (run_cs(*v[simd], jobs[simd], allow_spilling)) {
          cs_fill_push_const_info(compiler->devinfo, prog_data);
 
          brw_simd_mark_compiled(simd_state, simd, v[simd]->spilled_any_registers);
@@ -1417,8 +1417,12 @@ brw_assign_urb_setup(fs_visitor &s)
    s.first_non_payload_grf += prog_data->num_per_primitive_inputs / 2 * s.max_polygons;
 }
 
+/**
+ * Translates the shader from NIR, leaving \p s ready for optimize_fs() unless
+ * \p do_rep_send, which needs nothing else.
+ */
 static bool
-run_fs(fs_visitor &s, bool allow_spilling, bool do_rep_send)
+run_fs_nir(fs_visitor &s, bool do_rep_send)
 {
    const struct intel_device_info *devinfo = s.devinfo;
    struct brw_wm_prog_data *wm_prog_data = brw_wm_prog_data(s.prog_data);
@@ -1475,25 +1479,71 @@ run_fs(fs_visitor &s, bool allow_spilling, bool do_rep_send)
 
       brw_calculate_cfg(s);
 
-      brw_fs_optimize(s);
+      /* Done by brw_fs_optimize() otherwise, but wider variants import the
+       * push constant layout before this one is optimized.
+       */
+      s.assign_constant_locations();
+   }
 
-      s.assign_curb_setup();
+   return !s.failed;
+}
 
-      if (devinfo->ver == 9)
-         gfx9_ps_header_only_workaround(wm_prog_data);
+static void
+optimize_fs(fs_visitor &s)
+{
+   struct brw_wm_prog_data *wm_prog_data = brw_wm_prog_data(s.prog_data);
+
+   brw_fs_optimize(s);
+
+   s.assign_curb_setup();
+
+   if (s.devinfo->ver == 9)
+      gfx9_ps_header_only_workaround(wm_prog_data);
 
-      brw_assign_urb_setup(s);
+   brw_assign_urb_setup(s);
 
-      brw_fs_lower_3src_null_dest(s);
-      brw_fs_workaround_memory_fence_before_eot(s);
-      brw_fs_workaround_emit_dummy_mov_instruction(s);
+   brw_fs_lower_3src_null_dest(s);
+   brw_fs_workaround_memory_fence_before_eot(s);
+   brw_fs_workaround_emit_dummy_mov_instruction(s);
+}
 
+static bool
+run_fs(fs_visitor &s, bool allow_spilling, bool do_rep_send)
+{
+   if (!run_fs_nir(s, do_rep_send))
+      return false;
+
+   if (!do_rep_send) {
+      optimize_fs(s);
       brw_allocate_registers(s, allow_spilling);
    }
 
    return !s.failed;
 }
 
+/**
+ * Finishes compiling a SIMD variant that may have been translated from NIR
+ * and handed to \p job ahead of time.
+ */
+static bool
+run_fs_variant(fs_visitor &s, brw_simd_job &job, bool allow_spilling,
+               bool do_rep_send)
+{
+   if (job.started())
+      return job.finish();
+
+   if (s.failed)
+      return false;
+
+   if (s.cfg == NULL)
+      return run_fs(s, allow_spilling, do_rep_send);
+
+   optimize_fs(s);
+   brw_allocate_registers(s, allow_spilling);
+
+   return !s.failed;
+}
+
 const unsigned *
 brw_compile_fs(const struct brw_compiler *compiler,
                struct brw_compile_fs_params *params)
@@ -1543,12 +1593,85 @@ brw_compile_fs(const struct brw_compiler *compiler,
    float throughput = 0;
    bool has_spilled = false;
 
+   /* Unless the shader is being debugged, the wider variants are translated
+    * from NIR up front and then optimized and register allocated on the
+    * compiler's thread pool while this thread compiles the narrowest one.
+    * Whether they are used is still decided below as if they had been
+    * compiled one after the other, they never spill, and a failing SIMD16
+    * cancels SIMD32.
+    */
+   struct util_queue *queue =
+      !debug_enabled && !params->use_rep_send &&
+      (devinfo->ver >= 20 || INTEL_SIMD(FS, 8)) ?
+      brw_get_simd_queue(compiler) : NULL;
+   bool cancelled[3] = {};
+   brw_simd_job simd16_job, simd32_job;
+
    if (devinfo->ver < 20) {
       v8 = std::make_unique<fs_visitor>(compiler, &params->base, key,
                                         prog_data, nir, 8, 1,
                                         params->base.stats != NULL,
                                         debug_enabled);
-      if (!run_fs(*v8, allow_spilling, false /* do_rep_send */)) {
+      if (!run_fs_nir(*v8, false /* do_rep_send */)) {
+         params->base.error_str = ralloc_strdup(params->base.mem_ctx,
+                                                v8->fail_msg);
+         return NULL;
+      }
+   }
+
+   if (key->coarse_pixel && devinfo->ver < 20) {
+      if (prog_data->dual_src_blend) {
+         v8->limit_dispatch_width(8, "SIMD16 coarse pixel shading cannot"
+                                  " use SIMD8 messages.\n");
+      }
+      v8->limit_dispatch_width(16, "SIMD32 not supported with coarse"
+                               " pixel shading.\n");
+   }
+
+   if (queue) {
+      /* Each variant running on the queue needs its own mem_ctx. */
+      struct brw_compile_params job_params = params->base;
+
+      if ((!v8 || v8->max_dispatch_width >= 16) && INTEL_SIMD(FS, 16)) {
+         if (v8)
+            job_params.mem_ctx = ralloc_context(params->base.mem_ctx);
+         v16 = std::make_unique<fs_visitor>(compiler, &job_params, key,
+                                            prog_data, nir, 16, 1,
+                                            params->base.stats != NULL,
+                                            debug_enabled);
+         if (v8)
+            v16->import_uniforms(v8.get());
+         if (run_fs_nir(*v16, false) && v8) {
+            simd16_job.cancel_on_failure = BITFIELD_BIT(2);
+            simd16_job.start(queue, v16.get(), 1, false, optimize_fs,
+                             cancelled);
+         }
+      }
+
+      if ((!v8 || v8->max_dispatch_width >= 32) &&
+          (!v16 || (!v16->failed && v16->max_dispatch_width >= 32)) &&
+          INTEL_SIMD(FS, 32)) {
+         job_params.mem_ctx = ralloc_context(params->base.mem_ctx);
+         v32 = std::make_unique<fs_visitor>(compiler, &job_params, key,
+                                            prog_data, nir, 32, 1,
+                                            params->base.stats != NULL,
+                                            debug_enabled);
+         if (v8)
+            v32->import_uniforms(v8.get());
+         else if (v16)
+            v32->import_uniforms(v16.get());
+         if (run_fs_nir(*v32, false)) {
+            simd32_job.start(queue, v32.get(), 2, false, optimize_fs,
+                             cancelled);
+         }
+      }
+   }
+
+   if (v8) {
+      optimize_fs(*v8);
+      brw_allocate_registers(*v8, allow_spilling);
+
+      if (v8->failed) {
          params->base.error_str = ralloc_strdup(params->base.mem_ctx,
                                                 v8->fail_msg);
          return NULL;
@@ -1565,26 +1688,20 @@ brw_compile_fs(const struct brw_compiler *compiler,
       }
    }
 
-   if (key->coarse_pixel && devinfo->ver < 20) {
-      if (prog_data->dual_src_blend) {
-         v8->limit_dispatch_width(8, "SIMD16 coarse pixel shading cannot"
-                                  " use SIMD8 messages.\n");
-      }
-      v8->limit_dispatch_width(16, "SIMD32 not supported with coarse"
-                               " pixel shading.\n");
-   }
-
    if (!has_spilled &&
        (!v8 || v8->max_dispatch_width >= 16) &&
        (INTEL_SIMD(FS, 16) || params->use_rep_send)) {
       /* Try a SIMD16 compile */
-      v16 = std::make_unique<fs_visitor>(compiler, &params->base, key,
-                                         prog_data, nir, 16, 1,
-                                         params->base.stats != NULL,
-                                         debug_enabled);
-      if (v8)
-         v16->import_uniforms(v8.get());
-      if (!run_fs(*v16, allow_spilling, params->use_rep_send)) {
+      if (!v16) {
+         v16 = std::make_unique<fs_visitor>(compiler, &params->base, key,
+                                            prog_data, nir, 16, 1,
+                                            params->base.stats != NULL,
+                                            debug_enabled);
+         if (v8)
+            v16->import_uniforms(v8.get());
+      }
+      if (!run_fs_variant(*v16, simd16_job, allow_spilling,
+                          params->use_rep_send)) {
          brw_shader_perf_log(compiler, params->base.log_data,
                              "SIMD16 shader failed to compile: %s\n",
                              v16->fail_msg);
@@ -1599,6 +1716,10 @@ brw_compile_fs(const struct brw_compiler *compiler,
          has_spilled = v16->spilled_any_registers;
          allow_spilling = false;
       }
+   } else if (v16) {
+      if (simd16_job.started())
+         simd16_job.cancel();
+      v16.reset();
    }
 
    const bool simd16_failed = v16 && !simd16_cfg;
@@ -1610,16 +1731,18 @@ brw_compile_fs(const struct brw_compiler *compiler,
        !simd16_failed &&
        INTEL_SIMD(FS, 32)) {
       /* Try a SIMD32 compile */
-      v32 = std::make_unique<fs_visitor>(compiler, &params->base, key,
-                                         prog_data, nir, 32, 1,
-                                         params->base.stats != NULL,
-                                         debug_enabled);
-      if (v8)
-         v32->import_uniforms(v8.get());
-      else if (v16)
-         v32->import_uniforms(v16.get());
-
-      if (!run_fs(*v32, allow_spilling, false)) {
+      if (!v32) {
+         v32 = std::make_unique<fs_visitor>(compiler, &params->base, key,
+                                            prog_data, nir, 32, 1,
+                                            params->base.stats != NULL,
+                                            debug_enabled);
+         if (v8)
+            v32->import_uniforms(v8.get());
+         else if (v16)
+            v32->import_uniforms(v16.get());
+      }
+
+      if (!run_fs_variant(*v32, simd32_job, allow_spilling, false)) {
          brw_shader_perf_log(compiler, params->base.log_data,
                              "SIMD32 shader failed to compile: %s\n",
                              v32->fail_msg);
@@ -1638,6 +1761,10 @@ brw_compile_fs(const struct brw_compiler *compiler,
             throughput = MAX2(throughput, perf.throughput);
          }
       }
+   } else if (v32) {
+      if (simd32_job.started())
+         simd32_job.cancel();
+      v32.reset();
    }
 
    if (devinfo->ver >= 12 && !has_spilled &&
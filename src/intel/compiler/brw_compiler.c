@@ -27,7 +27,10 @@
 #include "brw_private.h"
 #include "dev/intel_debug.h"
 #include "compiler/nir/nir.h"
+#include "util/u_call_once.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
+#include "util/u_queue.h"
 
 const struct nir_shader_compiler_options brw_scalar_nir_options = {
    .avoid_ternary_with_two_constants = true,
@@ -83,6 +86,49 @@ const struct nir_shader_compiler_options brw_scalar_nir_options = {
    .scalarize_ddx = true,
 };
 
+struct brw_simd_queue {
+   util_once_flag once;
+   unsigned num_threads;
+   struct util_queue queue;
+};
+
+static void
+brw_simd_queue_init(const void *data)
+{
+   struct brw_simd_queue *simd_queue = (struct brw_simd_queue *)data;
+
+   util_queue_init(&simd_queue->queue, "brw_simd", 32,
+                   simd_queue->num_threads,
+                   UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+}
+
+static void
+brw_simd_queue_destroy(void *data)
+{
+   struct brw_simd_queue *simd_queue = data;
+
+   if (util_queue_is_initialized(&simd_queue->queue))
+      util_queue_destroy(&simd_queue->queue);
+}
+
+/**
+ * Returns the thread pool compiling SIMD variants, or NULL if there is none.
+ * The threads are only started the first time a shader needs them.
+ */
+struct util_queue *
+brw_get_simd_queue(const struct brw_compiler *compiler)
+{
+   struct brw_simd_queue *simd_queue = compiler->simd_queue;
+
+   if (simd_queue == NULL)
+      return NULL;
+
+   util_call_once_data(&simd_queue->once, brw_simd_queue_init, simd_queue);
+
+   return util_queue_is_initialized(&simd_queue->queue) ?
+          &simd_queue->queue : NULL;
+}
+
 struct brw_compiler *
 brw_compiler_create(void *mem_ctx, const struct intel_device_info *devinfo)
 {
@@ -200,6 +246,17 @@ brw_compiler_create(void *mem_ctx, const struct intel_device_info *devinfo)
    compiler->mesh.mue_compaction =
          debug_get_bool_option("INTEL_MESH_COMPACTION", true);
 
+   /* The thread compiling a shader handles one of its variants itself. */
+   const unsigned simd_threads =
+      debug_get_num_option("INTEL_SIMD_COMPILE_THREADS",
+                           util_get_cpu_caps()->nr_cpus - 1);
+   if (simd_threads > 0) {
+      compiler->simd_queue = rzalloc(compiler, struct brw_simd_queue);
+      compiler->simd_queue->once = (util_once_flag)UTIL_ONCE_FLAG_INIT;
+      compiler->simd_queue->num_threads = simd_threads;
+      ralloc_set_destructor(compiler->simd_queue, brw_simd_queue_destroy);
+   }
+
    return compiler;
 }
 
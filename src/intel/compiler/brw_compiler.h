@@ -42,6 +42,7 @@ extern "C" {
 #endif
 
 struct ra_regs;
+struct brw_simd_queue;
 struct nir_shader;
 struct shader_info;
 
@@ -128,6 +129,12 @@ struct brw_compiler {
       unsigned mue_header_packing;
       bool mue_compaction;
    } mesh;
+
+   /**
+    * Thread pool compiling the wider SIMD variants of fragment and compute
+    * shaders, created on first use.  NULL if disabled.
+    */
+   struct brw_simd_queue *simd_queue;
 };
 
 #define brw_shader_debug_log(compiler, data, fmt, ... ) do {    \
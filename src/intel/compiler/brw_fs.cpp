@@ -41,6 +41,7 @@
 #include "dev/intel_wa.h"
 #include "compiler/glsl_types.h"
 #include "compiler/nir/nir_builder.h"
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 
 using namespace brw;
@@ -1783,6 +1784,133 @@ brw_allocate_registers(fs_visitor &s, bool allow_spilling)
    brw_fs_lower_scoreboard(s);
 }
 
+brw_simd_job::brw_simd_job()
+   : cancel_on_failure(0), queue(NULL), v(NULL), simd(0),
+     allow_spilling(false), optimize(NULL), cancelled(NULL),
+     prog_data(NULL)
+{
+   util_queue_fence_init(&fence);
+}
+
+brw_simd_job::~brw_simd_job()
+{
+   if (started())
+      cancel();
+
+   util_queue_fence_destroy(&fence);
+}
+
+void
+brw_simd_job::execute(void *data, void *gdata, int thread_index)
+{
+   brw_simd_job *job = (brw_simd_job *)data;
+   fs_visitor &s = *job->v;
+
+   /* Stop early if a narrower variant made this one useless. */
+   if (!p_atomic_read(&job->cancelled[job->simd]))
+      job->optimize(s);
+
+   if (!s.failed && p_atomic_read(&job->cancelled[job->simd]))
+      s.fail("Compile cancelled");
+
+   if (!s.failed)
+      brw_allocate_registers(s, job->allow_spilling);
+
+   if (s.failed) {
+      u_foreach_bit(simd, job->cancel_on_failure)
+         p_atomic_set(&job->cancelled[simd], true);
+   }
+}
+
+/**
+ * Starts optimizing and register allocating \p v, whose mem_ctx must not be
+ * shared with any other variant, on \p queue.  \p cancelled is indexed by
+ * SIMD and shared by all the variants of the shader.
+ */
+void
+brw_simd_job::start(struct util_queue *queue, fs_visitor *v, unsigned simd,
+                    bool allow_spilling, void (*optimize)(fs_visitor &s),
+                    bool *cancelled)
+{
+   assert(!started() && !v->failed && v->cfg);
+
+   this->queue = queue;
+   this->v = v;
+   this->simd = simd;
+   this->allow_spilling = allow_spilling;
+   this->optimize = optimize;
+   this->cancelled = cancelled;
+
+   assert(v->stage == MESA_SHADER_FRAGMENT ||
+          gl_shader_stage_is_compute(v->stage));
+   assert(brw_prog_data_size(v->stage) <= sizeof(job_prog_data));
+
+   prog_data = v->prog_data;
+   memcpy(&job_prog_data, prog_data, brw_prog_data_size(v->stage));
+   v->prog_data = &job_prog_data.base;
+
+   util_queue_add_job(queue, this, &fence, execute, NULL, 0);
+}
+
+/**
+ * Waits for the job and applies the changes it made to the prog_data.
+ * Returns whether the variant compiled.
+ */
+bool
+brw_simd_job::finish()
+{
+   assert(started());
+   util_queue_fence_wait(&fence);
+
+   /* These are all the fields the backend writes after translation from
+    * NIR.  Apart from the scratch size, which is the maximum over all
+    * variants, they don't depend on the dispatch width, so other variants
+    * compiled meanwhile wrote the same values.
+    */
+   const struct brw_stage_prog_data *job = &job_prog_data.base;
+
+   /* assign_curb_setup() and brw_fs_lower_constant_loads() */
+   prog_data->curb_read_length = job->curb_read_length;
+   prog_data->has_ubo_pull |= job->has_ubo_pull;
+
+   /* brw_allocate_registers() */
+   prog_data->total_scratch = MAX2(prog_data->total_scratch,
+                                   job->total_scratch);
+
+   if (v->stage == MESA_SHADER_FRAGMENT) {
+      /* gfx9_ps_header_only_workaround() */
+      struct brw_wm_prog_data *wm_prog_data = brw_wm_prog_data(prog_data);
+      const struct brw_wm_prog_data *job_wm = &job_prog_data.wm;
+
+      wm_prog_data->num_varying_inputs = job_wm->num_varying_inputs;
+      wm_prog_data->urb_setup[VARYING_SLOT_LAYER] =
+         job_wm->urb_setup[VARYING_SLOT_LAYER];
+      memcpy(wm_prog_data->urb_setup_attribs, job_wm->urb_setup_attribs,
+             sizeof(wm_prog_data->urb_setup_attribs));
+      wm_prog_data->urb_setup_attribs_count = job_wm->urb_setup_attribs_count;
+   }
+
+   v->prog_data = prog_data;
+   queue = NULL;
+
+   return !v->failed;
+}
+
+/**
+ * Cancels the job, waiting for it if it already started running.  The
+ * variant must not be used afterwards.
+ */
+void
+brw_simd_job::cancel()
+{
+   assert(started());
+   p_atomic_set(&cancelled[simd], true);
+   util_queue_drop_job(queue, &fence);
+
+   v->prog_data = prog_data;
+   queue = NULL;
+}
+
 /**
  * Move load_interpolated_input with simple (payload-based) barycentric modes
  * to the top of the program so we don't emit multiple PLNs for the same input.
@@ -35,6 +35,7 @@
 #include "brw_fs_live_variables.h"
 #include "brw_ir_performance.h"
 #include "compiler/nir/nir.h"
+#include "util/u_queue.h"
 
 struct bblock_t;
 namespace {
@@ -608,6 +609,48 @@ void brw_schedule_instructions_pre_ra(fs_visitor &s, instruction_scheduler *sche
 void brw_schedule_instructions_post_ra(fs_visitor &s);
 
 void brw_allocate_registers(fs_visitor &s, bool allow_spilling);
+
+/**
+ * Optimization and register allocation of a SIMD variant that was already
+ * translated from NIR, run on the compiler's thread pool while the calling
+ * thread works on another variant.  The variant uses a private copy of the
+ * prog_data, and finish() copies the fields the backend writes back to the
+ * real one as if the variant had been compiled in place.
+ */
+class brw_simd_job {
+public:
+   brw_simd_job();
+   ~brw_simd_job();
+
+   void start(struct util_queue *queue, fs_visitor *v, unsigned simd,
+              bool allow_spilling, void (*optimize)(fs_visitor &s),
+              bool *cancelled);
+   bool finish();
+   void cancel();
+
+   bool started() const { return queue != NULL; }
+
+   /** Mask of the SIMD variants to cancel if this one fails. */
+   unsigned cancel_on_failure;
+
+private:
+   static void execute(void *data, void *gdata, int thread_index);
+
+   struct util_queue *queue;
+   struct util_queue_fence fence;
+   fs_visitor *v;
+   unsigned simd;
+   bool allow_spilling;
+   void (*optimize)(fs_visitor &s);
+   bool *cancelled;
+
+   struct brw_stage_prog_data *prog_data;
+   union {
+      struct brw_stage_prog_data base;
+      struct brw_wm_prog_data wm;
+      struct brw_cs_prog_data cs;
+   } job_prog_data;
+};
 bool brw_assign_regs(fs_visitor &s, bool allow_spilling, bool spill_all);
 void brw_assign_regs_trivial(fs_visitor &s);
 
@@ -34,6 +34,9 @@ extern "C" {
 /* brw_fs_reg_allocate.cpp */
 void brw_fs_alloc_reg_sets(struct brw_compiler *compiler);
 
+/* brw_compiler.c */
+struct util_queue *brw_get_simd_queue(const struct brw_compiler *compiler);
+
 /* brw_disasm.c */
 extern const char *const conditional_modifier[16];
 extern const char *const pred_ctrl_align16[16];
@@ -0,0 +1,359 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Compiles the same shaders with and without the compiler's SIMD thread
+ * pool and checks that the results are identical.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "brw_compiler.h"
+#include "brw_nir.h"
+#include "brw_private.h"
+#include "compiler/nir/nir_builder.h"
+#include "dev/intel_debug.h"
+#include "dev/intel_device_info.h"
+#include "util/ralloc.h"
+
+static const struct intel_gfx_info {
+   const char *name;
+} gfx_names[] = {
+   { "skl", },
+   { "tgl", },
+   { "dg2", },
+   { "lnl", },
+};
+
+union prog_data {
+   struct brw_stage_prog_data base;
+   struct brw_wm_prog_data wm;
+   struct brw_cs_prog_data cs;
+};
+
+struct compile_result {
+   std::vector<uint8_t> program;
+   union prog_data prog_data;
+   std::vector<brw_shader_reloc> relocs;
+   struct brw_compile_stats stats[3];
+};
+
+class simd_compile_test : public ::testing::TestWithParam<struct intel_gfx_info> {
+protected:
+   simd_compile_test();
+   ~simd_compile_test() override;
+
+   void SetUp() override;
+
+   nir_shader *create_cs(unsigned live_values);
+   nir_shader *create_fs(bool read_varyings, unsigned live_values);
+
+   void compile_cs(struct brw_compiler *compiler, unsigned live_values,
+                   struct compile_result *result);
+   void compile_fs(struct brw_compiler *compiler, bool read_varyings,
+                   unsigned live_values, struct compile_result *result);
+
+   void *mem_ctx;
+   struct intel_device_info devinfo;
+
+   /* Compiles every variant on the calling thread. */
+   struct brw_compiler *sequential;
+
+   /* Optimizes and register allocates the wider variants on its thread
+    * pool.
+    */
+   struct brw_compiler *threaded;
+};
+
+static void
+compiler_log(void *data, unsigned *id, const char *fmt, ...)
+{
+}
+
+simd_compile_test::simd_compile_test()
+   : mem_ctx(ralloc_context(NULL)), sequential(NULL), threaded(NULL)
+{
+   memset(&devinfo, 0, sizeof(devinfo));
+}
+
+simd_compile_test::~simd_compile_test()
+{
+   ralloc_free(mem_ctx);
+}
+
+void
+simd_compile_test::SetUp()
+{
+   const int devid = intel_device_name_to_pci_device_id(GetParam().name);
+   ASSERT_TRUE(intel_get_device_info_from_pci_id(devid, &devinfo));
+
+   process_intel_debug_variable();
+
+   /* The option is only read once per process, so this must happen before
+    * the first compiler is created.
+    */
+   setenv("INTEL_SIMD_COMPILE_THREADS", "2", 1);
+
+   threaded = brw_compiler_create(mem_ctx, &devinfo);
+   threaded->shader_debug_log = compiler_log;
+   threaded->shader_perf_log = compiler_log;
+   if (brw_get_simd_queue(threaded) == NULL)
+      GTEST_SKIP() << "no SIMD compile threads";
+
+   sequential = brw_compiler_create(mem_ctx, &devinfo);
+   sequential->shader_debug_log = compiler_log;
+   sequential->shader_perf_log = compiler_log;
+   ralloc_free(sequential->simd_queue);
+   sequential->simd_queue = NULL;
+}
+
+/* Sums many values loaded up front, in the opposite order, so that they are
+ * all live at the same time and the wider variants run out of registers.
+ */
+static nir_def *
+sum_live_values(nir_builder *b, nir_def **values, unsigned count)
+{
+   nir_def *sum = values[count - 1];
+   for (int i = count - 2; i >= 0; i--)
+      sum = nir_ffma(b, sum, values[i], values[i]);
+   return sum;
+}
+
+nir_shader *
+simd_compile_test::create_cs(unsigned live_values)
+{
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_COMPUTE,
+                                     threaded->nir_options[MESA_SHADER_COMPUTE],
+                                     "simd compile test");
+   ralloc_steal(mem_ctx, b.shader);
+   b.shader->info.workgroup_size_variable = true;
+
+   nir_def *base = nir_load_uniform(&b, 1, 64, nir_imm_int(&b, 0),
+                                    .base = 0, .range = 8);
+   nir_def *index = nir_load_local_invocation_index(&b);
+   nir_def *addr =
+      nir_iadd(&b, base, nir_u2u64(&b, nir_imul_imm(&b, index, 16)));
+
+   nir_def **values = ralloc_array(mem_ctx, nir_def *, live_values);
+   for (unsigned i = 0; i < live_values; i++) {
+      values[i] = nir_load_global(&b, nir_iadd_imm(&b, addr, i * 4096),
+                                  16, 4, 32);
+   }
+
+   nir_store_global(&b, addr, 16, sum_live_values(&b, values, live_values),
+                    0xf);
+
+   return b.shader;
+}
+
+nir_shader *
+simd_compile_test::create_fs(bool read_varyings, unsigned live_values)
+{
+   nir_builder b =
+      nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT,
+                                     threaded->nir_options[MESA_SHADER_FRAGMENT],
+                                     "simd compile test");
+   ralloc_steal(mem_ctx, b.shader);
+
+   nir_variable *out =
+      nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                          "color");
+   out->data.location = FRAG_RESULT_DATA0;
+
+   nir_def *input;
+   if (read_varyings) {
+      nir_variable *in =
+         nir_variable_create(b.shader, nir_var_shader_in, glsl_vec4_type(),
+                             "in");
+      in->data.location = VARYING_SLOT_VAR0;
+      input = nir_load_var(&b, in);
+   } else {
+      input = nir_load_frag_coord(&b);
+   }
+
+   nir_def **values = ralloc_array(mem_ctx, nir_def *, live_values);
+   for (unsigned i = 0; i < live_values; i++)
+      values[i] = nir_fsin(&b, nir_fmul_imm(&b, input, i + 1));
+
+   nir_store_var(&b, out, sum_live_values(&b, values, live_values), 0xf);
+
+   return b.shader;
+}
+
+void
+simd_compile_test::compile_cs(struct brw_compiler *compiler,
+                              unsigned live_values,
+                              struct compile_result *result)
+{
+   nir_shader *nir = create_cs(live_values);
+
+   memset(&result->prog_data, 0, sizeof(result->prog_data));
+   memset(result->stats, 0, sizeof(result->stats));
+
+   const struct brw_nir_compiler_opts opts = {};
+   brw_preprocess_nir(compiler, nir, &opts);
+
+   nir->num_uniforms = 8;
+   result->prog_data.base.nr_params = nir->num_uniforms / 4;
+   result->prog_data.base.param =
+      rzalloc_array(mem_ctx, uint32_t, result->prog_data.base.nr_params);
+
+   NIR_PASS(_, nir, brw_nir_lower_cs_intrinsics, &devinfo,
+            &result->prog_data.cs);
+
+   struct brw_cs_prog_key key = {};
+
+   struct brw_compile_cs_params params = {};
+   params.base.mem_ctx = mem_ctx;
+   params.base.nir = nir;
+   params.base.stats = result->stats;
+   params.key = &key;
+   params.prog_data = &result->prog_data.cs;
+
+   const unsigned *program = brw_compile_cs(compiler, &params);
+   ASSERT_NE(program, nullptr) << params.base.error_str;
+
+   const uint8_t *bytes = (const uint8_t *)program;
+   result->program.assign(bytes,
+                          bytes + result->prog_data.base.program_size);
+}
+
+void
+simd_compile_test::compile_fs(struct brw_compiler *compiler,
+                              bool read_varyings, unsigned live_values,
+                              struct compile_result *result)
+{
+   nir_shader *nir = create_fs(read_varyings, live_values);
+
+   memset(&result->prog_data, 0, sizeof(result->prog_data));
+   memset(result->stats, 0, sizeof(result->stats));
+
+   const struct brw_nir_compiler_opts opts = {};
+   brw_preprocess_nir(compiler, nir, &opts);
+   nir_shader_gather_info(nir, nir_shader_get_entrypoint(nir));
+
+   struct brw_wm_prog_key key = {};
+   key.input_slots_valid = nir->info.inputs_read | VARYING_BIT_POS;
+   key.color_outputs_valid = 1;
+   key.nr_color_regions = 1;
+
+   struct intel_vue_map vue_map;
+   brw_compute_vue_map(&devinfo, &vue_map, key.input_slots_valid,
+                       false, 1);
+
+   struct brw_compile_fs_params params = {};
+   params.base.mem_ctx = mem_ctx;
+   params.base.nir = nir;
+   params.base.stats = result->stats;
+   params.key = &key;
+   params.prog_data = &result->prog_data.wm;
+   params.vue_map = &vue_map;
+   params.allow_spilling = true;
+   params.max_polygons = 1;
+
+   const unsigned *program = brw_compile_fs(compiler, &params);
+   ASSERT_NE(program, nullptr) << params.base.error_str;
+
+   const uint8_t *bytes = (const uint8_t *)program;
+   result->program.assign(bytes,
+                          bytes + result->prog_data.base.program_size);
+}
+
+/* Takes the pointers out of the prog_data so that it can be compared
+ * bytewise.
+ */
+static void
+detach_pointers(struct compile_result *result)
+{
+   struct brw_stage_prog_data *prog_data = &result->prog_data.base;
+
+   result->relocs.assign(prog_data->relocs,
+                         prog_data->relocs + prog_data->num_relocs);
+   prog_data->relocs = NULL;
+   prog_data->param = NULL;
+}
+
+static void
+expect_equal(struct compile_result *sequential,
+             struct compile_result *threaded)
+{
+   detach_pointers(sequential);
+   detach_pointers(threaded);
+
+   EXPECT_EQ(sequential->program, threaded->program);
+   EXPECT_EQ(0, memcmp(&sequential->prog_data, &threaded->prog_data,
+                       sizeof(sequential->prog_data)));
+   EXPECT_EQ(sequential->relocs.size(), threaded->relocs.size());
+   EXPECT_EQ(0, memcmp(sequential->relocs.data(), threaded->relocs.data(),
+                       MIN2(sequential->relocs.size(),
+                            threaded->relocs.size()) *
+                       sizeof(brw_shader_reloc)));
+   EXPECT_EQ(0, memcmp(sequential->stats, threaded->stats,
+                       sizeof(sequential->stats)));
+}
+
+struct gfx_name {
+   template <class ParamType>
+   std::string
+   operator()(const ::testing::TestParamInfo<ParamType>& info) const {
+      return info.param.name;
+   }
+};
+
+INSTANTIATE_TEST_SUITE_P(
+   simd_compile, simd_compile_test,
+   ::testing::ValuesIn(gfx_names),
+   gfx_name()
+);
+
+TEST_P(simd_compile_test, cs)
+{
+   struct compile_result a, b;
+
+   ASSERT_NO_FATAL_FAILURE(compile_cs(sequential, 4, &a));
+   ASSERT_NO_FATAL_FAILURE(compile_cs(threaded, 4, &b));
+   expect_equal(&a, &b);
+}
+
+TEST_P(simd_compile_test, cs_spilling)
+{
+   struct compile_result a, b;
+
+   ASSERT_NO_FATAL_FAILURE(compile_cs(sequential, 48, &a));
+   ASSERT_NO_FATAL_FAILURE(compile_cs(threaded, 48, &b));
+   expect_equal(&a, &b);
+}
+
+TEST_P(simd_compile_test, fs)
+{
+   struct compile_result a, b;
+
+   ASSERT_NO_FATAL_FAILURE(compile_fs(sequential, true, 4, &a));
+   ASSERT_NO_FATAL_FAILURE(compile_fs(threaded, true, 4, &b));
+   expect_equal(&a, &b);
+}
+
+TEST_P(simd_compile_test, fs_high_pressure)
+{
+   struct compile_result a, b;
+
+   ASSERT_NO_FATAL_FAILURE(compile_fs(sequential, true, 48, &a));
+   ASSERT_NO_FATAL_FAILURE(compile_fs(threaded, true, 48, &b));
+   expect_equal(&a, &b);
+}
+
+/* On Gfx9 this hits gfx9_ps_header_only_workaround(), which changes the
+ * URB setup from the job.
+ */
+TEST_P(simd_compile_test, fs_no_varyings)
+{
+   struct compile_result a, b;
+
+   ASSERT_NO_FATAL_FAILURE(compile_fs(sequential, false, 4, &a));
+   ASSERT_NO_FATAL_FAILURE(compile_fs(threaded, false, 4, &b));
+   expect_equal(&a, &b);
+}
@@ -639,6 +639,8 @@ struct gc_ctx {
 
    uint8_t current_gen;
    void *rubbish;
+
+   uint64_t allocated_size;
 };
 
 static gc_block_header *
@@ -854,6 +856,8 @@ gc_alloc_size(gc_ctx *ctx, size_t size, size_t alignment)
    header->canary = GC_CANARY;
 #endif
 
+   ctx->allocated_size += size;
+
    uint8_t *ptr = (uint8_t *)header + header_size;
    if ((header_size - 1) != offsetof(gc_block_header, flags))
       ptr[-1] = IS_PADDING | (header_size - sizeof(gc_block_header));
@@ -898,6 +902,12 @@ gc_ctx *gc_get_context(void *ptr)
       return ralloc_parent(header);
 }
 
+uint64_t
+gc_get_allocated_size(const gc_ctx *ctx)
+{
+   return ctx->allocated_size;
+}
+
 void
 gc_sweep_start(gc_ctx *ctx)
 {
@@ -49,6 +49,7 @@
 #include <stddef.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "macros.h"
 
@@ -508,6 +509,12 @@ void *gc_zalloc_size(gc_ctx *ctx, size_t size, size_t alignment) MALLOCLIKE;
 void gc_free(void *ptr);
 gc_ctx *gc_get_context(void *ptr);
 
+/**
+ * Return the total number of bytes ever allocated from the context,
+ * including block headers and the allocations that were freed since.
+ */
+uint64_t gc_get_allocated_size(const gc_ctx *ctx);
+
 void gc_sweep_start(gc_ctx *ctx);
 void gc_mark_live(gc_ctx *ctx, const void *mem);
 void gc_sweep_end(gc_ctx *ctx);
@@ -99,6 +99,28 @@ void u_thread_setname( const char *name )
    (void)name;
 }
 
+bool
+util_get_thread_affinity(thrd_t thread,
+                         uint32_t *mask,
+                         unsigned num_mask_bits)
+{
+#if defined(HAVE_PTHREAD_SETAFFINITY)
+   cpu_set_t cpuset;
+
+   if (pthread_getaffinity_np(thread, sizeof(cpuset), &cpuset) != 0)
+      return false;
+
+   memset(mask, 0, num_mask_bits / 8);
+   for (unsigned i = 0; i < num_mask_bits && i < CPU_SETSIZE; i++) {
+      if (CPU_ISSET(i, &cpuset))
+         mask[i / 32] |= 1u << (i % 32);
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
 bool
 util_set_thread_affinity(thrd_t thread,
                          const uint32_t *mask,
@@ -108,16 +130,8 @@ util_set_thread_affinity(thrd_t thread,
 #if defined(HAVE_PTHREAD_SETAFFINITY)
    cpu_set_t cpuset;
 
-   if (old_mask) {
-      if (pthread_getaffinity_np(thread, sizeof(cpuset), &cpuset) != 0)
-         return false;
-
-      memset(old_mask, 0, num_mask_bits / 8);
-      for (unsigned i = 0; i < num_mask_bits && i < CPU_SETSIZE; i++) {
-         if (CPU_ISSET(i, &cpuset))
-            old_mask[i / 32] |= 1u << (i % 32);
-      }
-   }
+   if (old_mask && !util_get_thread_affinity(thread, old_mask, num_mask_bits))
+      return false;
 
    CPU_ZERO(&cpuset);
    for (unsigned i = 0; i < num_mask_bits && i < CPU_SETSIZE; i++) {
@@ -68,6 +68,19 @@ int u_thread_create(thrd_t *thrd, int (*routine)(void *), void *param);
 
 void u_thread_setname( const char *name );
 
+/**
+ * Get thread affinity.
+ *
+ * \param thread         Thread
+ * \param mask           Returned affinity mask
+ * \param num_mask_bits  Number of bits in the mask
+ * \return  true on success
+ */
+bool
+util_get_thread_affinity(thrd_t thread,
+                         uint32_t *mask,
+                         unsigned num_mask_bits);
+
 /**
  * Set thread affinity.
  *
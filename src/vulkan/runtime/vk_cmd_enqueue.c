@@ -80,14 +80,6 @@ vk_cmd_push_descriptor_set_with_template2_khr_free(
 
    vk_descriptor_update_template_unref(device, templ);
    vk_pipeline_layout_unref(device, layout);
-
-   if (info->pNext) {
-      VkPipelineLayoutCreateInfo *pnext = (void *)info->pNext;
-
-      vk_free(queue->alloc, (void *)pnext->pSetLayouts);
-      vk_free(queue->alloc, (void *)pnext->pPushConstantRanges);
-      vk_free(queue->alloc, pnext);
-   }
 }
 
 VKAPI_ATTR void VKAPI_CALL
@@ -100,8 +92,8 @@ vk_cmd_enqueue_CmdPushDescriptorSetWithTemplate2KHR(
    struct vk_cmd_queue *queue = &cmd_buffer->cmd_queue;
 
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(*cmd), 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                          vk_cmd_queue_type_sizes[VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE2_KHR]);
    if (!cmd)
       return;
 
@@ -110,9 +102,7 @@ vk_cmd_enqueue_CmdPushDescriptorSetWithTemplate2KHR(
    list_addtail(&cmd->cmd_link, &cmd_buffer->cmd_queue.cmds);
 
    VkPushDescriptorSetWithTemplateInfoKHR *info =
-      vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                sizeof(VkPushDescriptorSetWithTemplateInfoKHR), 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue, sizeof(VkPushDescriptorSetWithTemplateInfoKHR));
 
    cmd->u.push_descriptor_set_with_template2_khr
       .push_descriptor_set_with_template_info = info;
@@ -162,8 +152,7 @@ vk_cmd_enqueue_CmdPushDescriptorSetWithTemplate2KHR(
       data_size = MAX2(data_size, end);
    }
 
-   uint8_t *out_pData = vk_zalloc(cmd_buffer->cmd_queue.alloc, data_size, 8,
-                                  VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   uint8_t *out_pData = vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue, data_size);
    const uint8_t *pData = pPushDescriptorSetWithTemplateInfo->pData;
 
    /* Now walk the template again, copying what we actually need */
@@ -194,8 +183,7 @@ vk_cmd_enqueue_CmdPushDescriptorSetWithTemplate2KHR(
 #if 0
       case VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO:
          info->pNext =
-            vk_zalloc(queue->alloc, sizeof(VkPipelineLayoutCreateInfo), 8,
-                      VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+            vk_cmd_queue_zalloc(queue, sizeof(VkPipelineLayoutCreateInfo));
          if (info->pNext == NULL)
             goto err;
 
@@ -206,10 +194,8 @@ vk_cmd_enqueue_CmdPushDescriptorSetWithTemplate2KHR(
          VkPipelineLayoutCreateInfo *tmp_src2 = (void *)pnext;
 
          if (tmp_src2->pSetLayouts) {
-            tmp_dst2->pSetLayouts = vk_zalloc(
-               queue->alloc,
-               sizeof(*tmp_dst2->pSetLayouts) * tmp_dst2->setLayoutCount, 8,
-               VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+            tmp_dst2->pSetLayouts = vk_cmd_queue_zalloc(
+               queue, sizeof(*tmp_dst2->pSetLayouts) * tmp_dst2->setLayoutCount);
             if (tmp_dst2->pSetLayouts == NULL)
                goto err;
 
@@ -220,10 +206,9 @@ vk_cmd_enqueue_CmdPushDescriptorSetWithTemplate2KHR(
 
          if (tmp_src2->pPushConstantRanges) {
             tmp_dst2->pPushConstantRanges =
-               vk_zalloc(queue->alloc,
-                         sizeof(*tmp_dst2->pPushConstantRanges) *
-                            tmp_dst2->pushConstantRangeCount,
-                         8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+               vk_cmd_queue_zalloc(queue,
+                                   sizeof(*tmp_dst2->pPushConstantRanges) *
+                                      tmp_dst2->pushConstantRangeCount);
             if (tmp_dst2->pPushConstantRanges == NULL)
                goto err;
 
@@ -279,8 +264,8 @@ vk_cmd_enqueue_CmdDrawMultiEXT(VkCommandBuffer commandBuffer,
    VK_FROM_HANDLE(vk_command_buffer, cmd_buffer, commandBuffer);
 
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(*cmd), 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                          vk_cmd_queue_type_sizes[VK_CMD_DRAW_MULTI_EXT]);
    if (!cmd)
       return;
 
@@ -291,9 +276,8 @@ vk_cmd_enqueue_CmdDrawMultiEXT(VkCommandBuffer commandBuffer,
    if (pVertexInfo) {
       unsigned i = 0;
       cmd->u.draw_multi_ext.vertex_info =
-         vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                   sizeof(*cmd->u.draw_multi_ext.vertex_info) * drawCount, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                             sizeof(*cmd->u.draw_multi_ext.vertex_info) * drawCount);
 
       vk_foreach_multi_draw(draw, i, pVertexInfo, drawCount, stride) {
          memcpy(&cmd->u.draw_multi_ext.vertex_info[i], draw,
@@ -317,8 +301,8 @@ vk_cmd_enqueue_CmdDrawMultiIndexedEXT(VkCommandBuffer commandBuffer,
    VK_FROM_HANDLE(vk_command_buffer, cmd_buffer, commandBuffer);
 
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(*cmd), 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                          vk_cmd_queue_type_sizes[VK_CMD_DRAW_MULTI_INDEXED_EXT]);
    if (!cmd)
       return;
 
@@ -330,9 +314,8 @@ vk_cmd_enqueue_CmdDrawMultiIndexedEXT(VkCommandBuffer commandBuffer,
    if (pIndexInfo) {
       unsigned i = 0;
       cmd->u.draw_multi_indexed_ext.index_info =
-         vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                   sizeof(*cmd->u.draw_multi_indexed_ext.index_info) * drawCount, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                             sizeof(*cmd->u.draw_multi_indexed_ext.index_info) * drawCount);
 
       vk_foreach_multi_draw_indexed(draw, i, pIndexInfo, drawCount, stride) {
          cmd->u.draw_multi_indexed_ext.index_info[i].firstIndex = draw->firstIndex;
@@ -348,9 +331,8 @@ vk_cmd_enqueue_CmdDrawMultiIndexedEXT(VkCommandBuffer commandBuffer,
 
    if (pVertexOffset) {
       cmd->u.draw_multi_indexed_ext.vertex_offset =
-         vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                   sizeof(*cmd->u.draw_multi_indexed_ext.vertex_offset), 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                             sizeof(*cmd->u.draw_multi_indexed_ext.vertex_offset));
 
       memcpy(cmd->u.draw_multi_indexed_ext.vertex_offset, pVertexOffset,
              sizeof(*cmd->u.draw_multi_indexed_ext.vertex_offset));
@@ -367,30 +349,6 @@ push_descriptors_set_free(struct vk_cmd_queue *queue,
 
    VK_FROM_HANDLE(vk_pipeline_layout, vk_layout, pds->layout);
    vk_pipeline_layout_unref(cmd_buffer->base.device, vk_layout);
-
-  for (unsigned i = 0; i < pds->descriptor_write_count; i++) {
-    VkWriteDescriptorSet *entry = &pds->descriptor_writes[i];
-    switch (entry->descriptorType) {
-    case VK_DESCRIPTOR_TYPE_SAMPLER:
-    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
-    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
-    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
-    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
-       vk_free(queue->alloc, (void *)entry->pImageInfo);
-       break;
-    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
-    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
-       vk_free(queue->alloc, (void *)entry->pTexelBufferView);
-       break;
-    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
-    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
-    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
-    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
-    default:
-       vk_free(queue->alloc, (void *)entry->pBufferInfo);
-       break;
-    }
-  }
 }
 
 VKAPI_ATTR void VKAPI_CALL
@@ -405,8 +363,8 @@ vk_cmd_enqueue_CmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer,
    struct vk_cmd_push_descriptor_set_khr *pds;
 
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(*cmd), 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                          vk_cmd_queue_type_sizes[VK_CMD_PUSH_DESCRIPTOR_SET_KHR]);
    if (!cmd)
       return;
 
@@ -429,9 +387,8 @@ vk_cmd_enqueue_CmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer,
 
    if (pDescriptorWrites) {
       pds->descriptor_writes =
-         vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                   sizeof(*pds->descriptor_writes) * descriptorWriteCount, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                             sizeof(*pds->descriptor_writes) * descriptorWriteCount);
       memcpy(pds->descriptor_writes,
              pDescriptorWrites,
              sizeof(*pds->descriptor_writes) * descriptorWriteCount);
@@ -444,9 +401,9 @@ vk_cmd_enqueue_CmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer,
          case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
          case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
             pds->descriptor_writes[i].pImageInfo =
-               vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                         sizeof(VkDescriptorImageInfo) * pds->descriptor_writes[i].descriptorCount, 8,
-                         VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+               vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                                   sizeof(VkDescriptorImageInfo) *
+                                      pds->descriptor_writes[i].descriptorCount);
             memcpy((VkDescriptorImageInfo *)pds->descriptor_writes[i].pImageInfo,
                    pDescriptorWrites[i].pImageInfo,
                    sizeof(VkDescriptorImageInfo) * pds->descriptor_writes[i].descriptorCount);
@@ -454,9 +411,9 @@ vk_cmd_enqueue_CmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer,
          case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
          case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
             pds->descriptor_writes[i].pTexelBufferView =
-               vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                         sizeof(VkBufferView) * pds->descriptor_writes[i].descriptorCount, 8,
-                         VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+               vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                                   sizeof(VkBufferView) *
+                                      pds->descriptor_writes[i].descriptorCount);
             memcpy((VkBufferView *)pds->descriptor_writes[i].pTexelBufferView,
                    pDescriptorWrites[i].pTexelBufferView,
                    sizeof(VkBufferView) * pds->descriptor_writes[i].descriptorCount);
@@ -467,9 +424,9 @@ vk_cmd_enqueue_CmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer,
          case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
          default:
             pds->descriptor_writes[i].pBufferInfo =
-               vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                         sizeof(VkDescriptorBufferInfo) * pds->descriptor_writes[i].descriptorCount, 8,
-                         VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+               vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                                   sizeof(VkDescriptorBufferInfo) *
+                                      pds->descriptor_writes[i].descriptorCount);
             memcpy((VkDescriptorBufferInfo *)pds->descriptor_writes[i].pBufferInfo,
                    pDescriptorWrites[i].pBufferInfo,
                    sizeof(VkDescriptorBufferInfo) * pds->descriptor_writes[i].descriptorCount);
@@ -506,8 +463,8 @@ vk_cmd_enqueue_CmdBindDescriptorSets(VkCommandBuffer commandBuffer,
    VK_FROM_HANDLE(vk_command_buffer, cmd_buffer, commandBuffer);
 
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(*cmd), 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                          vk_cmd_queue_type_sizes[VK_CMD_BIND_DESCRIPTOR_SETS]);
    if (!cmd)
       return;
 
@@ -527,9 +484,9 @@ vk_cmd_enqueue_CmdBindDescriptorSets(VkCommandBuffer commandBuffer,
    cmd->u.bind_descriptor_sets.descriptor_set_count = descriptorSetCount;
    if (pDescriptorSets) {
       cmd->u.bind_descriptor_sets.descriptor_sets =
-         vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                   sizeof(*cmd->u.bind_descriptor_sets.descriptor_sets) * descriptorSetCount, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                             sizeof(*cmd->u.bind_descriptor_sets.descriptor_sets) *
+                                descriptorSetCount);
 
       memcpy(cmd->u.bind_descriptor_sets.descriptor_sets, pDescriptorSets,
              sizeof(*cmd->u.bind_descriptor_sets.descriptor_sets) * descriptorSetCount);
@@ -537,9 +494,9 @@ vk_cmd_enqueue_CmdBindDescriptorSets(VkCommandBuffer commandBuffer,
    cmd->u.bind_descriptor_sets.dynamic_offset_count = dynamicOffsetCount;
    if (pDynamicOffsets) {
       cmd->u.bind_descriptor_sets.dynamic_offsets =
-         vk_zalloc(cmd_buffer->cmd_queue.alloc,
-                   sizeof(*cmd->u.bind_descriptor_sets.dynamic_offsets) * dynamicOffsetCount, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                             sizeof(*cmd->u.bind_descriptor_sets.dynamic_offsets) *
+                                dynamicOffsetCount);
 
       memcpy(cmd->u.bind_descriptor_sets.dynamic_offsets, pDynamicOffsets,
              sizeof(*cmd->u.bind_descriptor_sets.dynamic_offsets) * dynamicOffsetCount);
@@ -547,20 +504,6 @@ vk_cmd_enqueue_CmdBindDescriptorSets(VkCommandBuffer commandBuffer,
 }
 
 #ifdef VK_ENABLE_BETA_EXTENSIONS
-static void
-dispatch_graph_amdx_free(struct vk_cmd_queue *queue, struct vk_cmd_queue_entry *cmd)
-{
-   VkDispatchGraphCountInfoAMDX *count_info = cmd->u.dispatch_graph_amdx.count_info;
-   void *infos = (void *)count_info->infos.hostAddress;
-
-   for (uint32_t i = 0; i < count_info->count; i++) {
-      VkDispatchGraphInfoAMDX *info = (void *)((const uint8_t *)infos + i * count_info->stride);
-      vk_free(queue->alloc, (void *)info->payloads.hostAddress);
-   }
-
-   vk_free(queue->alloc, infos);
-}
-
 VKAPI_ATTR void VKAPI_CALL
 vk_cmd_enqueue_CmdDispatchGraphAMDX(VkCommandBuffer commandBuffer, VkDeviceAddress scratch,
                                     const VkDispatchGraphCountInfoAMDX *pCountInfo)
@@ -570,23 +513,18 @@ vk_cmd_enqueue_CmdDispatchGraphAMDX(VkCommandBuffer commandBuffer, VkDeviceAddre
    if (vk_command_buffer_has_error(cmd_buffer))
       return;
 
-   VkResult result = VK_SUCCESS;
-   const VkAllocationCallbacks *alloc = cmd_buffer->cmd_queue.alloc;
-
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(alloc, sizeof(struct vk_cmd_queue_entry), 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!cmd) {
-      result = VK_ERROR_OUT_OF_HOST_MEMORY;
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                          vk_cmd_queue_type_sizes[VK_CMD_DISPATCH_GRAPH_AMDX]);
+   if (!cmd)
       goto err;
-   }
 
    cmd->type = VK_CMD_DISPATCH_GRAPH_AMDX;
-   cmd->driver_free_cb = dispatch_graph_amdx_free;
 
    cmd->u.dispatch_graph_amdx.scratch = scratch;
 
    cmd->u.dispatch_graph_amdx.count_info =
-      vk_zalloc(alloc, sizeof(VkDispatchGraphCountInfoAMDX), 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue, sizeof(VkDispatchGraphCountInfoAMDX));
    if (cmd->u.dispatch_graph_amdx.count_info == NULL)
       goto err;
 
@@ -594,7 +532,7 @@ vk_cmd_enqueue_CmdDispatchGraphAMDX(VkCommandBuffer commandBuffer, VkDeviceAddre
           sizeof(VkDispatchGraphCountInfoAMDX));
 
    uint32_t infos_size = pCountInfo->count * pCountInfo->stride;
-   void *infos = vk_zalloc(alloc, infos_size, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   void *infos = vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue, infos_size);
    cmd->u.dispatch_graph_amdx.count_info->infos.hostAddress = infos;
    memcpy(infos, pCountInfo->infos.hostAddress, infos_size);
 
@@ -602,38 +540,19 @@ vk_cmd_enqueue_CmdDispatchGraphAMDX(VkCommandBuffer commandBuffer, VkDeviceAddre
       VkDispatchGraphInfoAMDX *info = (void *)((const uint8_t *)infos + i * pCountInfo->stride);
 
       uint32_t payloads_size = info->payloadCount * info->payloadStride;
-      void *dst_payload = vk_zalloc(alloc, payloads_size, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      void *dst_payload = vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue, payloads_size);
       memcpy(dst_payload, info->payloads.hostAddress, payloads_size);
       info->payloads.hostAddress = dst_payload;
    }
 
    list_addtail(&cmd->cmd_link, &cmd_buffer->cmd_queue.cmds);
-   goto finish;
-err:
-   if (cmd) {
-      vk_free(alloc, cmd);
-      dispatch_graph_amdx_free(&cmd_buffer->cmd_queue, cmd);
-   }
+   return;
 
-finish:
-   if (unlikely(result != VK_SUCCESS))
-      vk_command_buffer_set_error(cmd_buffer, result);
+err:
+   vk_command_buffer_set_error(cmd_buffer, VK_ERROR_OUT_OF_HOST_MEMORY);
 }
 #endif
 
-static void
-vk_cmd_build_acceleration_structures_khr_free(struct vk_cmd_queue *queue,
-                                              struct vk_cmd_queue_entry *cmd)
-{
-   struct vk_cmd_build_acceleration_structures_khr *build =
-      &cmd->u.build_acceleration_structures_khr;
-   
-   for (uint32_t i = 0; i < build->info_count; i++) {
-      vk_free(queue->alloc, (void *)build->infos[i].pGeometries);
-      vk_free(queue->alloc, (void *)build->pp_build_range_infos[i]);
-   }
-}
-
 VKAPI_ATTR void VKAPI_CALL
 vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(
    VkCommandBuffer commandBuffer, uint32_t infoCount,
@@ -648,21 +567,18 @@ vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(
    struct vk_cmd_queue *queue = &cmd_buffer->cmd_queue;
 
    struct vk_cmd_queue_entry *cmd =
-      vk_zalloc(queue->alloc, vk_cmd_queue_type_sizes[VK_CMD_BUILD_ACCELERATION_STRUCTURES_KHR], 8,
-                VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      vk_cmd_queue_zalloc(queue, vk_cmd_queue_type_sizes[VK_CMD_BUILD_ACCELERATION_STRUCTURES_KHR]);
    if (!cmd)
       goto err;
 
    cmd->type = VK_CMD_BUILD_ACCELERATION_STRUCTURES_KHR;
-   cmd->driver_free_cb = vk_cmd_build_acceleration_structures_khr_free;
 
    struct vk_cmd_build_acceleration_structures_khr *build =
       &cmd->u.build_acceleration_structures_khr;
 
    build->info_count = infoCount;
    if (pInfos) {
-      build->infos = vk_zalloc(queue->alloc, sizeof(*build->infos) * infoCount, 8,
-                               VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      build->infos = vk_cmd_queue_zalloc(queue, sizeof(*build->infos) * infoCount);
       if (!build->infos)
          goto err;
 
@@ -673,7 +589,7 @@ vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(
          uint32_t geometries_size =
             build->infos[i].geometryCount * sizeof(VkAccelerationStructureGeometryKHR);
          VkAccelerationStructureGeometryKHR *geometries =
-            vk_zalloc(queue->alloc, geometries_size, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+            vk_cmd_queue_zalloc(queue, geometries_size);
          if (!geometries)
             goto err;
 
@@ -689,8 +605,7 @@ vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(
    }
    if (ppBuildRangeInfos) {
       build->pp_build_range_infos =
-         vk_zalloc(queue->alloc, sizeof(*build->pp_build_range_infos) * infoCount, 8,
-                   VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         vk_cmd_queue_zalloc(queue, sizeof(*build->pp_build_range_infos) * infoCount);
       if (!build->pp_build_range_infos)
          goto err;
 
@@ -701,7 +616,7 @@ vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(
          uint32_t build_range_size =
             build->infos[i].geometryCount * sizeof(VkAccelerationStructureBuildRangeInfoKHR);
          VkAccelerationStructureBuildRangeInfoKHR *p_build_range_infos =
-            vk_zalloc(queue->alloc, build_range_size, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+            vk_cmd_queue_zalloc(queue, build_range_size);
          if (!p_build_range_infos)
             goto err;
 
@@ -715,9 +630,6 @@ vk_cmd_enqueue_CmdBuildAccelerationStructuresKHR(
    return;
 
 err:
-   if (cmd)
-      vk_cmd_build_acceleration_structures_khr_free(queue, cmd);
-
    vk_command_buffer_set_error(cmd_buffer, VK_ERROR_OUT_OF_HOST_MEMORY);
 }
 
@@ -728,17 +640,15 @@ VKAPI_ATTR void VKAPI_CALL vk_cmd_enqueue_CmdPushConstants2KHR(
    VK_FROM_HANDLE(vk_command_buffer, cmd_buffer, commandBuffer);
    struct vk_cmd_queue *queue = &cmd_buffer->cmd_queue;
 
-   struct vk_cmd_queue_entry *cmd = vk_zalloc(queue->alloc, vk_cmd_queue_type_sizes[VK_CMD_PUSH_CONSTANTS2_KHR], 8,
-                                              VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   struct vk_cmd_queue_entry *cmd =
+      vk_cmd_queue_zalloc(queue, vk_cmd_queue_type_sizes[VK_CMD_PUSH_CONSTANTS2_KHR]);
    if (!cmd)
       return;
 
    cmd->type = VK_CMD_PUSH_CONSTANTS2_KHR;
 
-   VkPushConstantsInfoKHR *info = vk_zalloc(queue->alloc, sizeof(*info), 8,
-                                            VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   void *pValues = vk_zalloc(queue->alloc, pPushConstantsInfo->size, 8,
-                             VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   VkPushConstantsInfoKHR *info = vk_cmd_queue_zalloc(queue, sizeof(*info));
+   void *pValues = vk_cmd_queue_zalloc(queue, pPushConstantsInfo->size);
 
    memcpy(info, pPushConstantsInfo, sizeof(*info));
    memcpy(pValues, pPushConstantsInfo->pValues, pPushConstantsInfo->size);
@@ -761,16 +671,16 @@ VKAPI_ATTR void VKAPI_CALL vk_cmd_enqueue_CmdPushDescriptorSet2KHR(
     const VkPushDescriptorSetInfoKHR*           pPushDescriptorSetInfo)
 {
    VK_FROM_HANDLE(vk_command_buffer, cmd_buffer, commandBuffer);
-   struct vk_cmd_queue_entry *cmd = vk_zalloc(cmd_buffer->cmd_queue.alloc, vk_cmd_queue_type_sizes[VK_CMD_PUSH_DESCRIPTOR_SET2_KHR], 8,
-                                              VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   struct vk_cmd_queue_entry *cmd = vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                                                        vk_cmd_queue_type_sizes[VK_CMD_PUSH_DESCRIPTOR_SET2_KHR]);
 
    cmd->type = VK_CMD_PUSH_DESCRIPTOR_SET2_KHR;
    cmd->driver_free_cb = vk_free_cmd_push_descriptor_set2_khr;
 
    void *ctx = cmd->driver_data = ralloc_context(NULL);
    if (pPushDescriptorSetInfo) {
-      cmd->u.push_descriptor_set2_khr.push_descriptor_set_info = vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(VkPushDescriptorSetInfoKHR), 8,
-                                                                           VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      cmd->u.push_descriptor_set2_khr.push_descriptor_set_info = vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                                                                                     sizeof(VkPushDescriptorSetInfoKHR));
 
       memcpy((void*)cmd->u.push_descriptor_set2_khr.push_descriptor_set_info, pPushDescriptorSetInfo, sizeof(VkPushDescriptorSetInfoKHR));
       VkPushDescriptorSetInfoKHR *tmp_dst1 = (void *) cmd->u.push_descriptor_set2_khr.push_descriptor_set_info; (void) tmp_dst1;
@@ -804,8 +714,8 @@ VKAPI_ATTR void VKAPI_CALL vk_cmd_enqueue_CmdPushDescriptorSet2KHR(
          }
       }
       if (tmp_src1->pDescriptorWrites) {
-         tmp_dst1->pDescriptorWrites = vk_zalloc(cmd_buffer->cmd_queue.alloc, sizeof(*tmp_dst1->pDescriptorWrites) * tmp_dst1->descriptorWriteCount, 8,
-                                                 VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+         tmp_dst1->pDescriptorWrites = vk_cmd_queue_zalloc(&cmd_buffer->cmd_queue,
+                                                           sizeof(*tmp_dst1->pDescriptorWrites) * tmp_dst1->descriptorWriteCount);
 
          memcpy((void*)tmp_dst1->pDescriptorWrites, tmp_src1->pDescriptorWrites, sizeof(*tmp_dst1->pDescriptorWrites) * tmp_dst1->descriptorWriteCount);
          for (unsigned i = 0; i < tmp_src1->descriptorWriteCount; i++) {
@@ -27,6 +27,7 @@
 #include "vk_util.h"
 
 #include "util/simple_mtx.h"
+#include "util/u_memory.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -147,6 +148,17 @@ void
 vk_pipeline_cache_object_unref(struct vk_device *device,
                                struct vk_pipeline_cache_object *object);
 
+/** Number of independently locked parts of a vk_pipeline_cache */
+#define VK_PIPELINE_CACHE_SHARD_BITS 4
+#define VK_PIPELINE_CACHE_SHARD_COUNT (1 << VK_PIPELINE_CACHE_SHARD_BITS)
+
+struct vk_pipeline_cache_shard {
+   /** Protects objects, on a cache line of its own for every shard */
+   alignas(CACHE_LINE_SIZE) simple_mtx_t lock;
+
+   struct set *objects;
+};
+
 /** A generic implementation of VkPipelineCache */
 struct vk_pipeline_cache {
    struct vk_object_base base;
@@ -156,14 +168,25 @@ struct vk_pipeline_cache {
    bool weak_ref;
    bool skip_disk_cache;
 
-   struct vk_pipeline_cache_header header;
+   /** False if VK_ENABLE_PIPELINE_CACHE disabled this cache */
+   bool enabled;
 
-   /** Protects object_cache */
-   simple_mtx_t lock;
+   struct vk_pipeline_cache_header header;
 
-   struct set *object_cache;
+   /* The objects are spread over the shards by the hash of their key, so
+    * that threads looking up or adding different objects rarely wait for
+    * each other. The cache is allocated aligned to the shards.
+    */
+   struct vk_pipeline_cache_shard shards[VK_PIPELINE_CACHE_SHARD_COUNT];
 };
 
+/** Returns the number of objects in the cache
+ *
+ * The count is only exact if nothing is added to the cache concurrently.
+ */
+uint32_t
+vk_pipeline_cache_object_count(struct vk_pipeline_cache *cache);
+
 VK_DEFINE_NONDISP_HANDLE_CASTS(vk_pipeline_cache, base, VkPipelineCache,
                                VK_OBJECT_TYPE_PIPELINE_CACHE)
 
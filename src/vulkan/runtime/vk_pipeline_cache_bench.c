@@ -0,0 +1,200 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Looks up and adds raw data objects in a vk_pipeline_cache from several
+ * threads at once, like a driver compiling pipelines on a thread pool.
+ *
+ *   vk_pipeline_cache_bench [max_threads] [insert_percent]
+ *
+ * The cache is filled with KEY_COUNT objects first. Each thread then runs
+ * OPS_PER_THREAD operations on random keys, of which insert_percent add a
+ * new object and the others look up an existing one. The run is repeated
+ * for 1, 2, 4, ... threads up to max_threads, and once single-threaded with
+ * VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT, which skips the
+ * locking. It prints the operations per second of each run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vk_alloc.h"
+#include "vk_device.h"
+#include "vk_physical_device.h"
+#include "vk_pipeline_cache.h"
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+
+#define KEY_COUNT 4096
+#define OPS_PER_THREAD 200000
+
+struct bench_key {
+   uint32_t thread;
+   uint32_t index;
+   uint32_t pad[3];
+};
+
+struct bench_thread {
+   struct vk_pipeline_cache *cache;
+   unsigned id;
+   unsigned insert_percent;
+   uint32_t hits;
+};
+
+static VKAPI_ATTR void VKAPI_CALL
+bench_GetPhysicalDeviceProperties(VkPhysicalDevice physicalDevice,
+                                  VkPhysicalDeviceProperties *pProperties)
+{
+   memset(pProperties, 0, sizeof(*pProperties));
+}
+
+static uint32_t
+bench_rand(uint32_t *state)
+{
+   /* xorshift32 */
+   *state ^= *state << 13;
+   *state ^= *state >> 17;
+   *state ^= *state << 5;
+   return *state;
+}
+
+static struct vk_pipeline_cache_object *
+bench_insert(struct vk_pipeline_cache *cache, const struct bench_key *key)
+{
+   return vk_pipeline_cache_create_and_insert_object(cache, key, sizeof(*key),
+                                                     key, sizeof(*key),
+                                                     &vk_raw_data_cache_object_ops);
+}
+
+static int
+bench_thread_main(void *data)
+{
+   struct bench_thread *thread = data;
+   struct vk_device *device = thread->cache->base.device;
+   uint32_t state = 0x9e3779b9 * (thread->id + 1);
+   uint32_t inserted = 0;
+
+   for (unsigned i = 0; i < OPS_PER_THREAD; i++) {
+      struct vk_pipeline_cache_object *object;
+
+      if (bench_rand(&state) % 100 < thread->insert_percent) {
+         const struct bench_key key = {
+            .thread = thread->id + 1,
+            .index = inserted++,
+         };
+         object = bench_insert(thread->cache, &key);
+      } else {
+         const struct bench_key key = {
+            .index = bench_rand(&state) % KEY_COUNT,
+         };
+         bool cache_hit = false;
+         object = vk_pipeline_cache_lookup_object(thread->cache, &key,
+                                                  sizeof(key),
+                                                  &vk_raw_data_cache_object_ops,
+                                                  &cache_hit);
+         thread->hits += cache_hit;
+      }
+
+      if (object)
+         vk_pipeline_cache_object_unref(device, object);
+   }
+
+   return 0;
+}
+
+static void
+bench_run(struct vk_device *device, unsigned thread_count,
+          unsigned insert_percent, VkPipelineCacheCreateFlags flags)
+{
+   const VkPipelineCacheCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .flags = flags,
+   };
+   const struct vk_pipeline_cache_create_info info = {
+      .pCreateInfo = &create_info,
+      .force_enable = true,
+      .skip_disk_cache = true,
+   };
+   struct vk_pipeline_cache *cache =
+      vk_pipeline_cache_create(device, &info, NULL);
+   if (cache == NULL) {
+      fprintf(stderr, "failed to create the pipeline cache\n");
+      exit(1);
+   }
+
+   for (unsigned i = 0; i < KEY_COUNT; i++) {
+      const struct bench_key key = { .index = i };
+      vk_pipeline_cache_object_unref(device, bench_insert(cache, &key));
+   }
+
+   struct bench_thread threads[64];
+   thrd_t handles[64];
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < thread_count; i++) {
+      threads[i] = (struct bench_thread) {
+         .cache = cache,
+         .id = i,
+         .insert_percent = insert_percent,
+      };
+      if (thread_count == 1) {
+         bench_thread_main(&threads[i]);
+      } else if (thrd_create(&handles[i], bench_thread_main,
+                             &threads[i]) != thrd_success) {
+         fprintf(stderr, "failed to create a thread\n");
+         exit(1);
+      }
+   }
+   for (unsigned i = 0; thread_count > 1 && i < thread_count; i++)
+      thrd_join(handles[i], NULL);
+   int64_t elapsed = os_time_get_nano() - start;
+
+   uint32_t hits = 0;
+   for (unsigned i = 0; i < thread_count; i++)
+      hits += threads[i].hits;
+
+   const double ops = (double)thread_count * OPS_PER_THREAD;
+   printf("%-8s %2u threads: %8.2f Mops/s, %u hits, %u objects\n",
+          (flags & VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT) ?
+             "extsync" : "locked",
+          thread_count, ops * 1000.0 / elapsed, hits,
+          vk_pipeline_cache_object_count(cache));
+
+   vk_pipeline_cache_destroy(cache, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_threads = argc > 1 ? atoi(argv[1]) :
+                          MAX2(util_get_cpu_caps()->nr_cpus, 4);
+   unsigned insert_percent = argc > 2 ? atoi(argv[2]) : 5;
+   max_threads = CLAMP(max_threads, 1, 64);
+   insert_percent = MIN2(insert_percent, 100);
+
+   struct vk_physical_device physical_device = {
+      .base.type = VK_OBJECT_TYPE_PHYSICAL_DEVICE,
+   };
+   physical_device.dispatch_table.GetPhysicalDeviceProperties =
+      bench_GetPhysicalDeviceProperties;
+
+   struct vk_device device = {
+      .base.type = VK_OBJECT_TYPE_DEVICE,
+   };
+   device.physical = &physical_device;
+   device.alloc = *vk_default_allocator();
+
+   printf("%u keys, %u ops per thread, %u%% inserts\n",
+          KEY_COUNT, OPS_PER_THREAD, insert_percent);
+
+   bench_run(&device, 1, insert_percent,
+             VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT);
+   for (unsigned t = 1; t <= max_threads; t *= 2)
+      bench_run(&device, t, insert_percent, 0);
+
+   return 0;
+}
@@ -76,6 +76,10 @@ TEMPLATE_H = Template(COPYRIGHT + """\
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "util/list.h"
 
 #define VK_PROTOTYPES
@@ -89,10 +93,21 @@ extern "C" {
 #endif
 
 struct vk_device_dispatch_table;
+struct vk_cmd_queue_block;
 
 struct vk_cmd_queue {
    const VkAllocationCallbacks *alloc;
    struct list_head cmds;
+
+   /* The commands and the data they point to are allocated linearly from a
+    * chain of blocks, so that recording doesn't go through the allocator
+    * for each of them and replay walks memory in order. The blocks are kept
+    * when the queue is reset, and only freed with the queue.
+    */
+   struct vk_cmd_queue_block *first_block;
+   struct vk_cmd_queue_block *block;
+   uint8_t *block_ptr;
+   uint8_t *block_end;
 };
 
 enum vk_cmd_type {
@@ -181,11 +196,34 @@ struct vk_cmd_queue_entry {
 
 void vk_free_queue(struct vk_cmd_queue *queue);
 
+void *vk_cmd_queue_zalloc_block(struct vk_cmd_queue *queue, size_t size);
+
+void vk_cmd_queue_free_blocks(struct vk_cmd_queue *queue);
+
+/* Allocates zeroed memory which lives until the queue is reset. */
+static inline void *
+vk_cmd_queue_zalloc(struct vk_cmd_queue *queue, size_t size)
+{
+   size = (size + 7) & ~(size_t)7;
+
+   if (size > (size_t)(queue->block_end - queue->block_ptr))
+      return vk_cmd_queue_zalloc_block(queue, size);
+
+   void *ptr = queue->block_ptr;
+   queue->block_ptr += size;
+   memset(ptr, 0, size);
+   return ptr;
+}
+
 static inline void
 vk_cmd_queue_init(struct vk_cmd_queue *queue, VkAllocationCallbacks *alloc)
 {
    queue->alloc = alloc;
    list_inithead(&queue->cmds);
+   queue->first_block = NULL;
+   queue->block = NULL;
+   queue->block_ptr = NULL;
+   queue->block_end = NULL;
 }
 
 static inline void
@@ -193,6 +231,11 @@ vk_cmd_queue_reset(struct vk_cmd_queue *queue)
 {
    vk_free_queue(queue);
    list_inithead(&queue->cmds);
+
+   /* Start over from the first block */
+   queue->block = NULL;
+   queue->block_ptr = NULL;
+   queue->block_end = NULL;
 }
 
 static inline void
@@ -200,6 +243,7 @@ vk_cmd_queue_finish(struct vk_cmd_queue *queue)
 {
    vk_free_queue(queue);
    list_inithead(&queue->cmds);
+   vk_cmd_queue_free_blocks(queue);
 }
 
 void vk_cmd_queue_execute(struct vk_cmd_queue *queue,
@@ -259,25 +303,6 @@ size_t vk_cmd_queue_type_sizes[] = {
 % if c.guard is not None:
 #ifdef ${c.guard}
 % endif
-static void
-vk_free_${to_underscore(c.name)}(struct vk_cmd_queue *queue,
-${' ' * len('vk_free_' + to_underscore(c.name) + '(')}\\
-struct vk_cmd_queue_entry *cmd)
-{
-   if (cmd->driver_free_cb)
-      cmd->driver_free_cb(queue, cmd);
-   else
-      vk_free(queue->alloc, cmd->driver_data);
-% for p in c.params[1:]:
-% if p.len:
-   vk_free(queue->alloc, (${remove_suffix(p.decl.replace("const", ""), p.name)})cmd->u.${to_struct_field_name(c.name)}.${to_field_name(p.name)});
-% elif '*' in p.decl:
-   ${get_struct_free(c, p, types)}
-% endif
-% endfor
-   vk_free(queue->alloc, cmd);
-}
-
 % if c.name not in manual_commands and c.name not in no_enqueue_commands:
 VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 % for p in c.params[1:]:
@@ -285,8 +310,8 @@ VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 % endfor
 )
 {
-   struct vk_cmd_queue_entry *cmd = vk_zalloc(queue->alloc, vk_cmd_queue_type_sizes[${to_enum_name(c.name)}], 8,
-                                              VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   struct vk_cmd_queue_entry *cmd =
+      vk_cmd_queue_zalloc(queue, vk_cmd_queue_type_sizes[${to_enum_name(c.name)}]);
    if (!cmd) return VK_ERROR_OUT_OF_HOST_MEMORY;
 
    cmd->type = ${to_enum_name(c.name)};
@@ -316,8 +341,6 @@ VkResult vk_enqueue_${to_underscore(c.name)}(struct vk_cmd_queue *queue
 
 % if need_error_handling:
 err:
-   if (cmd)
-      vk_free_${to_underscore(c.name)}(queue, cmd);
    return VK_ERROR_OUT_OF_HOST_MEMORY;
 % endif
 }
@@ -328,24 +351,80 @@ err:
 
 % endfor
 
+struct vk_cmd_queue_block {
+   struct vk_cmd_queue_block *next;
+   size_t size;
+   uint8_t data[];
+};
+
+#define VK_CMD_QUEUE_BLOCK_MIN_SIZE (16 * 1024)
+#define VK_CMD_QUEUE_BLOCK_MAX_SIZE (1024 * 1024)
+
+void *
+vk_cmd_queue_zalloc_block(struct vk_cmd_queue *queue, size_t size)
+{
+   /* Reuse the blocks from before the last reset, in order */
+   struct vk_cmd_queue_block *block =
+      queue->block ? queue->block->next : queue->first_block;
+   while (block && block->size < size)
+      block = block->next;
+
+   if (!block) {
+      size_t block_size = VK_CMD_QUEUE_BLOCK_MIN_SIZE;
+      if (queue->block)
+         block_size = MIN2(queue->block->size * 2, VK_CMD_QUEUE_BLOCK_MAX_SIZE);
+      block_size = MAX2(block_size, size);
+
+      block = vk_alloc(queue->alloc, sizeof(*block) + block_size, 8,
+                       VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (!block)
+         return NULL;
+
+      block->size = block_size;
+      if (queue->block) {
+         block->next = queue->block->next;
+         queue->block->next = block;
+      } else {
+         block->next = queue->first_block;
+         queue->first_block = block;
+      }
+   }
+
+   queue->block = block;
+   queue->block_ptr = block->data + size;
+   queue->block_end = block->data + block->size;
+
+   memset(block->data, 0, size);
+   return block->data;
+}
+
+void
+vk_cmd_queue_free_blocks(struct vk_cmd_queue *queue)
+{
+   struct vk_cmd_queue_block *block = queue->first_block;
+   while (block) {
+      struct vk_cmd_queue_block *next = block->next;
+      vk_free(queue->alloc, block);
+      block = next;
+   }
+
+   queue->first_block = NULL;
+   queue->block = NULL;
+   queue->block_ptr = NULL;
+   queue->block_end = NULL;
+}
+
 void
 vk_free_queue(struct vk_cmd_queue *queue)
 {
-   struct vk_cmd_queue_entry *tmp, *cmd;
-   LIST_FOR_EACH_ENTRY_SAFE(cmd, tmp, &queue->cmds, cmd_link) {
-      switch(cmd->type) {
-% for c in commands:
-% if c.guard is not None:
-#ifdef ${c.guard}
-% endif
-      case ${to_enum_name(c.name)}:
-         vk_free_${to_underscore(c.name)}(queue, cmd);
-         break;
-% if c.guard is not None:
-#endif // ${c.guard}
-% endif
-% endfor
-      }
+   /* The commands themselves are in the queue blocks, only what the drivers
+    * attached to them needs to be released.
+    */
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      if (cmd->driver_free_cb)
+         cmd->driver_free_cb(queue, cmd);
+      else
+         vk_free(queue->alloc, cmd->driver_data);
    }
 }
 
@@ -470,7 +549,7 @@ def get_array_copy(command, param):
         field_size = "1"
     else:
         field_size = "sizeof(*%s)" % field_name
-    allocation = "%s = vk_zalloc(queue->alloc, %s * (%s), 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, param.len, field_name)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s * (%s));\n   if (%s == NULL) goto err;\n" % (field_name, field_size, param.len, field_name)
     copy = "memcpy((void*)%s, %s, %s * (%s));" % (field_name, param.name, field_size, param.len)
     return "%s\n   %s" % (allocation, copy)
 
@@ -480,7 +559,7 @@ def get_array_member_copy(struct, src_name, member):
         field_size = "sizeof(*%s)" % (field_name)
     else:
         field_size = "sizeof(*%s) * %s->%s" % (field_name, struct, member.len)
-    allocation = "%s = vk_zalloc(queue->alloc, %s, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, field_name)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s);\n   if (%s == NULL) goto err;\n" % (field_name, field_size, field_name)
     copy = "memcpy((void*)%s, %s->%s, %s);" % (field_name, src_name, member.name, field_size)
     return "if (%s->%s) {\n   %s\n   %s\n}\n" % (src_name, member.name, allocation, copy)
 
@@ -516,7 +595,7 @@ def get_struct_copy(dst, src_name, src_type, size, types, level=0):
     global tmp_dst_idx
     global tmp_src_idx
 
-    allocation = "%s = vk_zalloc(queue->alloc, %s, 8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);\n      if (%s == NULL) goto err;\n" % (dst, size, dst)
+    allocation = "%s = vk_cmd_queue_zalloc(queue, %s);\n      if (%s == NULL) goto err;\n" % (dst, size, dst)
     copy = "memcpy((void*)%s, %s, %s);" % (dst, src_name, size)
 
     level += 1
@@ -536,19 +615,6 @@ def get_struct_copy(dst, src_name, src_type, size, types, level=0):
     indent = "   " * level
     return "%s\n      %s\n      %s\n      %s\n      %s\n      %s\n%s} else {\n      %s\n%s}" % (if_stmt, allocation, copy, tmp_dst, tmp_src, member_copies, indent, null_assignment, indent)
 
-def get_struct_free(command, param, types):
-    field_name = "cmd->u.%s.%s" % (to_struct_field_name(command.name), to_field_name(param.name))
-    const_cast = remove_suffix(param.decl.replace("const", ""), param.name)
-    struct_free = "vk_free(queue->alloc, (%s)%s);" % (const_cast, field_name)
-    member_frees = ""
-    if (param.type in types):
-        for member in types[param.type].members:
-            if member.len and member.len != 'null-terminated':
-                member_name = "cmd->u.%s.%s->%s" % (to_struct_field_name(command.name), to_field_name(param.name), member.name)
-                const_cast = remove_suffix(member.decl.replace("const", ""), member.name)
-                member_frees += "vk_free(queue->alloc, (%s)%s);\n" % (const_cast, member_name)
-    return "%s      %s\n" % (member_frees, struct_free)
-
 EntrypointType = namedtuple('EntrypointType', 'name enum members extended_by guard')
 
 def get_types_defines(doc):
@@ -666,7 +732,6 @@ def main():
         'to_struct_name': to_struct_name,
         'get_array_copy': get_array_copy,
         'get_struct_copy': get_struct_copy,
-        'get_struct_free': get_struct_free,
         'types': types,
         'manual_commands': MANUAL_COMMANDS,
         'no_enqueue_commands': NO_ENQUEUE_COMMANDS,